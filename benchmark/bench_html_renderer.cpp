@@ -0,0 +1,153 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+// Compares the former std::stringstream HTML loop with render_html_table
+// on the chinook example database. Queries are run once, only the
+// rendering of their result is timed.
+//
+// usage: bench_html_renderer [path/to/chinook.db] [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "xeus-sqlite/xhtml_renderer.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+
+namespace
+{
+    const char* queries[] = {
+        "SELECT * FROM tracks",
+        "SELECT * FROM invoice_items JOIN invoices USING (InvoiceId)",
+        "SELECT * FROM customers"
+    };
+
+    sqlite3_stmt* prepare(sqlite3* db, const char* sql)
+    {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            std::cerr << sqlite3_errmsg(db) << std::endl;
+            std::exit(1);
+        }
+        return stmt;
+    }
+
+    struct materialized
+    {
+        std::vector<std::string> names;
+        std::vector<std::vector<std::string>> rows;
+        xeus_sqlite::result_table table;
+    };
+
+    /* Runs the query once, the renderers are timed on its result only */
+    materialized run(sqlite3* db, const char* sql)
+    {
+        materialized result;
+        sqlite3_stmt* stmt = prepare(db, sql);
+        const int columns = sqlite3_column_count(stmt);
+        for (int col = 0; col < columns; col++)
+        {
+            const char* declared = sqlite3_column_decltype(stmt, col);
+            result.names.push_back(sqlite3_column_name(stmt, col));
+            result.table.add_column(result.names.back(), declared ? declared : "");
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            std::vector<std::string> row;
+            for (int col = 0; col < columns; col++)
+            {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+                std::size_t size = static_cast<std::size_t>(sqlite3_column_bytes(stmt, col));
+                row.emplace_back(text ? text : "", size);
+                result.table.push_cell(xeus_sqlite::cell_type::text, text, size);
+            }
+            result.rows.push_back(std::move(row));
+        }
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
+    /* The loop process_SQLite_input used before the dedicated writer */
+    std::string stringstream_loop(const materialized& result)
+    {
+        std::stringstream html_table("");
+        html_table << "<table>\n<tr>\n";
+        for (const std::string& name : result.names)
+        {
+            html_table << "<th>" << name << "</th>\n";
+        }
+        html_table << "</tr>\n";
+        for (const auto& row : result.rows)
+        {
+            html_table << "<tr>\n";
+            for (const std::string& cell : row)
+            {
+                html_table << "<td>" << cell << "</td>\n";
+            }
+            html_table << "</tr>\n";
+        }
+        html_table << "</table>";
+        return html_table.str();
+    }
+
+    std::string html_writer(const materialized& result)
+    {
+        xeus_sqlite::html_table_options options;
+        options.max_rows = 0;
+        return xeus_sqlite::render_html_table(result.table, options);
+    }
+
+    template <class F>
+    double time_ms(F&& f, int iterations, std::size_t& bytes)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            bytes = f().size();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "examples/chinook.db";
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        std::cerr << "Could not open " << path << std::endl;
+        return 1;
+    }
+
+    for (const char* sql : queries)
+    {
+        materialized result = run(db, sql);
+        std::size_t old_bytes = 0;
+        std::size_t new_bytes = 0;
+        double old_ms = time_ms([&] { return stringstream_loop(result); }, iterations, old_bytes);
+        double new_ms = time_ms([&] { return html_writer(result); }, iterations, new_bytes);
+
+        std::cout << sql << " (" << result.rows.size() << " rows)\n"
+                  << "  stringstream loop: " << old_ms << " ms, " << old_bytes << " bytes\n"
+                  << "  html writer:       " << new_ms << " ms, " << new_bytes << " bytes\n"
+                  << "  speedup:           " << old_ms / new_ms << "x\n";
+    }
+
+    sqlite3_close(db);
+    return 0;
+}
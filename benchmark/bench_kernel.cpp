@@ -0,0 +1,444 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+// Throughput and soak test of the kernel. The interpreter is driven in
+// process through the xinterpreter API: a publisher and a reply callback
+// stand for the IOPub and shell channels, so that no socket, thread or
+// serialization of the messaging layer is measured.
+//
+// Workloads are recorded sessions, replayed in order at each iteration:
+// - .jsonl files, one request per line, {"execute": "<code>"} or
+//   {"complete": "<code>", "cursor_pos": <n>} (end of the code by default);
+// - .ipynb notebooks, each code cell is executed.
+// {db} is replaced by the path given with --db, {scratch} by a temporary
+// database file.
+//
+// The latency of each request is recorded, throughput, p50 and p99 are
+// reported with the resident memory every --report-every iterations. The
+// run fails when a threshold is exceeded or a request fails.
+//
+// usage: bench_kernel [--db=examples/chinook.db] [--iterations=200]
+//                     [--warmup=10] [--report-every=20]
+//                     [--min-throughput=<requests/s>] [--max-p50=<ms>]
+//                     [--max-p99=<ms>] [--max-rss-growth=<MiB>]
+//                     [--max-errors=0] workload...
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xinterpreter.hpp"
+
+#include "xeus-sqlite/xeus_sqlite_interpreter.hpp"
+
+namespace nl = nlohmann;
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    struct request
+    {
+        bool complete = false;
+        std::string code;
+        int cursor_pos = 0;
+        /* Workload and line, for error reports */
+        std::string origin;
+    };
+
+    struct options
+    {
+        std::string db = "examples/chinook.db";
+        int iterations = 200;
+        int warmup = 10;
+        int report_every = 20;
+        double min_throughput = 0;
+        double max_p50 = 0;
+        double max_p99 = 0;
+        double max_rss_growth = 0;
+        long max_errors = 0;
+        std::vector<std::string> workloads;
+    };
+
+    /* Messages published on IOPub, counted instead of being sent */
+    struct mock_iopub
+    {
+        std::map<std::string, long> messages;
+        std::size_t bytes = 0;
+
+        void publish(const std::string& msg_type, const nl::json& content, const xeus::buffer_sequence& buffers)
+        {
+            ++messages[msg_type];
+            bytes += content.dump().size();
+            for (const auto& buffer : buffers)
+            {
+                bytes += buffer.size();
+            }
+        }
+    };
+
+    void replace_all(std::string& text, const std::string& from, const std::string& to)
+    {
+        for (std::size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.size()))
+        {
+            text.replace(pos, from.size(), to);
+        }
+    }
+
+    std::string join_source(const nl::json& source)
+    {
+        if (source.is_string())
+        {
+            return source.get<std::string>();
+        }
+        std::string code;
+        for (const auto& line : source)
+        {
+            code += line.get<std::string>();
+        }
+        return code;
+    }
+
+    std::vector<request> load_workload(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        std::vector<request> requests;
+        if (std::filesystem::path(path).extension() == ".ipynb")
+        {
+            const nl::json notebook = nl::json::parse(file);
+            for (const auto& cell : notebook.at("cells"))
+            {
+                if (cell.value("cell_type", "") == "code")
+                {
+                    request r;
+                    r.code = join_source(cell.at("source"));
+                    r.origin = path;
+                    requests.push_back(std::move(r));
+                }
+            }
+            return requests;
+        }
+
+        std::string line;
+        for (int number = 1; std::getline(file, line); ++number)
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            const nl::json entry = nl::json::parse(line);
+            request r;
+            r.origin = path + ":" + std::to_string(number);
+            if (entry.contains("complete"))
+            {
+                r.complete = true;
+                r.code = entry["complete"].get<std::string>();
+                r.cursor_pos = entry.value("cursor_pos", static_cast<int>(r.code.size()));
+            }
+            else
+            {
+                r.code = entry.at("execute").get<std::string>();
+            }
+            requests.push_back(std::move(r));
+        }
+        return requests;
+    }
+
+    /* Resident set size of the process in bytes, 0 where unsupported */
+    std::size_t resident_memory()
+    {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        std::size_t pages = 0;
+        std::size_t resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                      reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        {
+            return 0;
+        }
+        return info.resident_size;
+#else
+        return 0;
+#endif
+    }
+
+    double mib(std::size_t bytes)
+    {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+    /* Nearest rank percentile, reorders latencies */
+    double percentile(std::vector<double>& latencies, double p)
+    {
+        if (latencies.empty())
+        {
+            return 0;
+        }
+        std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1) + 0.5);
+        std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+        return latencies[rank];
+    }
+
+    bool parse_arguments(int argc, char* argv[], options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const std::size_t equal = arg.find('=');
+            const std::string key = arg.substr(0, equal);
+            const std::string value = equal == std::string::npos ? "" : arg.substr(equal + 1);
+            if (arg.rfind("--", 0) != 0)
+            {
+                opts.workloads.push_back(arg);
+            }
+            else if (key == "--db")
+            {
+                opts.db = value;
+            }
+            else if (key == "--iterations")
+            {
+                opts.iterations = std::atoi(value.c_str());
+            }
+            else if (key == "--warmup")
+            {
+                opts.warmup = std::atoi(value.c_str());
+            }
+            else if (key == "--report-every")
+            {
+                opts.report_every = std::max(1, std::atoi(value.c_str()));
+            }
+            else if (key == "--min-throughput")
+            {
+                opts.min_throughput = std::atof(value.c_str());
+            }
+            else if (key == "--max-p50")
+            {
+                opts.max_p50 = std::atof(value.c_str());
+            }
+            else if (key == "--max-p99")
+            {
+                opts.max_p99 = std::atof(value.c_str());
+            }
+            else if (key == "--max-rss-growth")
+            {
+                opts.max_rss_growth = std::atof(value.c_str());
+            }
+            else if (key == "--max-errors")
+            {
+                opts.max_errors = std::atol(value.c_str());
+            }
+            else
+            {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+        if (opts.workloads.empty() || opts.iterations <= 0 || opts.warmup < 0)
+        {
+            std::cerr << "usage: bench_kernel [--db=path] [--iterations=N] [--warmup=N] [--report-every=N] "
+                         "[--min-throughput=R] [--max-p50=MS] [--max-p99=MS] [--max-rss-growth=MIB] "
+                         "[--max-errors=N] workload..." << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    options opts;
+    if (!parse_arguments(argc, argv, opts))
+    {
+        return 2;
+    }
+
+    const std::string scratch = (std::filesystem::temp_directory_path() / "xsqlite_bench_kernel.db").string();
+    const std::string db = std::filesystem::absolute(opts.db).string();
+    std::vector<request> requests;
+    try
+    {
+        for (const std::string& path : opts.workloads)
+        {
+            for (request& r : load_workload(path))
+            {
+                replace_all(r.code, "{db}", db);
+                replace_all(r.code, "{scratch}", scratch);
+                requests.push_back(std::move(r));
+            }
+        }
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+
+    mock_iopub iopub;
+    xeus::xcomm_manager comm_manager;
+    xeus_sqlite::interpreter kernel;
+    xeus::xinterpreter& interpreter = kernel;
+    interpreter.register_publisher(
+        [&iopub](const std::string& msg_type, nl::json /*metadata*/, nl::json content, xeus::buffer_sequence buffers)
+        {
+            iopub.publish(msg_type, content, buffers);
+        });
+    interpreter.register_comm_manager(&comm_manager);
+    interpreter.configure();
+
+    long errors = 0;
+    long completions = 0;
+    auto replay = [&](std::vector<double>* latencies)
+    {
+        for (const request& r : requests)
+        {
+            auto start = clock::now();
+            if (r.complete)
+            {
+                nl::json reply = interpreter.complete_request(r.code, r.cursor_pos);
+                completions += reply.value("matches", nl::json::array()).size();
+            }
+            else
+            {
+                nl::json reply;
+                interpreter.execute_request(xeus::xrequest_context(),
+                                            [&reply](nl::json content) { reply = std::move(content); },
+                                            r.code,
+                                            xeus::execute_request_config{false, true, false},
+                                            nl::json::object());
+                if (reply.value("status", "") != "ok")
+                {
+                    if (++errors <= 10)
+                    {
+                        std::cerr << r.origin << ": " << reply.value("evalue", reply.dump()) << std::endl;
+                    }
+                }
+            }
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            if (latencies != nullptr)
+            {
+                latencies->push_back(elapsed.count());
+            }
+        }
+    };
+
+    for (int i = 0; i < opts.warmup; ++i)
+    {
+        replay(nullptr);
+    }
+    const std::size_t baseline_rss = resident_memory();
+
+    std::cout << std::fixed << std::setprecision(2)
+              << requests.size() << " requests per iteration, " << opts.iterations << " iterations after "
+              << opts.warmup << " warmup, baseline RSS " << mib(baseline_rss) << " MiB\n"
+              << "iteration  requests/s    p50 ms    p99 ms   RSS MiB\n";
+
+    std::vector<double> latencies;
+    std::vector<double> window;
+    latencies.reserve(requests.size() * static_cast<std::size_t>(opts.iterations));
+    std::size_t peak_rss = baseline_rss;
+    double window_ms = 0;
+    double total_ms = 0;
+    for (int i = 1; i <= opts.iterations; ++i)
+    {
+        auto start = clock::now();
+        replay(&window);
+        std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+        window_ms += elapsed.count();
+        total_ms += elapsed.count();
+        peak_rss = std::max(peak_rss, resident_memory());
+
+        if (i % opts.report_every == 0 || i == opts.iterations)
+        {
+            const double throughput = static_cast<double>(window.size()) * 1000.0 / window_ms;
+            latencies.insert(latencies.end(), window.begin(), window.end());
+            const double p50 = percentile(window, 0.50);
+            const double p99 = percentile(window, 0.99);
+            std::cout << std::setw(9) << i << std::setw(12) << throughput << std::setw(10) << p50
+                      << std::setw(10) << p99 << std::setw(10) << mib(resident_memory()) << "\n";
+            window.clear();
+            window_ms = 0;
+        }
+    }
+
+    const std::size_t final_rss = resident_memory();
+    const double throughput = static_cast<double>(latencies.size()) * 1000.0 / total_ms;
+    const double p50 = percentile(latencies, 0.50);
+    const double p99 = percentile(latencies, 0.99);
+    const double growth = mib(final_rss) - mib(baseline_rss);
+
+    std::cout << "\nthroughput:  " << throughput << " requests/s\n"
+              << "latency:     p50 " << p50 << " ms, p99 " << p99 << " ms\n"
+              << "RSS:         " << mib(baseline_rss) << " -> " << mib(final_rss) << " MiB (peak "
+              << mib(peak_rss) << ", growth " << growth << " MiB)\n"
+              << "errors:      " << errors << "\n"
+              << "completions: " << completions << " matches\n"
+              << "IOPub:       " << mib(iopub.bytes) << " MiB in";
+    for (const auto& [msg_type, count] : iopub.messages)
+    {
+        std::cout << " " << count << " " << msg_type;
+    }
+    std::cout << std::endl;
+
+    std::vector<std::string> failures;
+    if (opts.min_throughput > 0 && throughput < opts.min_throughput)
+    {
+        failures.push_back("throughput below " + std::to_string(opts.min_throughput) + " requests/s");
+    }
+    if (opts.max_p50 > 0 && p50 > opts.max_p50)
+    {
+        failures.push_back("p50 latency above " + std::to_string(opts.max_p50) + " ms");
+    }
+    if (opts.max_p99 > 0 && p99 > opts.max_p99)
+    {
+        failures.push_back("p99 latency above " + std::to_string(opts.max_p99) + " ms");
+    }
+    if (opts.max_rss_growth > 0 && baseline_rss != 0 && growth > opts.max_rss_growth)
+    {
+        failures.push_back("RSS growth above " + std::to_string(opts.max_rss_growth) + " MiB");
+    }
+    if (errors > opts.max_errors)
+    {
+        failures.push_back(std::to_string(errors) + " failed requests");
+    }
+    std::remove(scratch.c_str());
+
+    for (const std::string& failure : failures)
+    {
+        std::cerr << "FAILED: " << failure << std::endl;
+    }
+    return failures.empty() ? 0 : 1;
+}
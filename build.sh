@@ -27,7 +27,6 @@ emcmake cmake \
 -DCMAKE_PREFIX_PATH=$PREFIX                       \
 -DCMAKE_INSTALL_PREFIX=$PREFIX                    \
 -DCMAKE_FIND_ROOT_PATH_MODE_PACKAGE=ON            \
--Dtabulate_DIR=$PREFIX/lib/cmake/tabulate         \
 -DXSQL_BUILD_XSQLITE_EXECUTABLE=OFF               \
 -DXSQL_BUILD_SHARED=OFF                           \
 -DXSQL_BUILD_STATIC=ON                            \
@@ -0,0 +1,56 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XBLOB_IO_HPP
+#define XEUS_SQLITE_XBLOB_IO_HPP
+
+#include <cstdint>
+#include <string>
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /* Bytes moved between the file and the BLOB at once */
+    constexpr std::size_t blob_chunk_size = 256 * 1024;
+
+    /*! \brief export_blob - writes a BLOB to a file.
+     *
+     * The value is read in chunks with sqlite3_blob_read, it is never held
+     * in memory as a whole. table may be qualified with its schema, as in
+     * aux.images. A partially written file is removed on error.
+     *
+     * param accList sqlite3* db, const std::string& table, const std::string& column, std::int64_t rowid, const std::string& path
+     * return std::int64_t, the number of bytes written
+     */
+    XEUS_SQLITE_API std::int64_t export_blob(sqlite3* db,
+                                             const std::string& table,
+                                             const std::string& column,
+                                             std::int64_t rowid,
+                                             const std::string& path);
+
+    /*! \brief import_blob - replaces a value by the content of a file.
+     *
+     * The row must exist. Its value is set to a zeroblob of the file size,
+     * then filled in chunks with sqlite3_blob_write. Both steps run in a
+     * savepoint, the row is left unchanged on error.
+     *
+     * param accList sqlite3* db, const std::string& path, const std::string& table, const std::string& column, std::int64_t rowid
+     * return std::int64_t, the number of bytes read
+     */
+    XEUS_SQLITE_API std::int64_t import_blob(sqlite3* db,
+                                             const std::string& path,
+                                             const std::string& table,
+                                             const std::string& column,
+                                             std::int64_t rowid);
+}
+
+#endif
@@ -0,0 +1,88 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XCOMPRESSED_VFS_HPP
+#define XEUS_SQLITE_XCOMPRESSED_VFS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /* Name of the VFS, as in %LOAD archive.sqlz r vfs=compressed */
+    constexpr const char* compressed_vfs_name = "compressed";
+
+    struct compressed_vfs_options
+    {
+        /* Bytes of decompressed blocks cached per open file, the least recently used are dropped beyond */
+        std::size_t cache_size = std::size_t(16) << 20;
+    };
+
+    /*! \brief register_compressed_vfs - registers the read-only compressed VFS.
+     *
+     * Files written by compress_database are read through a cache of
+     * decompressed blocks, located with the block index at the end of the
+     * file. They are opened read-only and immutable, without locks nor
+     * journal. Other files, and the journals and temporary files SQLite
+     * needs, are passed to the default VFS, so that the VFS can open any
+     * database. Registering again only changes the options.
+     *
+     * Throws if xeus-sqlite is built without zlib, see XSQL_HAVE_ZLIB.
+     *
+     * param accList const compressed_vfs_options& options
+     * return void
+     */
+    XEUS_SQLITE_API void register_compressed_vfs(const compressed_vfs_options& options = {});
+
+    /* False when xeus-sqlite is built without zlib */
+    XEUS_SQLITE_API bool compressed_vfs_available() noexcept;
+
+    struct compress_options
+    {
+        /* Uncompressed size of a block, a power of two from 512 bytes to 16 MiB,
+           at least the page size so that a page is read from a single block */
+        std::size_t block_size = 64 * 1024;
+        /* zlib level, 1 is the fastest and 9 the smallest */
+        int level = 6;
+    };
+
+    struct compress_result
+    {
+        std::uint64_t database_bytes = 0;
+        std::uint64_t compressed_bytes = 0;
+        std::size_t blocks = 0;
+    };
+
+    /*! \brief compress_database - writes a compressed copy of a database.
+     *
+     * The database is first copied with VACUUM INTO next to destination,
+     * which gives a consistent, compact snapshot in rollback journal mode
+     * even if it is being written, then compressed block by block:
+     *
+     * - header: "xsqlz\0\0\1", block size and codec (1 for zlib) on 32
+     *   bits, database size, block count and index offset on 64 bits,
+     *   little endian;
+     * - the compressed blocks;
+     * - the index, offset and compressed size of each block.
+     *
+     * The copy is removed afterwards, destination is removed on error.
+     * Throws if destination exists.
+     *
+     * param accList const std::string& source, const std::string& destination, const compress_options& options
+     * return compress_result
+     */
+    XEUS_SQLITE_API compress_result compress_database(const std::string& source,
+                                                      const std::string& destination,
+                                                      const compress_options& options = {});
+}
+
+#endif
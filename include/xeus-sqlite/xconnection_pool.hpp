@@ -0,0 +1,81 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XCONNECTION_POOL_HPP
+#define XEUS_SQLITE_XCONNECTION_POOL_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    struct connection
+    {
+        std::string name;
+        std::string path;
+        std::unique_ptr<SQLite::Database> db;
+    };
+
+    /*! \brief connection_pool - named connections kept open while unused.
+     *
+     * Holds the connections that were loaded and then switched away from,
+     * so that switching back reuses their page cache, temp tables and
+     * prepared plans. Beyond the capacity, the least recently used
+     * connection is closed.
+     */
+    class XEUS_SQLITE_API connection_pool
+    {
+    public:
+
+        explicit connection_pool(std::size_t capacity = 3);
+
+        /* Stores the connection as the most recently used one, replacing
+           a connection of the same name */
+        void park(connection conn);
+        /* Removes the connection from the pool, throws if it is unknown */
+        connection take(const std::string& name);
+        void erase(const std::string& name);
+        bool contains(const std::string& name) const;
+
+        /* Names, most recently used first */
+        std::vector<std::string> names() const;
+        /* Calls f(const connection&), most recently used first */
+        template <class F>
+        void for_each(F&& f) const;
+        std::size_t size() const noexcept;
+
+        std::size_t capacity() const noexcept;
+        void set_capacity(std::size_t capacity);
+
+    private:
+
+        void evict();
+
+        std::list<connection> m_connections;
+        std::size_t m_capacity;
+    };
+
+    template <class F>
+    inline void connection_pool::for_each(F&& f) const
+    {
+        for (const connection& conn : m_connections)
+        {
+            f(conn);
+        }
+    }
+}
+
+#endif
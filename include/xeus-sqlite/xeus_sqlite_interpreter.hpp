@@ -11,32 +11,187 @@
 #define XEUS_SQLITE_INTERPRETER_HPP
 
 #include "xeus_sqlite_config.hpp"
+#include "xconnection_pool.hpp"
+#include "xhistory.hpp"
+#include "xhtml_renderer.hpp"
+#include "xjson_renderer.hpp"
+#include "xmaintenance.hpp"
+#include "xplan_history.hpp"
+#include "xprewarm.hpp"
+#include "xmagic_parser.hpp"
+#include "xquery_limits.hpp"
+#include "xresult_pager.hpp"
+#include "xsession.hpp"
+#include "xtext_renderer.hpp"
+#include "xtrace.hpp"
 #include "xvega_sqlite.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
 #include <SQLiteCpp/SQLiteCpp.h>
 #include <SQLiteCpp/VariadicBind.h>
 
 #include "nlohmann/json.hpp"
+#include "xeus/xcomm.hpp"
 #include "xeus/xinterpreter.hpp"
 
 namespace nl = nlohmann;
 
 namespace xeus_sqlite
 {
+    /* Mimetypes built for query results, see %OUTPUT */
+    enum output_format : unsigned
+    {
+        output_none = 0,
+        output_text = 1 << 0,
+        output_html = 1 << 1,
+        output_json = 1 << 2,
+        output_dataresource = 1 << 3
+    };
+
     class XEUS_SQLITE_API interpreter : public xeus::xinterpreter
     {
     friend class SQLite::Database;
 
     public:
 
+        using magic_handler = std::function<void(int, const magic_input&)>;
+
         interpreter();
         virtual ~interpreter() = default;
 
+        /*! \brief register_magic - adds or replaces a magic command.
+         *
+         * Names are case insensitive. When requires_db is true the handler
+         * is only called once a database has been loaded or created.
+         *
+         * param accList const std::string& name, magic_handler handler, bool requires_db
+         * return void
+         */
+        void register_magic(const std::string& name,
+                            magic_handler handler,
+                            bool requires_db = true);
+
+        /*! \brief set_history_manager - history receiving the execution
+         * time and row count of each cell, may be null.
+         *
+         * The history manager is owned by the kernel and outlives the
+         * interpreter's use of it.
+         *
+         * param accList sqlite_history_manager* history
+         * return void
+         */
+        void set_history_manager(sqlite_history_manager* history);
+
     private:
+
+        struct magic_entry
+        {
+            magic_handler handler;
+            bool requires_db;
+        };
+
+        /* Magic names, upper case, to their handlers */
+        std::unordered_map<std::string, magic_entry> m_magics;
+
         std::unique_ptr<SQLite::Database> m_db = nullptr;
         std::unique_ptr<SQLite::Database> m_backup_db = nullptr;
+        /* Handle of m_db for interrupt requests, which run on the control thread */
+        std::mutex m_interrupt_mutex;
+        sqlite3* p_interrupt_db = nullptr;
         bool m_bd_is_loaded = false;
         std::string m_db_path;
+        std::string m_db_name;
+
+        /* Loaded connections that are not in use, see %USE */
+        connection_pool m_connections;
+
+        /* Write transaction kept open across cells, see %BEGIN_BATCH */
+        struct batch_state
+        {
+            bool active = false;
+            /* Cells between two savepoints */
+            std::size_t savepoint_every = 1;
+            std::size_t pending_cells = 0;
+            std::size_t statements = 0;
+            long long rows = 0;
+            /* Counts at the last savepoint */
+            std::size_t saved_statements = 0;
+            long long saved_rows = 0;
+            /* COMMIT or ROLLBACK failed and left the transaction open */
+            bool ending_failed = false;
+        };
+        batch_state m_batch;
+
+        /* Opt-in housekeeping when idle, see %MAINTENANCE */
+        maintenance_scheduler m_maintenance;
+
+        /* Reads the database ahead of the first queries, see %PREWARM */
+        prewarmer m_prewarm;
+
+        /* Changes recorded on the database in use, see %SESSION_START */
+        change_recorder m_changes;
+
+        /* Results kept for the frontends paging them, see pager_comm_target */
+        result_pager m_pager;
+        /* Comms opened by the frontends, results are only kept while there is one */
+        std::map<std::string, xeus::xcomm> m_pager_comms;
+        /* Closed comms, removed outside of their own handlers */
+        std::vector<std::string> m_closed_pager_comms;
+
+        /* Comms of the bulk inserts, see ingest_comm_target */
+        std::map<std::string, xeus::xcomm> m_ingest_comms;
+        std::vector<std::string> m_closed_ingest_comms;
+
+        /* Receives the statistics of each cell */
+        sqlite_history_manager* m_history = nullptr;
+        /* Rows returned or changed by the running cell */
+        long long m_cell_rows = 0;
+
+        /* Buffers of the last published result, see %MEMORY */
+        struct output_usage
+        {
+            std::size_t rows = 0;
+            std::size_t table_bytes = 0;
+            std::size_t rendered_bytes = 0;
+            std::size_t json_values = 0;
+            std::size_t peak_table_bytes = 0;
+            std::size_t peak_rendered_bytes = 0;
+        };
+        output_usage m_output_usage;
+
+        /* XVEGA_PLOT output settings, see %XVEGA_DATA and %XVEGA_TABLES,
+           the data goes to files in m_xvega_data_dir when it is not empty */
+        bool m_xvega_inline_data = false;
+        std::string m_xvega_data_dir;
+        bool m_xvega_tables = true;
+
+        unsigned m_output_formats = output_text | output_html;
+
+        /* Budgets of each statement, see %LIMITS, and the kernel defaults */
+        query_limits m_limits;
+        query_limits m_default_limits;
+
+        /* Set by interrupt requests to stop the connections of %PARALLEL */
+        std::atomic<bool> m_parallel_interrupted{false};
+
+        /* Timeline of the cells, see %TRACE */
+        tracer m_tracer;
+
+        /* Plans and latencies of the queries, see %PLAN_HISTORY, null if unavailable,
+           only recorded after %PLAN_HISTORY on */
+        std::unique_ptr<plan_history> m_plans;
+        bool m_plans_enabled = false;
+
+        /* Truncation rules of the text/plain, text/html and dataresource outputs */
+        text_table_options m_text_options;
+        html_table_options m_html_options;
+        dataresource_options m_dataresource_options;
 
         void configure_impl() override;
         void execute_request_impl(send_reply_callback cb,
@@ -54,34 +209,101 @@ namespace xeus_sqlite
         nl::json shutdown_request_impl(bool restart) override;
         nl::json interrupt_request_impl() override;
 
+        void register_builtin_magics();
+
+        /*! \brief open_pager_comm - handles a comm opened on pager_comm_target.
+         *
+         * The comm receives the requests of result_pager::handle_request and
+         * replies on the same comm. The list of kept results is sent when
+         * it opens.
+         *
+         * param accList xeus::xcomm&& comm
+         * return void
+         */
+        void open_pager_comm(xeus::xcomm&& comm);
+
+        /* True while a frontend can page results */
+        bool pager_open();
+
+        /*! \brief open_ingest_comm - handles a comm opened on ingest_comm_target.
+         *
+         * Each message is a request of handle_ingest_request on the database
+         * in use, with the column buffers of the message, and is replied on
+         * the same comm. Inserts made while a batch is open are part of it.
+         *
+         * param accList xeus::xcomm&& comm
+         * return void
+         */
+        void open_ingest_comm(xeus::xcomm&& comm);
+
         /**
-         * Parses magic and calls the correct function.
+         * Looks up the magic in the dispatch table and calls its handler.
          */
-        void parse_SQLite_magic(int execution_counter, const std::vector<std::string>& tokenized_input);
+        void parse_SQLite_magic(int execution_counter, const magic_input& input);
+
+        /*! \brief open_connection - makes a new connection the one in use.
+         *
+         * Every database is opened through this method. The connection in
+         * use is kept warm in the pool under its name, unless it is the one
+         * being replaced. vfs names the SQLite VFS of the connection, the
+         * default one if empty.
+         *
+         * param accList const std::string& name, const std::string& path, int flags, const std::string& vfs
+         * return void
+         */
+        void open_connection(const std::string& name,
+                             const std::string& path,
+                             int flags,
+                             const std::string& vfs = "");
 
         /*! \brief load_db - loads a database.
          *
-         * Receives three arguments: the command %LOAD, the path of the database
-         * location and a third optional parameter that might be RW or R to set the
-         * read and write or the read mode, respectively.
-         * If no third arguments are passed to this method, it will default to read
-         * and write mode.
+         * Receives the arguments of %LOAD: the path of the database location
+         * and an optional parameter that might be RW or R to set the read and
+         * write or the read mode, respectively.
+         * If no mode is passed to this method, it will default to read and
+         * write mode. A trailing AS <name> names the connection, it defaults
+         * to the path, and vfs=<name> selects the SQLite VFS, such as
+         * compressed for the files written by %COMPRESS.
          *
-         * param accList std::vector<std::string>& tokenized_input
+         * param accList const magic_input& input
          * return void
          */
-        void load_db(const std::vector<std::string> tokenized_input);
+        void load_db(const magic_input& input);
 
         /*! \brief create_db - creates a database.
          *
          * Creates the a database in read and write mode.
-         * Receives two arguments: the command %CREATE, the path to where the
-         * database will be created and the name of the database.
+         * Receives the arguments of %CREATE: the path to where the database
+         * will be created and the name of the database.
          *
-         * param accList std::vector<std::string>& tokenized_input
+         * param accList const magic_input& input
+         * return void
+         */
+        void create_db(const magic_input& input);
+
+        /*! \brief use_connection - switches to another loaded database.
+         *
+         * Handles %USE [name] and outputs the list of open connections.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json use_connection(const magic_input& input);
+
+        /*! \brief attach_db - handles %ATTACH <path> AS <schema>.
+         *
+         * param accList const magic_input& input
+         * return void
+         */
+        void attach_db(const magic_input& input);
+
+        /*! \brief detach_db - handles %DETACH <schema>.
+         *
+         * param accList const magic_input& input
          * return void
          */
-        void create_db(const std::vector<std::string> tokenized_input);
+        void detach_db(const magic_input& input);
 
         /*! \brief delete_db - deletes a database.
          *
@@ -160,18 +382,244 @@ namespace xeus_sqlite
          */
         void backup(std::string backup_type);
 
+        /*! \brief set_xvega_output - configures the XVEGA_PLOT output.
+         *
+         * Handles %XVEGA_DATA inline|named|file <directory>, which selects
+         * whether the chart data is kept inline in the spec, emitted once as
+         * a named dataset or written to a file, and %XVEGA_TABLES on|off,
+         * which toggles the text and HTML tables of chart cells.
+         *
+         * param accList const magic_input& input
+         * return void
+         */
+        void set_xvega_output(const magic_input& input);
+
+        /*! \brief xvega_plot - runs %XVEGA_PLOT.
+         *
+         * The query after <> is passed to SQLite as it was typed, the chart
+         * is built from its result.
+         *
+         * param accList int execution_counter, const magic_input& input
+         * return void
+         */
+        void xvega_plot(int execution_counter, const magic_input& input);
+
+
+        /*! \brief parallel_query - runs %PARALLEL <glob> <query>.
+         *
+         * Runs the query on every file matching the pattern, on a pool of
+         * read-only connections, and publishes the merged result.
+         *
+         * param accList int execution_counter, const magic_input& input
+         * return void
+         */
+        void parallel_query(int execution_counter, const magic_input& input);
+
+        /*! \brief query_file - runs %QUERY_FILE <path> <query>.
+         *
+         * Exposes a CSV or JSON lines file as a temporary xcsv or xjsonl
+         * virtual table named after the file, runs the query on it and
+         * drops the table. Uses an in-memory database if none is loaded.
+         *
+         * param accList int execution_counter, const magic_input& input
+         * return void
+         */
+        void query_file(int execution_counter, const magic_input& input);
+
+        /*! \brief blob_export - handles %BLOB_EXPORT <table> <column> <rowid> <path>.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json blob_export(const magic_input& input);
+
+        /*! \brief blob_import - handles %BLOB_IMPORT <path> <table> <column> <rowid>.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json blob_import(const magic_input& input);
+
+        /*! \brief begin_batch - opens a write transaction across cells.
+         *
+         * Handles %BEGIN_BATCH [savepoint_every=N]. A savepoint is taken
+         * every N cells so that a failing or interrupted cell only rolls
+         * back to it, the transaction stays open.
+         *
+         * param accList const magic_input& input
+         * return void
+         */
+        void begin_batch(const magic_input& input);
+
+        /*! \brief end_batch - commits or rolls back the batch transaction.
+         *
+         * Outputs the number of statements and rows affected by the batch.
+         * When COMMIT or ROLLBACK fails and the transaction stays open, the
+         * batch stays open too and the error says so.
+         *
+         * param accList bool commit
+         * return nl::json
+         */
+        nl::json end_batch(bool commit);
+
+        /* Publishes the handle of the connection in use to interrupt_request_impl,
+           null before the connection is closed or parked */
+        void set_interrupt_handle(sqlite3* db);
+
+        /* Called after each cell run inside a batch */
+        void batch_cell_done();
+        /* Rolls back to the last savepoint, returns a note for the error */
+        std::string batch_cell_failed();
+
+        /*! \brief set_maintenance - handles %MAINTENANCE on [idle=60s] | off | status.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json set_maintenance(const magic_input& input);
+
+        /*! \brief memory_report - handles %MEMORY [reset].
+         *
+         * Reports the SQLite heap and limits, the usage of each open
+         * connection and the buffers of the last published result. With
+         * reset, the peaks and counters start over.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json memory_report(const magic_input& input);
+
+        /*! \brief fts_index - handles %FTS_INDEX <table> <column> ... [tokenize=<name>] | drop.
+         *
+         * Builds the full-text index of a table and reports its progress
+         * on stdout while the rows are copied.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json fts_index(const magic_input& input);
+
+        /*! \brief search - runs %SEARCH <table> [limit=N] <query>.
+         *
+         * param accList int execution_counter, const magic_input& input
+         * return void
+         */
+        void search(int execution_counter, const magic_input& input);
+
+        /*! \brief prewarm - handles %PREWARM [<table> ...] | status | stop.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json prewarm(const magic_input& input);
+
+        /*! \brief session - handles %SESSION_START [<table> ...], %SESSION_SAVE <path> and %SESSION_STOP.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json session(const magic_input& input);
+
+        /*! \brief changeset_apply - handles %CHANGESET_APPLY <path> [conflict=abort|omit|replace].
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json changeset_apply(const magic_input& input);
+
+        /*! \brief compress - handles %COMPRESS <source> <destination> [block_size=<n>] [level=<n>].
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json compress(const magic_input& input);
+
+        /*! \brief set_output_formats - selects the mimetypes built for results.
+         *
+         * Handles %OUTPUT [html] [text] [json] [dataresource] [none] and outputs the current
+         * selection. The kernel-level default is read from the XSQLITE_OUTPUT
+         * environment variable.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json set_output_formats(const magic_input& input);
+
+        /*! \brief set_limits - handles %LIMITS [timeout=30s] [max_steps=N] [max_rows=N] [max_mem=2GB] | reset.
+         *
+         * Sets the budgets enforced on each statement run by
+         * process_SQLite_input and outputs them. reset goes back to the
+         * kernel defaults read from the XSQLITE_LIMITS environment variable.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json set_limits(const magic_input& input);
+
+        /*! \brief set_trace - handles %TRACE [on [<path>] | off].
+         *
+         * Starts or stops recording the phases of each cell to a Chrome
+         * trace-event file, and outputs the state of the trace. The
+         * XSQLITE_TRACE environment variable traces from the start.
+         *
+         * param accList const magic_input& input
+         * return nl::json
+         */
+        nl::json set_trace(const magic_input& input);
+
+        /*! \brief set_plan_history - handles %PLAN_HISTORY [<n>] | on | off | clear | [slowdown=<factor>] [min_duration=<duration>].
+         *
+         * Without argument or with a count, shows the plans recorded for
+         * the queries of the database in use. The other arguments change
+         * the recording and the warning thresholds, and output them.
+         *
+         * param accList int execution_counter, const magic_input& input
+         * return void
+         */
+        void set_plan_history(int execution_counter, const magic_input& input);
+
+        /*! \brief record_plan - stores the plan and duration of a statement that ran.
+         *
+         * Publishes the warning of plan_history::record on stderr, if any.
+         *
+         * param accList const std::string& plan, const std::string& code,
+         *               std::chrono::steady_clock::time_point start, long long rows
+         * return void
+         */
+        void record_plan(const std::string& plan,
+                         const std::string& code,
+                         std::chrono::steady_clock::time_point start,
+                         long long rows);
 
         /*! \brief get_header_info - backups a database.
          *
          * Runs pure SQLite code. Sends the result as HTML or Text to the front
-         * end.
+         * end, only the formats selected with %OUTPUT are built. With none
+         * the row count and timing are reported instead. xv_sqlite_df is only
+         * filled when it is not null.
          *
          * return void
          */
         void process_SQLite_input(int execution_counter,
                                         std::unique_ptr<SQLite::Database> &m_db,
                                         const std::string& code,
-                                        xv::df_type& xv_sqlite_df);
+                                        xv::df_type* xv_sqlite_df,
+                                        bool publish_tables = true);
+
+        /* First and last rows of a result shown by the selected outputs, false
+           if one of them shows every row */
+        bool displayed_rows(std::size_t& head, std::size_t& tail) const;
+
+        /* Publishes the formats selected with %OUTPUT, or the summary with none */
+        void publish_table(int execution_counter,
+                           const result_table& table,
+                           std::size_t row_count,
+                           std::chrono::steady_clock::time_point start,
+                           nl::json metadata = nl::json::object());
+
+        void publish_summary(int execution_counter,
+                             const std::string& what,
+                             std::chrono::steady_clock::time_point start);
     };
 }
 
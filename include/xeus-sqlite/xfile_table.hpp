@@ -0,0 +1,54 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XFILE_TABLE_HPP
+#define XEUS_SQLITE_XFILE_TABLE_HPP
+
+#include <string>
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /*! \brief register_file_tables - adds the xcsv and xjsonl virtual table modules.
+     *
+     * CREATE VIRTUAL TABLE t USING xcsv(path=data.csv [, header=no] [, delimiter=';'])
+     * CREATE VIRTUAL TABLE t USING xjsonl(path=events.jsonl)
+     *
+     * The file is memory mapped and queried in place, text values point
+     * into the mapping. The rowid is the record number, an index of every
+     * 1024th record offset is built while the file is read so that rowid
+     * lookups and ranges seek instead of scanning. Equality constraints on
+     * columns are checked on the raw record before SQLite sees the row.
+     *
+     * param accList sqlite3* db
+     * return void
+     */
+    XEUS_SQLITE_API void register_file_tables(sqlite3* db);
+
+    /*! \brief file_table_module - module reading the file, xjsonl for .jsonl,
+     * .ndjson and .json files, xcsv otherwise.
+     *
+     * param accList const std::string& path
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string file_table_module(const std::string& path);
+
+    /*! \brief file_table_name - table name made from the file name, for
+     * instance access_log for logs/access-log.csv.
+     *
+     * param accList const std::string& path
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string file_table_name(const std::string& path);
+}
+
+#endif
@@ -0,0 +1,82 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XFTS_HPP
+#define XEUS_SQLITE_XFTS_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    struct fts_index_options
+    {
+        /* FTS5 tokenizer, for instance porter or trigram, unicode61 if empty */
+        std::string tokenize;
+        /* Rows copied to the index per transaction */
+        std::size_t batch_rows = 50000;
+    };
+
+    /* Called after each batch with the rows indexed so far and the total */
+    using fts_progress = std::function<void(long long indexed, long long total)>;
+
+    /*! \brief fts_table_name - name of the full-text index of a table, <table>_fts.
+     *
+     * param accList const std::string& table
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string fts_table_name(const std::string& table);
+
+    /*! \brief create_fts_index - builds an external-content FTS5 index.
+     *
+     * The index is the <table>_fts virtual table, in the schema of the
+     * table. It stores no copy of the text, snippets read the table. It is
+     * kept in sync by insert, update and delete triggers on the table. The
+     * existing rows are copied in batches of options.batch_rows rows, each
+     * in its own transaction, or savepoint when a transaction is open. On
+     * error the index and its triggers are removed.
+     *
+     * param accList SQLite::Database& db, const std::string& table, const std::vector<std::string>& columns, const fts_index_options& options, const fts_progress& progress
+     * return long long, the number of rows indexed
+     */
+    XEUS_SQLITE_API long long create_fts_index(SQLite::Database& db,
+                                               const std::string& table,
+                                               const std::vector<std::string>& columns,
+                                               const fts_index_options& options,
+                                               const fts_progress& progress);
+
+    /*! \brief drop_fts_index - removes the index of a table and its triggers.
+     *
+     * param accList SQLite::Database& db, const std::string& table
+     * return void
+     */
+    XEUS_SQLITE_API void drop_fts_index(SQLite::Database& db, const std::string& table);
+
+    /*! \brief fts_search_query - SELECT of the hits of a full-text query.
+     *
+     * Returns the rowid, the score and a snippet of the best matching
+     * column of at most limit rows, best first. Throws if the table has no
+     * index.
+     *
+     * param accList SQLite::Database& db, const std::string& table, const std::string& query, long long limit
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string fts_search_query(SQLite::Database& db,
+                                                 const std::string& table,
+                                                 const std::string& query,
+                                                 long long limit);
+}
+
+#endif
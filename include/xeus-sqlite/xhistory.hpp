@@ -0,0 +1,158 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XHISTORY_HPP
+#define XEUS_SQLITE_XHISTORY_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus/xhistory_manager.hpp"
+
+#include "xeus_sqlite_config.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    struct history_options
+    {
+        /* Cells kept in the file, the oldest are removed beyond */
+        std::size_t max_entries = 100000;
+        /* Writes waiting for the writer thread, later ones are dropped */
+        std::size_t max_pending = 4096;
+        /* Delay during which writes are gathered in one transaction */
+        std::chrono::milliseconds flush_interval = std::chrono::milliseconds(500);
+    };
+
+    /*! \brief sqlite_history_manager - execution history stored in a SQLite file.
+     *
+     * Each kernel run is a new session of the file, so the history of
+     * previous runs stays available. Inputs are queued and written by a
+     * background thread in batched transactions, the shell thread never
+     * waits for the disk, except when a history request is served. The
+     * execution time and the number of rows of each cell are recorded
+     * along with the input.
+     *
+     * Tail and range requests are served from the rowid and (session, line)
+     * indexes. Glob searches use an FTS5 trigram index when SQLite provides
+     * one, and the index on the input otherwise, which only helps patterns
+     * that do not start with a wildcard.
+     */
+    class XEUS_SQLITE_API sqlite_history_manager : public xeus::xhistory_manager
+    {
+    public:
+
+        sqlite_history_manager(const std::string& path, const history_options& options);
+        ~sqlite_history_manager() override;
+
+        sqlite_history_manager(const sqlite_history_manager&) = delete;
+        sqlite_history_manager& operator=(const sqlite_history_manager&) = delete;
+
+        /* Called by the interpreter once a cell has run */
+        void record_execution(int line_num, double duration_ms, long long rows);
+
+        /* Blocks until the queued writes are in the file */
+        void flush() const;
+
+        int session() const noexcept;
+        /* Writes lost because the queue was full or the file not writable */
+        std::size_t dropped() const;
+
+    private:
+
+        struct pending_write
+        {
+            int line;
+            /* Empty for the statistics of a cell */
+            std::string source;
+            bool is_input;
+            double duration_ms;
+            long long rows;
+        };
+
+        void configure_impl() override;
+        void store_inputs_impl(int session, int line_num, const std::string& input) override;
+        nl::json get_tail_impl(int session, int n, bool raw, bool output) const override;
+        nl::json get_range_impl(int session, int start, int stop, bool raw, bool output) const override;
+        nl::json search_impl(int session,
+                             const std::string& pattern,
+                             bool raw,
+                             bool output,
+                             int n,
+                             bool unique) const override;
+
+        void enqueue(pending_write write);
+        void run();
+        void write_batch(const std::vector<pending_write>& batch);
+        nl::json make_reply(SQLite::Statement& query, bool output, bool reverse) const;
+
+        history_options m_options;
+        bool m_has_search_index = false;
+        int m_session = 0;
+
+        /* Used by the writer only */
+        std::unique_ptr<SQLite::Database> m_writer;
+        std::size_t m_batches = 0;
+        /* Used by the shell thread for requests */
+        std::unique_ptr<SQLite::Database> m_reader;
+
+        mutable std::mutex m_mutex;
+        mutable std::condition_variable m_wakeup;
+        mutable std::condition_variable m_flushed;
+        std::vector<pending_write> m_queue;
+        bool m_writing = false;
+        mutable bool m_flush_requested = false;
+        bool m_stop = false;
+        std::size_t m_dropped = 0;
+        std::thread m_thread;
+    };
+
+    /*! \brief jupyter_data_file - path of a file in the Jupyter data directory.
+     *
+     * The directory is looked up as jupyter --data-dir does, and created
+     * if needed. Empty if no suitable directory is found.
+     *
+     * param accList const std::string& name
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string jupyter_data_file(const std::string& name);
+
+    /*! \brief default_history_path - history file of the kernel.
+     *
+     * XSQLITE_HISTORY if it is set, otherwise xsqlite_history.db in the
+     * Jupyter data directory. Empty if no suitable directory is found.
+     *
+     * param accList
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string default_history_path();
+
+    /*! \brief make_sqlite_history_manager - opens or creates the history file.
+     *
+     * Throws if the file cannot be opened.
+     *
+     * param accList const std::string& path, const history_options& options
+     * return std::unique_ptr<sqlite_history_manager>
+     */
+    XEUS_SQLITE_API std::unique_ptr<sqlite_history_manager>
+    make_sqlite_history_manager(const std::string& path, const history_options& options = {});
+}
+
+#endif
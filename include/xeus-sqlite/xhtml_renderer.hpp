@@ -0,0 +1,49 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XHTML_RENDERER_HPP
+#define XEUS_SQLITE_XHTML_RENDERER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "xeus_sqlite_config.hpp"
+#include "xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    struct html_table_options
+    {
+        /* Rows shown, the first and last halves are kept when exceeded */
+        std::size_t max_rows = 1000;
+        /* Emits a colgroup with one xsql-<type> class per column */
+        bool column_classes = true;
+    };
+
+    /*! \brief append_html_escaped - appends text with HTML special characters escaped.
+     *
+     * Scans the input eight bytes at a time and copies runs that need no
+     * escaping in one go.
+     *
+     * param accList std::string& out, std::string_view text
+     * return void
+     */
+    XEUS_SQLITE_API void append_html_escaped(std::string& out, std::string_view text);
+
+    /*! \brief render_html_table - builds the text/html output of a result.
+     *
+     * param accList const result_table& table, const html_table_options& options
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string render_html_table(const result_table& table,
+                                                  const html_table_options& options = {});
+}
+
+#endif
@@ -0,0 +1,73 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XINGEST_HPP
+#define XEUS_SQLITE_XINGEST_HPP
+
+#include <cstdint>
+
+#include <sqlite3.h>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xmessage.hpp"
+
+#include "xeus_sqlite_config.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    /* Comm target of the bulk inserts, see handle_ingest_request */
+    constexpr const char* ingest_comm_target = "xsqlite.ingest";
+
+    /*! \brief ingest_columns - inserts column buffers into a table.
+     *
+     * The request describes the table, the row count and the columns, each
+     * with a name, a type and the indices of its buffers in the message:
+     *
+     * - int32, int64, float64: data, little endian values;
+     * - bool: data, one bit per value;
+     * - utf8, binary: data and offsets, rows + 1 int32 offsets in data,
+     *   int64 offsets for large_utf8 and large_binary;
+     * - any type: validity, optional, one bit per value, 0 for NULL.
+     *
+     * Bits are in the Arrow order, least significant bit first. The values
+     * are bound from the buffers to a single prepared INSERT, without
+     * copy nor conversion to text, and all the rows are inserted in one
+     * savepoint: either all of them are inserted or none.
+     *
+     * The table is created with the columns if it does not exist. With
+     * if_exists set to replace, it is dropped and created again, with fail,
+     * an existing table is an error. Otherwise the rows are appended to the
+     * columns of the same names.
+     *
+     * param accList sqlite3* db, const nl::json& request, const xeus::buffer_sequence& buffers
+     * return std::int64_t, the number of rows inserted
+     */
+    XEUS_SQLITE_API std::int64_t ingest_columns(sqlite3* db,
+                                                const nl::json& request,
+                                                const xeus::buffer_sequence& buffers);
+
+    /*! \brief handle_ingest_request - serves a request of a frontend.
+     *
+     * Requests are objects with an action, insert, which takes the
+     * arguments of ingest_columns. The reply is the inserted action with
+     * the table and rows, or the error action and a message. The id of the
+     * request, if any, is copied to the reply. This never throws.
+     *
+     * param accList sqlite3* db, const nl::json& request, const xeus::buffer_sequence& buffers
+     * return nl::json
+     */
+    XEUS_SQLITE_API nl::json handle_ingest_request(sqlite3* db,
+                                                   const nl::json& request,
+                                                   const xeus::buffer_sequence& buffers);
+}
+
+#endif
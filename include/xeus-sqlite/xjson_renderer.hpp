@@ -0,0 +1,86 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XJSON_RENDERER_HPP
+#define XEUS_SQLITE_XJSON_RENDERER_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus_sqlite_config.hpp"
+#include "xresult_table.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    struct dataresource_options
+    {
+        /* Rows sent, the first ones are kept when exceeded, 0 for all */
+        std::size_t max_rows = 10000;
+    };
+
+    /*! \brief table_schema_type - Table Schema type of a result column.
+     *
+     * Follows the SQLite affinity rules on the declared type, with
+     * boolean, date, time and datetime recognized by name. Columns without
+     * declared type, such as expressions, take the type of their values.
+     *
+     * param accList const result_table& table, std::size_t col
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string table_schema_type(const result_table& table, std::size_t col);
+
+    /*! \brief write_json_records - appends the application/json output of a result to out.
+     *
+     * An array with one object per row, up to the same max_rows as the
+     * dataresource output. Repeated column names get a _2, _3... suffix
+     * so that no value is lost. The JSON is written directly from the
+     * cells, keys are escaped once per column, and invalid UTF-8 in the
+     * text is replaced by U+FFFD.
+     *
+     * param accList std::string& out, const result_table& table, const dataresource_options& options
+     * return void
+     */
+    XEUS_SQLITE_API void write_json_records(std::string& out,
+                                            const result_table& table,
+                                            const dataresource_options& options = {});
+
+    /*! \brief write_dataresource - appends the application/vnd.dataresource+json output of a result to out.
+     *
+     * The schema lists the columns with their table_schema_type, the data
+     * holds the rows as in write_json_records.
+     *
+     * param accList std::string& out, const result_table& table, const dataresource_options& options
+     * return void
+     */
+    XEUS_SQLITE_API void write_dataresource(std::string& out,
+                                            const result_table& table,
+                                            const dataresource_options& options = {});
+
+    /*! \brief render_json_records - the output of write_json_records as nl::json.
+     *
+     * param accList const result_table& table, const dataresource_options& options
+     * return nl::json
+     */
+    XEUS_SQLITE_API nl::json render_json_records(const result_table& table,
+                                                 const dataresource_options& options = {});
+
+    /*! \brief render_dataresource - the output of write_dataresource as nl::json.
+     *
+     * param accList const result_table& table, const dataresource_options& options
+     * return nl::json
+     */
+    XEUS_SQLITE_API nl::json render_dataresource(const result_table& table,
+                                                 const dataresource_options& options = {});
+}
+
+#endif
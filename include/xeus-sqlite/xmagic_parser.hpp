@@ -0,0 +1,106 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XMAGIC_PARSER_HPP
+#define XEUS_SQLITE_XMAGIC_PARSER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /*! \brief magic_input - a magic line split into views of the cell code.
+     *
+     * name is the magic name without the leading %, args are the
+     * whitespace separated arguments and arguments is the raw text that
+     * follows the name, line breaks included.
+     */
+    struct magic_input
+    {
+        std::string_view name;
+        std::vector<std::string_view> args;
+        std::string_view arguments;
+    };
+
+    /*! \brief is_magic - checks whether a cell starts with %.
+     *
+     * Only looks at the leading whitespace, plain SQL cells do not go
+     * through any tokenization.
+     *
+     * param accList std::string_view code
+     * return bool
+     */
+    XEUS_SQLITE_API bool is_magic(std::string_view code);
+
+    /*! \brief parse_magic - splits a magic cell without copying it.
+     *
+     * The returned views point into code, which must outlive them.
+     *
+     * param accList std::string_view code
+     * return magic_input
+     */
+    XEUS_SQLITE_API magic_input parse_magic(std::string_view code);
+
+    XEUS_SQLITE_API std::vector<std::string_view> split_arguments(std::string_view text);
+
+    /*! \brief split_option - splits a key=value magic argument.
+     *
+     * Returns false when the argument has no =.
+     *
+     * param accList std::string_view arg, std::string_view& key, std::string_view& value
+     * return bool
+     */
+    XEUS_SQLITE_API bool split_option(std::string_view arg,
+                                      std::string_view& key,
+                                      std::string_view& value);
+
+    /*! \brief parse_duration - parses 250ms, 30s, 5m, 1h, or seconds.
+     *
+     * Throws on values that are not a positive duration.
+     *
+     * param accList std::string_view text
+     * return std::chrono::milliseconds
+     */
+    XEUS_SQLITE_API std::chrono::milliseconds parse_duration(std::string_view text);
+
+    /* Table argument of a magic, schema is main when it is not given */
+    struct qualified_name
+    {
+        std::string schema;
+        std::string name;
+    };
+
+    /*! \brief split_qualified_name - splits schema.table.
+     *
+     * param accList std::string_view arg
+     * return qualified_name
+     */
+    XEUS_SQLITE_API qualified_name split_qualified_name(std::string_view arg);
+
+    /*! \brief quote_identifier - quotes a name for use in SQL, "my ""table""".
+     *
+     * param accList std::string_view name
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string quote_identifier(std::string_view name);
+
+    XEUS_SQLITE_API bool iequals(std::string_view lhs, std::string_view rhs);
+
+    XEUS_SQLITE_API std::string to_upper(std::string_view text);
+
+    /* "1 row", "2 rows" */
+    XEUS_SQLITE_API std::string plural(std::size_t count, const std::string& noun);
+}
+
+#endif
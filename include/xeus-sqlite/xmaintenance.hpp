@@ -0,0 +1,94 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XMAINTENANCE_HPP
+#define XEUS_SQLITE_XMAINTENANCE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /*! \brief maintenance_scheduler - housekeeping of the database in use.
+     *
+     * Once the kernel has been idle for the configured period, a
+     * background thread runs PRAGMA optimize, a PASSIVE WAL checkpoint
+     * and an incremental vacuum on its own connection. If the kernel stays
+     * idle for twice that period, the checkpoint is escalated to TRUNCATE
+     * so that the WAL file shrinks. Any activity interrupts a running pass
+     * and waits for it to stop. Not available in the emscripten build, which has no threads.
+     */
+    class XEUS_SQLITE_API maintenance_scheduler
+    {
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        maintenance_scheduler();
+        ~maintenance_scheduler();
+
+        maintenance_scheduler(const maintenance_scheduler&) = delete;
+        maintenance_scheduler& operator=(const maintenance_scheduler&) = delete;
+
+        void start(std::chrono::milliseconds idle);
+        void stop();
+        bool running() const;
+
+        /* Database the passes run on, read-only databases are skipped */
+        void set_database(const std::string& path, bool read_only);
+
+        /* Called when a cell starts and ends executing, begin_activity
+           returns once no pass is running */
+        void begin_activity();
+        void end_activity();
+
+        std::string status() const;
+
+    private:
+
+        void run();
+        void run_pass(bool escalate);
+        /* Activity or stop since the pass started */
+        bool pass_cancelled() const;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+        std::condition_variable m_pass_done;
+        std::thread m_thread;
+        bool m_stop = false;
+
+        std::chrono::milliseconds m_idle;
+        clock::time_point m_last_activity;
+        bool m_busy = false;
+        /* 0: nothing done since the last activity, 1: light pass, 2: escalated */
+        int m_stage = 0;
+
+        std::string m_path;
+        bool m_read_only = false;
+        /* Only accessed by the worker, closed with m_mutex held */
+        std::unique_ptr<SQLite::Database> m_db;
+        std::string m_db_path;
+        bool m_in_pass = false;
+
+        std::size_t m_passes = 0;
+        clock::time_point m_last_pass;
+        std::string m_last_report;
+    };
+}
+
+#endif
@@ -0,0 +1,85 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XMEMORY_HPP
+#define XEUS_SQLITE_XMEMORY_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    struct sqlite_memory_options
+    {
+        /* Size of the preallocated page cache pool, 0 for none */
+        std::int64_t pagecache = 0;
+        /* Lookaside slots of each connection, 0 keeps SQLite's default */
+        int lookaside_slot_size = 0;
+        int lookaside_slots = 0;
+        /* Hard heap limit, 0 for none */
+        std::int64_t heap_limit = 0;
+    };
+
+    /*! \brief parse_sqlite_memory_options - reads the memory options of xsqlite.
+     *
+     * --sqlite-pagecache=<size>, --sqlite-lookaside=<slot size>,<slots> and
+     * --sqlite-heap-limit=<size>, sizes are given as 512K, 64M or 1G. The
+     * options are removed from argv. Throws on an invalid value.
+     *
+     * param accList int& argc, char* argv[]
+     * return sqlite_memory_options
+     */
+    XEUS_SQLITE_API sqlite_memory_options parse_sqlite_memory_options(int& argc, char* argv[]);
+
+    /*! \brief configure_sqlite_memory - applies the memory options.
+     *
+     * Must be called before the first connection is opened, SQLite does
+     * not accept a new page cache or lookaside configuration afterwards.
+     *
+     * param accList const sqlite_memory_options& options
+     * return void
+     */
+    XEUS_SQLITE_API void configure_sqlite_memory(const sqlite_memory_options& options);
+
+    /*! \brief parse_byte_size - parses 4096, 512K, 64M or 1G.
+     *
+     * param accList std::string_view text
+     * return std::int64_t
+     */
+    XEUS_SQLITE_API std::int64_t parse_byte_size(std::string_view text);
+
+    /*! \brief format_bytes - formats a size as 812 B, 3.4 KiB or 1.2 MiB.
+     *
+     * param accList std::int64_t bytes
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string format_bytes(std::int64_t bytes);
+
+    /*! \brief sqlite_memory_report - heap, limits and pools of the process.
+     *
+     * param accList bool reset
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string sqlite_memory_report(bool reset);
+
+    /*! \brief connection_memory_report - cache, schema, statement and
+     * lookaside usage of a connection, from sqlite3_db_status.
+     *
+     * param accList sqlite3* db, bool reset
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string connection_memory_report(sqlite3* db, bool reset);
+}
+
+#endif
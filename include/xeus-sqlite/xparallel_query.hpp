@@ -0,0 +1,108 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XPARALLEL_QUERY_HPP
+#define XEUS_SQLITE_XPARALLEL_QUERY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "xeus_sqlite_config.hpp"
+#include "xquery_limits.hpp"
+#include "xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    enum class aggregate_kind
+    {
+        none,
+        count,
+        sum,
+        total,
+        min,
+        max
+    };
+
+    struct order_term
+    {
+        std::size_t column;
+        bool descending;
+        bool nulls_first;
+    };
+
+    /*! \brief merge_plan - how the per file results of a query are combined.
+     *
+     * When one of the columns is an aggregate, rows with the same values
+     * in the other columns are combined. Otherwise the results are merged
+     * on the ORDER BY terms, or concatenated without them.
+     */
+    struct merge_plan
+    {
+        std::vector<aggregate_kind> aggregates;
+        std::vector<order_term> order;
+        /* -1 without LIMIT */
+        long long limit = -1;
+        bool grouped = false;
+    };
+
+    /*! \brief plan_merge - analyzes the top-level SELECT of a query.
+     *
+     * Only merges that give the same result as running the query on the
+     * union of the files are accepted, other queries throw: AVG, DISTINCT,
+     * OFFSET, HAVING, window functions, compound selects, and LIMIT or
+     * COLLATE combined with aggregates.
+     *
+     * param accList std::string_view sql, const std::vector<std::string>& column_names
+     * return merge_plan
+     */
+    XEUS_SQLITE_API merge_plan plan_merge(std::string_view sql,
+                                          const std::vector<std::string>& column_names);
+
+    /*! \brief merge_results - combines the results of every file.
+     *
+     * Ordered results go through a k-way merge that stops at the LIMIT,
+     * partial COUNT, SUM, TOTAL, MIN and MAX are combined per group.
+     *
+     * param accList const std::vector<result_table>& parts, const merge_plan& plan
+     * return result_table
+     */
+    XEUS_SQLITE_API result_table merge_results(const std::vector<result_table>& parts,
+                                               const merge_plan& plan);
+
+    /*! \brief glob_files - expands *, ? and [...] in the components of a path.
+     *
+     * param accList const std::string& pattern
+     * return std::vector<std::string>, sorted
+     */
+    XEUS_SQLITE_API std::vector<std::string> glob_files(const std::string& pattern);
+
+    /*! \brief run_parallel - runs a query on several database files.
+     *
+     * Every file is opened read-only on its own connection, the files are
+     * spread over at most max_threads threads (the number of cores when 0).
+     * The emscripten build runs them one after the other. The limits are
+     * enforced on every connection, and the query stops on all of them
+     * when interrupted is set. At most LIMIT rows are kept from each file,
+     * and without LIMIT max_rows also applies to the rows of all the files,
+     * so that the results held before the merge stay within the budget.
+     *
+     * param accList const std::vector<std::string>& files, const std::string& sql, std::size_t max_threads, const query_limits& limits, const std::atomic<bool>* interrupted
+     * return result_table
+     */
+    XEUS_SQLITE_API result_table run_parallel(const std::vector<std::string>& files,
+                                              const std::string& sql,
+                                              std::size_t max_threads = 0,
+                                              const query_limits& limits = query_limits(),
+                                              const std::atomic<bool>* interrupted = nullptr);
+}
+
+#endif
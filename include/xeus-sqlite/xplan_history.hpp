@@ -0,0 +1,137 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XPLAN_HISTORY_HPP
+#define XEUS_SQLITE_XPLAN_HISTORY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <sqlite3.h>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus_sqlite_config.hpp"
+#include "xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    struct plan_history_options
+    {
+        /* Warns when a run is this many times slower than the median of the previous ones */
+        double slowdown = 10;
+        /* Runs faster than this never warn */
+        std::chrono::milliseconds min_duration = std::chrono::milliseconds(100);
+        /* Previous runs the median is taken on, and runs needed before warning */
+        std::size_t window = 20;
+        std::size_t min_runs = 3;
+        /* Runs kept in the file, the oldest are removed beyond with the queries and plans left unused */
+        std::size_t max_runs = 100000;
+    };
+
+    /*! \brief normalize_query - the text identifying a query in the plan history.
+     *
+     * Comments are removed, white space is collapsed, keywords and
+     * identifiers are lower cased and literals and parameters are replaced
+     * with ?, lists of them by a single ?. Queries differing only by their
+     * constants share the same normalized text.
+     *
+     * param accList std::string_view sql
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string normalize_query(std::string_view sql);
+
+    /*! \brief explain_plan - EXPLAIN QUERY PLAN of a prepared statement.
+     *
+     * One line per step of the plan, indented by its depth in the plan
+     * tree. Empty for statements without plan, such as INSERT ... VALUES
+     * or CREATE TABLE, and if the plan cannot be obtained.
+     *
+     * param accList sqlite3_stmt* stmt
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string explain_plan(sqlite3_stmt* stmt);
+
+    /* Short hash of a plan, equal plans have the same fingerprint */
+    XEUS_SQLITE_API std::string plan_fingerprint(std::string_view plan);
+
+    /*! \brief plan_history - plans and latencies of the queries run, kept in a SQLite file.
+     *
+     * Queries are identified by their database and normalize_query. Each
+     * run records the fingerprint of its plan and its duration, and is
+     * compared with the previous runs of the query: a different plan than
+     * the last run, or a duration much larger than the median of the last
+     * runs, gives a warning.
+     *
+     * Recording is best effort, errors such as a locked file lose the run
+     * without failing the query.
+     */
+    class XEUS_SQLITE_API plan_history
+    {
+    public:
+
+        /* ":memory:" keeps the history for the session only */
+        plan_history(const std::string& path, const plan_history_options& options = {});
+        ~plan_history();
+
+        plan_history(const plan_history&) = delete;
+        plan_history& operator=(const plan_history&) = delete;
+
+        /*! \brief record - stores a run and compares it with the history of the query.
+         *
+         * param accList const std::string& database, std::string_view sql, const std::string& plan,
+         *               double duration_ms, long long rows
+         * return std::string the warning to show, empty if none
+         */
+        std::string record(const std::string& database,
+                           std::string_view sql,
+                           const std::string& plan,
+                           double duration_ms,
+                           long long rows);
+
+        /* Plans of the queries run on database, the most recently used first */
+        result_table recent_plans(const std::string& database, std::size_t limit);
+
+        /* Removes the history of database */
+        void clear(const std::string& database);
+
+        const std::string& path() const noexcept;
+        plan_history_options& options() noexcept;
+
+    private:
+
+        std::string m_path;
+        plan_history_options m_options;
+        std::unique_ptr<SQLite::Database> p_db;
+        std::size_t m_records = 0;
+
+        /* Statements of record, prepared once */
+        std::unique_ptr<SQLite::Statement> m_find_query;
+        std::unique_ptr<SQLite::Statement> m_insert_query;
+        std::unique_ptr<SQLite::Statement> m_last_runs;
+        std::unique_ptr<SQLite::Statement> m_find_plan;
+        std::unique_ptr<SQLite::Statement> m_insert_plan;
+        std::unique_ptr<SQLite::Statement> m_insert_run;
+    };
+
+    /*! \brief default_plan_history_path - plan history file of the kernel.
+     *
+     * XSQLITE_PLAN_HISTORY if it is set, otherwise xsqlite_plans.db in the
+     * Jupyter data directory. Empty if no suitable directory is found.
+     *
+     * param accList
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string default_plan_history_path();
+}
+
+#endif
@@ -0,0 +1,92 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XPREWARM_HPP
+#define XEUS_SQLITE_XPREWARM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /*! \brief prewarmer - reads a database file ahead of the first queries.
+     *
+     * A background thread reads the whole file, or only the b-trees of the
+     * given tables and indexes starting from their root page, so that the
+     * pages are in the operating system cache when SQLite needs them. The
+     * file is read directly, outside of SQLite, and the thread stops at the
+     * next page as soon as cancel is called. Not available in the
+     * emscripten build, which has no threads.
+     */
+    class XEUS_SQLITE_API prewarmer
+    {
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        prewarmer() = default;
+        ~prewarmer();
+
+        prewarmer(const prewarmer&) = delete;
+        prewarmer& operator=(const prewarmer&) = delete;
+
+        /*
+            Starts warming path, a previous run is cancelled. objects lists
+            tables and indexes, a table also warms its indexes, the whole file
+            is read if it is empty. Throws if an object does not exist.
+        */
+        void start(const std::string& path, const std::vector<std::string>& objects);
+        /* Stops the thread at the next page, does not wait for it */
+        void cancel() noexcept;
+        /* Cancels and waits for the thread */
+        void stop();
+
+        std::string status() const;
+
+    private:
+
+        /* One b-tree to walk, or the whole file when root is 0 */
+        struct target
+        {
+            std::string name;
+            std::uint32_t root;
+        };
+
+        void run(std::vector<target> targets);
+        void read_file(std::istream& in, std::vector<char>& buffer);
+        void walk_btree(std::istream& in, std::uint32_t root, std::vector<char>& visited,
+                        std::vector<char>& page);
+
+        mutable std::mutex m_mutex;
+        std::thread m_thread;
+        std::atomic<bool> m_cancel{false};
+
+        std::string m_path;
+        std::string m_scope;
+        std::uint32_t m_page_size = 0;
+        std::uint32_t m_page_count = 0;
+        std::atomic<std::uint64_t> m_pages{0};
+        clock::time_point m_start;
+        clock::time_point m_end;
+        /* idle, running, finished, cancelled or failed */
+        std::string m_state = "idle";
+        std::string m_error;
+    };
+}
+
+#endif
@@ -0,0 +1,118 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XQUERY_LIMITS_HPP
+#define XEUS_SQLITE_XQUERY_LIMITS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+#include "xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    /* Budgets of a statement, 0 for no limit */
+    struct query_limits
+    {
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(0);
+        /* Virtual machine instructions */
+        std::int64_t max_steps = 0;
+        /* Rows returned */
+        std::int64_t max_rows = 0;
+        /* Growth of the SQLite heap and size of the result buffer, in bytes */
+        std::int64_t max_mem = 0;
+    };
+
+    /*! \brief parse_query_limits - updates limits from key=value arguments.
+     *
+     * Keys are timeout, max_steps, max_rows and max_mem, for instance
+     * timeout=30s max_rows=1e6 max_mem=2GB. The value off removes a limit.
+     * Throws on an unknown key or an invalid value.
+     *
+     * param accList const std::vector<std::string_view>& args, query_limits& limits
+     * return void
+     */
+    XEUS_SQLITE_API void parse_query_limits(const std::vector<std::string_view>& args, query_limits& limits);
+
+    /*! \brief query_limits_to_string - the limits in the syntax of parse_query_limits.
+     *
+     * param accList const query_limits& limits
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string query_limits_to_string(const query_limits& limits);
+
+    /*! \brief query_governor - enforces query_limits while a statement runs.
+     *
+     * The deadline, the step budget and the memory budget are checked by
+     * a progress handler installed on the connection, which interrupts
+     * the statement. The memory budget is compared to the growth of the
+     * SQLite heap since the statement started, and also lowers the
+     * maximum length of a value of the connection to the budget. Nothing
+     * global is changed, the other connections and threads allocate as
+     * usual. The handler is removed and the limits restored on
+     * destruction. Rows and the result buffer are checked by count_row.
+     * When interrupted is given, the statement is also interrupted once it
+     * is set, for connections that another thread cannot reach.
+     */
+    class XEUS_SQLITE_API query_governor
+    {
+    public:
+
+        query_governor(sqlite3* db, const query_limits& limits,
+                       const std::atomic<bool>* interrupted = nullptr);
+        ~query_governor();
+
+        query_governor(const query_governor&) = delete;
+        query_governor& operator=(const query_governor&) = delete;
+
+        /* Called for each row returned, table is the result buffer if any */
+        void count_row(const result_table* table);
+
+        /* For a query split over several connections, checks max_rows
+           against the rows returned by all of them so far */
+        void count_total_rows(std::int64_t total) const;
+
+        /*! \brief throw_if_exceeded - called when a statement failed, throws
+         * an error naming the budget that stopped it if it was one.
+         *
+         * return void
+         */
+        void throw_if_exceeded() const;
+
+    private:
+
+        using clock = std::chrono::steady_clock;
+
+        static int progress(void* self);
+        [[noreturn]] void exceeded(const std::string& key) const;
+        bool uses_progress_handler() const;
+
+        sqlite3* p_db;
+        query_limits m_limits;
+        const std::atomic<bool>* p_interrupted;
+        clock::time_point m_deadline;
+        std::int64_t m_steps = 0;
+        std::int64_t m_rows = 0;
+        /* Budget that interrupted the statement, empty if none */
+        std::string m_stopped_by;
+
+        /* SQLite heap when the statement started */
+        sqlite3_int64 m_heap_base = 0;
+        int m_previous_length_limit = -1;
+    };
+}
+
+#endif
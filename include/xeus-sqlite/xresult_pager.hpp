@@ -0,0 +1,151 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XRESULT_PAGER_HPP
+#define XEUS_SQLITE_XRESULT_PAGER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    /* Comm target of the pager, see result_pager::handle_request */
+    constexpr const char* pager_comm_target = "xsqlite.pager";
+
+    struct pager_options
+    {
+        /* Results kept, the least recently used are evicted beyond */
+        std::size_t max_handles = 8;
+        /* Size of the spill file, the least recently used results are evicted beyond */
+        std::size_t max_spill_bytes = std::size_t(1) << 30;
+        /* Rows of a page, larger requests are clamped */
+        std::size_t max_page_size = 1000;
+        /* Results not paged for this long are evicted */
+        std::chrono::seconds idle_timeout = std::chrono::seconds(600);
+    };
+
+    /*! \brief result_pager - query results kept for paging.
+     *
+     * The rows of a result are copied to a table of a private temporary
+     * database as the statement steps, with their values unchanged. The
+     * database has a small page cache and lives on disk, so the memory of
+     * the kernel is bounded by the page being served whatever the size of
+     * the result.
+     *
+     * Kept results are addressed by a handle and served page by page,
+     * sorted and filtered on request. Sorting on a column indexes it the
+     * first time. Results are evicted when there are too many, when the
+     * spill file grows beyond its limit, and when they have not been paged
+     * for a while, which is checked by evict_idle. A result that does not fit in the spill file on its own
+     * is kept truncated.
+     */
+    class XEUS_SQLITE_API result_pager
+    {
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        explicit result_pager(const pager_options& options = {});
+        ~result_pager();
+
+        result_pager(const result_pager&) = delete;
+        result_pager& operator=(const result_pager&) = delete;
+
+        void set_options(const pager_options& options);
+        const pager_options& options() const noexcept;
+
+        /* Starts copying the rows of a statement, an unfinished copy is discarded */
+        void begin(const SQLite::Statement& query);
+        /* Copies the current row of the statement given to begin */
+        void append(const SQLite::Statement& query);
+        bool spilling() const noexcept;
+
+        /*! \brief commit - keeps the copied rows under a new handle.
+         *
+         * Returns the description of the result: handle, columns, rows and
+         * truncated.
+         *
+         * return nl::json
+         */
+        nl::json commit();
+        void discard();
+
+        /*! \brief handle_request - serves a request of a frontend.
+         *
+         * Requests are objects with an action:
+         *
+         * - page: handle, page, page_size, and optionally sort, a list of
+         *   {column, descending}, and filter, a list of {column, op, value}
+         *   with op one of = != < <= > >= contains null not_null;
+         * - close: handle;
+         * - list.
+         *
+         * The id of the request, if any, is copied to the reply. Errors are
+         * replied with the error action and a message, this never throws.
+         *
+         * param accList const nl::json& request
+         * return nl::json
+         */
+        nl::json handle_request(const nl::json& request);
+
+        /* Evicts the results not paged for options().idle_timeout, called by
+           the kernel after each cell and before each comm request */
+        void evict_idle(clock::time_point now = clock::now());
+        void clear();
+
+        /* Results kept */
+        std::size_t size() const noexcept;
+        /* Size of the spill file in bytes */
+        std::size_t spill_bytes() const;
+
+    private:
+
+        struct result_entry
+        {
+            std::vector<std::string> columns;
+            long long rows = 0;
+            bool truncated = false;
+            clock::time_point last_used;
+            /* Row count of the last filter, to page without counting again */
+            std::string count_filter;
+            long long count = -1;
+        };
+
+        SQLite::Database& database();
+        nl::json page(const nl::json& request);
+        void drop(const std::string& handle);
+        /* Evicts the least recently used result other than keep, false if none */
+        bool evict_one(const std::string& keep);
+        nl::json describe(const std::string& handle, const result_entry& entry) const;
+
+        pager_options m_options;
+        std::unique_ptr<SQLite::Database> m_db;
+        std::map<std::string, result_entry> m_results;
+        std::size_t m_next_handle = 1;
+
+        /* Result being copied */
+        std::string m_pending_handle;
+        result_entry m_pending;
+        std::unique_ptr<SQLite::Statement> m_insert;
+    };
+}
+
+#endif
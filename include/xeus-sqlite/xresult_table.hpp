@@ -0,0 +1,132 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XRESULT_TABLE_HPP
+#define XEUS_SQLITE_XRESULT_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace SQLite
+{
+    class Statement;
+}
+
+namespace xeus_sqlite
+{
+    enum class cell_type : std::uint8_t
+    {
+        integer,
+        floating,
+        text,
+        blob,
+        null
+    };
+
+    /* Bytes of a BLOB kept for its preview */
+    constexpr std::size_t blob_preview_size = 8;
+
+    /*! \brief result_table - buffer holding the result of a query.
+     *
+     * Cells are stored row by row, their contents are appended to a single
+     * arena so that filling the table from the statement step loop does not
+     * allocate per cell. Renderers walk this buffer instead of the statement.
+     * A BLOB cell may hold only the first bytes of the value, along with
+     * its full size and the summary displayed in its place. Rows of the
+     * middle of a large result may be left out, only their count is kept.
+     */
+    class XEUS_SQLITE_API result_table
+    {
+    public:
+
+        void add_column(std::string name, std::string declared_type = "");
+        void push_cell(cell_type type, const char* data, std::size_t size);
+        /* BLOB of full_size bytes of which the first stored ones are kept */
+        void push_blob(const char* data, std::size_t stored, std::size_t full_size);
+        /* Appends a row of a table with the same columns */
+        void push_row(const result_table& other, std::size_t row);
+        void reserve_rows(std::size_t rows);
+        void clear();
+        /* Removes the rows, the columns are kept */
+        void clear_rows();
+
+        /* Rows of the result not in the buffer, between the first and the last ones */
+        void set_omitted_rows(std::size_t count) noexcept;
+        std::size_t omitted_rows() const noexcept;
+
+        std::size_t column_count() const noexcept;
+        /* Rows in the buffer, omitted_rows not included */
+        std::size_t row_count() const noexcept;
+        /* Total size in bytes of the cell contents */
+        std::size_t content_size() const noexcept;
+        /* Bytes allocated by the buffers, capacity included */
+        std::size_t memory_usage() const noexcept;
+
+        const std::string& column_name(std::size_t col) const;
+        const std::string& column_declared_type(std::size_t col) const;
+
+        std::string_view cell(std::size_t row, std::size_t col) const;
+        cell_type type(std::size_t row, std::size_t col) const;
+        /* Text shown for the cell, the summary of a BLOB */
+        std::string_view display(std::size_t row, std::size_t col) const;
+        /* Full size of a BLOB cell, the size of other cells */
+        std::size_t blob_size(std::size_t row, std::size_t col) const;
+
+    private:
+
+        struct cell_ref
+        {
+            std::size_t offset;
+            std::size_t size;
+            cell_type type;
+        };
+
+        std::vector<std::string> m_names;
+        std::vector<std::string> m_declared_types;
+        std::vector<cell_ref> m_cells;
+        std::string m_arena;
+        std::size_t m_omitted_rows = 0;
+    };
+
+    /*! \brief add_columns - adds the result columns of a prepared statement.
+     *
+     * Expressions and computed columns get an empty declared type.
+     *
+     * param accList result_table& table, const SQLite::Statement& query
+     * return void
+     */
+    XEUS_SQLITE_API void add_columns(result_table& table, const SQLite::Statement& query);
+
+    /*! \brief push_row - appends the current row of a statement.
+     *
+     * At most blob_limit bytes of a BLOB are copied, the rest of the value
+     * is only accounted for in its size.
+     *
+     * param accList result_table& table, const SQLite::Statement& query, std::size_t blob_limit
+     * return void
+     */
+    XEUS_SQLITE_API void push_row(result_table& table,
+                                  const SQLite::Statement& query,
+                                  std::size_t blob_limit = blob_preview_size);
+
+    /*! \brief blob_summary - text shown for a BLOB, its size and the hex
+     * dump of its first bytes, for instance BLOB 1.2 MiB 89504e470d0a1a0a...
+     *
+     * param accList std::string_view preview, std::size_t size
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string blob_summary(std::string_view preview, std::size_t size);
+}
+
+#endif
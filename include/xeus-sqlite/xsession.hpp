@@ -0,0 +1,161 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XSESSION_HPP
+#define XEUS_SQLITE_XSESSION_HPP
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+
+/* Only declared by sqlite3.h with SQLITE_ENABLE_SESSION */
+struct sqlite3_session;
+
+namespace xeus_sqlite
+{
+    /* What apply_changeset does with a change that conflicts with the database */
+    enum class changeset_conflict
+    {
+        /* Rolls back the whole changeset */
+        abort,
+        /* Skips the change */
+        omit,
+        /* Overwrites the row when possible, skips the change otherwise */
+        replace
+    };
+
+    /*! \brief parse_changeset_conflict - abort, omit or replace.
+     *
+     * param accList std::string_view text
+     * return changeset_conflict
+     */
+    XEUS_SQLITE_API changeset_conflict parse_changeset_conflict(std::string_view text);
+
+    /* Changes of a changeset on a table */
+    struct changeset_counts
+    {
+        std::size_t inserts = 0;
+        std::size_t updates = 0;
+        std::size_t deletes = 0;
+    };
+
+    /* Changes of a changeset file, by table */
+    struct changeset_summary
+    {
+        std::map<std::string, changeset_counts> tables;
+        std::size_t bytes = 0;
+
+        std::size_t changes() const noexcept;
+        std::string to_string() const;
+    };
+
+    /*! \brief read_changeset_summary - counts the changes of a changeset file.
+     *
+     * The file is streamed, it is never held in memory as a whole.
+     *
+     * param accList const std::string& path
+     * return changeset_summary
+     */
+    XEUS_SQLITE_API changeset_summary read_changeset_summary(const std::string& path);
+
+    struct changeset_report
+    {
+        changeset_summary summary;
+        /* Changes skipped and rows overwritten because of conflicts */
+        std::size_t omitted = 0;
+        std::size_t replaced = 0;
+        /* Description of the first conflicts */
+        std::vector<std::string> conflicts;
+        std::size_t conflict_count = 0;
+
+        std::string to_string() const;
+    };
+
+    /*! \brief apply_changeset - applies a changeset file to the main database.
+     *
+     * The changes are applied in a savepoint. A change conflicts when the
+     * row it updates or deletes does not exist or differs from the one it
+     * was recorded on, when the row it inserts already exists, or when a
+     * constraint fails. Conflicts are handled according to policy, except
+     * foreign key violations which always abort. Throws if the changeset
+     * is aborted, the database is then left unchanged.
+     *
+     * param accList sqlite3* db, const std::string& path, changeset_conflict policy
+     * return changeset_report
+     */
+    XEUS_SQLITE_API changeset_report apply_changeset(sqlite3* db,
+                                                     const std::string& path,
+                                                     changeset_conflict policy);
+
+    /*! \brief change_recorder - records the changes made to a database.
+     *
+     * Wraps a session of the SQLite session extension on the main database
+     * of a connection. Only tables with a primary key are recorded. save
+     * writes the net changes recorded since the session started, as a
+     * changeset that apply_changeset replays on a copy of the database,
+     * and starts a new session so that successive changesets hold
+     * successive changes.
+     *
+     * The session must end before its connection is closed. Sessions are
+     * only available when SQLite is built with the session extension, see
+     * XSQL_HAVE_SQLITE_SESSION, start throws otherwise.
+     */
+    class XEUS_SQLITE_API change_recorder
+    {
+    public:
+
+        change_recorder() = default;
+        ~change_recorder();
+
+        change_recorder(const change_recorder&) = delete;
+        change_recorder& operator=(const change_recorder&) = delete;
+
+        /*! \brief start - starts recording the changes to tables.
+         *
+         * All the tables are recorded if tables is empty, including those
+         * created later. A running session is discarded. Returns a
+         * description of what is recorded.
+         *
+         * param accList sqlite3* db, const std::vector<std::string>& tables
+         * return std::string
+         */
+        std::string start(sqlite3* db, const std::vector<std::string>& tables);
+
+        /* Discards the running session and the changes it recorded */
+        void stop();
+        bool active() const noexcept;
+        sqlite3* database() const noexcept;
+
+        /*! \brief save - writes the recorded changes to a changeset file.
+         *
+         * The file is streamed from the session. A new session then starts
+         * on the same tables.
+         *
+         * param accList const std::string& path
+         * return changeset_summary, the changes written
+         */
+        changeset_summary save(const std::string& path);
+
+    private:
+
+        void attach();
+
+        sqlite3* p_db = nullptr;
+        sqlite3_session* p_session = nullptr;
+        std::vector<std::string> m_tables;
+    };
+}
+
+#endif
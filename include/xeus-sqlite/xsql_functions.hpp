@@ -0,0 +1,36 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XSQL_FUNCTIONS_HPP
+#define XEUS_SQLITE_XSQL_FUNCTIONS_HPP
+
+#include <sqlite3.h>
+
+#include "xeus_sqlite_config.hpp"
+
+namespace xeus_sqlite
+{
+    /*! \brief register_sql_functions - adds the statistical SQL functions.
+     *
+     * Registers on the connection:
+     * median(x) and percentile_cont(x, fraction), also as window functions
+     * stddev(x), variance(x), stddev_pop(x), var_pop(x), also as window functions
+     * width_bucket(x, low, high, count) and histogram(x, low, high, count)
+     * approx_count_distinct(x), a HyperLogLog estimate within about 1%
+     * tdigest_quantile(x, fraction), a t-digest estimate in bounded memory
+     *
+     * NULL and non numeric values are ignored by the aggregates.
+     *
+     * param accList sqlite3* db
+     * return void
+     */
+    XEUS_SQLITE_API void register_sql_functions(sqlite3* db);
+}
+
+#endif
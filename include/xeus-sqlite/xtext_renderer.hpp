@@ -0,0 +1,53 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XTEXT_RENDERER_HPP
+#define XEUS_SQLITE_XTEXT_RENDERER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "xeus_sqlite_config.hpp"
+#include "xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    struct text_table_options
+    {
+        /* Rows shown, the first and last halves are kept when exceeded */
+        std::size_t max_rows = 1000;
+        /* Display width after which cells are cut and end with "..." */
+        std::size_t max_column_width = 80;
+    };
+
+    /*! \brief display_width - number of terminal columns used by a string.
+     *
+     * Decodes UTF-8, counts combining marks as zero and East Asian wide
+     * characters as two columns.
+     *
+     * param accList std::string_view text
+     * return std::size_t
+     */
+    XEUS_SQLITE_API std::size_t display_width(std::string_view text);
+
+    /*! \brief render_text_table - builds the text/plain output of a result.
+     *
+     * Produces the same bordered layout as tabulate did, column widths are
+     * computed in a first pass over the table and the output is written in a
+     * second pass into a single preallocated string.
+     *
+     * param accList const result_table& table, const text_table_options& options
+     * return std::string
+     */
+    XEUS_SQLITE_API std::string render_text_table(const result_table& table,
+                                                  const text_table_options& options = {});
+}
+
+#endif
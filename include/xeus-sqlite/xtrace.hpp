@@ -0,0 +1,194 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XTRACE_HPP
+#define XEUS_SQLITE_XTRACE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus_sqlite_config.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    /*! \brief tracer - records the phases of the cells as a Chrome trace-event file.
+     *
+     * Spans are kept in memory and appended to the file by flush, which
+     * the kernel calls after each cell. The file uses the JSON array
+     * format, readable by https://ui.perfetto.dev and chrome://tracing even
+     * if the kernel died before stop wrote the closing bracket.
+     *
+     * Not thread safe, spans are recorded by the thread running the cells.
+     */
+    class XEUS_SQLITE_API tracer
+    {
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+        tracer() = default;
+        ~tracer();
+
+        tracer(const tracer&) = delete;
+        tracer& operator=(const tracer&) = delete;
+
+        /* The only check made by the spans when tracing is off */
+        bool enabled() const noexcept
+        {
+            return m_enabled;
+        }
+
+        /*! \brief start - truncates the file at path and starts recording.
+         *
+         * A running trace is stopped first. Throws if the file cannot be
+         * written.
+         *
+         * param accList const std::string& path
+         * return void
+         */
+        void start(const std::string& path);
+
+        /* Flushes and closes the file, does nothing if not started */
+        void stop();
+
+        /* Appends the spans recorded since the last flush to the file */
+        void flush();
+
+        /* Adds a complete event, dropped when not enabled */
+        void record(const char* name,
+                    const char* category,
+                    clock::time_point start,
+                    clock::time_point end,
+                    nl::json args);
+
+        const std::string& path() const noexcept;
+        /* Spans written to the file or waiting for flush */
+        std::size_t event_count() const noexcept;
+
+    private:
+
+        struct event
+        {
+            const char* name;
+            const char* category;
+            clock::time_point start;
+            clock::time_point end;
+            nl::json args;
+        };
+
+        void write(const nl::json& trace_event);
+
+        bool m_enabled = false;
+        std::string m_path;
+        std::ofstream m_file;
+        clock::time_point m_origin;
+        std::vector<event> m_events;
+        /* Spans written, the metadata events excluded */
+        std::size_t m_written = 0;
+        bool m_first_event = true;
+    };
+
+    /*! \brief trace_span - records the time between its construction and end.
+     *
+     * The tracer is only looked at on construction: a span created while
+     * tracing is off costs a branch and records nothing. name and category
+     * must be string literals.
+     */
+    class trace_span
+    {
+    public:
+
+        trace_span(tracer& t, const char* name, const char* category)
+            : p_tracer(t.enabled() ? &t : nullptr)
+            , m_name(name)
+            , m_category(category)
+        {
+            if (p_tracer != nullptr)
+            {
+                m_start = tracer::clock::now();
+            }
+        }
+
+        ~trace_span()
+        {
+            end();
+        }
+
+        trace_span(const trace_span&) = delete;
+        trace_span& operator=(const trace_span&) = delete;
+
+        /* Shown in the details of the span */
+        template <class T>
+        void arg(const char* key, T&& value)
+        {
+            if (p_tracer != nullptr)
+            {
+                m_args[key] = std::forward<T>(value);
+            }
+        }
+
+        void end()
+        {
+            if (p_tracer != nullptr)
+            {
+                p_tracer->record(m_name, m_category, m_start, tracer::clock::now(), std::move(m_args));
+                p_tracer = nullptr;
+            }
+        }
+
+        /* Ends the span and starts the next one of a sequence, such as step batches */
+        void restart()
+        {
+            if (p_tracer != nullptr)
+            {
+                tracer& t = *p_tracer;
+                end();
+                p_tracer = &t;
+                m_args = nl::json();
+                m_start = tracer::clock::now();
+            }
+        }
+
+    private:
+
+        tracer* p_tracer;
+        const char* m_name;
+        const char* m_category;
+        tracer::clock::time_point m_start;
+        nl::json m_args;
+    };
+
+    /* Stands for trace_span when tracing is compiled out */
+    class null_trace_span
+    {
+    public:
+
+        template <class T>
+        void arg(const char*, T&&) {}
+        void end() {}
+        void restart() {}
+    };
+}
+
+/* Spans of the execute pipeline, removed unless built with XSQL_ENABLE_TRACING */
+#ifdef XSQL_ENABLE_TRACING
+#define XSQL_TRACE_SPAN(var, tracer, name, category) ::xeus_sqlite::trace_span var((tracer), (name), (category))
+#else
+#define XSQL_TRACE_SPAN(var, tracer, name, category) ::xeus_sqlite::null_trace_span var; (void)var; (void)(tracer)
+#endif
+
+#endif
@@ -14,6 +14,7 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -25,6 +26,9 @@ namespace nl = nlohmann;
 
 namespace xeus_sqlite
 {
+    /* Directory of the chart data files, relative to the kernel working directory */
+    constexpr const char* default_chart_data_dir = "xsqlite-data";
+
     class XEUS_SQLITE_API xv_sqlite
     {
     public:
@@ -33,6 +37,32 @@ namespace xeus_sqlite
 
         static std::pair<std::vector<std::string>, std::vector<std::string>>
                split_xv_sqlite_input(std::vector<std::string>);
+
+        /*! \brief split_xv_sqlite_input - splits XVEGA_PLOT arguments on <>.
+         *
+         * Returns the xvega tokens and the SQL text that follows the <>
+         * token, as it was typed in the cell.
+         *
+         * param accList std::string_view arguments
+         * return std::pair<std::vector<std::string>, std::string_view>
+         */
+        static std::pair<std::vector<std::string>, std::string_view>
+               split_xv_sqlite_input(std::string_view arguments);
+
+        /*! \brief externalize_datasets - moves inline chart data out of the specs.
+         *
+         * Replaces every inline ``data.values`` array of the vega-lite specs
+         * found in the mime bundle by a reference to a named dataset, so the
+         * data is only serialized once. When data_dir is empty the dataset is
+         * stored in the top-level ``datasets`` property of the spec, otherwise
+         * it is written as a compact JSON file in data_dir, created if needed,
+         * and referenced by url so that it is not part of the message.
+         *
+         * param accList nl::json mime_bundle, const std::string& data_dir
+         * return nl::json
+         */
+        static nl::json externalize_datasets(nl::json mime_bundle,
+                                             const std::string& data_dir = "");
     };
 }
 
@@ -7,6 +7,9 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <iostream>
 #include <signal.h>
@@ -27,6 +30,8 @@
 
 #include "xeus-sqlite/xeus_sqlite_interpreter.hpp"
 #include "xeus-sqlite/xeus_sqlite_config.hpp"
+#include "xeus-sqlite/xhistory.hpp"
+#include "xeus-sqlite/xmemory.hpp"
 
 #ifdef __GNUC__
 void handler(int sig)
@@ -66,6 +71,17 @@ int main(int argc, char* argv[])
 #endif
     signal(SIGINT, stop_handler);
 
+    // SQLite pools and heap limit, before any database is opened
+    try
+    {
+        xeus_sqlite::configure_sqlite_memory(xeus_sqlite::parse_sqlite_memory_options(argc, argv));
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "xsqlite: " << err.what() << std::endl;
+        return 1;
+    }
+
     // Load configuration file
     std::string file_name = xeus::extract_filename(argc, argv);
 
@@ -79,7 +95,44 @@ int main(int argc, char* argv[])
     // xeus::xkernel kernel(config, xeus::get_user_name(), std::move(interpreter));
     // kernel.start();
     using history_manager_ptr = std::unique_ptr<xeus::xhistory_manager>;
-    history_manager_ptr hist = xeus::make_in_memory_history_manager();
+    history_manager_ptr hist = nullptr;
+
+    // History stored in a SQLite file, XSQLITE_HISTORY=memory keeps it in memory
+    std::string history_path = xeus_sqlite::default_history_path();
+    if (!history_path.empty() && history_path != "memory")
+    {
+        try
+        {
+            xeus_sqlite::history_options options;
+            if (const char* max_entries = std::getenv("XSQLITE_HISTORY_SIZE"))
+            {
+                char* end = nullptr;
+                errno = 0;
+                const unsigned long long value = std::strtoull(max_entries, &end, 10);
+                if (end == max_entries || *end != '\0' || errno == ERANGE || value < 1 ||
+                    std::strchr(max_entries, '-') != nullptr)
+                {
+                    std::clog << "xsqlite: ignoring XSQLITE_HISTORY_SIZE=" << max_entries
+                              << ", expected a positive number of cells" << std::endl;
+                }
+                else
+                {
+                    options.max_entries = static_cast<std::size_t>(value);
+                }
+            }
+            auto sqlite_hist = xeus_sqlite::make_sqlite_history_manager(history_path, options);
+            interpreter->set_history_manager(sqlite_hist.get());
+            hist = std::move(sqlite_hist);
+        }
+        catch (const std::exception& err)
+        {
+            std::clog << "xsqlite: history kept in memory, " << history_path << ": " << err.what() << std::endl;
+        }
+    }
+    if (hist == nullptr)
+    {
+        hist = xeus::make_in_memory_history_manager();
+    }
 
     if (!file_name.empty())
     {
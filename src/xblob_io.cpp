@@ -0,0 +1,202 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "xeus-sqlite/xblob_io.hpp"
+#include "xeus-sqlite/xmagic_parser.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        [[noreturn]] void throw_sqlite_error(sqlite3* db, const std::string& context)
+        {
+            throw std::runtime_error(context + ": " + sqlite3_errmsg(db));
+        }
+
+        /* Closes the handle when the transfer ends, successful or not */
+        class blob_handle
+        {
+        public:
+
+            blob_handle(sqlite3* db, const qualified_name& name, const std::string& column,
+                        std::int64_t rowid, bool writable)
+            {
+                if (sqlite3_blob_open(db, name.schema.c_str(), name.name.c_str(), column.c_str(),
+                                      rowid, writable ? 1 : 0, &m_blob) != SQLITE_OK)
+                {
+                    sqlite3_blob_close(m_blob);
+                    throw_sqlite_error(db, "Could not open " + name.name + "." + column +
+                                           " at rowid " + std::to_string(rowid));
+                }
+            }
+
+            ~blob_handle()
+            {
+                sqlite3_blob_close(m_blob);
+            }
+
+            blob_handle(const blob_handle&) = delete;
+            blob_handle& operator=(const blob_handle&) = delete;
+
+            sqlite3_blob* get() const noexcept
+            {
+                return m_blob;
+            }
+
+        private:
+
+            sqlite3_blob* m_blob = nullptr;
+        };
+
+        void exec(sqlite3* db, const char* sql)
+        {
+            if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+            {
+                throw_sqlite_error(db, sql);
+            }
+        }
+
+        void set_zeroblob(sqlite3* db, const qualified_name& name, const std::string& column,
+                          std::int64_t rowid, std::int64_t size)
+        {
+            std::string sql = "UPDATE " + quote_identifier(name.schema) + "." + quote_identifier(name.name) +
+                              " SET " + quote_identifier(column) + " = ? WHERE rowid = ?";
+            sqlite3_stmt* stmt = nullptr;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            {
+                throw_sqlite_error(db, "Could not update " + name.name + "." + column);
+            }
+            sqlite3_bind_zeroblob64(stmt, 1, static_cast<sqlite3_uint64>(size));
+            sqlite3_bind_int64(stmt, 2, rowid);
+            int rc = sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            if (rc != SQLITE_DONE)
+            {
+                throw_sqlite_error(db, "Could not update " + name.name + "." + column);
+            }
+            if (sqlite3_changes(db) == 0)
+            {
+                throw std::runtime_error("No row with rowid " + std::to_string(rowid) + " in " + name.name + ".");
+            }
+        }
+    }
+
+    std::int64_t export_blob(sqlite3* db,
+                             const std::string& table,
+                             const std::string& column,
+                             std::int64_t rowid,
+                             const std::string& path)
+    {
+        blob_handle blob(db, split_qualified_name(table), column, rowid, false);
+        const int size = sqlite3_blob_bytes(blob.get());
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw std::runtime_error("Could not open " + path + " for writing.");
+        }
+
+        std::vector<char> chunk(blob_chunk_size);
+        try
+        {
+            for (int offset = 0; offset < size;)
+            {
+                int count = static_cast<int>(std::min<std::size_t>(chunk.size(), static_cast<std::size_t>(size - offset)));
+                if (sqlite3_blob_read(blob.get(), chunk.data(), count, offset) != SQLITE_OK)
+                {
+                    throw_sqlite_error(db, "Could not read " + table + "." + column);
+                }
+                if (!out.write(chunk.data(), count))
+                {
+                    throw std::runtime_error("Could not write to " + path + ".");
+                }
+                offset += count;
+            }
+            out.close();
+            if (!out)
+            {
+                throw std::runtime_error("Could not write to " + path + ".");
+            }
+        }
+        catch (...)
+        {
+            out.close();
+            std::error_code ec;
+            fs::remove(path, ec);
+            throw;
+        }
+        return size;
+    }
+
+    std::int64_t import_blob(sqlite3* db,
+                             const std::string& path,
+                             const std::string& table,
+                             const std::string& column,
+                             std::int64_t rowid)
+    {
+        std::error_code ec;
+        const std::uintmax_t file_size = fs::file_size(path, ec);
+        if (ec)
+        {
+            throw std::runtime_error("Could not read " + path + ": " + ec.message() + ".");
+        }
+        const std::int64_t size = static_cast<std::int64_t>(file_size);
+        const int max_length = sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1);
+        if (size > max_length)
+        {
+            throw std::runtime_error(path + " is larger than the maximum value size of " +
+                                     std::to_string(max_length) + " bytes.");
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error("Could not open " + path + " for reading.");
+        }
+
+        const qualified_name name = split_qualified_name(table);
+        exec(db, "SAVEPOINT xsql_blob_import");
+        try
+        {
+            set_zeroblob(db, name, column, rowid, size);
+            blob_handle blob(db, name, column, rowid, true);
+            std::vector<char> chunk(blob_chunk_size);
+            for (std::int64_t offset = 0; offset < size;)
+            {
+                int count = static_cast<int>(std::min<std::int64_t>(static_cast<std::int64_t>(chunk.size()), size - offset));
+                if (!in.read(chunk.data(), count))
+                {
+                    throw std::runtime_error("Could not read " + path + ", the file changed during the import.");
+                }
+                if (sqlite3_blob_write(blob.get(), chunk.data(), count, static_cast<int>(offset)) != SQLITE_OK)
+                {
+                    throw_sqlite_error(db, "Could not write " + table + "." + column);
+                }
+                offset += count;
+            }
+        }
+        catch (...)
+        {
+            sqlite3_exec(db, "ROLLBACK TO xsql_blob_import", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "RELEASE xsql_blob_import", nullptr, nullptr, nullptr);
+            throw;
+        }
+        exec(db, "RELEASE xsql_blob_import");
+        return size;
+    }
+}
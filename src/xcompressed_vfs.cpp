@@ -0,0 +1,692 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <stdexcept>
+#include <string>
+
+#include "xeus-sqlite/xcompressed_vfs.hpp"
+
+#ifdef XSQL_HAVE_ZLIB
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+#include <zlib.h>
+
+#include "xfile_handle.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        constexpr char file_magic[8] = {'x', 's', 'q', 'l', 'z', '\0', '\0', '\1'};
+        constexpr std::uint32_t zlib_codec = 1;
+        constexpr std::size_t header_size = 40;
+        constexpr std::size_t index_entry_size = 12;
+        constexpr std::uint32_t min_block_size = 512;
+        constexpr std::uint32_t max_block_size = 16 << 20;
+
+        void put_u32(unsigned char* out, std::uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                out[i] = static_cast<unsigned char>(value >> (8 * i));
+            }
+        }
+
+        void put_u64(unsigned char* out, std::uint64_t value)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                out[i] = static_cast<unsigned char>(value >> (8 * i));
+            }
+        }
+
+        std::uint32_t get_u32(const unsigned char* in)
+        {
+            std::uint32_t value = 0;
+            for (int i = 3; i >= 0; --i)
+            {
+                value = (value << 8) | in[i];
+            }
+            return value;
+        }
+
+        std::uint64_t get_u64(const unsigned char* in)
+        {
+            std::uint64_t value = 0;
+            for (int i = 7; i >= 0; --i)
+            {
+                value = (value << 8) | in[i];
+            }
+            return value;
+        }
+
+        bool valid_block_size(std::uint64_t size)
+        {
+            return size >= min_block_size && size <= max_block_size && (size & (size - 1)) == 0;
+        }
+
+        struct block_entry
+        {
+            std::uint64_t offset = 0;
+            std::uint32_t size = 0;
+        };
+
+        /* Blocks of a compressed file, decompressed on demand */
+        class block_reader
+        {
+        public:
+
+            block_reader(sqlite3_file* file, std::size_t cache_size)
+                : p_file(file), m_cache_size(cache_size)
+            {
+            }
+
+            /* Reads and checks the header and the block index */
+            int open()
+            {
+                sqlite3_int64 file_size = 0;
+                int rc = p_file->pMethods->xFileSize(p_file, &file_size);
+                if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+                unsigned char header[header_size];
+                if (file_size < static_cast<sqlite3_int64>(header_size) ||
+                    p_file->pMethods->xRead(p_file, header, static_cast<int>(header_size), 0) != SQLITE_OK ||
+                    std::memcmp(header, file_magic, sizeof(file_magic)) != 0 ||
+                    get_u32(header + 12) != zlib_codec)
+                {
+                    return SQLITE_CANTOPEN;
+                }
+                m_block_size = get_u32(header + 8);
+                m_size = get_u64(header + 16);
+                const std::uint64_t count = get_u64(header + 24);
+                const std::uint64_t index_offset = get_u64(header + 32);
+                if (!valid_block_size(m_block_size) ||
+                    count != (m_size + m_block_size - 1) / m_block_size ||
+                    index_offset < header_size ||
+                    index_offset > static_cast<std::uint64_t>(file_size) ||
+                    count > (static_cast<std::uint64_t>(file_size) - index_offset) / index_entry_size)
+                {
+                    return SQLITE_CORRUPT;
+                }
+
+                std::vector<unsigned char> index(static_cast<std::size_t>(count) * index_entry_size);
+                if (!index.empty() &&
+                    p_file->pMethods->xRead(p_file, index.data(), static_cast<int>(index.size()),
+                                            static_cast<sqlite3_int64>(index_offset)) != SQLITE_OK)
+                {
+                    return SQLITE_IOERR_READ;
+                }
+                m_index.resize(static_cast<std::size_t>(count));
+                for (std::size_t i = 0; i < m_index.size(); ++i)
+                {
+                    block_entry& entry = m_index[i];
+                    entry.offset = get_u64(index.data() + i * index_entry_size);
+                    entry.size = get_u32(index.data() + i * index_entry_size + 8);
+                    if (entry.offset < header_size || entry.offset + entry.size > index_offset ||
+                        entry.size > compressBound(m_block_size))
+                    {
+                        return SQLITE_CORRUPT;
+                    }
+                }
+                return SQLITE_OK;
+            }
+
+            int read(void* buffer, int amount, sqlite3_int64 offset)
+            {
+                char* out = static_cast<char*>(buffer);
+                std::uint64_t position = static_cast<std::uint64_t>(offset);
+                std::size_t remaining = static_cast<std::size_t>(amount);
+                while (remaining != 0)
+                {
+                    if (position >= m_size)
+                    {
+                        /* SQLite expects the rest of the buffer to be zeroed */
+                        std::memset(out, 0, remaining);
+                        return SQLITE_IOERR_SHORT_READ;
+                    }
+                    const std::size_t index = static_cast<std::size_t>(position / m_block_size);
+                    const std::size_t within = static_cast<std::size_t>(position % m_block_size);
+                    const std::vector<char>* data = block(index);
+                    if (data == nullptr)
+                    {
+                        return SQLITE_IOERR_READ;
+                    }
+                    const std::size_t count = std::min(remaining, data->size() - within);
+                    std::memcpy(out, data->data() + within, count);
+                    out += count;
+                    position += count;
+                    remaining -= count;
+                }
+                return SQLITE_OK;
+            }
+
+            sqlite3_int64 size() const noexcept
+            {
+                return static_cast<sqlite3_int64>(m_size);
+            }
+
+        private:
+
+            using cache_list = std::list<std::pair<std::size_t, std::vector<char>>>;
+
+            const std::vector<char>* block(std::size_t index)
+            {
+                auto cached = m_cache_index.find(index);
+                if (cached != m_cache_index.end())
+                {
+                    m_cache.splice(m_cache.begin(), m_cache, cached->second);
+                    return &cached->second->second;
+                }
+
+                const block_entry& entry = m_index[index];
+                m_compressed.resize(entry.size);
+                if (entry.size != 0 &&
+                    p_file->pMethods->xRead(p_file, m_compressed.data(), static_cast<int>(entry.size),
+                                            static_cast<sqlite3_int64>(entry.offset)) != SQLITE_OK)
+                {
+                    return nullptr;
+                }
+                const std::uint64_t start = static_cast<std::uint64_t>(index) * m_block_size;
+                std::vector<char> data(static_cast<std::size_t>(std::min<std::uint64_t>(m_block_size, m_size - start)));
+                uLongf length = static_cast<uLongf>(data.size());
+                if (uncompress(reinterpret_cast<Bytef*>(data.data()), &length,
+                               reinterpret_cast<const Bytef*>(m_compressed.data()),
+                               static_cast<uLong>(entry.size)) != Z_OK ||
+                    length != data.size())
+                {
+                    return nullptr;
+                }
+
+                m_cached_bytes += data.size();
+                m_cache.emplace_front(index, std::move(data));
+                m_cache_index[index] = m_cache.begin();
+                /* The block just read is kept even if it is larger than the cache */
+                while (m_cached_bytes > m_cache_size && m_cache.size() > 1)
+                {
+                    m_cached_bytes -= m_cache.back().second.size();
+                    m_cache_index.erase(m_cache.back().first);
+                    m_cache.pop_back();
+                }
+                return &m_cache.front().second;
+            }
+
+            sqlite3_file* p_file;
+            std::size_t m_cache_size;
+            std::uint32_t m_block_size = 0;
+            std::uint64_t m_size = 0;
+            std::vector<block_entry> m_index;
+            std::vector<char> m_compressed;
+            cache_list m_cache;
+            std::unordered_map<std::size_t, cache_list::iterator> m_cache_index;
+            std::size_t m_cached_bytes = 0;
+        };
+
+        /* The real file of the default VFS is stored right after it */
+        struct compressed_file
+        {
+            sqlite3_file base;
+            sqlite3_file* real;
+            block_reader* reader;
+        };
+
+        struct compressed_vfs
+        {
+            sqlite3_vfs vfs;
+            sqlite3_vfs* root = nullptr;
+            std::atomic<std::size_t> cache_size{0};
+        };
+
+        compressed_vfs& vfs_instance()
+        {
+            static compressed_vfs instance;
+            return instance;
+        }
+
+        sqlite3_vfs* root_vfs(sqlite3_vfs* vfs)
+        {
+            return static_cast<compressed_vfs*>(vfs->pAppData)->root;
+        }
+
+        compressed_file* as_compressed(sqlite3_file* file)
+        {
+            return reinterpret_cast<compressed_file*>(file);
+        }
+
+        int file_close(sqlite3_file* file)
+        {
+            compressed_file* self = as_compressed(file);
+            int rc = self->real->pMethods->xClose(self->real);
+            delete self->reader;
+            self->reader = nullptr;
+            return rc;
+        }
+
+        int file_read(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset)
+        {
+            try
+            {
+                return as_compressed(file)->reader->read(buffer, amount, offset);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return SQLITE_IOERR_NOMEM;
+            }
+        }
+
+        int file_write(sqlite3_file*, const void*, int, sqlite3_int64)
+        {
+            return SQLITE_READONLY;
+        }
+
+        int file_truncate(sqlite3_file*, sqlite3_int64)
+        {
+            return SQLITE_READONLY;
+        }
+
+        int file_sync(sqlite3_file*, int)
+        {
+            return SQLITE_OK;
+        }
+
+        int file_size(sqlite3_file* file, sqlite3_int64* size)
+        {
+            *size = as_compressed(file)->reader->size();
+            return SQLITE_OK;
+        }
+
+        /* Immutable, nothing to lock */
+        int file_lock(sqlite3_file*, int)
+        {
+            return SQLITE_OK;
+        }
+
+        int file_check_reserved_lock(sqlite3_file*, int* reserved)
+        {
+            *reserved = 0;
+            return SQLITE_OK;
+        }
+
+        int file_control(sqlite3_file*, int, void*)
+        {
+            return SQLITE_NOTFOUND;
+        }
+
+        int file_sector_size(sqlite3_file*)
+        {
+            return 512;
+        }
+
+        int file_device_characteristics(sqlite3_file*)
+        {
+            return SQLITE_IOCAP_IMMUTABLE;
+        }
+
+        const sqlite3_io_methods compressed_io_methods = {
+            1,
+            file_close,
+            file_read,
+            file_write,
+            file_truncate,
+            file_sync,
+            file_size,
+            file_lock,
+            file_lock,
+            file_check_reserved_lock,
+            file_control,
+            file_sector_size,
+            file_device_characteristics,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr
+        };
+
+        bool is_compressed(const char* path)
+        {
+            file_handle input(path, "rb");
+            char magic[sizeof(file_magic)];
+            return input.file != nullptr &&
+                   std::fread(magic, 1, sizeof(magic), input.file) == sizeof(magic) &&
+                   std::memcmp(magic, file_magic, sizeof(magic)) == 0;
+        }
+
+        int vfs_open(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* out_flags)
+        {
+            sqlite3_vfs* root = root_vfs(vfs);
+            /* Journals, temporary files and plain databases are files of the default VFS */
+            if (name == nullptr || (flags & SQLITE_OPEN_MAIN_DB) == 0 || !is_compressed(name))
+            {
+                return root->xOpen(root, name, file, flags, out_flags);
+            }
+
+            compressed_file* self = as_compressed(file);
+            self->base.pMethods = nullptr;
+            self->real = reinterpret_cast<sqlite3_file*>(self + 1);
+            self->reader = nullptr;
+            const int read_only = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) | SQLITE_OPEN_READONLY;
+            int rc = root->xOpen(root, name, self->real, read_only, nullptr);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+            try
+            {
+                self->reader = new block_reader(self->real, vfs_instance().cache_size.load());
+                rc = self->reader->open();
+            }
+            catch (const std::bad_alloc&)
+            {
+                rc = SQLITE_NOMEM;
+            }
+            if (rc != SQLITE_OK)
+            {
+                file_close(file);
+                return rc;
+            }
+            self->base.pMethods = &compressed_io_methods;
+            if (out_flags != nullptr)
+            {
+                *out_flags = read_only;
+            }
+            return SQLITE_OK;
+        }
+
+        int vfs_delete(sqlite3_vfs* vfs, const char* name, int sync_dir)
+        {
+            return root_vfs(vfs)->xDelete(root_vfs(vfs), name, sync_dir);
+        }
+
+        int vfs_access(sqlite3_vfs* vfs, const char* name, int flags, int* result)
+        {
+            return root_vfs(vfs)->xAccess(root_vfs(vfs), name, flags, result);
+        }
+
+        int vfs_full_pathname(sqlite3_vfs* vfs, const char* name, int size, char* out)
+        {
+            return root_vfs(vfs)->xFullPathname(root_vfs(vfs), name, size, out);
+        }
+
+        void* vfs_dl_open(sqlite3_vfs* vfs, const char* path)
+        {
+            return root_vfs(vfs)->xDlOpen(root_vfs(vfs), path);
+        }
+
+        void vfs_dl_error(sqlite3_vfs* vfs, int size, char* message)
+        {
+            root_vfs(vfs)->xDlError(root_vfs(vfs), size, message);
+        }
+
+        void (*vfs_dl_sym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void)
+        {
+            return root_vfs(vfs)->xDlSym(root_vfs(vfs), handle, symbol);
+        }
+
+        void vfs_dl_close(sqlite3_vfs* vfs, void* handle)
+        {
+            root_vfs(vfs)->xDlClose(root_vfs(vfs), handle);
+        }
+
+        int vfs_randomness(sqlite3_vfs* vfs, int size, char* out)
+        {
+            return root_vfs(vfs)->xRandomness(root_vfs(vfs), size, out);
+        }
+
+        int vfs_sleep(sqlite3_vfs* vfs, int microseconds)
+        {
+            return root_vfs(vfs)->xSleep(root_vfs(vfs), microseconds);
+        }
+
+        int vfs_current_time(sqlite3_vfs* vfs, double* now)
+        {
+            return root_vfs(vfs)->xCurrentTime(root_vfs(vfs), now);
+        }
+
+        int vfs_get_last_error(sqlite3_vfs* vfs, int size, char* message)
+        {
+            sqlite3_vfs* root = root_vfs(vfs);
+            return root->xGetLastError != nullptr ? root->xGetLastError(root, size, message) : 0;
+        }
+
+        int vfs_current_time_int64(sqlite3_vfs* vfs, sqlite3_int64* now)
+        {
+            return root_vfs(vfs)->xCurrentTimeInt64(root_vfs(vfs), now);
+        }
+
+        /* Removes a file when leaving the scope, unless released */
+        struct remove_guard
+        {
+            std::string path;
+
+            ~remove_guard()
+            {
+                if (!path.empty())
+                {
+                    std::error_code ec;
+                    fs::remove(path, ec);
+                }
+            }
+        };
+
+        /* Consistent copy of source, without free pages */
+        void vacuum_into(const std::string& source, const std::string& copy)
+        {
+            sqlite3* db = nullptr;
+            int rc = sqlite3_open_v2(source.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+            sqlite3_stmt* stmt = nullptr;
+            if (rc == SQLITE_OK)
+            {
+                rc = sqlite3_prepare_v2(db, "VACUUM INTO ?", -1, &stmt, nullptr);
+            }
+            if (rc == SQLITE_OK)
+            {
+                sqlite3_bind_text(stmt, 1, copy.c_str(), -1, SQLITE_TRANSIENT);
+                rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(db);
+            }
+            const std::string message = db != nullptr ? sqlite3_errmsg(db) : sqlite3_errstr(rc);
+            sqlite3_finalize(stmt);
+            sqlite3_close(db);
+            if (rc != SQLITE_OK)
+            {
+                throw std::runtime_error("Could not copy " + source + ": " + message);
+            }
+        }
+    }
+
+    void register_compressed_vfs(const compressed_vfs_options& options)
+    {
+        static std::mutex registration;
+        std::lock_guard<std::mutex> lock(registration);
+
+        compressed_vfs& instance = vfs_instance();
+        instance.cache_size = options.cache_size;
+        if (instance.root != nullptr)
+        {
+            return;
+        }
+
+        sqlite3_vfs* root = sqlite3_vfs_find(nullptr);
+        if (root == nullptr)
+        {
+            throw std::runtime_error("Could not register the compressed VFS, SQLite has no default VFS.");
+        }
+        sqlite3_vfs& vfs = instance.vfs;
+        vfs = sqlite3_vfs();
+        vfs.iVersion = root->iVersion >= 2 && root->xCurrentTimeInt64 != nullptr ? 2 : 1;
+        vfs.szOsFile = static_cast<int>(sizeof(compressed_file)) + root->szOsFile;
+        vfs.mxPathname = root->mxPathname;
+        vfs.zName = compressed_vfs_name;
+        vfs.pAppData = &instance;
+        vfs.xOpen = vfs_open;
+        vfs.xDelete = vfs_delete;
+        vfs.xAccess = vfs_access;
+        vfs.xFullPathname = vfs_full_pathname;
+        vfs.xDlOpen = vfs_dl_open;
+        vfs.xDlError = vfs_dl_error;
+        vfs.xDlSym = vfs_dl_sym;
+        vfs.xDlClose = vfs_dl_close;
+        vfs.xRandomness = vfs_randomness;
+        vfs.xSleep = vfs_sleep;
+        vfs.xCurrentTime = vfs_current_time;
+        vfs.xGetLastError = vfs_get_last_error;
+        vfs.xCurrentTimeInt64 = vfs_current_time_int64;
+        if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK)
+        {
+            throw std::runtime_error("Could not register the compressed VFS.");
+        }
+        instance.root = root;
+    }
+
+    bool compressed_vfs_available() noexcept
+    {
+        return true;
+    }
+
+    compress_result compress_database(const std::string& source,
+                                      const std::string& destination,
+                                      const compress_options& options)
+    {
+        if (!valid_block_size(options.block_size))
+        {
+            throw std::runtime_error("Invalid block size " + std::to_string(options.block_size) +
+                                     ", expected a power of two from 512 to 16777216.");
+        }
+        if (options.level < 1 || options.level > 9)
+        {
+            throw std::runtime_error("Invalid level " + std::to_string(options.level) + ", expected 1 to 9.");
+        }
+        std::error_code ec;
+        if (fs::exists(destination, ec))
+        {
+            throw std::runtime_error(destination + " already exists.");
+        }
+        const std::string copy = destination + "-vacuum";
+        if (fs::exists(copy, ec))
+        {
+            throw std::runtime_error(copy + " already exists.");
+        }
+
+        /* Removes a partial copy if VACUUM INTO fails, copy did not exist before */
+        remove_guard copy_guard{copy};
+        vacuum_into(source, copy);
+
+        file_handle input(copy, "rb");
+        remove_guard output_guard{destination};
+        file_handle output(destination, "wb");
+        if (input.file == nullptr || output.file == nullptr)
+        {
+            throw std::runtime_error("Could not open " + (input.file == nullptr ? copy : destination) + ".");
+        }
+
+        compress_result result;
+        unsigned char header[header_size] = {};
+        bool written = std::fwrite(header, 1, header_size, output.file) == header_size;
+        std::uint64_t offset = header_size;
+        std::vector<unsigned char> block(options.block_size);
+        std::vector<unsigned char> compressed(compressBound(static_cast<uLong>(options.block_size)));
+        std::vector<unsigned char> index;
+        while (written)
+        {
+            const std::size_t size = std::fread(block.data(), 1, block.size(), input.file);
+            if (size == 0)
+            {
+                break;
+            }
+            /* The copy keeps the journal mode of source, read and write versions 2 are WAL */
+            if (result.database_bytes == 0 && size > 19 && block[18] == 2 && block[19] == 2)
+            {
+                block[18] = 1;
+                block[19] = 1;
+            }
+            uLongf length = static_cast<uLongf>(compressed.size());
+            if (compress2(compressed.data(), &length, block.data(), static_cast<uLong>(size), options.level) != Z_OK)
+            {
+                throw std::runtime_error("Could not compress " + source + ".");
+            }
+            written = std::fwrite(compressed.data(), 1, length, output.file) == length;
+
+            unsigned char entry[index_entry_size];
+            put_u64(entry, offset);
+            put_u32(entry + 8, static_cast<std::uint32_t>(length));
+            index.insert(index.end(), entry, entry + index_entry_size);
+            offset += length;
+            result.database_bytes += size;
+            ++result.blocks;
+        }
+        if (std::ferror(input.file))
+        {
+            throw std::runtime_error("Could not read " + copy + ".");
+        }
+
+        std::memcpy(header, file_magic, sizeof(file_magic));
+        put_u32(header + 8, static_cast<std::uint32_t>(options.block_size));
+        put_u32(header + 12, zlib_codec);
+        put_u64(header + 16, result.database_bytes);
+        put_u64(header + 24, result.blocks);
+        put_u64(header + 32, offset);
+        written = written &&
+                  std::fwrite(index.data(), 1, index.size(), output.file) == index.size() &&
+                  std::fseek(output.file, 0, SEEK_SET) == 0 &&
+                  std::fwrite(header, 1, header_size, output.file) == header_size;
+        if (!output.close() || !written)
+        {
+            throw std::runtime_error("Could not write " + destination + ".");
+        }
+        result.compressed_bytes = offset + index.size();
+        output_guard.path.clear();
+        return result;
+    }
+}
+
+#else
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        [[noreturn]] void throw_unavailable()
+        {
+            throw std::runtime_error("Compressed databases are not available, xeus-sqlite was built without zlib.");
+        }
+    }
+
+    void register_compressed_vfs(const compressed_vfs_options&)
+    {
+        throw_unavailable();
+    }
+
+    bool compressed_vfs_available() noexcept
+    {
+        return false;
+    }
+
+    compress_result compress_database(const std::string&, const std::string&, const compress_options&)
+    {
+        throw_unavailable();
+    }
+}
+
+#endif
@@ -0,0 +1,89 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "xeus-sqlite/xconnection_pool.hpp"
+
+namespace xeus_sqlite
+{
+    connection_pool::connection_pool(std::size_t capacity)
+        : m_capacity(capacity)
+    {
+    }
+
+    void connection_pool::park(connection conn)
+    {
+        erase(conn.name);
+        m_connections.push_front(std::move(conn));
+        evict();
+    }
+
+    connection connection_pool::take(const std::string& name)
+    {
+        auto it = std::find_if(m_connections.begin(), m_connections.end(),
+                               [&name](const connection& conn) { return conn.name == name; });
+        if (it == m_connections.end())
+        {
+            throw std::runtime_error("No connection named " + name +
+                                     ", load it with %LOAD <path> AS " + name + ".");
+        }
+        connection conn = std::move(*it);
+        m_connections.erase(it);
+        return conn;
+    }
+
+    void connection_pool::erase(const std::string& name)
+    {
+        m_connections.remove_if([&name](const connection& conn) { return conn.name == name; });
+    }
+
+    bool connection_pool::contains(const std::string& name) const
+    {
+        return std::any_of(m_connections.begin(), m_connections.end(),
+                           [&name](const connection& conn) { return conn.name == name; });
+    }
+
+    std::vector<std::string> connection_pool::names() const
+    {
+        std::vector<std::string> result;
+        result.reserve(m_connections.size());
+        for (const auto& conn : m_connections)
+        {
+            result.push_back(conn.name);
+        }
+        return result;
+    }
+
+    std::size_t connection_pool::size() const noexcept
+    {
+        return m_connections.size();
+    }
+
+    std::size_t connection_pool::capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    void connection_pool::set_capacity(std::size_t capacity)
+    {
+        m_capacity = capacity;
+        evict();
+    }
+
+    void connection_pool::evict()
+    {
+        while (m_connections.size() > m_capacity)
+        {
+            m_connections.pop_back();
+        }
+    }
+}
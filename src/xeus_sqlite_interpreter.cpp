@@ -7,9 +7,14 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iostream>
 #include <memory>
 #include <sstream>
 #include <stack>
@@ -18,11 +23,27 @@
 #include <tuple>
 
 #include "xvega-bindings/xvega_bindings.hpp"
+#include "xeus/xcomm.hpp"
 #include "xeus/xhelper.hpp"
 #include "xeus/xinterpreter.hpp"
-#include "tabulate/table.hpp"
 
+#include "xeus-sqlite/xblob_io.hpp"
+#include "xeus-sqlite/xcompressed_vfs.hpp"
 #include "xeus-sqlite/xeus_sqlite_interpreter.hpp"
+#include "xeus-sqlite/xfile_table.hpp"
+#include "xeus-sqlite/xfts.hpp"
+#include "xeus-sqlite/xhtml_renderer.hpp"
+#include "xeus-sqlite/xingest.hpp"
+#include "xeus-sqlite/xjson_renderer.hpp"
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xmemory.hpp"
+#include "xeus-sqlite/xparallel_query.hpp"
+#include "xeus-sqlite/xplan_history.hpp"
+#include "xeus-sqlite/xquery_limits.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+#include "xeus-sqlite/xsql_functions.hpp"
+#include "xeus-sqlite/xtext_renderer.hpp"
+#include "xeus-sqlite/xtrace.hpp"
 
 #include <SQLiteCpp/VariadicBind.h>
 #include <SQLiteCpp/SQLiteCpp.h>
@@ -50,65 +71,360 @@ namespace xeus_sqlite
         return std::isalpha(c) || std::isdigit(c) || c == '_';
     }
 
+    template <class It>
+    unsigned parse_output_formats(It first, It last)
+    {
+        unsigned formats = output_none;
+        for (; first != last; ++first)
+        {
+            if (iequals(*first, "text"))
+            {
+                formats |= output_text;
+            }
+            else if (iequals(*first, "html"))
+            {
+                formats |= output_html;
+            }
+            else if (iequals(*first, "json"))
+            {
+                formats |= output_json;
+            }
+            else if (iequals(*first, "dataresource"))
+            {
+                formats |= output_dataresource;
+            }
+            else if (!iequals(*first, "none"))
+            {
+                throw std::runtime_error("Unknown output format " + std::string(*first) +
+                                         ", expected html, text, json, dataresource or none.");
+            }
+        }
+        return formats;
+    }
+
+    inline static std::string output_formats_to_string(unsigned formats)
+    {
+        std::string names;
+        for (auto format : {std::make_pair(output_text, "text"),
+                            std::make_pair(output_html, "html"),
+                            std::make_pair(output_json, "json"),
+                            std::make_pair(output_dataresource, "dataresource")})
+        {
+            if (formats & format.first)
+            {
+                names += names.empty() ? format.second : std::string(" ") + format.second;
+            }
+        }
+        return names.empty() ? "none" : names;
+    }
+
+    /* Positional argument of a magic, throws with the usage if missing */
+    inline static std::string argument(const magic_input& input,
+                                       std::size_t index,
+                                       const std::string& usage)
+    {
+        if (index >= input.args.size())
+        {
+            throw std::runtime_error("Missing argument, usage: " + usage);
+        }
+        return std::string(input.args[index]);
+    }
+
+    /* Arguments after the positional one at index, as typed */
+    inline static std::string_view remaining_arguments(const magic_input& input,
+                                                       std::size_t index,
+                                                       const std::string& usage)
+    {
+        if (index >= input.args.size())
+        {
+            throw std::runtime_error("Missing argument, usage: " + usage);
+        }
+        const std::string_view& arg = input.args[index];
+        std::string_view rest = input.arguments.substr(
+            static_cast<std::size_t>(arg.data() - input.arguments.data()) + arg.size());
+        if (split_arguments(rest).empty())
+        {
+            throw std::runtime_error("Missing argument, usage: " + usage);
+        }
+        return rest;
+    }
+
+    inline static std::int64_t rowid_argument(const magic_input& input,
+                                              std::size_t index,
+                                              const std::string& usage)
+    {
+        std::string text = argument(input, index, usage);
+        std::int64_t rowid = 0;
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), rowid);
+        if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size())
+        {
+            throw std::runtime_error("Invalid rowid " + text + ", usage: " + usage);
+        }
+        return rowid;
+    }
+
+    /* Removes a trailing "AS <name>" from the arguments and returns name */
+    inline static std::string take_alias(magic_input& input)
+    {
+        std::size_t count = input.args.size();
+        if (count >= 3 && iequals(input.args[count - 2], "AS"))
+        {
+            std::string alias(input.args[count - 1]);
+            input.args.resize(count - 2);
+            return alias;
+        }
+        return "";
+    }
+
+    /* Absolute path of the main database, empty if in memory */
+    inline static std::string database_file(SQLite::Database& db)
+    {
+        const char* file = sqlite3_db_filename(db.getHandle(), "main");
+        return file != nullptr ? file : "";
+    }
+
+    /* Applies a kernel default read from the environment, a bad value is
+       reported on stderr and the built-in default is kept */
+    template <class F>
+    inline static void apply_environment(const char* variable, F&& apply)
+    {
+        const char* value = std::getenv(variable);
+        if (value == nullptr)
+        {
+            return;
+        }
+        try
+        {
+            apply(value);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "xsqlite: ignoring " << variable << "=" << value << ", " << e.what() << std::endl;
+        }
+    }
+
+    /* Rows stepped in each step span of a trace */
+    constexpr std::size_t trace_step_rows = 4096;
+
+    /* Wait for a lock held by another connection, such as a maintenance checkpoint */
+    constexpr int busy_timeout_ms = 5000;
+
+    /* Upper bound of XSQLITE_MAX_CONNECTIONS, each one holds file descriptors and a page cache */
+    constexpr std::size_t max_open_connections = 64;
+
     interpreter::interpreter()
     {
         xeus::register_interpreter(this);
+        register_builtin_magics();
+    }
+
+    void interpreter::set_history_manager(sqlite_history_manager* history)
+    {
+        m_history = history;
+    }
+
+    void interpreter::open_connection(const std::string& name,
+                                      const std::string& path,
+                                      int flags,
+                                      const std::string& vfs)
+    {
+        if (m_batch.active)
+        {
+            throw std::runtime_error("Commit or roll back the batch before changing database.");
+        }
+        if (m_changes.active())
+        {
+            throw std::runtime_error("Save or stop the session before changing database.");
+        }
+
+        /* Opens first so that a failure keeps the current connection */
+        auto db = std::make_unique<SQLite::Database>(path, flags, 0, vfs);
+        db->setBusyTimeout(busy_timeout_ms);
+        register_sql_functions(db->getHandle());
+        register_file_tables(db->getHandle());
+
+        set_interrupt_handle(nullptr);
+        if (m_bd_is_loaded && name != m_db_name)
+        {
+            m_connections.park(connection{m_db_name, m_db_path, std::move(m_db)});
+        }
+        m_connections.erase(name);
+
+        m_db = std::move(db);
+        set_interrupt_handle(m_db->getHandle());
+        m_db_name = name;
+        m_db_path = path;
+        m_bd_is_loaded = true;
+        m_maintenance.set_database(m_db_path, sqlite3_db_readonly(m_db->getHandle(), "main") == 1);
     }
 
-    void interpreter::load_db(const std::vector<std::string> tokenized_input)
+    void interpreter::load_db(const magic_input& input)
     {
         /*
             Loads the database. If the open mode is not specified it defaults
             to read and write mode.
         */
 
-        if (tokenized_input.back().find("rw") != std::string::npos)
+        magic_input args = input;
+        std::string name = take_alias(args);
+
+        /* prewarm or prewarm=<table>,<index>... and vfs=<name> may follow the mode */
+        bool warm = false;
+        std::vector<std::string> objects;
+        std::string vfs;
+        for (auto it = args.args.begin() + std::min<std::size_t>(args.args.size(), 1); it != args.args.end();)
+        {
+            std::string_view key = *it, value;
+            split_option(*it, key, value);
+            if (iequals(key, "vfs"))
+            {
+                vfs = value;
+                it = args.args.erase(it);
+                continue;
+            }
+            if (!iequals(key, "prewarm"))
+            {
+                ++it;
+                continue;
+            }
+            warm = true;
+            while (!value.empty())
+            {
+                std::size_t comma = std::min(value.find(','), value.size());
+                if (comma != 0)
+                {
+                    objects.emplace_back(value.substr(0, comma));
+                }
+                value.remove_prefix(std::min(comma + 1, value.size()));
+            }
+            it = args.args.erase(it);
+        }
+
+        const std::string usage = "%LOAD <path> [r | rw] [prewarm[=<table>,...]] [vfs=<name>] [AS <name>]";
+        std::string path = argument(args, 0, usage);
+        std::ifstream path_is_valid(path);
+        if (!path_is_valid.is_open())
         {
-            m_bd_is_loaded = true;
-            m_db = std::make_unique<SQLite::Database>(m_db_path,
-                        SQLite::OPEN_READWRITE);
+            throw std::runtime_error("The path doesn't exist.");
         }
-        else if (tokenized_input.back().find("r") != std::string::npos)
+        if (vfs == compressed_vfs_name && warm)
         {
-            m_bd_is_loaded = true;
-            m_db = std::make_unique<SQLite::Database>(m_db_path,
-                        SQLite::OPEN_READONLY);
+            /* The prewarm reads the file through the default VFS */
+            throw std::runtime_error("Compressed databases cannot be prewarmed, usage: " + usage);
         }
-        /* Opening as read and write because mode is unspecified */
-        else if (tokenized_input.size() < 4)
+
+        std::string_view mode = args.args.size() > 1 ? args.args[1] : "rw";
+        if (iequals(mode, "rw"))
+        {
+            open_connection(name.empty() ? path : name, path, SQLite::OPEN_READWRITE, vfs);
+        }
+        else if (iequals(mode, "r"))
         {
-            m_bd_is_loaded = true;
-            m_db = std::make_unique<SQLite::Database>(m_db_path,
-                        SQLite::OPEN_READWRITE);
+            open_connection(name.empty() ? path : name, path, SQLite::OPEN_READONLY, vfs);
         }
         else
         {
             throw std::runtime_error("Wasn't able to load the database correctly.");
         }
+
+        if (warm)
+        {
+            m_prewarm.start(path, objects);
+        }
     }
 
-    void interpreter::create_db(const std::vector<std::string> tokenized_input)
+    void interpreter::create_db(const magic_input& input)
     {
-        m_bd_is_loaded = true;
-        m_db_path = tokenized_input[1];
+        magic_input args = input;
+        std::string name = take_alias(args);
+        std::string path = argument(args, 0, "%CREATE <path> [AS <name>]");
 
         /* Creates the file */
-        std::ofstream(m_db_path.c_str()).close();
+        std::ofstream(path.c_str()).close();
 
-        /* Creates the database */
-        m_db = std::make_unique<SQLite::Database>(m_db_path,
-                                                    SQLite::OPEN_READWRITE |
-                                                    SQLite::OPEN_CREATE);
-        
     #ifdef XSQL_EMSCRIPTEN_WASM_BUILD
         // Force SQlite to write a well formed db to FS
-        m_db->exec("CREATE TABLE __xeus_sqlite_init (id INTEGER);");
-        m_db.reset();
-        m_db = std::make_unique<SQLite::Database>(m_db_path, SQLite::OPEN_READWRITE);
-        m_db->exec("DROP TABLE __xeus_sqlite_init;");
-        m_db.reset();
-        m_db = std::make_unique<SQLite::Database>(m_db_path, SQLite::OPEN_READWRITE); 
+        {
+            SQLite::Database init(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            init.exec("CREATE TABLE __xeus_sqlite_init (id INTEGER);");
+        }
+        {
+            SQLite::Database init(path, SQLite::OPEN_READWRITE);
+            init.exec("DROP TABLE __xeus_sqlite_init;");
+        }
     #endif
+
+        /* Creates the database */
+        open_connection(name.empty() ? path : name, path,
+                        SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    }
+
+    nl::json interpreter::use_connection(const magic_input& input)
+    {
+        nl::json pub_data;
+        if (!input.args.empty())
+        {
+            std::string name(input.args[0]);
+            if (!m_bd_is_loaded || name != m_db_name)
+            {
+                if (m_batch.active)
+                {
+                    throw std::runtime_error("Commit or roll back the batch before changing database.");
+                }
+                if (m_changes.active())
+                {
+                    throw std::runtime_error("Save or stop the session before changing database.");
+                }
+                connection conn = m_connections.take(name);
+                set_interrupt_handle(nullptr);
+                if (m_bd_is_loaded)
+                {
+                    m_connections.park(connection{m_db_name, m_db_path, std::move(m_db)});
+                }
+                m_db = std::move(conn.db);
+                set_interrupt_handle(m_db->getHandle());
+                m_db_name = std::move(conn.name);
+                m_db_path = std::move(conn.path);
+                m_bd_is_loaded = true;
+                m_maintenance.set_database(m_db_path, sqlite3_db_readonly(m_db->getHandle(), "main") == 1);
+            }
+        }
+
+        /* Lists the connections, the one in use first */
+        std::string listing;
+        if (m_bd_is_loaded)
+        {
+            listing = "* " + m_db_name + " (" + m_db_path + ")";
+        }
+        for (const std::string& name : m_connections.names())
+        {
+            listing += (listing.empty() ? "  " : "\n  ") + name;
+        }
+        pub_data["text/plain"] = listing.empty() ? "No database is loaded." : listing;
+        return pub_data;
+    }
+
+    void interpreter::attach_db(const magic_input& input)
+    {
+        const std::string usage = "%ATTACH <path> AS <schema>";
+        magic_input args = input;
+        std::string schema = take_alias(args);
+        if (schema.empty() || args.args.size() != 1)
+        {
+            throw std::runtime_error("Missing argument, usage: " + usage);
+        }
+
+        SQLite::Statement attach(*m_db, "ATTACH DATABASE ? AS ?");
+        attach.bind(1, argument(args, 0, usage));
+        attach.bind(2, schema);
+        attach.exec();
+    }
+
+    void interpreter::detach_db(const magic_input& input)
+    {
+        SQLite::Statement detach(*m_db, "DETACH DATABASE ?");
+        detach.bind(1, argument(input, 0, "%DETACH <schema>"));
+        detach.exec();
     }
 
     void interpreter::delete_db()
@@ -138,246 +454,1483 @@ namespace xeus_sqlite
         }
     }
 
-    nl::json interpreter::is_unencrypted()
+    nl::json interpreter::is_unencrypted()
+    {
+        nl::json pub_data;
+        if (SQLite::Database::isUnencrypted(m_db_path))
+        {
+            pub_data["text/plain"] = "The database is unencrypted.";
+            return pub_data;
+        }
+        else
+        {
+            pub_data["text/plain"] = "The database is encrypted.";
+            return pub_data;
+        }
+    }
+
+    nl::json interpreter::get_header_info()
+    {
+        SQLite::Header header;
+        header = SQLite::Database::getHeaderInfo(m_db_path);
+
+    /* Official documentation for fields can be found here:
+        https://www.sqlite.org/fileformat.html#the_database_header*/
+        nl::json pub_data;
+        pub_data["text/plain"] =
+            "Magic header string: "           + std::string(&header.headerStr[0], &header.headerStr[15]) + "\n" +
+            "Page size bytes: "               + std::to_string(header.pageSizeBytes)                     + "\n" +
+            "File format write version: "     + std::to_string(header.fileFormatWriteVersion)            + "\n" +
+            "File format read version: "      + std::to_string(header.fileFormatReadVersion)             + "\n" +
+            "Reserved space bytes: "          + std::to_string(header.reservedSpaceBytes)                + "\n" +
+            "Max embedded payload fraction "  + std::to_string(header.maxEmbeddedPayloadFrac)            + "\n" +
+            "Min embedded payload fraction: " + std::to_string(header.minEmbeddedPayloadFrac)            + "\n" +
+            "Leaf payload fraction: "         + std::to_string(header.leafPayloadFrac)                   + "\n" +
+            "File change counter: "           + std::to_string(header.fileChangeCounter)                 + "\n" +
+            "Database size pages: "           + std::to_string(header.databaseSizePages)                 + "\n" +
+            "First freelist trunk page: "     + std::to_string(header.firstFreelistTrunkPage)            + "\n" +
+            "Total freelist trunk pages: "    + std::to_string(header.totalFreelistPages)                + "\n" +
+            "Schema cookie: "                 + std::to_string(header.schemaCookie)                      + "\n" +
+            "Schema format number: "          + std::to_string(header.schemaFormatNumber)                + "\n" +
+            "Default page cache size bytes: " + std::to_string(header.defaultPageCacheSizeBytes)         + "\n" +
+            "Largest B tree page number: "    + std::to_string(header.largestBTreePageNumber)            + "\n" +
+            "Database text encoding: "        + std::to_string(header.databaseTextEncoding)              + "\n" +
+            "User version: "                  + std::to_string(header.userVersion)                       + "\n" +
+            "Incremental vaccum mode: "       + std::to_string(header.incrementalVaccumMode)             + "\n" +
+            "Application ID: "                + std::to_string(header.applicationId)                     + "\n" +
+            "Version valid for: "             + std::to_string(header.versionValidFor)                   + "\n" +
+            "SQLite version: "                + std::to_string(header.sqliteVersion)                     + "\n";
+        return pub_data;
+    }
+
+    void interpreter::backup(std::string backup_type)
+    {
+        if (backup_type.size() > 1 && (int)backup_type[0] <= 1)
+        {
+            throw std::runtime_error("This is not a valid backup type.");
+        }
+        else
+        {
+            m_backup_db->SQLite::Database::backup(m_db_path.c_str(),
+                (SQLite::Database::BackupType)backup_type[0]);
+        }
+    }
+
+    void interpreter::set_xvega_output(const magic_input& input)
+    {
+        std::string option = argument(input, 0, "%" + std::string(input.name) + " <option>");
+        if (iequals(input.name, "XVEGA_TABLES"))
+        {
+            if (iequals(option, "on"))
+            {
+                m_xvega_tables = true;
+            }
+            else if (iequals(option, "off"))
+            {
+                m_xvega_tables = false;
+            }
+            else
+            {
+                throw std::runtime_error("XVEGA_TABLES expects on or off.");
+            }
+        }
+        else if (iequals(option, "inline"))
+        {
+            m_xvega_inline_data = true;
+            m_xvega_data_dir.clear();
+        }
+        else if (iequals(option, "named"))
+        {
+            m_xvega_inline_data = false;
+            m_xvega_data_dir.clear();
+        }
+        else if (iequals(option, "file"))
+        {
+            m_xvega_inline_data = false;
+            m_xvega_data_dir = input.args.size() > 1 ? std::string(input.args[1]) : default_chart_data_dir;
+        }
+        else
+        {
+            throw std::runtime_error("XVEGA_DATA expects inline, named or file <directory>.");
+        }
+    }
+
+    void interpreter::xvega_plot(int execution_counter, const magic_input& input)
+    {
+        std::vector<std::string> xvega_input;
+        std::string_view sqlite_input;
+        std::tie(xvega_input, sqlite_input) = xv_sqlite::split_xv_sqlite_input(input.arguments);
+
+        /* This structure is only used when xvega code is run */
+        xv::df_type xv_sqlite_df;
+        process_SQLite_input(execution_counter,
+                             m_db,
+                             std::string(sqlite_input),
+                             &xv_sqlite_df,
+                             m_xvega_tables);
+
+        XSQL_TRACE_SPAN(xvega, m_tracer, "xvega", "xvega");
+        nl::json chart = xv_bindings::process_xvega_input(xvega_input,
+                                                          xv_sqlite_df);
+
+        if (!m_xvega_inline_data)
+        {
+            chart = xv_sqlite::externalize_datasets(std::move(chart),
+                                                    m_xvega_data_dir);
+        }
+        xvega.end();
+
+        XSQL_TRACE_SPAN(span, m_tracer, "publish_execution_result", "publish");
+        publish_execution_result(execution_counter,
+                                 std::move(chart),
+                                 nl::json::object());
+    }
+
+    void interpreter::parallel_query(int execution_counter, const magic_input& input)
+    {
+        const std::string usage = "%PARALLEL <glob> <query>";
+        std::string pattern = argument(input, 0, usage);
+        /* The query is passed as typed, after the pattern */
+        std::string_view sql = remaining_arguments(input, 0, usage);
+
+        std::vector<std::string> files = glob_files(pattern);
+        if (files.empty())
+        {
+            throw std::runtime_error("No file matches " + pattern + ".");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        m_parallel_interrupted = false;
+        result_table table = run_parallel(files, std::string(sql), 0, m_limits, &m_parallel_interrupted);
+        publish_table(execution_counter, table, table.row_count(), start);
+    }
+
+    void interpreter::query_file(int execution_counter, const magic_input& input)
+    {
+        const std::string usage = "%QUERY_FILE <path> <query>";
+        std::string path = argument(input, 0, usage);
+        std::string sql(remaining_arguments(input, 0, usage));
+
+        std::unique_ptr<SQLite::Database> scratch;
+        if (!m_bd_is_loaded)
+        {
+            scratch = std::make_unique<SQLite::Database>(":memory:", SQLite::OPEN_READWRITE);
+            register_sql_functions(scratch->getHandle());
+            register_file_tables(scratch->getHandle());
+        }
+        std::unique_ptr<SQLite::Database>& db = m_bd_is_loaded ? m_db : scratch;
+
+        std::string literal = "'";
+        for (char c : path)
+        {
+            literal += c == '\'' ? "''" : std::string(1, c);
+        }
+        literal += "'";
+
+        std::string table = "temp.\"" + file_table_name(path) + "\"";
+        db->exec("CREATE VIRTUAL TABLE " + table + " USING " + file_table_module(path) +
+                 "(path=" + literal + ")");
+        try
+        {
+            process_SQLite_input(execution_counter, db, sql, nullptr);
+        }
+        catch (...)
+        {
+            db->exec("DROP TABLE IF EXISTS " + table);
+            throw;
+        }
+        db->exec("DROP TABLE IF EXISTS " + table);
+    }
+
+    nl::json interpreter::blob_export(const magic_input& input)
+    {
+        const std::string usage = "%BLOB_EXPORT <table> <column> <rowid> <path>";
+        std::string table = argument(input, 0, usage);
+        std::string column = argument(input, 1, usage);
+        std::int64_t rowid = rowid_argument(input, 2, usage);
+        std::string path = argument(input, 3, usage);
+
+        std::int64_t size = export_blob(m_db->getHandle(), table, column, rowid, path);
+        nl::json pub_data;
+        pub_data["text/plain"] = "Exported " + format_bytes(size) + " to " + path;
+        return pub_data;
+    }
+
+    nl::json interpreter::blob_import(const magic_input& input)
+    {
+        const std::string usage = "%BLOB_IMPORT <path> <table> <column> <rowid>";
+        std::string path = argument(input, 0, usage);
+        std::string table = argument(input, 1, usage);
+        std::string column = argument(input, 2, usage);
+        std::int64_t rowid = rowid_argument(input, 3, usage);
+
+        std::int64_t size = import_blob(m_db->getHandle(), path, table, column, rowid);
+        nl::json pub_data;
+        pub_data["text/plain"] = "Imported " + format_bytes(size) + " from " + path;
+        return pub_data;
+    }
+
+    nl::json interpreter::session(const magic_input& input)
+    {
+        nl::json pub_data;
+        if (iequals(input.name, "SESSION_START"))
+        {
+            pub_data["text/plain"] = m_changes.start(m_db->getHandle(),
+                std::vector<std::string>(input.args.begin(), input.args.end()));
+        }
+        else if (iequals(input.name, "SESSION_SAVE"))
+        {
+            const std::string path = argument(input, 0, "%SESSION_SAVE <path>");
+            pub_data["text/plain"] = "Saved " + m_changes.save(path).to_string() + "\nto " + path;
+        }
+        else
+        {
+            pub_data["text/plain"] = m_changes.active() ? "Session stopped, the changes since the last save are discarded."
+                                                        : "No session.";
+            m_changes.stop();
+        }
+        return pub_data;
+    }
+
+    nl::json interpreter::changeset_apply(const magic_input& input)
+    {
+        const std::string usage = "%CHANGESET_APPLY <path> [conflict=abort|omit|replace]";
+        const std::string path = argument(input, 0, usage);
+        changeset_conflict policy = changeset_conflict::abort;
+        for (std::size_t i = 1; i < input.args.size(); ++i)
+        {
+            std::string_view key, value;
+            if (!split_option(input.args[i], key, value) || !iequals(key, "conflict"))
+            {
+                throw std::runtime_error("Unknown option " + std::string(input.args[i]) + ", usage: " + usage);
+            }
+            policy = parse_changeset_conflict(value);
+        }
+        if (m_changes.active())
+        {
+            /* The applied changes would be recorded and sent back */
+            throw std::runtime_error("Stop the session before applying a changeset to its database.");
+        }
+
+        nl::json pub_data;
+        pub_data["text/plain"] = apply_changeset(m_db->getHandle(), path, policy).to_string();
+        return pub_data;
+    }
+
+    nl::json interpreter::compress(const magic_input& input)
+    {
+        const std::string usage = "%COMPRESS <source> <destination> [block_size=<n>] [level=<n>]";
+        const std::string source = argument(input, 0, usage);
+        const std::string destination = argument(input, 1, usage);
+        compress_options options;
+        for (std::size_t i = 2; i < input.args.size(); ++i)
+        {
+            std::string_view key, value;
+            split_option(input.args[i], key, value);
+            if (iequals(key, "block_size"))
+            {
+                options.block_size = static_cast<std::size_t>(parse_byte_size(value));
+            }
+            else if (iequals(key, "level"))
+            {
+                auto parsed = std::from_chars(value.data(), value.data() + value.size(), options.level);
+                if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size())
+                {
+                    throw std::runtime_error("Invalid level " + std::string(value) + ", usage: " + usage);
+                }
+            }
+            else
+            {
+                throw std::runtime_error("Unknown option " + std::string(input.args[i]) + ", usage: " + usage);
+            }
+        }
+
+        const compress_result result = compress_database(source, destination, options);
+        const double ratio = result.database_bytes == 0 ? 0.
+            : 100. * static_cast<double>(result.compressed_bytes) / static_cast<double>(result.database_bytes);
+        char percent[16];
+        std::snprintf(percent, sizeof(percent), "%.1f%%", ratio);
+
+        nl::json pub_data;
+        pub_data["text/plain"] = "Compressed " + format_bytes(static_cast<std::int64_t>(result.database_bytes)) +
+                                 " to " + format_bytes(static_cast<std::int64_t>(result.compressed_bytes)) +
+                                 " (" + percent + ", " + std::to_string(result.blocks) + " blocks of " +
+                                 format_bytes(static_cast<std::int64_t>(options.block_size)) + ")" +
+                                 "\nOpen it with %LOAD " + destination + " r vfs=" + compressed_vfs_name;
+        return pub_data;
+    }
+
+    void interpreter::begin_batch(const magic_input& input)
+    {
+        if (m_batch.active)
+        {
+            throw std::runtime_error("A batch is already open, use %COMMIT_BATCH or %ROLLBACK_BATCH.");
+        }
+        if (sqlite3_get_autocommit(m_db->getHandle()) == 0)
+        {
+            throw std::runtime_error("A transaction is already open on this database.");
+        }
+
+        batch_state batch;
+        for (std::string_view arg : input.args)
+        {
+            std::string_view key, value;
+            if (!split_option(arg, key, value) || !iequals(key, "savepoint_every"))
+            {
+                throw std::runtime_error("Unknown option " + std::string(arg) +
+                                         ", usage: %BEGIN_BATCH [savepoint_every=N]");
+            }
+            long every = std::strtol(std::string(value).c_str(), nullptr, 10);
+            if (every <= 0)
+            {
+                throw std::runtime_error("savepoint_every expects a positive number of cells.");
+            }
+            batch.savepoint_every = static_cast<std::size_t>(every);
+        }
+
+        /* IMMEDIATE takes the write lock now rather than at the first write */
+        m_db->exec("BEGIN IMMEDIATE");
+        m_db->exec("SAVEPOINT xsql_batch");
+        batch.active = true;
+        m_batch = batch;
+    }
+
+    nl::json interpreter::end_batch(bool commit)
+    {
+        if (!m_batch.active)
+        {
+            throw std::runtime_error("No batch is open, start one with %BEGIN_BATCH.");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        if (sqlite3_get_autocommit(m_db->getHandle()) == 0)
+        {
+            try
+            {
+                m_db->exec(commit ? "COMMIT" : "ROLLBACK");
+            }
+            catch (const std::exception& err)
+            {
+                /* Some errors make SQLite roll back the whole transaction */
+                if (sqlite3_get_autocommit(m_db->getHandle()) != 0)
+                {
+                    m_batch = batch_state();
+                    throw std::runtime_error(std::string(err.what()) +
+                                             "\nSQLite rolled back the batch, start a new one with %BEGIN_BATCH.");
+                }
+                /* Such as SQLITE_BUSY or a deferred foreign key violation, nothing
+                   is undone and the cell is not rolled back to the savepoint */
+                m_batch.ending_failed = true;
+                throw std::runtime_error(std::string(err.what()) + "\nThe batch is still open, use " +
+                                         (commit ? "%COMMIT_BATCH again or %ROLLBACK_BATCH." :
+                                                   "%ROLLBACK_BATCH again."));
+            }
+        }
+        const batch_state batch = m_batch;
+        m_batch = batch_state();
+
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        char timing[64];
+        std::snprintf(timing, sizeof(timing), " in %.3f ms", elapsed.count());
+
+        nl::json pub_data;
+        pub_data["text/plain"] = std::string(commit ? "Committed " : "Rolled back ") +
+                                 plural(batch.statements, "statement") + ", " +
+                                 plural(static_cast<std::size_t>(batch.rows), "row") + " affected" + timing;
+        return pub_data;
+    }
+
+    void interpreter::batch_cell_done()
+    {
+        if (++m_batch.pending_cells >= m_batch.savepoint_every)
+        {
+            m_db->exec("RELEASE xsql_batch");
+            m_db->exec("SAVEPOINT xsql_batch");
+            m_batch.pending_cells = 0;
+            m_batch.saved_statements = m_batch.statements;
+            m_batch.saved_rows = m_batch.rows;
+        }
+    }
+
+    void interpreter::set_interrupt_handle(sqlite3* db)
+    {
+        std::lock_guard<std::mutex> lock(m_interrupt_mutex);
+        p_interrupt_db = db;
+    }
+
+    std::string interpreter::batch_cell_failed()
+    {
+        /* Interrupts and some errors make SQLite roll back the whole transaction */
+        if (sqlite3_get_autocommit(m_db->getHandle()) != 0)
+        {
+            m_batch = batch_state();
+            return "SQLite rolled back the batch, start a new one with %BEGIN_BATCH.";
+        }
+
+        std::size_t lost = m_batch.pending_cells;
+        m_db->exec("ROLLBACK TO xsql_batch");
+        m_batch.pending_cells = 0;
+        m_batch.statements = m_batch.saved_statements;
+        m_batch.rows = m_batch.saved_rows;
+        return "Rolled back to the last savepoint, " +
+               (lost == 0 ? std::string("no previous cell was") :
+                            plural(lost, "previous cell") + (lost == 1 ? " was" : " were")) +
+               " undone, the batch is still open.";
+    }
+
+    nl::json interpreter::set_maintenance(const magic_input& input)
+    {
+        const std::string usage = "%MAINTENANCE on [idle=60s] | off | status";
+        std::string_view mode = input.args.empty() ? "status" : input.args[0];
+        if (iequals(mode, "on"))
+        {
+            std::chrono::milliseconds idle = std::chrono::seconds(60);
+            for (std::size_t i = 1; i < input.args.size(); ++i)
+            {
+                std::string_view key, value;
+                if (!split_option(input.args[i], key, value) || !iequals(key, "idle"))
+                {
+                    throw std::runtime_error("Unknown option " + std::string(input.args[i]) +
+                                             ", usage: " + usage);
+                }
+                idle = parse_duration(value);
+            }
+            m_maintenance.start(idle);
+        }
+        else if (iequals(mode, "off"))
+        {
+            m_maintenance.stop();
+        }
+        else if (!iequals(mode, "status"))
+        {
+            throw std::runtime_error("Unknown option " + std::string(mode) + ", usage: " + usage);
+        }
+
+        nl::json pub_data;
+        pub_data["text/plain"] = m_maintenance.status();
+        return pub_data;
+    }
+
+    nl::json interpreter::memory_report(const magic_input& input)
+    {
+        bool reset = false;
+        if (!input.args.empty())
+        {
+            if (input.args.size() > 1 || !iequals(input.args[0], "reset"))
+            {
+                throw std::runtime_error("Unknown option " + std::string(input.args[0]) +
+                                         ", usage: %MEMORY [reset]");
+            }
+            reset = true;
+        }
+
+        std::string report = sqlite_memory_report(reset) + "\n\nConnections:";
+        if (m_bd_is_loaded)
+        {
+            report += "\n  " + m_db_name + " (in use): " + connection_memory_report(m_db->getHandle(), reset);
+        }
+        m_connections.for_each([&](const connection& conn)
+        {
+            report += "\n  " + conn.name + ": " + connection_memory_report(conn.db->getHandle(), reset);
+        });
+        if (!m_bd_is_loaded && m_connections.size() == 0)
+        {
+            report += " none";
+        }
+
+        const output_usage& usage = m_output_usage;
+        report += "\n\nLast result: " + plural(usage.rows, "row") +
+                  ", buffer " + format_bytes(static_cast<std::int64_t>(usage.table_bytes)) +
+                  ", rendered " + format_bytes(static_cast<std::int64_t>(usage.rendered_bytes));
+        if (usage.json_values != 0)
+        {
+            report += " and " + plural(usage.json_values, "JSON value");
+        }
+        report += "\nPeak: buffer " + format_bytes(static_cast<std::int64_t>(usage.peak_table_bytes)) +
+                  ", rendered " + format_bytes(static_cast<std::int64_t>(usage.peak_rendered_bytes));
+        if (reset)
+        {
+            m_output_usage.peak_table_bytes = m_output_usage.table_bytes;
+            m_output_usage.peak_rendered_bytes = m_output_usage.rendered_bytes;
+        }
+
+        nl::json pub_data;
+        pub_data["text/plain"] = report;
+        return pub_data;
+    }
+
+    nl::json interpreter::fts_index(const magic_input& input)
+    {
+        const std::string usage = "%FTS_INDEX <table> <column> [<column> ...] [tokenize=<tokenizer>] | drop";
+        std::string table = argument(input, 0, usage);
+        argument(input, 1, usage);
+
+        nl::json pub_data;
+        if (input.args.size() == 2 && iequals(input.args[1], "drop"))
+        {
+            drop_fts_index(*m_db, table);
+            pub_data["text/plain"] = "Removed the full-text index of " + table;
+            return pub_data;
+        }
+
+        /* Columns may also be separated by commas */
+        fts_index_options options;
+        std::vector<std::string> columns;
+        for (std::size_t i = 1; i < input.args.size(); ++i)
+        {
+            std::string_view key, value;
+            if (split_option(input.args[i], key, value))
+            {
+                if (!iequals(key, "tokenize"))
+                {
+                    throw std::runtime_error("Unknown option " + std::string(input.args[i]) + ", usage: " + usage);
+                }
+                options.tokenize = std::string(value);
+                std::replace(options.tokenize.begin(), options.tokenize.end(), ',', ' ');
+                continue;
+            }
+            std::string_view names = input.args[i];
+            while (!names.empty())
+            {
+                std::size_t comma = std::min(names.find(','), names.size());
+                if (comma != 0)
+                {
+                    columns.emplace_back(names.substr(0, comma));
+                }
+                names.remove_prefix(std::min(comma + 1, names.size()));
+            }
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        auto last_report = start;
+        long long rows = create_fts_index(*m_db, table, columns, options,
+            [&](long long indexed, long long total)
+            {
+                /* At most one line per second */
+                const auto now = std::chrono::steady_clock::now();
+                if (indexed < total && now - last_report < std::chrono::seconds(1))
+                {
+                    return;
+                }
+                last_report = now;
+                publish_stream("stdout", "Indexed " + std::to_string(indexed) + " of " + std::to_string(total) +
+                                         " rows (" + std::to_string(total == 0 ? 100 : 100 * indexed / total) + "%)\n");
+            });
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        char timing[32];
+        std::snprintf(timing, sizeof(timing), " in %.1f s", elapsed.count());
+        pub_data["text/plain"] = "Indexed " + plural(static_cast<std::size_t>(rows), "row") + " of " + table +
+                                 " into " + fts_table_name(split_qualified_name(table).name) + timing +
+                                 ", search it with %SEARCH " + table + " <query>";
+        return pub_data;
+    }
+
+    void interpreter::search(int execution_counter, const magic_input& input)
+    {
+        const std::string usage = "%SEARCH <table> [limit=N] <query>";
+        std::string table = argument(input, 0, usage);
+
+        long long limit = 20;
+        std::size_t last = 0;
+        std::string_view key, value;
+        if (input.args.size() > 1 && split_option(input.args[1], key, value) && iequals(key, "limit"))
+        {
+            auto parsed = std::from_chars(value.data(), value.data() + value.size(), limit);
+            if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() || limit <= 0)
+            {
+                throw std::runtime_error("Invalid limit " + std::string(value) + ", usage: " + usage);
+            }
+            last = 1;
+        }
+        std::string query(remaining_arguments(input, last, usage));
+        process_SQLite_input(execution_counter, m_db, fts_search_query(*m_db, table, query, limit), nullptr);
+    }
+
+    nl::json interpreter::prewarm(const magic_input& input)
+    {
+        const std::string usage = "%PREWARM [<table> ...] | status | stop";
+        std::string_view mode = input.args.empty() ? "" : input.args[0];
+        if (iequals(mode, "stop"))
+        {
+            m_prewarm.stop();
+        }
+        else if (!iequals(mode, "status"))
+        {
+            if (m_db_path.empty() || m_db_path == ":memory:")
+            {
+                throw std::runtime_error("In-memory databases cannot be prewarmed, usage: " + usage);
+            }
+            sqlite3_vfs* vfs = nullptr;
+            sqlite3_file_control(m_db->getHandle(), "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+            if (vfs != nullptr && std::string(vfs->zName) == compressed_vfs_name)
+            {
+                throw std::runtime_error("Compressed databases cannot be prewarmed, usage: " + usage);
+            }
+            m_prewarm.start(m_db_path, std::vector<std::string>(input.args.begin(), input.args.end()));
+        }
+
+        nl::json pub_data;
+        pub_data["text/plain"] = m_prewarm.status();
+        return pub_data;
+    }
+
+    void interpreter::register_magic(const std::string& name,
+                                     magic_handler handler,
+                                     bool requires_db)
+    {
+        m_magics[to_upper(name)] = magic_entry{std::move(handler), requires_db};
+    }
+
+    void interpreter::register_builtin_magics()
+    {
+        auto publish = [this](int execution_counter, nl::json pub_data)
+        {
+            XSQL_TRACE_SPAN(span, m_tracer, "publish_execution_result", "publish");
+            publish_execution_result(execution_counter,
+                                     std::move(pub_data),
+                                     nl::json::object());
+        };
+
+        /* Magics that do not need a database */
+        register_magic("LOAD", [this](int, const magic_input& input)
+        {
+            load_db(input);
+        }, false);
+        register_magic("CREATE", [this](int, const magic_input& input)
+        {
+            create_db(input);
+        }, false);
+        register_magic("USE", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, use_connection(input));
+        }, false);
+        register_magic("PARALLEL", [this](int execution_counter, const magic_input& input)
+        {
+            parallel_query(execution_counter, input);
+        }, false);
+        register_magic("QUERY_FILE", [this](int execution_counter, const magic_input& input)
+        {
+            query_file(execution_counter, input);
+        }, false);
+        register_magic("MAINTENANCE", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, set_maintenance(input));
+        }, false);
+        register_magic("MEMORY", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, memory_report(input));
+        }, false);
+        register_magic("OUTPUT", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, set_output_formats(input));
+        }, false);
+        register_magic("LIMITS", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, set_limits(input));
+        }, false);
+        register_magic("TRACE", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, set_trace(input));
+        }, false);
+        register_magic("PLAN_HISTORY", [this](int execution_counter, const magic_input& input)
+        {
+            set_plan_history(execution_counter, input);
+        }, false);
+        register_magic("XVEGA_DATA", [this](int, const magic_input& input)
+        {
+            set_xvega_output(input);
+        }, false);
+        register_magic("XVEGA_TABLES", [this](int, const magic_input& input)
+        {
+            set_xvega_output(input);
+        }, false);
+    #ifdef XSQL_EMSCRIPTEN_WASM_BUILD
+        register_magic("FETCH", [](int, const magic_input& input)
+        {
+            xeus_lite::fetch(argument(input, 0, "%FETCH <url> <filename>"),
+                             argument(input, 1, "%FETCH <url> <filename>"));
+        }, false);
+        register_magic("PUSH_TO_IDBFS", [](int, const magic_input&)
+        {
+            xeus_lite::ems_sync_db();
+        }, false);
+        register_magic("SET_IDBFS_DIR", [](int, const magic_input& input)
+        {
+            xeus_lite::ems_init_idbfs(argument(input, 0, "%SET_IDBFS_DIR <path>"));
+        }, false);
+    #endif
+
+        /* Magics that operate on the loaded database */
+        register_magic("DELETE", [this](int, const magic_input&)
+        {
+            delete_db();
+        });
+        register_magic("ATTACH", [this](int, const magic_input& input)
+        {
+            attach_db(input);
+        });
+        register_magic("DETACH", [this](int, const magic_input& input)
+        {
+            detach_db(input);
+        });
+        register_magic("BEGIN_BATCH", [this](int, const magic_input& input)
+        {
+            begin_batch(input);
+        });
+        register_magic("COMMIT_BATCH", [this, publish](int execution_counter, const magic_input&)
+        {
+            publish(execution_counter, end_batch(true));
+        });
+        register_magic("ROLLBACK_BATCH", [this, publish](int execution_counter, const magic_input&)
+        {
+            publish(execution_counter, end_batch(false));
+        });
+        register_magic("AUTOCOMMIT", [this, publish](int execution_counter, const magic_input& input)
+        {
+            std::string mode = argument(input, 0, "%AUTOCOMMIT <on | off>");
+            if (iequals(mode, "off"))
+            {
+                begin_batch(magic_input());
+            }
+            else if (iequals(mode, "on"))
+            {
+                if (m_batch.active)
+                {
+                    publish(execution_counter, end_batch(true));
+                }
+            }
+            else
+            {
+                throw std::runtime_error("AUTOCOMMIT expects on or off.");
+            }
+        });
+        register_magic("TABLE_EXISTS", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, table_exists(argument(input, 0, "%TABLE_EXISTS <table>")));
+        });
+        register_magic("LOAD_EXTENSION", [this](int, const magic_input& input)
+        {
+            std::string entry_point = input.args.size() > 1 ? std::string(input.args[1]) : "";
+            m_db->SQLite::Database::loadExtension(
+                argument(input, 0, "%LOAD_EXTENSION <library> [entry point]").c_str(),
+                entry_point.empty() ? nullptr : entry_point.c_str());
+        });
+        register_magic("SET_KEY", [this](int, const magic_input& input)
+        {
+            m_db->SQLite::Database::key(argument(input, 0, "%SET_KEY <key>"));
+        });
+        register_magic("REKEY", [this](int, const magic_input& input)
+        {
+            m_db->SQLite::Database::rekey(input.args.empty() ? "" : std::string(input.args[0]));
+        });
+        register_magic("IS_UNENCRYPTED", [this, publish](int execution_counter, const magic_input&)
+        {
+            publish(execution_counter, is_unencrypted());
+        });
+        register_magic("GET_INFO", [this, publish](int execution_counter, const magic_input&)
+        {
+            publish(execution_counter, get_header_info());
+        });
+        register_magic("BACKUP", [this](int, const magic_input& input)
+        {
+            backup(argument(input, 0, "%BACKUP <0 | 1>"));
+        });
+        register_magic("XVEGA_PLOT", [this](int execution_counter, const magic_input& input)
+        {
+            xvega_plot(execution_counter, input);
+        });
+        register_magic("BLOB_EXPORT", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, blob_export(input));
+        });
+        register_magic("BLOB_IMPORT", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, blob_import(input));
+        });
+        register_magic("PREWARM", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, prewarm(input));
+        });
+        register_magic("SESSION_START", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, session(input));
+        });
+        register_magic("SESSION_SAVE", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, session(input));
+        });
+        register_magic("SESSION_STOP", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, session(input));
+        }, false);
+        register_magic("CHANGESET_APPLY", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, changeset_apply(input));
+        });
+        register_magic("COMPRESS", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, compress(input));
+        }, false);
+        register_magic("FTS_INDEX", [this, publish](int execution_counter, const magic_input& input)
+        {
+            publish(execution_counter, fts_index(input));
+        });
+        register_magic("SEARCH", [this](int execution_counter, const magic_input& input)
+        {
+            search(execution_counter, input);
+        });
+    }
+
+    void interpreter::parse_SQLite_magic(int execution_counter, const magic_input& input)
+    {
+        auto magic = m_magics.find(to_upper(input.name));
+        if (magic == m_magics.end())
+        {
+            throw std::runtime_error("Unknown magic %" + std::string(input.name) + ".");
+        }
+        if (magic->second.requires_db && !m_bd_is_loaded)
+        {
+            throw SQLite::Exception("Load a database to run this command.");
+        }
+        XSQL_TRACE_SPAN(span, m_tracer, "magic", "magic");
+        span.arg("name", magic->first);
+        magic->second.handler(execution_counter, input);
+    }
+
+    nl::json interpreter::set_output_formats(const magic_input& input)
+    {
+        if (!input.args.empty())
+        {
+            m_output_formats = parse_output_formats(input.args.begin(), input.args.end());
+        }
+
+        nl::json pub_data;
+        pub_data["text/plain"] = "Output formats: " + output_formats_to_string(m_output_formats);
+        return pub_data;
+    }
+
+    nl::json interpreter::set_limits(const magic_input& input)
     {
-        nl::json pub_data;
-        if (SQLite::Database::isUnencrypted(m_db_path))
+        if (input.args.size() == 1 && iequals(input.args[0], "reset"))
         {
-            pub_data["text/plain"] = "The database is unencrypted.";
-            return pub_data;
+            m_limits = m_default_limits;
         }
         else
         {
-            pub_data["text/plain"] = "The database is encrypted.";
-            return pub_data;
+            /* Applied only if every argument is valid */
+            query_limits limits = m_limits;
+            parse_query_limits(input.args, limits);
+            m_limits = limits;
         }
-    }
-
-    nl::json interpreter::get_header_info()
-    {
-        SQLite::Header header;
-        header = SQLite::Database::getHeaderInfo(m_db_path);
 
-    /* Official documentation for fields can be found here:
-        https://www.sqlite.org/fileformat.html#the_database_header*/
         nl::json pub_data;
-        pub_data["text/plain"] =
-            "Magic header string: "           + std::string(&header.headerStr[0], &header.headerStr[15]) + "\n" +
-            "Page size bytes: "               + std::to_string(header.pageSizeBytes)                     + "\n" +
-            "File format write version: "     + std::to_string(header.fileFormatWriteVersion)            + "\n" +
-            "File format read version: "      + std::to_string(header.fileFormatReadVersion)             + "\n" +
-            "Reserved space bytes: "          + std::to_string(header.reservedSpaceBytes)                + "\n" +
-            "Max embedded payload fraction "  + std::to_string(header.maxEmbeddedPayloadFrac)            + "\n" +
-            "Min embedded payload fraction: " + std::to_string(header.minEmbeddedPayloadFrac)            + "\n" +
-            "Leaf payload fraction: "         + std::to_string(header.leafPayloadFrac)                   + "\n" +
-            "File change counter: "           + std::to_string(header.fileChangeCounter)                 + "\n" +
-            "Database size pages: "           + std::to_string(header.databaseSizePages)                 + "\n" +
-            "First freelist trunk page: "     + std::to_string(header.firstFreelistTrunkPage)            + "\n" +
-            "Total freelist trunk pages: "    + std::to_string(header.totalFreelistPages)                + "\n" +
-            "Schema cookie: "                 + std::to_string(header.schemaCookie)                      + "\n" +
-            "Schema format number: "          + std::to_string(header.schemaFormatNumber)                + "\n" +
-            "Default page cache size bytes: " + std::to_string(header.defaultPageCacheSizeBytes)         + "\n" +
-            "Largest B tree page number: "    + std::to_string(header.largestBTreePageNumber)            + "\n" +
-            "Database text encoding: "        + std::to_string(header.databaseTextEncoding)              + "\n" +
-            "User version: "                  + std::to_string(header.userVersion)                       + "\n" +
-            "Incremental vaccum mode: "       + std::to_string(header.incrementalVaccumMode)             + "\n" +
-            "Application ID: "                + std::to_string(header.applicationId)                     + "\n" +
-            "Version valid for: "             + std::to_string(header.versionValidFor)                   + "\n" +
-            "SQLite version: "                + std::to_string(header.sqliteVersion)                     + "\n";
+        pub_data["text/plain"] = "Limits: " + query_limits_to_string(m_limits);
         return pub_data;
     }
 
-    void interpreter::backup(std::string backup_type)
+    nl::json interpreter::set_trace(const magic_input& input)
     {
-        if (backup_type.size() > 1 && (int)backup_type[0] <= 1)
+        const std::string usage = "%TRACE [on [<path>] | off]";
+        nl::json pub_data;
+        if (input.args.empty())
         {
-            throw std::runtime_error("This is not a valid backup type.");
+            pub_data["text/plain"] = m_tracer.enabled()
+                ? "Tracing to " + m_tracer.path() + ", " + plural(m_tracer.event_count(), "span") + " recorded."
+                : std::string("Tracing is off.");
+            return pub_data;
         }
-        else
+        if (iequals(input.args[0], "on") && input.args.size() <= 2)
         {
-            m_backup_db->SQLite::Database::backup(m_db_path.c_str(),
-                (SQLite::Database::BackupType)backup_type[0]);
+#ifndef XSQL_ENABLE_TRACING
+            throw std::runtime_error("Tracing is not available, xeus-sqlite was built without XSQL_ENABLE_TRACING.");
+#else
+            m_tracer.start(input.args.size() == 2 ? std::string(input.args[1]) : "xsqlite_trace.json");
+            pub_data["text/plain"] = "Tracing to " + m_tracer.path() + ".";
+            return pub_data;
+#endif
+        }
+        if (iequals(input.args[0], "off") && input.args.size() == 1)
+        {
+            if (!m_tracer.enabled())
+            {
+                throw std::runtime_error("Tracing is not on, usage: " + usage);
+            }
+            const std::size_t spans = m_tracer.event_count();
+            m_tracer.stop();
+            pub_data["text/plain"] = "Trace written to " + m_tracer.path() + " (" + plural(spans, "span") +
+                                     "), open it in https://ui.perfetto.dev.";
+            return pub_data;
         }
+        throw std::runtime_error("Invalid arguments, usage: " + usage);
     }
 
-    void interpreter::parse_SQLite_magic(int execution_counter,
-                                    const std::vector<
-                                        std::string>& tokenized_input)
+    void interpreter::set_plan_history(int execution_counter, const magic_input& input)
     {
-        if (xv_bindings::case_insentive_equals(tokenized_input[0], "LOAD"))
+        const std::string usage = "%PLAN_HISTORY [<n>] | on | off | clear | [slowdown=<factor>] [min_duration=<duration>]";
+        if (m_plans == nullptr)
+        {
+            throw std::runtime_error("The plan history is not available, XSQLITE_PLAN_HISTORY is off or "
+                                     "its file could not be opened.");
+        }
+
+        std::size_t limit = 20;
+        if (input.args.size() == 1 && !input.args[0].empty() && std::isdigit(static_cast<unsigned char>(input.args[0][0])))
         {
-            m_db_path = tokenized_input[1];
-            std::ifstream path_is_valid(m_db_path);
-            if (!path_is_valid.is_open())
+            std::string_view arg = input.args[0];
+            auto parsed = std::from_chars(arg.data(), arg.data() + arg.size(), limit);
+            if (parsed.ec != std::errc() || parsed.ptr != arg.data() + arg.size() || limit == 0)
             {
-                throw std::runtime_error("The path doesn't exist.");
+                throw std::runtime_error("Invalid count " + std::string(arg) + ", usage: " + usage);
             }
-            else
+        }
+        else if (!input.args.empty())
+        {
+            plan_history_options options = m_plans->options();
+            for (std::string_view arg : input.args)
             {
-                return load_db(tokenized_input);
+                std::string_view key, value;
+                if (iequals(arg, "on") || iequals(arg, "off"))
+                {
+                    m_plans_enabled = iequals(arg, "on");
+                }
+                else if (iequals(arg, "clear"))
+                {
+                    if (!m_bd_is_loaded)
+                    {
+                        throw SQLite::Exception("Load a database to run this command.");
+                    }
+                    m_plans->clear(database_file(*m_db));
+                }
+                else if (split_option(arg, key, value) && iequals(key, "slowdown"))
+                {
+                    char* end = nullptr;
+                    const std::string text(value);
+                    options.slowdown = std::strtod(text.c_str(), &end);
+                    if (text.empty() || end != text.c_str() + text.size() || !(options.slowdown > 1))
+                    {
+                        throw std::runtime_error("Invalid slowdown " + text + ", expected a factor larger than 1.");
+                    }
+                }
+                else if (split_option(arg, key, value) && iequals(key, "min_duration"))
+                {
+                    options.min_duration = parse_duration(value);
+                }
+                else
+                {
+                    throw std::runtime_error("Invalid argument " + std::string(arg) + ", usage: " + usage);
+                }
             }
+            m_plans->options() = options;
+
+            char slowdown[32];
+            std::snprintf(slowdown, sizeof(slowdown), "%g", options.slowdown);
+            nl::json pub_data;
+            pub_data["text/plain"] = std::string("Plan history ") + (m_plans_enabled ? "on" : "off") +
+                                     " in " + m_plans->path() + ", warns when the plan of a query changes or a run is " +
+                                     slowdown + "x slower than its median and takes more than " +
+                                     std::to_string(options.min_duration.count()) + " ms.";
+            XSQL_TRACE_SPAN(span, m_tracer, "publish_execution_result", "publish");
+            publish_execution_result(execution_counter, std::move(pub_data), nl::json::object());
+            return;
         }
-        else if (xv_bindings::case_insentive_equals(tokenized_input[0], "CREATE"))
+
+        if (!m_bd_is_loaded)
         {
-            return create_db(tokenized_input);
-        }
-        #ifdef XSQL_EMSCRIPTEN_WASM_BUILD
-        else if (xv_bindings::case_insentive_equals(tokenized_input[0], "FETCH"))
-        {   
-            return xeus_lite::fetch(tokenized_input[1] /*url*/, tokenized_input[2] /*filename*/);
+            throw SQLite::Exception("Load a database to run this command.");
         }
-        else if (xv_bindings::case_insentive_equals(tokenized_input[0], "PUSH_TO_IDBFS"))
+        const auto start = std::chrono::steady_clock::now();
+        result_table table = m_plans->recent_plans(database_file(*m_db), limit);
+        publish_table(execution_counter, table, table.row_count(), start, nl::json::object());
+    }
+
+    void interpreter::record_plan(const std::string& plan,
+                                  const std::string& code,
+                                  std::chrono::steady_clock::time_point start,
+                                  long long rows)
+    {
+        /* In-memory databases have no history across sessions */
+        const std::string database = database_file(*m_db);
+        if (plan.empty() || database.empty())
         {
-            return xeus_lite::ems_sync_db();
+            return;
         }
-        else if (xv_bindings::case_insentive_equals(tokenized_input[0], "SET_IDBFS_DIR"))
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::string warning = m_plans->record(database, code, plan, elapsed.count(), rows);
+        if (!warning.empty())
         {
-            return xeus_lite::ems_init_idbfs(tokenized_input[1]);
+            publish_stream("stderr", warning);
         }
-        #endif
+    }
 
-        if (m_bd_is_loaded)
+    void interpreter::configure_impl()
+    {
+        /* Kernel-level default, e.g. set from the "env" of kernel.json */
+        apply_environment("XSQLITE_OUTPUT", [this](const char* formats)
         {
-            if (xv_bindings::case_insentive_equals(tokenized_input[0], "DELETE"))
-            {
-                delete_db();
-            }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "TABLE_EXISTS"))
-            {
-                publish_execution_result(execution_counter,
-                    std::move(table_exists(tokenized_input[1])),
-                    nl::json::object());
-            }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "LOAD_EXTENSION"))
+            std::vector<std::string_view> names = split_arguments(formats);
+            m_output_formats = parse_output_formats(names.begin(), names.end());
+        });
+
+        /* Budgets of each statement, %LIMITS reset goes back to them */
+        apply_environment("XSQLITE_LIMITS", [this](const char* limits)
+        {
+            query_limits parsed;
+            parse_query_limits(split_arguments(limits), parsed);
+            m_default_limits = parsed;
+            m_limits = m_default_limits;
+        });
+
+#ifdef XSQL_ENABLE_TRACING
+        /* Traces the whole session, as %TRACE on <path> */
+        apply_environment("XSQLITE_TRACE", [this](const char* trace)
+        {
+            m_tracer.start(trace);
+        });
+#endif
+
+        /* Plans and latencies of the queries, XSQLITE_PLAN_HISTORY=off disables it */
+        const std::string plans_path = default_plan_history_path();
+        if (!plans_path.empty() && plans_path != "off")
+        {
+            try
             {
-                //TODO: add a try catch to treat all void functions
-                m_db->SQLite::Database::loadExtension(tokenized_input[1].c_str(),
-                        tokenized_input[2].c_str());
+                m_plans = std::make_unique<plan_history>(plans_path == "memory" ? ":memory:" : plans_path);
             }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "SET_KEY"))
+            catch (const std::exception& e)
             {
-                m_db->SQLite::Database::key(tokenized_input[1]);
+                /* Queries run without it, %PLAN_HISTORY reports it */
+                std::cerr << "xsqlite: no plan history, " << plans_path << ": " << e.what() << std::endl;
             }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "REKEY"))
+        }
+
+        /* Connections kept open, the one in use included */
+        apply_environment("XSQLITE_MAX_CONNECTIONS", [this](const char* limit)
+        {
+            const std::string_view text(limit);
+            std::size_t max_connections = 0;
+            const auto parsed = std::from_chars(text.data(), text.data() + text.size(), max_connections);
+            if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size() ||
+                max_connections < 1 || max_connections > max_open_connections)
             {
-                m_db->SQLite::Database::rekey(tokenized_input[1]);
+                throw std::runtime_error("Expected a number of connections from 1 to " +
+                                         std::to_string(max_open_connections) + ".");
             }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "IS_UNENCRYPTED"))
+            m_connections.set_capacity(max_connections - 1);
+        });
+
+        /* %LOAD <path> vfs=compressed, XSQLITE_VFS_CACHE bounds the decompressed blocks per file */
+        compressed_vfs_options vfs_options;
+        apply_environment("XSQLITE_VFS_CACHE", [&vfs_options](const char* cache)
+        {
+            vfs_options.cache_size = static_cast<std::size_t>(parse_byte_size(cache));
+        });
+        try
+        {
+            register_compressed_vfs(vfs_options);
+        }
+        catch (const std::exception&)
+        {
+            /* Without zlib, opening with vfs=compressed reports "no such vfs" */
+        }
+
+        comm_manager().register_comm_target(pager_comm_target,
+            [this](xeus::xcomm&& comm, xeus::xmessage)
             {
-                publish_execution_result(execution_counter,
-                    std::move(is_unencrypted()),
-                    nl::json::object());
-            }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "GET_INFO"))
+                open_pager_comm(std::move(comm));
+            });
+        comm_manager().register_comm_target(ingest_comm_target,
+            [this](xeus::xcomm&& comm, xeus::xmessage)
             {
-                publish_execution_result(execution_counter,
-                    std::move(get_header_info()),
-                    nl::json::object());
-            }
-            else if (xv_bindings::case_insentive_equals(tokenized_input[0], "BACKUP"))
+                open_ingest_comm(std::move(comm));
+            });
+    }
+
+    void interpreter::open_pager_comm(xeus::xcomm&& comm)
+    {
+        pager_open();
+        const std::string id = comm.id();
+        comm.on_message([this, id](const xeus::xmessage& message)
+        {
+            m_pager.evict_idle();
+            auto it = m_pager_comms.find(id);
+            if (it != m_pager_comms.end())
             {
-                backup(tokenized_input[1]);
+                it->second.send(nl::json::object(),
+                                m_pager.handle_request(message.content().value("data", nl::json::object())),
+                                xeus::buffer_sequence());
             }
+        });
+        comm.on_close([this, id](const xeus::xmessage&)
+        {
+            m_closed_pager_comms.push_back(id);
+        });
+
+        auto it = m_pager_comms.emplace(id, std::move(comm)).first;
+        it->second.send(nl::json::object(),
+                        m_pager.handle_request({{"action", "list"}}),
+                        xeus::buffer_sequence());
+    }
+
+    bool interpreter::pager_open()
+    {
+        for (const std::string& id : m_closed_pager_comms)
+        {
+            m_pager_comms.erase(id);
         }
-        else
+        m_closed_pager_comms.clear();
+        if (m_pager_comms.empty())
         {
-            throw SQLite::Exception("Load a database to run this command.");
+            /* Nobody can page the kept results anymore */
+            m_pager.clear();
         }
+        return !m_pager_comms.empty();
     }
 
-    void interpreter::configure_impl()
+    void interpreter::open_ingest_comm(xeus::xcomm&& comm)
     {
+        for (const std::string& id : m_closed_ingest_comms)
+        {
+            m_ingest_comms.erase(id);
+        }
+        m_closed_ingest_comms.clear();
+
+        const std::string id = comm.id();
+        comm.on_message([this, id](const xeus::xmessage& message)
+        {
+            auto it = m_ingest_comms.find(id);
+            if (it == m_ingest_comms.end())
+            {
+                return;
+            }
+            XSQL_TRACE_SPAN(span, m_tracer, "ingest", "comm");
+            m_maintenance.begin_activity();
+            m_prewarm.cancel();
+            nl::json reply = handle_ingest_request(m_db != nullptr ? m_db->getHandle() : nullptr,
+                                                   message.content().value("data", nl::json::object()),
+                                                   message.buffers());
+            m_maintenance.end_activity();
+            if (reply["action"] == "inserted")
+            {
+                const long long rows = reply["rows"].get<long long>();
+                span.arg("rows", rows);
+                if (m_batch.active)
+                {
+                    ++m_batch.statements;
+                    m_batch.rows += rows;
+                }
+            }
+            span.end();
+            it->second.send(nl::json::object(), std::move(reply), xeus::buffer_sequence());
+        });
+        comm.on_close([this, id](const xeus::xmessage&)
+        {
+            m_closed_ingest_comms.push_back(id);
+        });
+        m_ingest_comms.emplace(id, std::move(comm));
     }
 
     void interpreter::process_SQLite_input(int execution_counter,
                                         std::unique_ptr<SQLite::Database> &m_db,
                                         const std::string& code,
-                                        xv::df_type& xv_sqlite_df)
+                                        xv::df_type* xv_sqlite_df,
+                                        bool publish_tables)
     {
         if (m_db == nullptr)
         {
             throw SQLite::Exception("Please load a database to perform operations");
         }
+        /* Queries have priority over the reads of a prewarm */
+        m_prewarm.cancel();
+        const auto start = std::chrono::steady_clock::now();
+        XSQL_TRACE_SPAN(prepare, m_tracer, "prepare", "sqlite");
         SQLite::Statement query(*m_db, code);
-        nl::json pub_data;
-
-        /* Builds text/plain output */
-        tabulate::Table plain_table;
-
-        /* Builds text/html output */
-        std::stringstream html_table("");
+        prepare.end();
+        /* Plan before the statement runs, compared with its history once it is done */
+        const bool record = m_plans != nullptr && m_plans_enabled;
+        const std::string plan = record ? explain_plan(query.getPreparedStatement()) : std::string();
+        /* Budgets of %LIMITS, until the statement is done */
+        query_governor governor(m_db->getHandle(), m_limits);
 
         /* The error handling on SQLite commands are being taken care of by SQLiteCpp*/
-        if (query.getColumnCount() != 0)
+        if (query.getColumnCount() == 0)
         {
-            tabulate::Table::Row_t col_names;
-
-            /* Builds text/html output */
-            html_table << "<table>\n<tr>\n";
-
-            /* Iterates through cols name and build table's title row */
-            for (int col = 0; col < query.getColumnCount(); col++) {
-                std::string name = query.getColumnName(col);
-
-                /* Builds text/plain output */
-                col_names.push_back(name);
+            try
+            {
+                XSQL_TRACE_SPAN(exec, m_tracer, "exec", "sqlite");
+                query.exec();
+            }
+            catch (const std::exception&)
+            {
+                governor.throw_if_exceeded();
+                throw;
+            }
+            m_cell_rows += m_db->getChanges();
+            if (record)
+            {
+                record_plan(plan, code, start, m_db->getChanges());
+            }
+            if (m_batch.active)
+            {
+                ++m_batch.statements;
+                m_batch.rows += m_db->getChanges();
+            }
+            if (publish_tables && m_output_formats == output_none)
+            {
+                publish_summary(execution_counter,
+                                std::to_string(m_db->getChanges()) + " rows affected",
+                                start);
+            }
+            return;
+        }
 
-                /* Builds text/html output */
-                html_table << "<th>" << name << "</th>\n";
+        /* Only the requested outputs are built, none just steps through */
+        const bool render = publish_tables && m_output_formats != output_none;
+        const bool collect = render || xv_sqlite_df != nullptr;
+        result_table table;
+        add_columns(table, query);
 
-                /* Build application/vnd.vegalite.v3+json output */
-                xv_sqlite_df[name] = { "name" };
-            }
-            /* Builds text/plain output */
-            plain_table.add_row(col_names);
+        /* Rows are also copied to the pager while a frontend can page them */
+        const bool spill = render && pager_open();
+        if (spill)
+        {
+            m_pager.begin(query);
+        }
 
-            /* Builds text/html output */
-            html_table << "</tr>\n";
+        /* With the pager, the rows that no output shows are only in its spill database,
+           the buffer keeps the first and last rows that the outputs display */
+        std::size_t keep_head = 0;
+        std::size_t keep_tail = 0;
+        const bool bounded = spill && xv_sqlite_df == nullptr && displayed_rows(keep_head, keep_tail);
+        result_table tail_rows[2];
+        std::size_t tail_current = 0;
+        if (bounded && keep_tail != 0)
+        {
+            add_columns(tail_rows[0], query);
+            add_columns(tail_rows[1], query);
+        }
 
-            /* Iterates through cols' rows and builds different kinds of
-               outputs
-            */
+        std::size_t row_count = 0;
+        try
+        {
+            /* One span per batch of rows, a span per step would distort the timings */
+            XSQL_TRACE_SPAN(steps, m_tracer, "step", "sqlite");
             while (query.executeStep())
             {
-                /* Builds text/html output */
-                html_table << "<tr>\n";
-
-                tabulate::Table::Row_t row;
-
-                for (int col = 0; col < query.getColumnCount(); col++) {
-                    std::string col_name;
-                    col_name = query.getColumnName(col);
-                    std::string cell = query.getColumn(col);
-
-                    /* Builds text/plain output */
-                    row.push_back(cell);
+                ++row_count;
+                if (row_count % trace_step_rows == 0)
+                {
+                    steps.arg("rows", trace_step_rows);
+                    steps.restart();
+                }
+                if (bounded && row_count > keep_head)
+                {
+                    /* The last keep_tail rows are in the two halves of the tail buffer */
+                    if (keep_tail != 0)
+                    {
+                        if (tail_rows[tail_current].row_count() == keep_tail)
+                        {
+                            tail_current = 1 - tail_current;
+                            tail_rows[tail_current].clear_rows();
+                        }
+                        push_row(tail_rows[tail_current], query);
+                    }
+                }
+                else if (collect)
+                {
+                    push_row(table, query);
+                }
+                governor.count_row(collect ? &table : nullptr);
+                if (spill)
+                {
+                    m_pager.append(query);
+                }
+            }
+            steps.arg("rows", row_count % trace_step_rows);
+        }
+        catch (const std::exception&)
+        {
+            if (spill)
+            {
+                m_pager.discard();
+            }
+            governor.throw_if_exceeded();
+            throw;
+        }
+        if (bounded && row_count > keep_head)
+        {
+            const result_table& previous = tail_rows[1 - tail_current];
+            const result_table& current = tail_rows[tail_current];
+            const std::size_t from_previous = std::min(previous.row_count(), keep_tail - current.row_count());
+            for (std::size_t row = previous.row_count() - from_previous; row < previous.row_count(); ++row)
+            {
+                table.push_row(previous, row);
+            }
+            for (std::size_t row = 0; row < current.row_count(); ++row)
+            {
+                table.push_row(current, row);
+            }
+            table.set_omitted_rows(row_count - table.row_count());
+        }
+        m_cell_rows += static_cast<long long>(row_count);
+        if (record)
+        {
+            record_plan(plan, code, start, static_cast<long long>(row_count));
+        }
+        if (m_batch.active)
+        {
+            ++m_batch.statements;
+        }
 
-                    /* Builds text/html output */
-                    html_table << "<td>" << cell << "</td>\n";
+        /* Build application/vnd.vegalite.v3+json output */
+        if (xv_sqlite_df != nullptr)
+        {
+            XSQL_TRACE_SPAN(span, m_tracer, "xvega_data", "xvega");
+            for (std::size_t col = 0; col < table.column_count(); col++) {
+                std::vector<std::string>& values = (*xv_sqlite_df)[table.column_name(col)];
+                values = { "name" };
+                values.reserve(table.row_count() + 1);
+                for (std::size_t row = 0; row < table.row_count(); row++) {
+                    values.emplace_back(table.display(row, col));
+                }
+            }
+        }
 
-                    /* Build application/vnd.vegalite.v3+json output */
-                    xv_sqlite_df[col_name].push_back(cell);
+        if (publish_tables)
+        {
+            nl::json metadata = nl::json::object();
+            if (spill)
+            {
+                /* Results shown in full are not kept */
+                std::size_t shown = row_count;
+                if ((m_output_formats & output_text) && m_text_options.max_rows != 0)
+                {
+                    shown = std::min(shown, m_text_options.max_rows);
+                }
+                if ((m_output_formats & output_html) && m_html_options.max_rows != 0)
+                {
+                    shown = std::min(shown, m_html_options.max_rows);
+                }
+                if ((m_output_formats & (output_json | output_dataresource)) && m_dataresource_options.max_rows != 0)
+                {
+                    shown = std::min(shown, m_dataresource_options.max_rows);
+                }
+                if (shown < row_count)
+                {
+                    metadata[pager_comm_target] = m_pager.commit();
+                }
+                else
+                {
+                    m_pager.discard();
                 }
-                /* Builds text/html output */
-                html_table << "</tr>\n";
+            }
+            publish_table(execution_counter, table, row_count, start, std::move(metadata));
+        }
+    }
 
-                /* Builds text/plain output */
-                plain_table.add_row(row);
+    bool interpreter::displayed_rows(std::size_t& head, std::size_t& tail) const
+    {
+        head = 0;
+        tail = 0;
+        /* The text and html outputs show the first and last halves, the others the first rows */
+        const std::pair<unsigned, std::size_t> elided[] = {{output_text, m_text_options.max_rows},
+                                                           {output_html, m_html_options.max_rows}};
+        for (const auto& format : elided)
+        {
+            if (m_output_formats & format.first)
+            {
+                if (format.second == 0)
+                {
+                    return false;
+                }
+                head = std::max(head, (format.second + 1) / 2);
+                tail = std::max(tail, format.second / 2);
+            }
+        }
+        if (m_output_formats & (output_json | output_dataresource))
+        {
+            if (m_dataresource_options.max_rows == 0)
+            {
+                return false;
             }
-            /* Builds text/html output */
-            html_table << "</table>";
+            head = std::max(head, m_dataresource_options.max_rows);
+        }
+        return true;
+    }
+
+    void interpreter::publish_table(int execution_counter,
+                                    const result_table& table,
+                                    std::size_t row_count,
+                                    std::chrono::steady_clock::time_point start,
+                                    nl::json metadata)
+    {
+        output_usage& usage = m_output_usage;
+        usage.rows = row_count;
+        usage.table_bytes = table.memory_usage();
+        usage.rendered_bytes = 0;
+        usage.json_values = 0;
 
-            pub_data["text/plain"] = plain_table.str();
-            pub_data["text/html"] = html_table.str();
+        if (m_output_formats != output_none)
+        {
+            nl::json pub_data;
+            if (m_output_formats & output_text)
+            {
+                XSQL_TRACE_SPAN(span, m_tracer, "render_text", "render");
+                std::string text = render_text_table(table, m_text_options);
+                usage.rendered_bytes += text.size();
+                pub_data["text/plain"] = std::move(text);
+            }
+            if (m_output_formats & output_html)
+            {
+                XSQL_TRACE_SPAN(span, m_tracer, "render_html", "render");
+                std::string html = render_html_table(table, m_html_options);
+                usage.rendered_bytes += html.size();
+                pub_data["text/html"] = std::move(html);
+            }
+            /* The json and dataresource outputs send the same rows */
+            const std::size_t json_rows = m_dataresource_options.max_rows == 0
+                ? table.row_count()
+                : std::min(table.row_count(), m_dataresource_options.max_rows);
+            if (m_output_formats & output_json)
+            {
+                XSQL_TRACE_SPAN(span, m_tracer, "render_json", "render");
+                usage.json_values += json_rows * table.column_count();
+                pub_data["application/json"] = render_json_records(table, m_dataresource_options);
+            }
+            if (m_output_formats & output_dataresource)
+            {
+                XSQL_TRACE_SPAN(span, m_tracer, "render_dataresource", "render");
+                usage.json_values += json_rows * table.column_count();
+                pub_data["application/vnd.dataresource+json"] = render_dataresource(table, m_dataresource_options);
+            }
 
+            XSQL_TRACE_SPAN(span, m_tracer, "publish_execution_result", "publish");
             publish_execution_result(execution_counter,
                                      std::move(pub_data),
-                                     nl::json::object());
+                                     std::move(metadata));
         }
         else
         {
-            query.exec();
+            publish_summary(execution_counter, std::to_string(row_count) + " rows", start);
         }
+        usage.peak_table_bytes = std::max(usage.peak_table_bytes, usage.table_bytes);
+        usage.peak_rendered_bytes = std::max(usage.peak_rendered_bytes, usage.rendered_bytes);
+    }
+
+    void interpreter::publish_summary(int execution_counter,
+                                      const std::string& what,
+                                      std::chrono::steady_clock::time_point start)
+    {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        char timing[64];
+        std::snprintf(timing, sizeof(timing), " in %.3f ms", elapsed.count());
+
+        nl::json pub_data;
+        pub_data["text/plain"] = what + timing;
+        XSQL_TRACE_SPAN(span, m_tracer, "publish_execution_result", "publish");
+        publish_execution_result(execution_counter, std::move(pub_data), nl::json::object());
     }
 
    void interpreter::execute_request_impl(send_reply_callback cb,
@@ -388,71 +1941,69 @@ namespace xeus_sqlite
     {
         std::vector<std::string> traceback;
         nl::json jresult;
-        std::string sanitized_code = xv_bindings::sanitize_string(code);
-        std::vector<std::string> tokenized_input = xv_bindings::tokenizer(sanitized_code);
-
-        /* This structure is only used when xvega code is run */
-        //TODO: but it ends up being used in process_SQLite_input, that's why
-        //it's initialized here. Not the best approach, this should be
-        //compartimentilized under xvega domain.
-        xv::df_type xv_sqlite_df;
+        /* Cells that open or close the batch are not part of it */
+        const bool in_batch = m_batch.active;
+        m_maintenance.begin_activity();
+        const auto start = std::chrono::steady_clock::now();
+        m_cell_rows = 0;
+        XSQL_TRACE_SPAN(cell, m_tracer, "execute_request", "kernel");
+        cell.arg("execution_count", execution_counter);
 
         try
         {
             /* Runs magic */
-            if(xv_bindings::is_magic(tokenized_input))
+            if (is_magic(code))
             {
-                /* Removes "%" symbol */
-                tokenized_input[0].erase(0, 1);
-
-                /* Runs SQLite magic */
-                parse_SQLite_magic(execution_counter, tokenized_input);
-
-                /* Runs xvega magic and SQLite code */
-                if(xv_bindings::is_xvega(tokenized_input))
-                {
-                    /* Removes XVEGA_PLOT command */
-                    tokenized_input.erase(tokenized_input.begin());
-
-                    nl::json chart;
-                    std::vector<std::string> xvega_input, sqlite_input;
-
-                    std::tie(xvega_input, sqlite_input) = 
-                        xv_sqlite::split_xv_sqlite_input(tokenized_input);
-
-                    /* Stringfies SQLite code again */
-                    std::stringstream stringfied_sqlite_input;
-                    for (size_t i = 0; i < sqlite_input.size(); i++) {
-                        stringfied_sqlite_input << " " << sqlite_input[i];
-                    }
-
-                    process_SQLite_input(execution_counter,
-                                         m_db,
-                                         stringfied_sqlite_input.str(),
-                                         xv_sqlite_df);
-
-                    chart = xv_bindings::process_xvega_input(xvega_input,
-                                                           xv_sqlite_df);
-
-                    publish_execution_result(execution_counter,
-                                             std::move(chart),
-                                             nl::json::object());
-                }
+                XSQL_TRACE_SPAN(parse, m_tracer, "parse_magic", "kernel");
+                const magic_input input = parse_magic(code);
+                parse.end();
+                parse_SQLite_magic(execution_counter, input);
             }
             /* Runs SQLite code */
             else
             {
-                process_SQLite_input(execution_counter, m_db, code, xv_sqlite_df);
+                process_SQLite_input(execution_counter, m_db, code, nullptr);
+            }
+            if (in_batch && m_batch.active)
+            {
+                batch_cell_done();
             }
             jresult = xeus::create_successful_reply();
         }
         catch (const std::exception& err)
         {
-            traceback.push_back("Error: " + (std::string)err.what());
-            jresult = xeus::create_error_reply("Error", err.what(), traceback);
+            std::string message = err.what();
+            /* Magics such as %BLOB_IMPORT may have written part of their changes */
+            if (in_batch && m_batch.active && m_batch.ending_failed)
+            {
+                m_batch.ending_failed = false;
+            }
+            else if (in_batch && m_batch.active)
+            {
+                try
+                {
+                    message += "\n" + batch_cell_failed();
+                }
+                catch (const std::exception& rollback_err)
+                {
+                    message += "\nThe rollback failed: " + std::string(rollback_err.what());
+                }
+            }
+            traceback.push_back("Error: " + message);
+            jresult = xeus::create_error_reply("Error", message, traceback);
             publish_execution_error(jresult["ename"], jresult["evalue"], traceback);
             traceback.clear();
         }
+        m_maintenance.end_activity();
+        m_pager.evict_idle();
+        if (m_history != nullptr)
+        {
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            m_history->record_execution(execution_counter, elapsed.count(), m_cell_rows);
+        }
+        cell.end();
+        /* Each cell is on disk before the next one runs */
+        m_tracer.flush();
         cb(jresult);
     }
 
@@ -696,11 +2247,23 @@ namespace xeus_sqlite
 
     nl::json interpreter::shutdown_request_impl(bool /*restart*/)
     {
+        m_maintenance.stop();
+        m_prewarm.stop();
+        m_pager.clear();
+        m_tracer.stop();
         return xeus::create_shutdown_reply(false);
     }
 
     nl::json interpreter::interrupt_request_impl()
     {
+        /* Makes the running statement fail with SQLITE_INTERRUPT */
+        m_parallel_interrupted = true;
+        /* Held while interrupting, so that the connection is not closed meanwhile */
+        std::lock_guard<std::mutex> lock(m_interrupt_mutex);
+        if (p_interrupt_db != nullptr)
+        {
+            sqlite3_interrupt(p_interrupt_db);
+        }
         return xeus::create_interrupt_reply();
     }
 }
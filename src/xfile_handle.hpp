@@ -0,0 +1,48 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_XFILE_HANDLE_HPP
+#define XEUS_SQLITE_XFILE_HANDLE_HPP
+
+/* Internal header of the library sources, not installed */
+
+#include <cstdio>
+#include <string>
+
+namespace xeus_sqlite
+{
+    /* A stdio file closed on every path, file is null if it could not be opened */
+    struct file_handle
+    {
+        std::FILE* file = nullptr;
+
+        file_handle(const std::string& path, const char* mode)
+            : file(std::fopen(path.c_str(), mode))
+        {
+        }
+
+        ~file_handle()
+        {
+            close();
+        }
+
+        file_handle(const file_handle&) = delete;
+        file_handle& operator=(const file_handle&) = delete;
+
+        /* False if buffered writes could not be flushed */
+        bool close()
+        {
+            const bool closed = file == nullptr || std::fclose(file) == 0;
+            file = nullptr;
+            return closed;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,1276 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "xeus-sqlite/xfile_table.hpp"
+#include "xeus-sqlite/xmagic_parser.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Records between two entries of the offset index */
+        constexpr std::int64_t index_stride = 1024;
+        /* JSON lines read to find the column names */
+        constexpr std::size_t json_sample = 100;
+
+        /*****************
+         * mapped_file   *
+         *****************/
+
+        class mapped_file
+        {
+        public:
+
+            explicit mapped_file(const std::string& path)
+            {
+#ifdef _WIN32
+                HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                          nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                {
+                    throw std::runtime_error("Cannot open " + path + ".");
+                }
+                LARGE_INTEGER size;
+                if (!GetFileSizeEx(file, &size))
+                {
+                    CloseHandle(file);
+                    throw std::runtime_error("Cannot read the size of " + path + ".");
+                }
+                m_size = static_cast<std::size_t>(size.QuadPart);
+                if (m_size != 0)
+                {
+                    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (mapping != nullptr)
+                    {
+                        m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                        CloseHandle(mapping);
+                    }
+                }
+                CloseHandle(file);
+#else
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                {
+                    throw std::runtime_error("Cannot open " + path + ".");
+                }
+                struct stat info;
+                if (::fstat(fd, &info) != 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("Cannot read the size of " + path + ".");
+                }
+                m_size = static_cast<std::size_t>(info.st_size);
+                if (m_size != 0)
+                {
+                    void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data != MAP_FAILED)
+                    {
+                        m_data = static_cast<const char*>(data);
+#ifdef MADV_SEQUENTIAL
+                        ::madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+                    }
+                }
+                ::close(fd);
+#endif
+                if (m_size != 0 && m_data == nullptr)
+                {
+                    throw std::runtime_error("Cannot map " + path + " in memory.");
+                }
+            }
+
+            ~mapped_file()
+            {
+                if (m_data != nullptr)
+                {
+#ifdef _WIN32
+                    UnmapViewOfFile(m_data);
+#else
+                    ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+                }
+            }
+
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            const char* data() const noexcept
+            {
+                return m_data;
+            }
+
+            std::size_t size() const noexcept
+            {
+                return m_size;
+            }
+
+        private:
+
+            const char* m_data = nullptr;
+            std::size_t m_size = 0;
+        };
+
+        /*********************
+         * records and fields *
+         *********************/
+
+        enum class file_format
+        {
+            csv,
+            jsonl
+        };
+
+        /* Module client data, their address is passed to SQLite */
+        file_format csv_format = file_format::csv;
+        file_format jsonl_format = file_format::jsonl;
+
+        enum class field_kind
+        {
+            missing,
+            text,
+            escaped_text,
+            number,
+            true_value,
+            false_value,
+            null_value,
+            raw_json
+        };
+
+        /* Slice of the mapping, decoded only when the column is read */
+        struct field
+        {
+            const char* data = nullptr;
+            std::size_t size = 0;
+            field_kind kind = field_kind::missing;
+        };
+
+        struct file_table : sqlite3_vtab
+        {
+            file_table()
+                : sqlite3_vtab()
+            {
+            }
+
+            std::unique_ptr<mapped_file> file;
+            file_format format = file_format::csv;
+            char delimiter = ',';
+            std::size_t data_start = 0;
+            std::vector<std::string> columns;
+            /* Keys are views on columns */
+            std::unordered_map<std::string_view, int> json_columns;
+            /* offsets[k] is where record k * index_stride starts */
+            std::vector<std::size_t> offsets;
+            /* Known once a scan reached the end of the file */
+            std::int64_t row_count = -1;
+        };
+
+        struct file_cursor : sqlite3_vtab_cursor
+        {
+            file_cursor()
+                : sqlite3_vtab_cursor()
+            {
+            }
+
+            std::size_t pos = 0;
+            std::size_t end = 0;
+            std::size_t next = 0;
+            std::int64_t row = -1;
+            std::int64_t last_row = std::numeric_limits<std::int64_t>::max();
+            bool eof = true;
+
+            bool parsed = false;
+            std::vector<field> fields;
+            std::string key_buffer;
+            std::string value_buffer;
+            std::vector<std::pair<int, std::string>> filters;
+        };
+
+        inline bool is_blank(const char* p, const char* e)
+        {
+            return std::all_of(p, e, [](char c) { return c == ' ' || c == '\t'; });
+        }
+
+        /* A newline inside a quoted CSV field does not end the record */
+        std::size_t record_end(const file_table& table, std::size_t pos)
+        {
+            const char* data = table.file->data();
+            const std::size_t size = table.file->size();
+            const void* newline = std::memchr(data + pos, '\n', size - pos);
+            const std::size_t line_end = newline != nullptr
+                ? static_cast<std::size_t>(static_cast<const char*>(newline) - data) : size;
+            if (table.format == file_format::csv && std::memchr(data + pos, '"', line_end - pos) != nullptr)
+            {
+                bool quoted = false;
+                for (std::size_t i = pos; i < size; ++i)
+                {
+                    if (data[i] == '"')
+                    {
+                        quoted = !quoted;
+                    }
+                    else if (data[i] == '\n' && !quoted)
+                    {
+                        return i;
+                    }
+                }
+                return size;
+            }
+            return line_end;
+        }
+
+        /* Finds the record starting at or after pos, blank lines are skipped */
+        bool find_record(const file_table& table, std::size_t& pos, std::size_t& end, std::size_t& next)
+        {
+            const char* data = table.file->data();
+            const std::size_t size = table.file->size();
+            while (pos < size)
+            {
+                next = record_end(table, pos);
+                end = next;
+                if (end > pos && data[end - 1] == '\r')
+                {
+                    --end;
+                }
+                if (next < size)
+                {
+                    ++next;
+                }
+                if (!is_blank(data + pos, data + end))
+                {
+                    return true;
+                }
+                pos = next;
+            }
+            return false;
+        }
+
+        void split_csv(const char* p, const char* e, char delimiter, std::vector<field>& fields)
+        {
+            fields.clear();
+            while (true)
+            {
+                field f;
+                f.kind = field_kind::text;
+                if (p < e && *p == '"')
+                {
+                    f.data = ++p;
+                    while (p < e)
+                    {
+                        if (*p == '"')
+                        {
+                            if (p + 1 < e && p[1] == '"')
+                            {
+                                f.kind = field_kind::escaped_text;
+                                p += 2;
+                                continue;
+                            }
+                            break;
+                        }
+                        ++p;
+                    }
+                    f.size = static_cast<std::size_t>(p - f.data);
+                    const void* stop = std::memchr(p, delimiter, static_cast<std::size_t>(e - p));
+                    p = stop != nullptr ? static_cast<const char*>(stop) : e;
+                }
+                else
+                {
+                    const void* stop = std::memchr(p, delimiter, static_cast<std::size_t>(e - p));
+                    const char* field_end = stop != nullptr ? static_cast<const char*>(stop) : e;
+                    f.data = p;
+                    f.size = static_cast<std::size_t>(field_end - p);
+                    p = field_end;
+                }
+                fields.push_back(f);
+                if (p >= e)
+                {
+                    break;
+                }
+                ++p;
+            }
+        }
+
+        void decode_csv(const field& f, std::string& out)
+        {
+            out.clear();
+            for (std::size_t i = 0; i < f.size; ++i)
+            {
+                out += f.data[i];
+                if (f.data[i] == '"' && i + 1 < f.size && f.data[i + 1] == '"')
+                {
+                    ++i;
+                }
+            }
+        }
+
+        /*************
+         * JSON lines *
+         *************/
+
+        inline const char* skip_json_spaces(const char* p, const char* e)
+        {
+            while (p < e && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            {
+                ++p;
+            }
+            return p;
+        }
+
+        /* p is after the opening quote, returns the closing quote */
+        const char* skip_json_string(const char* p, const char* e, bool& escaped)
+        {
+            while (p < e)
+            {
+                if (*p == '\\')
+                {
+                    escaped = true;
+                    p = e - p > 1 ? p + 2 : e;
+                }
+                else if (*p == '"')
+                {
+                    return p;
+                }
+                else
+                {
+                    ++p;
+                }
+            }
+            return e;
+        }
+
+        /* Returns the end of the value starting at p */
+        const char* read_json_value(const char* p, const char* e, field& f)
+        {
+            f.data = p;
+            if (p >= e)
+            {
+                f.kind = field_kind::missing;
+                return e;
+            }
+            if (*p == '"')
+            {
+                bool escaped = false;
+                const char* close = skip_json_string(p + 1, e, escaped);
+                f.data = p + 1;
+                f.size = static_cast<std::size_t>(close - f.data);
+                f.kind = escaped ? field_kind::escaped_text : field_kind::text;
+                return close < e ? close + 1 : e;
+            }
+            if (*p == '{' || *p == '[')
+            {
+                int depth = 0;
+                const char* q = p;
+                while (q < e)
+                {
+                    if (*q == '"')
+                    {
+                        bool escaped = false;
+                        q = skip_json_string(q + 1, e, escaped);
+                        q = q < e ? q + 1 : e;
+                        continue;
+                    }
+                    if (*q == '{' || *q == '[')
+                    {
+                        ++depth;
+                    }
+                    else if ((*q == '}' || *q == ']') && --depth == 0)
+                    {
+                        ++q;
+                        break;
+                    }
+                    ++q;
+                }
+                f.size = static_cast<std::size_t>(q - p);
+                f.kind = field_kind::raw_json;
+                return q;
+            }
+
+            const char* q = p;
+            while (q < e && *q != ',' && *q != '}' && *q != ']' && *q != ' ' && *q != '\t' && *q != '\r')
+            {
+                ++q;
+            }
+            f.size = static_cast<std::size_t>(q - p);
+            std::string_view token(p, f.size);
+            f.kind = token == "true" ? field_kind::true_value
+                   : token == "false" ? field_kind::false_value
+                   : token == "null" ? field_kind::null_value
+                   : field_kind::number;
+            return q;
+        }
+
+        int hex_value(const char* p)
+        {
+            int value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = p[i];
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                          : -1;
+                if (digit < 0)
+                {
+                    return -1;
+                }
+                value = value * 16 + digit;
+            }
+            return value;
+        }
+
+        void append_utf8(std::string& out, std::uint32_t cp)
+        {
+            if (cp < 0x80)
+            {
+                out += static_cast<char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        void decode_json(const char* p, std::size_t size, std::string& out)
+        {
+            out.clear();
+            const char* e = p + size;
+            while (p < e)
+            {
+                if (*p != '\\' || e - p < 2)
+                {
+                    out += *p++;
+                    continue;
+                }
+                char escape = p[1];
+                p += 2;
+                switch (escape)
+                {
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u':
+                    {
+                        int cp = e - p >= 4 ? hex_value(p) : -1;
+                        if (cp < 0)
+                        {
+                            out += "\\u";
+                            break;
+                        }
+                        p += 4;
+                        std::uint32_t code = static_cast<std::uint32_t>(cp);
+                        if (cp >= 0xD800 && cp <= 0xDBFF && e - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                        {
+                            int low = hex_value(p + 2);
+                            if (low >= 0xDC00 && low <= 0xDFFF)
+                            {
+                                code = 0x10000 + ((code - 0xD800) << 10) + static_cast<std::uint32_t>(low - 0xDC00);
+                                p += 6;
+                            }
+                        }
+                        append_utf8(out, code);
+                        break;
+                    }
+                    default: out += escape; break;
+                }
+            }
+        }
+
+        /* Calls callback(name, value) for each member of the object */
+        template <class F>
+        void for_each_member(const char* p, const char* e, std::string& key_buffer, F&& callback)
+        {
+            p = skip_json_spaces(p, e);
+            if (p >= e || *p != '{')
+            {
+                return;
+            }
+            ++p;
+            while (true)
+            {
+                p = skip_json_spaces(p, e);
+                if (p >= e || *p != '"')
+                {
+                    return;
+                }
+                bool escaped = false;
+                const char* key = p + 1;
+                p = skip_json_string(key, e, escaped);
+                if (p >= e)
+                {
+                    return;
+                }
+                std::string_view name(key, static_cast<std::size_t>(p - key));
+                if (escaped)
+                {
+                    decode_json(key, name.size(), key_buffer);
+                    name = key_buffer;
+                }
+                p = skip_json_spaces(p + 1, e);
+                if (p >= e || *p != ':')
+                {
+                    return;
+                }
+                field value;
+                p = read_json_value(skip_json_spaces(p + 1, e), e, value);
+                callback(name, value);
+                p = skip_json_spaces(p, e);
+                if (p >= e || *p != ',')
+                {
+                    return;
+                }
+                ++p;
+            }
+        }
+
+        /**********
+         * cursor *
+         **********/
+
+        inline file_table& table_of(file_cursor& cursor)
+        {
+            return *static_cast<file_table*>(cursor.pVtab);
+        }
+
+        void parse_record(file_cursor& cursor)
+        {
+            if (cursor.parsed)
+            {
+                return;
+            }
+            file_table& table = table_of(cursor);
+            const char* data = table.file->data();
+            if (table.format == file_format::csv)
+            {
+                split_csv(data + cursor.pos, data + cursor.end, table.delimiter, cursor.fields);
+            }
+            else
+            {
+                cursor.fields.assign(table.columns.size(), field());
+                for_each_member(data + cursor.pos, data + cursor.end, cursor.key_buffer,
+                    [&](std::string_view name, const field& value)
+                    {
+                        auto it = table.json_columns.find(name);
+                        if (it != table.json_columns.end())
+                        {
+                            cursor.fields[static_cast<std::size_t>(it->second)] = value;
+                        }
+                    });
+            }
+            cursor.parsed = true;
+        }
+
+        /* Moves to the next record and extends the offset index */
+        void step(file_cursor& cursor)
+        {
+            file_table& table = table_of(cursor);
+            std::size_t pos = cursor.next;
+            if (cursor.row >= cursor.last_row)
+            {
+                cursor.eof = true;
+                return;
+            }
+            if (!find_record(table, pos, cursor.end, cursor.next))
+            {
+                table.row_count = cursor.row + 1;
+                cursor.eof = true;
+                return;
+            }
+            cursor.pos = pos;
+            cursor.parsed = false;
+            ++cursor.row;
+            if (cursor.row % index_stride == 0 &&
+                cursor.row / index_stride == static_cast<std::int64_t>(table.offsets.size()))
+            {
+                table.offsets.push_back(pos);
+            }
+        }
+
+        /* Starts from the closest indexed record before the target */
+        void seek(file_cursor& cursor, std::int64_t target)
+        {
+            file_table& table = table_of(cursor);
+            const std::int64_t block = std::min(target / index_stride,
+                                                static_cast<std::int64_t>(table.offsets.size()) - 1);
+            if (block < 0)
+            {
+                cursor.row = -1;
+                cursor.next = table.data_start;
+            }
+            else
+            {
+                cursor.row = block * index_stride - 1;
+                cursor.next = table.offsets[static_cast<std::size_t>(block)];
+            }
+            cursor.eof = false;
+            do
+            {
+                step(cursor);
+            }
+            while (!cursor.eof && cursor.row < target);
+        }
+
+        /* Filters are only a shortcut, SQLite checks the constraints again */
+        bool matches(file_cursor& cursor)
+        {
+            if (cursor.filters.empty())
+            {
+                return true;
+            }
+            parse_record(cursor);
+            for (const auto& filter : cursor.filters)
+            {
+                const std::size_t col = static_cast<std::size_t>(filter.first);
+                const field f = col < cursor.fields.size() ? cursor.fields[col] : field();
+                std::string_view value;
+                switch (f.kind)
+                {
+                    case field_kind::text:
+                    case field_kind::raw_json:
+                        value = std::string_view(f.data, f.size);
+                        break;
+                    case field_kind::escaped_text:
+                        if (table_of(cursor).format == file_format::csv)
+                        {
+                            decode_csv(f, cursor.value_buffer);
+                        }
+                        else
+                        {
+                            decode_json(f.data, f.size, cursor.value_buffer);
+                        }
+                        value = cursor.value_buffer;
+                        break;
+                    default:
+                        return false;
+                }
+                if (value != filter.second)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void advance(file_cursor& cursor)
+        {
+            do
+            {
+                step(cursor);
+            }
+            while (!cursor.eof && !matches(cursor));
+        }
+
+        /*************
+         * xConnect  *
+         *************/
+
+        std::string unquote(std::string_view value)
+        {
+            if (value.size() >= 2 && (value.front() == '\'' || value.front() == '"') && value.back() == value.front())
+            {
+                std::string result;
+                for (std::size_t i = 1; i + 1 < value.size(); ++i)
+                {
+                    result += value[i];
+                    if (value[i] == value.front() && i + 2 < value.size() && value[i + 1] == value.front())
+                    {
+                        ++i;
+                    }
+                }
+                return result;
+            }
+            return std::string(value);
+        }
+
+        std::string quote_identifier(const std::string& name)
+        {
+            std::string quoted = "\"";
+            for (char c : name)
+            {
+                quoted += c;
+                if (c == '"')
+                {
+                    quoted += '"';
+                }
+            }
+            return quoted + "\"";
+        }
+
+        std::string extension_of(const std::string& path)
+        {
+            return to_upper(std::filesystem::path(path).extension().string());
+        }
+
+        /* Names are made unique, SQLite compares them case insensitively */
+        void add_column(file_table& table, std::string name, std::unordered_set<std::string>& seen)
+        {
+            if (name.empty())
+            {
+                name = "c" + std::to_string(table.columns.size() + 1);
+            }
+            if (!seen.insert(to_upper(name)).second)
+            {
+                name += "_" + std::to_string(table.columns.size() + 1);
+                seen.insert(to_upper(name));
+            }
+            table.columns.push_back(std::move(name));
+        }
+
+        void read_csv_columns(file_table& table, const std::string& path, bool header)
+        {
+            std::unordered_set<std::string> seen;
+            std::size_t pos = table.data_start;
+            std::size_t end = 0;
+            std::size_t next = 0;
+            if (!find_record(table, pos, end, next))
+            {
+                throw std::runtime_error("The file " + path + " is empty.");
+            }
+
+            std::vector<field> fields;
+            split_csv(table.file->data() + pos, table.file->data() + end, table.delimiter, fields);
+            std::string name;
+            for (const field& f : fields)
+            {
+                if (header)
+                {
+                    decode_csv(f, name);
+                }
+                add_column(table, header ? name : std::string(), seen);
+            }
+            table.data_start = header ? next : pos;
+        }
+
+        void read_json_columns(file_table& table, const std::string& path)
+        {
+            std::unordered_set<std::string> seen;
+            std::string key_buffer;
+            std::size_t pos = table.data_start;
+            std::size_t end = 0;
+            std::size_t next = 0;
+            for (std::size_t i = 0; i < json_sample && find_record(table, pos, end, next); ++i, pos = next)
+            {
+                for_each_member(table.file->data() + pos, table.file->data() + end, key_buffer,
+                    [&](std::string_view name, const field&)
+                    {
+                        if (seen.count(to_upper(name)) == 0)
+                        {
+                            add_column(table, std::string(name), seen);
+                        }
+                    });
+            }
+            if (table.columns.empty())
+            {
+                throw std::runtime_error("No JSON object found in the first lines of " + path + ".");
+            }
+            for (std::size_t i = 0; i < table.columns.size(); ++i)
+            {
+                table.json_columns.emplace(table.columns[i], static_cast<int>(i));
+            }
+        }
+
+        int file_connect(sqlite3* db, void* aux, int argc, const char* const* argv,
+                         sqlite3_vtab** vtab, char** error)
+        {
+            auto table = std::make_unique<file_table>();
+            table->format = *static_cast<file_format*>(aux);
+            try
+            {
+                std::string path;
+                std::string delimiter;
+                bool header = true;
+                for (int i = 3; i < argc; ++i)
+                {
+                    std::string_view key;
+                    std::string_view value;
+                    std::string_view arg(argv[i]);
+                    if (!split_option(arg, key, value))
+                    {
+                        throw std::runtime_error("Invalid argument " + std::string(arg) + ", expected key=value.");
+                    }
+                    while (!key.empty() && key.back() == ' ')
+                    {
+                        key.remove_suffix(1);
+                    }
+                    while (!value.empty() && value.front() == ' ')
+                    {
+                        value.remove_prefix(1);
+                    }
+                    if (iequals(key, "path"))
+                    {
+                        path = unquote(value);
+                    }
+                    else if (iequals(key, "delimiter") && table->format == file_format::csv)
+                    {
+                        delimiter = unquote(value);
+                    }
+                    else if (iequals(key, "header") && table->format == file_format::csv)
+                    {
+                        std::string flag = to_upper(unquote(value));
+                        header = flag == "YES" || flag == "TRUE" || flag == "ON" || flag == "1";
+                    }
+                    else
+                    {
+                        throw std::runtime_error("Unknown argument " + std::string(key) + ".");
+                    }
+                }
+                if (path.empty())
+                {
+                    throw std::runtime_error("Missing argument, for instance path='data.csv'.");
+                }
+
+                if (delimiter.empty())
+                {
+                    std::string extension = extension_of(path);
+                    table->delimiter = extension == ".TSV" || extension == ".TAB" ? '\t' : ',';
+                }
+                else if (iequals(delimiter, "tab") || delimiter == "\\t")
+                {
+                    table->delimiter = '\t';
+                }
+                else if (delimiter.size() == 1 && delimiter != "\"")
+                {
+                    table->delimiter = delimiter.front();
+                }
+                else
+                {
+                    throw std::runtime_error("The delimiter must be a single character.");
+                }
+
+                table->file = std::make_unique<mapped_file>(path);
+                if (table->file->size() >= 3 && std::memcmp(table->file->data(), "\xEF\xBB\xBF", 3) == 0)
+                {
+                    table->data_start = 3;
+                }
+
+                std::string schema = "CREATE TABLE x(";
+                if (table->format == file_format::csv)
+                {
+                    read_csv_columns(*table, path, header);
+                }
+                else
+                {
+                    read_json_columns(*table, path);
+                }
+                for (std::size_t i = 0; i < table->columns.size(); ++i)
+                {
+                    schema += (i == 0 ? "" : ", ") + quote_identifier(table->columns[i]) +
+                              (table->format == file_format::csv ? " TEXT" : "");
+                }
+                schema += ")";
+
+                if (sqlite3_declare_vtab(db, schema.c_str()) != SQLITE_OK)
+                {
+                    throw std::runtime_error(sqlite3_errmsg(db));
+                }
+            }
+            catch (const std::exception& err)
+            {
+                *error = sqlite3_mprintf("%s", err.what());
+                return SQLITE_ERROR;
+            }
+            *vtab = table.release();
+            return SQLITE_OK;
+        }
+
+        int file_disconnect(sqlite3_vtab* vtab)
+        {
+            delete static_cast<file_table*>(vtab);
+            return SQLITE_OK;
+        }
+
+        std::int64_t estimated_rows(const file_table& table)
+        {
+            if (table.row_count >= 0)
+            {
+                return std::max<std::int64_t>(table.row_count, 1);
+            }
+            const double bytes = static_cast<double>(table.file->size() - table.data_start);
+            double record_size = 100.0;
+            if (table.offsets.size() > 1)
+            {
+                record_size = static_cast<double>(table.offsets.back() - table.offsets.front()) /
+                              static_cast<double>((table.offsets.size() - 1) * index_stride);
+            }
+            return std::max<std::int64_t>(static_cast<std::int64_t>(bytes / record_size), 1);
+        }
+
+        /* The plan passed to xFilter is one token per argument: r=, r>, r>=,
+           r<, r<= for the rowid, c<index> for a column equality */
+        int file_best_index(sqlite3_vtab* vtab, sqlite3_index_info* info)
+        {
+            const file_table& table = *static_cast<file_table*>(vtab);
+            std::string plan;
+            int argument = 0;
+            bool rowid_equal = false;
+            bool lower = false;
+            bool upper = false;
+            int filters = 0;
+
+            for (int i = 0; i < info->nConstraint; ++i)
+            {
+                const auto& constraint = info->aConstraint[i];
+                if (!constraint.usable)
+                {
+                    continue;
+                }
+                std::string token;
+                if (constraint.iColumn < 0)
+                {
+                    const unsigned char op = constraint.op;
+                    if (op == SQLITE_INDEX_CONSTRAINT_EQ && !rowid_equal)
+                    {
+                        rowid_equal = true;
+                        token = "r=";
+                    }
+                    else if ((op == SQLITE_INDEX_CONSTRAINT_GT || op == SQLITE_INDEX_CONSTRAINT_GE) && !lower)
+                    {
+                        lower = true;
+                        token = op == SQLITE_INDEX_CONSTRAINT_GT ? "r>" : "r>=";
+                    }
+                    else if ((op == SQLITE_INDEX_CONSTRAINT_LT || op == SQLITE_INDEX_CONSTRAINT_LE) && !upper)
+                    {
+                        upper = true;
+                        token = op == SQLITE_INDEX_CONSTRAINT_LT ? "r<" : "r<=";
+                    }
+                }
+                else if (constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+                {
+                    const char* collation = sqlite3_vtab_collation(info, i);
+                    if (collation == nullptr || iequals(collation, "BINARY"))
+                    {
+                        token = "c" + std::to_string(constraint.iColumn);
+                        ++filters;
+                    }
+                }
+                if (!token.empty())
+                {
+                    info->aConstraintUsage[i].argvIndex = ++argument;
+                    plan += (plan.empty() ? "" : " ") + token;
+                }
+            }
+
+            const std::int64_t rows = estimated_rows(table);
+            if (rowid_equal)
+            {
+                info->estimatedRows = 1;
+                info->estimatedCost = 10.0;
+                info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+            }
+            else
+            {
+                const double scanned = static_cast<double>(rows) * (lower || upper ? 0.25 : 1.0);
+                info->estimatedRows = std::max<std::int64_t>(
+                    static_cast<std::int64_t>(scanned / (filters == 0 ? 1.0 : 10.0 * filters)), 1);
+                info->estimatedCost = scanned * (filters == 0 ? 1.0 : 0.5);
+            }
+            if (info->nOrderBy == 1 && info->aOrderBy[0].iColumn < 0 && !info->aOrderBy[0].desc)
+            {
+                info->orderByConsumed = 1;
+            }
+            info->idxStr = sqlite3_mprintf("%s", plan.c_str());
+            info->needToFreeIdxStr = 1;
+            return SQLITE_OK;
+        }
+
+        int file_open(sqlite3_vtab*, sqlite3_vtab_cursor** cursor)
+        {
+            *cursor = new (std::nothrow) file_cursor();
+            return *cursor != nullptr ? SQLITE_OK : SQLITE_NOMEM;
+        }
+
+        int file_close(sqlite3_vtab_cursor* cursor)
+        {
+            delete static_cast<file_cursor*>(cursor);
+            return SQLITE_OK;
+        }
+
+        /* Floor and ceiling of a rowid bound, false if it is not a number */
+        bool rowid_bound(sqlite3_value* value, std::int64_t& floor_value, std::int64_t& ceil_value)
+        {
+            const int type = sqlite3_value_numeric_type(value);
+            if (type == SQLITE_INTEGER)
+            {
+                floor_value = ceil_value = sqlite3_value_int64(value);
+                return true;
+            }
+            if (type == SQLITE_FLOAT)
+            {
+                const double bound = std::max(-1e18, std::min(1e18, sqlite3_value_double(value)));
+                floor_value = static_cast<std::int64_t>(std::floor(bound));
+                ceil_value = static_cast<std::int64_t>(std::ceil(bound));
+                return true;
+            }
+            return false;
+        }
+
+        int file_filter(sqlite3_vtab_cursor* base, int, const char* plan, int argc, sqlite3_value** argv)
+        {
+            file_cursor& cursor = *static_cast<file_cursor*>(base);
+            const file_table& table = table_of(cursor);
+            cursor.filters.clear();
+            cursor.last_row = std::numeric_limits<std::int64_t>::max();
+            std::int64_t first_row = 0;
+            bool empty = false;
+
+            /* Bounds are on the rowid, rows are numbered from 0 */
+            std::vector<std::string_view> tokens = split_arguments(plan != nullptr ? plan : "");
+            for (std::size_t i = 0; i < tokens.size() && static_cast<int>(i) < argc; ++i)
+            {
+                std::string_view token = tokens[i];
+                sqlite3_value* value = argv[i];
+                if (token.front() == 'c')
+                {
+                    const int type = sqlite3_value_type(value);
+                    if (type == SQLITE_NULL)
+                    {
+                        empty = true;
+                    }
+                    /* CSV columns have TEXT affinity, numbers are compared as text */
+                    else if (type == SQLITE_TEXT ||
+                             (table.format == file_format::csv && (type == SQLITE_INTEGER || type == SQLITE_FLOAT)))
+                    {
+                        const char* text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+                        int column = 0;
+                        std::from_chars(token.data() + 1, token.data() + token.size(), column);
+                        cursor.filters.emplace_back(column, std::string(text, static_cast<std::size_t>(sqlite3_value_bytes(value))));
+                    }
+                    continue;
+                }
+
+                std::int64_t floor_value = 0;
+                std::int64_t ceil_value = 0;
+                if (!rowid_bound(value, floor_value, ceil_value))
+                {
+                    continue;
+                }
+                if (token == "r=")
+                {
+                    empty = empty || floor_value != ceil_value;
+                    first_row = std::max(first_row, floor_value - 1);
+                    cursor.last_row = std::min(cursor.last_row, floor_value - 1);
+                }
+                else if (token == "r>")
+                {
+                    first_row = std::max(first_row, floor_value);
+                }
+                else if (token == "r>=")
+                {
+                    first_row = std::max(first_row, ceil_value - 1);
+                }
+                else if (token == "r<")
+                {
+                    cursor.last_row = std::min(cursor.last_row, ceil_value - 2);
+                }
+                else if (token == "r<=")
+                {
+                    cursor.last_row = std::min(cursor.last_row, floor_value - 1);
+                }
+            }
+
+            if (empty || first_row > cursor.last_row)
+            {
+                cursor.eof = true;
+                return SQLITE_OK;
+            }
+            seek(cursor, first_row);
+            if (!cursor.eof && !matches(cursor))
+            {
+                advance(cursor);
+            }
+            return SQLITE_OK;
+        }
+
+        int file_next(sqlite3_vtab_cursor* base)
+        {
+            advance(*static_cast<file_cursor*>(base));
+            return SQLITE_OK;
+        }
+
+        int file_eof(sqlite3_vtab_cursor* base)
+        {
+            return static_cast<file_cursor*>(base)->eof ? 1 : 0;
+        }
+
+        void result_number(sqlite3_context* context, const field& f)
+        {
+            std::int64_t integer = 0;
+            auto parsed = std::from_chars(f.data, f.data + f.size, integer);
+            if (parsed.ec == std::errc() && parsed.ptr == f.data + f.size)
+            {
+                sqlite3_result_int64(context, integer);
+                return;
+            }
+            std::string text(f.data, f.size);
+            char* end = nullptr;
+            double number = std::strtod(text.c_str(), &end);
+            if (!text.empty() && end == text.c_str() + text.size())
+            {
+                sqlite3_result_double(context, number);
+            }
+            else
+            {
+                sqlite3_result_text64(context, f.data, f.size, SQLITE_STATIC, SQLITE_UTF8);
+            }
+        }
+
+        /* Text is returned in place, only escaped values are copied */
+        int file_column(sqlite3_vtab_cursor* base, sqlite3_context* context, int col)
+        {
+            file_cursor& cursor = *static_cast<file_cursor*>(base);
+            parse_record(cursor);
+            const std::size_t index = static_cast<std::size_t>(col);
+            const field f = index < cursor.fields.size() ? cursor.fields[index] : field();
+            switch (f.kind)
+            {
+                case field_kind::text:
+                    sqlite3_result_text64(context, f.data, f.size, SQLITE_STATIC, SQLITE_UTF8);
+                    break;
+                case field_kind::escaped_text:
+                    if (table_of(cursor).format == file_format::csv)
+                    {
+                        decode_csv(f, cursor.value_buffer);
+                    }
+                    else
+                    {
+                        decode_json(f.data, f.size, cursor.value_buffer);
+                    }
+                    sqlite3_result_text64(context, cursor.value_buffer.data(), cursor.value_buffer.size(),
+                                          SQLITE_TRANSIENT, SQLITE_UTF8);
+                    break;
+                case field_kind::number:
+                    result_number(context, f);
+                    break;
+                case field_kind::true_value:
+                    sqlite3_result_int(context, 1);
+                    break;
+                case field_kind::false_value:
+                    sqlite3_result_int(context, 0);
+                    break;
+                case field_kind::raw_json:
+                    sqlite3_result_text64(context, f.data, f.size, SQLITE_STATIC, SQLITE_UTF8);
+                    sqlite3_result_subtype(context, 'J');
+                    break;
+                default:
+                    sqlite3_result_null(context);
+                    break;
+            }
+            return SQLITE_OK;
+        }
+
+        int file_rowid(sqlite3_vtab_cursor* base, sqlite3_int64* rowid)
+        {
+            *rowid = static_cast<file_cursor*>(base)->row + 1;
+            return SQLITE_OK;
+        }
+
+        const sqlite3_module& file_module()
+        {
+            static const sqlite3_module module = []()
+            {
+                sqlite3_module m = {};
+                m.xCreate = file_connect;
+                m.xConnect = file_connect;
+                m.xBestIndex = file_best_index;
+                m.xDisconnect = file_disconnect;
+                m.xDestroy = file_disconnect;
+                m.xOpen = file_open;
+                m.xClose = file_close;
+                m.xFilter = file_filter;
+                m.xNext = file_next;
+                m.xEof = file_eof;
+                m.xColumn = file_column;
+                m.xRowid = file_rowid;
+                return m;
+            }();
+            return module;
+        }
+    }
+
+    void register_file_tables(sqlite3* db)
+    {
+        for (auto module : { std::make_pair("xcsv", &csv_format), std::make_pair("xjsonl", &jsonl_format) })
+        {
+            if (sqlite3_create_module_v2(db, module.first, &file_module(), module.second, nullptr) != SQLITE_OK)
+            {
+                throw std::runtime_error(std::string("Could not register ") + module.first + ": " + sqlite3_errmsg(db));
+            }
+        }
+    }
+
+    std::string file_table_module(const std::string& path)
+    {
+        std::string extension = extension_of(path);
+        return extension == ".JSONL" || extension == ".NDJSON" || extension == ".JSON" ? "xjsonl" : "xcsv";
+    }
+
+    std::string file_table_name(const std::string& path)
+    {
+        std::string name = std::filesystem::path(path).stem().string();
+        for (char& c : name)
+        {
+            if (!std::isalnum(static_cast<unsigned char>(c)))
+            {
+                c = '_';
+            }
+        }
+        if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front())))
+        {
+            name.insert(0, "t_");
+        }
+        return name;
+    }
+}
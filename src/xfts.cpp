@@ -0,0 +1,250 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdint>
+#include <stdexcept>
+
+#include "xeus-sqlite/xfts.hpp"
+#include "xeus-sqlite/xmagic_parser.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        const char* const trigger_suffixes[] = {"_insert", "_delete", "_update"};
+
+        std::string quote_literal(const std::string& text)
+        {
+            std::string quoted = "'";
+            for (char c : text)
+            {
+                quoted += c;
+                if (c == '\'')
+                {
+                    quoted += c;
+                }
+            }
+            return quoted + "'";
+        }
+
+        /* prefix.col1, prefix.col2... */
+        std::string column_list(const std::vector<std::string>& columns, const std::string& prefix)
+        {
+            std::string list;
+            for (const std::string& column : columns)
+            {
+                list += (list.empty() ? "" : ", ") + prefix + quote_identifier(column);
+            }
+            return list;
+        }
+
+        bool index_exists(SQLite::Database& db, const qualified_name& name)
+        {
+            SQLite::Statement query(db, "SELECT 1 FROM " + quote_identifier(name.schema) +
+                                        ".sqlite_master WHERE type = 'table' AND name = ?");
+            query.bind(1, fts_table_name(name.name));
+            return query.executeStep();
+        }
+
+        void check_columns(SQLite::Database& db, const qualified_name& name, const std::vector<std::string>& columns)
+        {
+            SQLite::Statement info(db, "SELECT name FROM pragma_table_info(?1, ?2)");
+            info.bind(1, name.name);
+            info.bind(2, name.schema);
+            std::vector<std::string> existing;
+            while (info.executeStep())
+            {
+                existing.push_back(info.getColumn(0).getString());
+            }
+            if (existing.empty())
+            {
+                throw std::runtime_error("No table named " + name.name + ".");
+            }
+            for (const std::string& column : columns)
+            {
+                bool found = false;
+                for (const std::string& other : existing)
+                {
+                    found = found || iequals(column, other);
+                }
+                if (!found)
+                {
+                    throw std::runtime_error("No column named " + column + " in " + name.name + ".");
+                }
+            }
+        }
+    }
+
+    std::string fts_table_name(const std::string& table)
+    {
+        return table + "_fts";
+    }
+
+    long long create_fts_index(SQLite::Database& db,
+                               const std::string& table,
+                               const std::vector<std::string>& columns,
+                               const fts_index_options& options,
+                               const fts_progress& progress)
+    {
+        if (columns.empty())
+        {
+            throw std::runtime_error("No column to index.");
+        }
+        const qualified_name name = split_qualified_name(table);
+        const std::string schema = quote_identifier(name.schema) + ".";
+        const std::string source = schema + quote_identifier(name.name);
+        const std::string index_name = fts_table_name(name.name);
+        const std::string index = quote_identifier(index_name);
+
+        check_columns(db, name, columns);
+        try
+        {
+            SQLite::Statement rowid(db, "SELECT rowid FROM " + source + " LIMIT 0");
+        }
+        catch (const SQLite::Exception&)
+        {
+            throw std::runtime_error("Tables created WITHOUT ROWID cannot be indexed.");
+        }
+        if (index_exists(db, name))
+        {
+            throw std::runtime_error(name.name + " already has a full-text index, remove it with %FTS_INDEX " +
+                                     table + " drop.");
+        }
+
+        const std::string cols = column_list(columns, "");
+        const std::string new_cols = column_list(columns, "new.");
+        const std::string old_cols = column_list(columns, "old.");
+        std::string changed = "old.rowid IS NOT new.rowid";
+        for (const std::string& column : columns)
+        {
+            changed += " OR old." + quote_identifier(column) + " IS NOT new." + quote_identifier(column);
+        }
+
+        bool in_savepoint = false;
+        auto begin = [&]() { db.exec("SAVEPOINT xsql_fts_index"); in_savepoint = true; };
+        auto release = [&]() { db.exec("RELEASE xsql_fts_index"); in_savepoint = false; };
+
+        long long indexed = 0;
+        try
+        {
+            /* Statements of the triggers cannot name the schema, they use the one of the trigger */
+            begin();
+            db.exec("CREATE VIRTUAL TABLE " + schema + index + " USING fts5(" + cols +
+                    ", content=" + quote_literal(name.name) + ", content_rowid='rowid'" +
+                    (options.tokenize.empty() ? "" : ", tokenize=" + quote_literal(options.tokenize)) + ")");
+            db.exec("CREATE TRIGGER " + schema + quote_identifier(index_name + "_insert") + " AFTER INSERT ON " +
+                    quote_identifier(name.name) + " BEGIN INSERT INTO " + index + "(rowid, " + cols +
+                    ") VALUES (new.rowid, " + new_cols + "); END");
+            db.exec("CREATE TRIGGER " + schema + quote_identifier(index_name + "_delete") + " AFTER DELETE ON " +
+                    quote_identifier(name.name) + " BEGIN INSERT INTO " + index + "(" + index + ", rowid, " + cols +
+                    ") VALUES ('delete', old.rowid, " + old_cols + "); END");
+            db.exec("CREATE TRIGGER " + schema + quote_identifier(index_name + "_update") + " AFTER UPDATE ON " +
+                    quote_identifier(name.name) + " WHEN " + changed + " BEGIN INSERT INTO " + index +
+                    "(" + index + ", rowid, " + cols + ") VALUES ('delete', old.rowid, " + old_cols + "); " +
+                    "INSERT INTO " + index + "(rowid, " + cols + ") VALUES (new.rowid, " + new_cols + "); END");
+            release();
+
+            SQLite::Statement count(db, "SELECT count(*), min(rowid) FROM " + source);
+            count.executeStep();
+            const long long total = count.getColumn(0).getInt64();
+            std::int64_t lower = count.getColumn(1).getInt64();
+            count.reset();
+
+            /* Batches are rowid ranges, each one starts where the previous ended */
+            SQLite::Statement next(db, "SELECT rowid FROM " + source + " WHERE rowid >= ? ORDER BY rowid LIMIT 1 OFFSET ?");
+            SQLite::Statement copy(db, "INSERT INTO " + schema + index + "(rowid, " + cols + ") SELECT rowid, " + cols +
+                                       " FROM " + source + " WHERE rowid >= ?1 AND (?2 IS NULL OR rowid < ?2)");
+            bool done = total == 0;
+            while (!done)
+            {
+                next.bind(1, lower);
+                next.bind(2, static_cast<std::int64_t>(options.batch_rows));
+                done = !next.executeStep();
+                const std::int64_t upper = done ? 0 : next.getColumn(0).getInt64();
+                next.reset();
+
+                begin();
+                copy.bind(1, lower);
+                if (done)
+                {
+                    copy.bind(2);
+                }
+                else
+                {
+                    copy.bind(2, upper);
+                }
+                indexed += copy.exec();
+                copy.reset();
+                release();
+
+                lower = upper;
+                if (progress)
+                {
+                    progress(indexed, total);
+                }
+            }
+
+            /* Merges the segments written by the batches */
+            begin();
+            db.exec("INSERT INTO " + schema + index + "(" + index + ") VALUES ('optimize')");
+            release();
+        }
+        catch (...)
+        {
+            if (in_savepoint)
+            {
+                sqlite3_exec(db.getHandle(), "ROLLBACK TO xsql_fts_index", nullptr, nullptr, nullptr);
+                sqlite3_exec(db.getHandle(), "RELEASE xsql_fts_index", nullptr, nullptr, nullptr);
+            }
+            try
+            {
+                drop_fts_index(db, table);
+            }
+            catch (const std::exception&)
+            {
+            }
+            throw;
+        }
+        return indexed;
+    }
+
+    void drop_fts_index(SQLite::Database& db, const std::string& table)
+    {
+        const qualified_name name = split_qualified_name(table);
+        const std::string schema = quote_identifier(name.schema) + ".";
+        const std::string index_name = fts_table_name(name.name);
+        if (!index_exists(db, name))
+        {
+            throw std::runtime_error(name.name + " has no full-text index.");
+        }
+        for (const char* suffix : trigger_suffixes)
+        {
+            db.exec("DROP TRIGGER IF EXISTS " + schema + quote_identifier(index_name + suffix));
+        }
+        db.exec("DROP TABLE " + schema + quote_identifier(index_name));
+    }
+
+    std::string fts_search_query(SQLite::Database& db,
+                                 const std::string& table,
+                                 const std::string& query,
+                                 long long limit)
+    {
+        const qualified_name name = split_qualified_name(table);
+        if (!index_exists(db, name))
+        {
+            throw std::runtime_error("No full-text index on " + name.name + ", create one with %FTS_INDEX " +
+                                     table + " <column> ...");
+        }
+        const std::string index = quote_identifier(fts_table_name(name.name));
+        return "SELECT rowid, round(-rank, 3) AS score, snippet(" + index + ", -1, '[', ']', '...', 16) AS snippet"
+               " FROM " + quote_identifier(name.schema) + "." + index +
+               " WHERE " + index + " MATCH " + quote_literal(query) +
+               " ORDER BY rank LIMIT " + std::to_string(limit);
+    }
+}
@@ -0,0 +1,352 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+#include "xeus-sqlite/xhistory.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Cache of each connection, the history is small and read rarely */
+        constexpr const char* cache_size = "PRAGMA cache_size = -256";
+        /* Batches between two removals of the oldest cells */
+        constexpr std::size_t prune_every = 64;
+
+        void open_connection(SQLite::Database& db)
+        {
+            db.setBusyTimeout(5000);
+            db.exec(cache_size);
+        }
+
+        /* Session 0 is the current one, negative values count back from it */
+        int resolve_session(int session, int current)
+        {
+            return session > 0 ? session : current + session;
+        }
+    }
+
+    sqlite_history_manager::sqlite_history_manager(const std::string& path, const history_options& options)
+        : m_options(options)
+    {
+        m_writer = std::make_unique<SQLite::Database>(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        open_connection(*m_writer);
+        m_writer->exec("PRAGMA journal_mode = WAL");
+        m_writer->exec("CREATE TABLE IF NOT EXISTS sessions("
+                       "session INTEGER PRIMARY KEY, start TEXT NOT NULL)");
+        m_writer->exec("CREATE TABLE IF NOT EXISTS history("
+                       "session INTEGER NOT NULL, line INTEGER NOT NULL, source TEXT NOT NULL, "
+                       "duration_ms REAL, rows INTEGER, UNIQUE(session, line))");
+
+        /* Trigram index for substring globs, the plain index is the fallback */
+        const bool indexed = m_writer->tableExists("history_search");
+        try
+        {
+            m_writer->exec("CREATE VIRTUAL TABLE IF NOT EXISTS history_search USING fts5("
+                           "source, content='history', content_rowid='rowid', tokenize='trigram')");
+            m_writer->exec("CREATE TRIGGER IF NOT EXISTS history_search_insert AFTER INSERT ON history BEGIN "
+                           "INSERT INTO history_search(rowid, source) VALUES (new.rowid, new.source); END");
+            m_writer->exec("CREATE TRIGGER IF NOT EXISTS history_search_delete AFTER DELETE ON history BEGIN "
+                           "INSERT INTO history_search(history_search, rowid, source) "
+                           "VALUES ('delete', old.rowid, old.source); END");
+            m_writer->exec("CREATE TRIGGER IF NOT EXISTS history_search_update AFTER UPDATE OF source ON history BEGIN "
+                           "INSERT INTO history_search(history_search, rowid, source) "
+                           "VALUES ('delete', old.rowid, old.source); "
+                           "INSERT INTO history_search(rowid, source) VALUES (new.rowid, new.source); END");
+            if (!indexed)
+            {
+                m_writer->exec("INSERT INTO history_search(history_search) VALUES ('rebuild')");
+            }
+            m_has_search_index = true;
+        }
+        catch (const SQLite::Exception&)
+        {
+            m_writer->exec("CREATE INDEX IF NOT EXISTS history_source ON history(source)");
+        }
+
+        m_writer->exec("INSERT INTO sessions(start) VALUES (datetime('now'))");
+        m_session = static_cast<int>(m_writer->getLastInsertRowid());
+
+        m_reader = std::make_unique<SQLite::Database>(path, SQLite::OPEN_READONLY);
+        open_connection(*m_reader);
+
+#ifndef XSQL_EMSCRIPTEN_WASM_BUILD
+        m_thread = std::thread(&sqlite_history_manager::run, this);
+#endif
+    }
+
+    sqlite_history_manager::~sqlite_history_manager()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeup.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    void sqlite_history_manager::record_execution(int line_num, double duration_ms, long long rows)
+    {
+        enqueue({line_num, std::string(), false, duration_ms, rows});
+    }
+
+    void sqlite_history_manager::flush() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_flush_requested = true;
+        m_wakeup.notify_all();
+        m_flushed.wait(lock, [this]() { return (m_queue.empty() && !m_writing) || !m_thread.joinable(); });
+    }
+
+    int sqlite_history_manager::session() const noexcept
+    {
+        return m_session;
+    }
+
+    std::size_t sqlite_history_manager::dropped() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+    void sqlite_history_manager::configure_impl()
+    {
+        /* The file is opened by the constructor so that errors are reported early */
+    }
+
+    void sqlite_history_manager::store_inputs_impl(int /*session*/, int line_num, const std::string& input)
+    {
+        enqueue({line_num, input, true, 0.0, 0});
+    }
+
+    nl::json sqlite_history_manager::get_tail_impl(int /*session*/, int n, bool /*raw*/, bool output) const
+    {
+        flush();
+        SQLite::Statement query(*m_reader, "SELECT session, line, source FROM history WHERE source <> '' "
+                                           "ORDER BY rowid DESC LIMIT ?");
+        query.bind(1, std::max(n, 0));
+        return make_reply(query, output, true);
+    }
+
+    nl::json sqlite_history_manager::get_range_impl(int session, int start, int stop, bool /*raw*/, bool output) const
+    {
+        flush();
+        SQLite::Statement query(*m_reader, "SELECT session, line, source FROM history "
+                                           "WHERE session = ? AND line >= ? AND (? <= 0 OR line < ?) AND source <> '' "
+                                           "ORDER BY line");
+        query.bind(1, resolve_session(session, m_session));
+        query.bind(2, start);
+        query.bind(3, stop);
+        query.bind(4, stop);
+        return make_reply(query, output, false);
+    }
+
+    nl::json sqlite_history_manager::search_impl(int /*session*/,
+                                                 const std::string& pattern,
+                                                 bool /*raw*/,
+                                                 bool output,
+                                                 int n,
+                                                 bool unique) const
+    {
+        flush();
+        const std::string matches = m_has_search_index
+            ? "SELECT rowid FROM history_search WHERE source GLOB ?1"
+            : "SELECT rowid FROM history WHERE source GLOB ?1";
+        const std::string selected = unique
+            ? "SELECT max(rowid) FROM history WHERE rowid IN (" + matches + ") GROUP BY source"
+            : matches;
+        SQLite::Statement query(*m_reader, "SELECT session, line, source FROM history "
+                                           "WHERE rowid IN (" + selected + ") AND source <> '' "
+                                           "ORDER BY rowid DESC LIMIT ?2");
+        query.bind(1, pattern.empty() ? std::string("*") : pattern);
+        query.bind(2, n > 0 ? n : -1);
+        return make_reply(query, output, true);
+    }
+
+    void sqlite_history_manager::enqueue(pending_write write)
+    {
+#ifdef XSQL_EMSCRIPTEN_WASM_BUILD
+        /* No writer thread, the write is done right away */
+        write_batch({std::move(write)});
+#else
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.size() >= m_options.max_pending)
+            {
+                ++m_dropped;
+                return;
+            }
+            m_queue.push_back(std::move(write));
+        }
+        m_wakeup.notify_all();
+#endif
+    }
+
+    void sqlite_history_manager::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wakeup.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                break;
+            }
+            /* Gathers the writes of the next interval, unless asked to stop */
+            m_wakeup.wait_for(lock, m_options.flush_interval, [this]() { return m_stop || m_flush_requested; });
+
+            std::vector<pending_write> batch;
+            batch.swap(m_queue);
+            m_flush_requested = false;
+            m_writing = true;
+            lock.unlock();
+
+            write_batch(batch);
+
+            lock.lock();
+            m_writing = false;
+            m_flushed.notify_all();
+        }
+        m_flushed.notify_all();
+    }
+
+    void sqlite_history_manager::write_batch(const std::vector<pending_write>& batch)
+    {
+        try
+        {
+            SQLite::Transaction transaction(*m_writer);
+            SQLite::Statement insert(*m_writer, "INSERT INTO history(session, line, source) VALUES (?, ?, ?) "
+                                                "ON CONFLICT(session, line) DO UPDATE SET source = excluded.source");
+            /* The statistics may be written before the input, which then fills in the source */
+            SQLite::Statement update(*m_writer, "INSERT INTO history(session, line, source, duration_ms, rows) "
+                                                "VALUES (?, ?, '', ?, ?) ON CONFLICT(session, line) DO UPDATE SET "
+                                                "duration_ms = excluded.duration_ms, rows = excluded.rows");
+            for (const pending_write& write : batch)
+            {
+                if (write.is_input)
+                {
+                    insert.bind(1, m_session);
+                    insert.bind(2, write.line);
+                    insert.bind(3, write.source);
+                    insert.exec();
+                    insert.reset();
+                }
+                else
+                {
+                    update.bind(1, m_session);
+                    update.bind(2, write.line);
+                    update.bind(3, write.duration_ms);
+                    update.bind(4, static_cast<std::int64_t>(write.rows));
+                    update.exec();
+                    update.reset();
+                }
+            }
+
+            if (++m_batches % prune_every == 1)
+            {
+                SQLite::Statement prune(*m_writer, "DELETE FROM history WHERE rowid <= "
+                                                   "(SELECT max(rowid) FROM history) - ?");
+                prune.bind(1, static_cast<std::int64_t>(m_options.max_entries));
+                prune.exec();
+            }
+            transaction.commit();
+        }
+        catch (const std::exception&)
+        {
+            /* The history is best effort, a locked or full disk loses the batch */
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dropped += batch.size();
+        }
+    }
+
+    nl::json sqlite_history_manager::make_reply(SQLite::Statement& query, bool output, bool reverse) const
+    {
+        nl::json history = nl::json::array();
+        while (query.executeStep())
+        {
+            nl::json source = query.getColumn(2).getString();
+            history.push_back({query.getColumn(0).getInt(),
+                               query.getColumn(1).getInt(),
+                               output ? nl::json::array({std::move(source), nullptr}) : std::move(source)});
+        }
+        if (reverse)
+        {
+            std::reverse(history.begin(), history.end());
+        }
+
+        nl::json reply;
+        reply["history"] = std::move(history);
+        reply["status"] = "ok";
+        return reply;
+    }
+
+    std::string jupyter_data_file(const std::string& name)
+    {
+        /* Same lookup as jupyter --data-dir */
+        fs::path dir;
+        if (const char* data = std::getenv("JUPYTER_DATA_DIR"))
+        {
+            dir = data;
+        }
+#if defined(_WIN32)
+        else if (const char* appdata = std::getenv("APPDATA"))
+        {
+            dir = fs::path(appdata) / "jupyter";
+        }
+#elif defined(__APPLE__)
+        else if (const char* home = std::getenv("HOME"))
+        {
+            dir = fs::path(home) / "Library" / "Jupyter";
+        }
+#else
+        else if (const char* xdg = std::getenv("XDG_DATA_HOME"))
+        {
+            dir = fs::path(xdg) / "jupyter";
+        }
+        else if (const char* home = std::getenv("HOME"))
+        {
+            dir = fs::path(home) / ".local" / "share" / "jupyter";
+        }
+#endif
+        if (dir.empty())
+        {
+            return "";
+        }
+
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        return ec ? std::string() : (dir / name).string();
+    }
+
+    std::string default_history_path()
+    {
+        if (const char* path = std::getenv("XSQLITE_HISTORY"))
+        {
+            return path;
+        }
+        return jupyter_data_file("xsqlite_history.db");
+    }
+
+    std::unique_ptr<sqlite_history_manager>
+    make_sqlite_history_manager(const std::string& path, const history_options& options)
+    {
+        return std::make_unique<sqlite_history_manager>(path, options);
+    }
+}
@@ -0,0 +1,206 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+#include "xeus-sqlite/xhtml_renderer.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        constexpr std::uint64_t ones = 0x0101010101010101ull;
+        constexpr std::uint64_t highs = 0x8080808080808080ull;
+
+        /* Non zero if one of the bytes of word equals c */
+        inline std::uint64_t has_byte(std::uint64_t word, unsigned char c)
+        {
+            std::uint64_t x = word ^ (ones * c);
+            return (x - ones) & ~x & highs;
+        }
+
+        inline bool needs_escape(std::uint64_t word)
+        {
+            return (has_byte(word, '&') | has_byte(word, '<') | has_byte(word, '>') |
+                    has_byte(word, '"') | has_byte(word, '\'')) != 0;
+        }
+
+        inline const char* entity(char c)
+        {
+            switch (c)
+            {
+                case '&': return "&amp;";
+                case '<': return "&lt;";
+                case '>': return "&gt;";
+                case '"': return "&quot;";
+                case '\'': return "&#39;";
+                default: return nullptr;
+            }
+        }
+
+        /* SQLite type affinity rules, falling back on the stored values */
+        const char* column_class(const result_table& table, std::size_t col)
+        {
+            std::string declared = table.column_declared_type(col);
+            std::transform(declared.begin(), declared.end(), declared.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+            if (!declared.empty())
+            {
+                if (declared.find("INT") != std::string::npos)
+                {
+                    return "xsql-integer";
+                }
+                if (declared.find("CHAR") != std::string::npos ||
+                    declared.find("CLOB") != std::string::npos ||
+                    declared.find("TEXT") != std::string::npos)
+                {
+                    return "xsql-text";
+                }
+                if (declared.find("BLOB") != std::string::npos)
+                {
+                    return "xsql-blob";
+                }
+                if (declared.find("REAL") != std::string::npos ||
+                    declared.find("FLOA") != std::string::npos ||
+                    declared.find("DOUB") != std::string::npos)
+                {
+                    return "xsql-real";
+                }
+                return "xsql-numeric";
+            }
+
+            for (std::size_t row = 0; row < table.row_count(); ++row)
+            {
+                switch (table.type(row, col))
+                {
+                    case cell_type::integer: return "xsql-integer";
+                    case cell_type::floating: return "xsql-real";
+                    case cell_type::text: return "xsql-text";
+                    case cell_type::blob: return "xsql-blob";
+                    case cell_type::null: break;
+                }
+            }
+            return "xsql-null";
+        }
+
+        void append_row(std::string& out, const result_table& table, std::size_t row)
+        {
+            out.append("<tr>");
+            for (std::size_t col = 0; col < table.column_count(); ++col)
+            {
+                out.append("<td>");
+                append_html_escaped(out, table.display(row, col));
+                out.append("</td>");
+            }
+            out.append("</tr>");
+        }
+    }
+
+    void append_html_escaped(std::string& out, std::string_view text)
+    {
+        const char* data = text.data();
+        const std::size_t size = text.size();
+        std::size_t run_start = 0;
+        std::size_t pos = 0;
+
+        while (pos < size)
+        {
+            /* The tail is zero padded, zero never needs escaping */
+            const std::size_t chunk = std::min<std::size_t>(8, size - pos);
+            std::uint64_t word = 0;
+            std::memcpy(&word, data + pos, chunk);
+            if (!needs_escape(word))
+            {
+                pos += chunk;
+                continue;
+            }
+
+            /* Slow path, at most eight bytes before the next word */
+            const std::size_t stop = std::min(pos + 8, size);
+            for (; pos < stop; ++pos)
+            {
+                const char* replacement = entity(data[pos]);
+                if (replacement != nullptr)
+                {
+                    out.append(data + run_start, pos - run_start);
+                    out.append(replacement);
+                    run_start = pos + 1;
+                }
+            }
+        }
+        out.append(data + run_start, size - run_start);
+    }
+
+    std::string render_html_table(const result_table& table,
+                                  const html_table_options& options)
+    {
+        const std::size_t columns = table.column_count();
+        /* The omitted rows are in the elided part, the tail is the end of the buffer */
+        const std::size_t stored = table.row_count();
+        const std::size_t rows = stored + table.omitted_rows();
+        const bool elided = options.max_rows != 0 && rows > options.max_rows;
+        const std::size_t head = elided ? (options.max_rows + 1) / 2 : rows;
+        const std::size_t tail = elided ? options.max_rows / 2 : 0;
+
+        std::string out;
+        out.reserve(table.content_size() + (stored + 1) * (columns * 9 + 9) + 64);
+
+        out.append("<table>");
+        if (options.column_classes)
+        {
+            out.append("<colgroup>");
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                out.append("<col class=\"");
+                out.append(column_class(table, col));
+                out.append("\">");
+            }
+            out.append("</colgroup>");
+        }
+
+        out.append("<thead><tr>");
+        for (std::size_t col = 0; col < columns; ++col)
+        {
+            out.append("<th>");
+            append_html_escaped(out, table.column_name(col));
+            out.append("</th>");
+        }
+        out.append("</tr></thead><tbody>");
+
+        for (std::size_t row = 0; row < head; ++row)
+        {
+            append_row(out, table, row);
+        }
+        if (elided)
+        {
+            out.append("<tr>");
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                out.append("<td>...</td>");
+            }
+            out.append("</tr>");
+            for (std::size_t row = stored - tail; row < stored; ++row)
+            {
+                append_row(out, table, row);
+            }
+        }
+        out.append("</tbody></table>");
+
+        if (elided)
+        {
+            out.append("<p>" + std::to_string(rows) + " rows &times; "
+                       + std::to_string(columns) + " columns</p>");
+        }
+        return out;
+    }
+}
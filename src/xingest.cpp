@@ -0,0 +1,378 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "xeus-sqlite/xingest.hpp"
+#include "xeus-sqlite/xmagic_parser.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        [[noreturn]] void throw_sqlite_error(sqlite3* db, const std::string& context)
+        {
+            throw std::runtime_error(context + ": " + sqlite3_errmsg(db));
+        }
+
+        void exec(sqlite3* db, const std::string& sql)
+        {
+            if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+            {
+                throw_sqlite_error(db, sql);
+            }
+        }
+
+        enum class column_kind
+        {
+            int32,
+            int64,
+            float64,
+            boolean,
+            text,
+            blob
+        };
+
+        struct column_type
+        {
+            const char* name;
+            column_kind kind;
+            /* Size of the offsets, 0 for fixed width types */
+            std::size_t offset_size;
+            const char* declared_type;
+        };
+
+        const column_type column_types[] = {
+            {"int32", column_kind::int32, 0, "INTEGER"},
+            {"int64", column_kind::int64, 0, "INTEGER"},
+            {"float64", column_kind::float64, 0, "REAL"},
+            {"bool", column_kind::boolean, 0, "INTEGER"},
+            {"utf8", column_kind::text, 4, "TEXT"},
+            {"large_utf8", column_kind::text, 8, "TEXT"},
+            {"binary", column_kind::blob, 4, "BLOB"},
+            {"large_binary", column_kind::blob, 8, "BLOB"}
+        };
+
+        /* A column of the request, pointing into the message buffers */
+        struct column_view
+        {
+            std::string name;
+            const column_type* type = nullptr;
+            const char* data = nullptr;
+            std::size_t data_size = 0;
+            const char* offsets = nullptr;
+            const unsigned char* validity = nullptr;
+        };
+
+        template <class T>
+        T load(const char* p)
+        {
+            /* Buffers have no alignment guarantee */
+            T value;
+            std::memcpy(&value, p, sizeof(T));
+            return value;
+        }
+
+        bool bit(const unsigned char* bits, std::size_t i)
+        {
+            return (bits[i / 8] >> (i % 8)) & 1;
+        }
+
+        std::int64_t offset_at(const column_view& column, std::size_t row)
+        {
+            return column.type->offset_size == 4
+                ? load<std::int32_t>(column.offsets + row * 4)
+                : load<std::int64_t>(column.offsets + row * 8);
+        }
+
+        const xeus::binary_buffer& buffer_at(const xeus::buffer_sequence& buffers,
+                                             const nl::json& column,
+                                             const char* key,
+                                             std::size_t min_size)
+        {
+            const std::size_t index = column.at(key).get<std::size_t>();
+            if (index >= buffers.size())
+            {
+                throw std::runtime_error("Buffer " + std::to_string(index) + " of column " +
+                                         column.at("name").get<std::string>() + " is missing, the message has " +
+                                         std::to_string(buffers.size()) + " buffers.");
+            }
+            const xeus::binary_buffer& buffer = buffers[index];
+            if (buffer.size() < min_size)
+            {
+                throw std::runtime_error("The " + std::string(key) + " buffer of column " +
+                                         column.at("name").get<std::string>() + " has " +
+                                         std::to_string(buffer.size()) + " bytes, expected " +
+                                         std::to_string(min_size) + ".");
+            }
+            return buffer;
+        }
+
+        column_view make_column(const nl::json& column, const xeus::buffer_sequence& buffers, std::size_t rows)
+        {
+            column_view view;
+            view.name = column.at("name").get<std::string>();
+            const std::string type = column.at("type").get<std::string>();
+            for (const column_type& candidate : column_types)
+            {
+                if (type == candidate.name)
+                {
+                    view.type = &candidate;
+                }
+            }
+            if (view.type == nullptr)
+            {
+                throw std::runtime_error("Unsupported type " + type + " for column " + view.name +
+                                         ", expected int32, int64, float64, bool, utf8, large_utf8, binary or large_binary.");
+            }
+
+            std::size_t data_size = 0;
+            switch (view.type->kind)
+            {
+                case column_kind::int32: data_size = rows * 4; break;
+                case column_kind::int64:
+                case column_kind::float64: data_size = rows * 8; break;
+                case column_kind::boolean: data_size = (rows + 7) / 8; break;
+                default: break;
+            }
+            const xeus::binary_buffer& data = buffer_at(buffers, column, "data", data_size);
+            view.data = data.data();
+            view.data_size = data.size();
+
+            if (view.type->offset_size != 0)
+            {
+                view.offsets = buffer_at(buffers, column, "offsets", (rows + 1) * view.type->offset_size).data();
+                /* Checked once, so that the inserts read in bounds */
+                std::int64_t previous = offset_at(view, 0);
+                if (previous < 0)
+                {
+                    throw std::runtime_error("Negative offset in column " + view.name + ".");
+                }
+                for (std::size_t row = 1; row <= rows; ++row)
+                {
+                    const std::int64_t offset = offset_at(view, row);
+                    if (offset < previous)
+                    {
+                        throw std::runtime_error("Decreasing offsets at row " + std::to_string(row - 1) +
+                                                 " of column " + view.name + ".");
+                    }
+                    previous = offset;
+                }
+                if (static_cast<std::uint64_t>(previous) > view.data_size)
+                {
+                    throw std::runtime_error("The offsets of column " + view.name + " end at " +
+                                             std::to_string(previous) + ", beyond its data of " +
+                                             std::to_string(view.data_size) + " bytes.");
+                }
+            }
+
+            if (column.contains("validity") && !column.at("validity").is_null())
+            {
+                view.validity = reinterpret_cast<const unsigned char*>(
+                    buffer_at(buffers, column, "validity", (rows + 7) / 8).data());
+            }
+            return view;
+        }
+
+        bool table_exists(sqlite3* db, const qualified_name& name)
+        {
+            const std::string sql = "SELECT 1 FROM " + quote_identifier(name.schema) +
+                                    ".sqlite_master WHERE type IN ('table', 'view') AND name = ?";
+            sqlite3_stmt* stmt = nullptr;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            {
+                throw_sqlite_error(db, "Could not look up " + name.name);
+            }
+            sqlite3_bind_text(stmt, 1, name.name.c_str(), -1, SQLITE_TRANSIENT);
+            const int rc = sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            return rc == SQLITE_ROW;
+        }
+
+        /* Binds the values of a row, the buffers outlive the step */
+        int bind_row(sqlite3_stmt* stmt, const std::vector<column_view>& columns, std::size_t row)
+        {
+            int rc = SQLITE_OK;
+            for (std::size_t i = 0; i < columns.size() && rc == SQLITE_OK; ++i)
+            {
+                const column_view& column = columns[i];
+                const int index = static_cast<int>(i + 1);
+                if (column.validity != nullptr && !bit(column.validity, row))
+                {
+                    rc = sqlite3_bind_null(stmt, index);
+                    continue;
+                }
+                switch (column.type->kind)
+                {
+                    case column_kind::int32:
+                        rc = sqlite3_bind_int64(stmt, index, load<std::int32_t>(column.data + row * 4));
+                        break;
+                    case column_kind::int64:
+                        rc = sqlite3_bind_int64(stmt, index, load<std::int64_t>(column.data + row * 8));
+                        break;
+                    case column_kind::float64:
+                        /* NaN is bound as NULL by SQLite */
+                        rc = sqlite3_bind_double(stmt, index, load<double>(column.data + row * 8));
+                        break;
+                    case column_kind::boolean:
+                        rc = sqlite3_bind_int(stmt, index,
+                                              bit(reinterpret_cast<const unsigned char*>(column.data), row));
+                        break;
+                    case column_kind::text:
+                    case column_kind::blob:
+                    {
+                        const std::int64_t begin = offset_at(column, row);
+                        const sqlite3_uint64 size = static_cast<sqlite3_uint64>(offset_at(column, row + 1) - begin);
+                        /* A null pointer would bind NULL instead of an empty value */
+                        const char* value = size != 0 ? column.data + begin : "";
+                        rc = column.type->kind == column_kind::text
+                            ? sqlite3_bind_text64(stmt, index, value, size, SQLITE_STATIC, SQLITE_UTF8)
+                            : sqlite3_bind_blob64(stmt, index, value, size, SQLITE_STATIC);
+                        break;
+                    }
+                }
+            }
+            return rc;
+        }
+
+        /* Finalizes the statement on every path */
+        struct statement_guard
+        {
+            sqlite3_stmt* stmt = nullptr;
+
+            ~statement_guard()
+            {
+                sqlite3_finalize(stmt);
+            }
+        };
+    }
+
+    std::int64_t ingest_columns(sqlite3* db,
+                                const nl::json& request,
+                                const xeus::buffer_sequence& buffers)
+    {
+        if (db == nullptr)
+        {
+            throw std::runtime_error("Load a database to insert rows.");
+        }
+        const qualified_name name = split_qualified_name(request.at("table").get<std::string>());
+        const std::size_t rows = request.at("rows").get<std::size_t>();
+        if (rows > std::numeric_limits<std::size_t>::max() / 16)
+        {
+            throw std::runtime_error("Invalid row count " + std::to_string(rows) + ".");
+        }
+        const std::string if_exists = request.value("if_exists", std::string("append"));
+        if (if_exists != "append" && if_exists != "replace" && if_exists != "fail")
+        {
+            throw std::runtime_error("Invalid if_exists " + if_exists + ", expected append, replace or fail.");
+        }
+
+        std::vector<column_view> columns;
+        for (const nl::json& column : request.at("columns"))
+        {
+            columns.push_back(make_column(column, buffers, rows));
+        }
+        if (columns.empty())
+        {
+            throw std::runtime_error("No columns to insert in " + name.name + ".");
+        }
+        if (static_cast<int>(columns.size()) > sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1))
+        {
+            throw std::runtime_error("Too many columns to insert in " + name.name + ".");
+        }
+
+        const std::string table = quote_identifier(name.schema) + "." + quote_identifier(name.name);
+        std::string definition;
+        std::string column_list;
+        std::string parameters;
+        for (const column_view& column : columns)
+        {
+            const std::string separator = column_list.empty() ? "" : ", ";
+            definition += separator + quote_identifier(column.name) + " " + column.type->declared_type;
+            column_list += separator + quote_identifier(column.name);
+            parameters += separator + "?";
+        }
+
+        exec(db, "SAVEPOINT xsql_ingest");
+        try
+        {
+            const bool exists = table_exists(db, name);
+            if (exists && if_exists == "fail")
+            {
+                throw std::runtime_error("Table " + name.name + " already exists.");
+            }
+            if (exists && if_exists == "replace")
+            {
+                exec(db, "DROP TABLE " + table);
+            }
+            if (!exists || if_exists == "replace")
+            {
+                exec(db, "CREATE TABLE " + table + "(" + definition + ")");
+            }
+
+            const std::string sql = "INSERT INTO " + table + "(" + column_list + ") VALUES (" + parameters + ")";
+            statement_guard insert;
+            if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &insert.stmt, nullptr) != SQLITE_OK)
+            {
+                throw_sqlite_error(db, "Could not insert into " + name.name);
+            }
+            for (std::size_t row = 0; row < rows; ++row)
+            {
+                if (bind_row(insert.stmt, columns, row) != SQLITE_OK ||
+                    sqlite3_step(insert.stmt) != SQLITE_DONE)
+                {
+                    throw_sqlite_error(db, "Could not insert row " + std::to_string(row) + " into " + name.name);
+                }
+                sqlite3_reset(insert.stmt);
+            }
+        }
+        catch (...)
+        {
+            sqlite3_exec(db, "ROLLBACK TO xsql_ingest", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "RELEASE xsql_ingest", nullptr, nullptr, nullptr);
+            throw;
+        }
+        exec(db, "RELEASE xsql_ingest");
+        return static_cast<std::int64_t>(rows);
+    }
+
+    nl::json handle_ingest_request(sqlite3* db,
+                                   const nl::json& request,
+                                   const xeus::buffer_sequence& buffers)
+    {
+        nl::json reply;
+        try
+        {
+            const std::string action = request.at("action").get<std::string>();
+            if (action != "insert")
+            {
+                throw std::runtime_error("Unknown action " + action + ", expected insert.");
+            }
+            reply["action"] = "inserted";
+            reply["table"] = request.at("table");
+            reply["rows"] = ingest_columns(db, request, buffers);
+        }
+        catch (const std::exception& e)
+        {
+            reply = nl::json::object();
+            reply["action"] = "error";
+            reply["message"] = e.what();
+        }
+        if (request.is_object() && request.contains("id"))
+        {
+            reply["id"] = request["id"];
+        }
+        return reply;
+    }
+}
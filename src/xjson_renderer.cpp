@@ -0,0 +1,338 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#include "xeus-sqlite/xjson_renderer.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        bool contains(const std::string& declared, const char* name)
+        {
+            return declared.find(name) != std::string::npos;
+        }
+
+        /* Column names made unique, the keys of the records */
+        std::vector<std::string> field_names(const result_table& table)
+        {
+            std::vector<std::string> names;
+            std::unordered_set<std::string> used;
+            for (std::size_t col = 0; col < table.column_count(); ++col)
+            {
+                std::string name = table.column_name(col);
+                for (int n = 2; used.count(name) != 0; ++n)
+                {
+                    name = table.column_name(col) + "_" + std::to_string(n);
+                }
+                used.insert(name);
+                names.push_back(std::move(name));
+            }
+            return names;
+        }
+
+        /* Length of the UTF-8 sequence starting at data[i], 0 if invalid */
+        std::size_t utf8_length(const unsigned char* data, std::size_t size, std::size_t i)
+        {
+            const unsigned char lead = data[i];
+            std::size_t length = 0;
+            unsigned min = 0;
+            unsigned code = 0;
+            if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                length = 2;
+                min = 0x80;
+                code = lead & 0x1F;
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                length = 3;
+                min = 0x800;
+                code = lead & 0x0F;
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                length = 4;
+                min = 0x10000;
+                code = lead & 0x07;
+            }
+            if (length == 0 || i + length > size)
+            {
+                return 0;
+            }
+            for (std::size_t k = 1; k < length; ++k)
+            {
+                if ((data[i + k] & 0xC0) != 0x80)
+                {
+                    return 0;
+                }
+                code = (code << 6) | (data[i + k] & 0x3F);
+            }
+            /* Overlong forms, surrogates and code points beyond U+10FFFF */
+            if (code < min || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF)
+            {
+                return 0;
+            }
+            return length;
+        }
+
+        /* Appends text as a JSON string, invalid UTF-8 is replaced by U+FFFD */
+        void append_json_string(std::string& out, std::string_view text)
+        {
+            static const char hex[] = "0123456789abcdef";
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+            const std::size_t size = text.size();
+            out.push_back('"');
+            std::size_t run_start = 0;
+            std::size_t i = 0;
+            while (i < size)
+            {
+                const unsigned char c = data[i];
+                if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80)
+                {
+                    ++i;
+                    continue;
+                }
+                std::size_t length = c < 0x80 ? 1 : utf8_length(data, size, i);
+                if (length > 1)
+                {
+                    i += length;
+                    continue;
+                }
+                out.append(text.data() + run_start, i - run_start);
+                switch (c)
+                {
+                    case '"': out.append("\\\""); break;
+                    case '\\': out.append("\\\\"); break;
+                    case '\b': out.append("\\b"); break;
+                    case '\f': out.append("\\f"); break;
+                    case '\n': out.append("\\n"); break;
+                    case '\r': out.append("\\r"); break;
+                    case '\t': out.append("\\t"); break;
+                    default:
+                        if (c < 0x20)
+                        {
+                            const char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+                            out.append(escape, sizeof(escape));
+                        }
+                        else
+                        {
+                            out.append("\xEF\xBF\xBD");
+                        }
+                        break;
+                }
+                ++i;
+                run_start = i;
+            }
+            out.append(text.data() + run_start, size - run_start);
+            out.push_back('"');
+        }
+
+        /* SQLite writes doubles as JSON numbers, except the infinities that JSON lacks */
+        bool is_json_number(std::string_view text)
+        {
+            return !text.empty() && (std::isdigit(static_cast<unsigned char>(text.front())) ||
+                                     (text.front() == '-' && text.size() > 1 &&
+                                      std::isdigit(static_cast<unsigned char>(text[1]))));
+        }
+
+        void append_cell(std::string& out, const result_table& table, std::size_t row, std::size_t col, bool boolean)
+        {
+            const std::string_view cell = table.cell(row, col);
+            switch (table.type(row, col))
+            {
+                case cell_type::integer:
+                    if (boolean)
+                    {
+                        out.append(cell == "0" ? "false" : "true");
+                    }
+                    else
+                    {
+                        out.append(cell.data(), cell.size());
+                    }
+                    return;
+                case cell_type::floating:
+                    if (is_json_number(cell))
+                    {
+                        out.append(cell.data(), cell.size());
+                    }
+                    else
+                    {
+                        out.append("null");
+                    }
+                    return;
+                case cell_type::null:
+                    out.append("null");
+                    return;
+                case cell_type::text:
+                    append_json_string(out, cell);
+                    return;
+                case cell_type::blob:
+                    append_json_string(out, table.display(row, col));
+                    return;
+            }
+            out.append("null");
+        }
+
+        /* Appends the first rows of the table as an array of records, the
+           keys are escaped once and the values written from the cells */
+        void append_records(std::string& out,
+                            const result_table& table,
+                            const std::vector<std::string>& names,
+                            const std::vector<bool>& booleans,
+                            std::size_t rows)
+        {
+            const std::size_t columns = table.column_count();
+            std::vector<std::string> keys(columns);
+            std::size_t keys_size = 0;
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                keys[col].push_back(col == 0 ? '{' : ',');
+                append_json_string(keys[col], names[col]);
+                keys[col].push_back(':');
+                keys_size += keys[col].size();
+            }
+
+            /* Cells, keys and punctuation, escapes aside */
+            out.reserve(out.size() + table.content_size() + rows * (keys_size + columns * 4 + 2) + 2);
+            out.push_back('[');
+            for (std::size_t row = 0; row < rows; ++row)
+            {
+                if (row != 0)
+                {
+                    out.push_back(',');
+                }
+                for (std::size_t col = 0; col < columns; ++col)
+                {
+                    out.append(keys[col]);
+                    append_cell(out, table, row, col, booleans[col]);
+                }
+                out.append(columns == 0 ? "{}" : "}");
+            }
+            out.push_back(']');
+        }
+
+        std::size_t output_rows(const result_table& table, const dataresource_options& options)
+        {
+            return options.max_rows == 0 ? table.row_count() : std::min(table.row_count(), options.max_rows);
+        }
+    }
+
+    std::string table_schema_type(const result_table& table, std::size_t col)
+    {
+        std::string declared = table.column_declared_type(col);
+        std::transform(declared.begin(), declared.end(), declared.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+
+        if (!declared.empty())
+        {
+            if (contains(declared, "BOOL"))
+            {
+                return "boolean";
+            }
+            if (contains(declared, "DATETIME") || contains(declared, "TIMESTAMP"))
+            {
+                return "datetime";
+            }
+            if (contains(declared, "DATE"))
+            {
+                return "date";
+            }
+            if (contains(declared, "TIME"))
+            {
+                return "time";
+            }
+            if (contains(declared, "INT"))
+            {
+                return "integer";
+            }
+            if (contains(declared, "CHAR") || contains(declared, "CLOB") || contains(declared, "TEXT"))
+            {
+                return "string";
+            }
+            if (contains(declared, "BLOB"))
+            {
+                return "any";
+            }
+            return "number";
+        }
+
+        /* Expressions, the widest type of the values */
+        bool integers = false;
+        bool numbers = false;
+        bool others = false;
+        for (std::size_t row = 0; row < table.row_count(); ++row)
+        {
+            switch (table.type(row, col))
+            {
+                case cell_type::integer: integers = true; break;
+                case cell_type::floating: numbers = true; break;
+                case cell_type::null: break;
+                default: others = true; break;
+            }
+        }
+        if (others)
+        {
+            return integers || numbers ? "any" : "string";
+        }
+        if (numbers)
+        {
+            return "number";
+        }
+        return integers ? "integer" : "any";
+    }
+
+    void write_json_records(std::string& out, const result_table& table, const dataresource_options& options)
+    {
+        append_records(out, table, field_names(table), std::vector<bool>(table.column_count(), false),
+                       output_rows(table, options));
+    }
+
+    void write_dataresource(std::string& out, const result_table& table, const dataresource_options& options)
+    {
+        const std::vector<std::string> names = field_names(table);
+        std::vector<bool> booleans;
+        out.append("{\"schema\":{\"fields\":[");
+        for (std::size_t col = 0; col < table.column_count(); ++col)
+        {
+            const std::string type = table_schema_type(table, col);
+            booleans.push_back(type == "boolean");
+            out.append(col == 0 ? "{\"name\":" : ",{\"name\":");
+            append_json_string(out, names[col]);
+            out.append(",\"type\":\"");
+            out.append(type);
+            out.append("\"}");
+        }
+        out.append("]},\"data\":");
+        append_records(out, table, names, booleans, output_rows(table, options));
+        out.push_back('}');
+    }
+
+    nl::json render_json_records(const result_table& table, const dataresource_options& options)
+    {
+        std::string out;
+        write_json_records(out, table, options);
+        return nl::json::parse(out);
+    }
+
+    nl::json render_dataresource(const result_table& table, const dataresource_options& options)
+    {
+        std::string out;
+        write_dataresource(out, table, options);
+        return nl::json::parse(out);
+    }
+}
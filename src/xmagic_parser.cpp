@@ -0,0 +1,172 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        inline bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+        }
+
+        inline std::size_t skip_spaces(std::string_view text, std::size_t pos)
+        {
+            while (pos < text.size() && is_space(text[pos]))
+            {
+                ++pos;
+            }
+            return pos;
+        }
+
+        inline std::size_t skip_word(std::string_view text, std::size_t pos)
+        {
+            while (pos < text.size() && !is_space(text[pos]))
+            {
+                ++pos;
+            }
+            return pos;
+        }
+    }
+
+    bool is_magic(std::string_view code)
+    {
+        std::size_t pos = skip_spaces(code, 0);
+        return pos < code.size() && code[pos] == '%';
+    }
+
+    magic_input parse_magic(std::string_view code)
+    {
+        magic_input input;
+        std::size_t pos = skip_spaces(code, 0);
+        if (pos == code.size() || code[pos] != '%')
+        {
+            return input;
+        }
+
+        std::size_t name_end = skip_word(code, pos + 1);
+        input.name = code.substr(pos + 1, name_end - pos - 1);
+        input.arguments = code.substr(skip_spaces(code, name_end));
+        input.args = split_arguments(input.arguments);
+        return input;
+    }
+
+    std::vector<std::string_view> split_arguments(std::string_view text)
+    {
+        std::vector<std::string_view> args;
+        std::size_t pos = skip_spaces(text, 0);
+        while (pos < text.size())
+        {
+            std::size_t end = skip_word(text, pos);
+            args.push_back(text.substr(pos, end - pos));
+            pos = skip_spaces(text, end);
+        }
+        return args;
+    }
+
+    bool split_option(std::string_view arg, std::string_view& key, std::string_view& value)
+    {
+        std::size_t equal = arg.find('=');
+        if (equal == std::string_view::npos)
+        {
+            return false;
+        }
+        key = arg.substr(0, equal);
+        value = arg.substr(equal + 1);
+        return true;
+    }
+
+    std::chrono::milliseconds parse_duration(std::string_view text)
+    {
+        long long value = 0;
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        std::string_view unit = text.substr(static_cast<std::size_t>(parsed.ptr - text.data()));
+
+        long long factor = 0;
+        if (unit.empty() || unit == "s")
+        {
+            factor = 1000;
+        }
+        else if (unit == "ms")
+        {
+            factor = 1;
+        }
+        else if (unit == "m")
+        {
+            factor = 60 * 1000;
+        }
+        else if (unit == "h")
+        {
+            factor = 60 * 60 * 1000;
+        }
+
+        if (parsed.ec != std::errc() || parsed.ptr == text.data() || value <= 0 || factor == 0)
+        {
+            throw std::runtime_error("Invalid duration " + std::string(text) +
+                                     ", expected for instance 250ms, 30s, 5m or 1h.");
+        }
+        return std::chrono::milliseconds(value * factor);
+    }
+
+    qualified_name split_qualified_name(std::string_view arg)
+    {
+        std::size_t dot = arg.find('.');
+        if (dot == std::string_view::npos)
+        {
+            return {"main", std::string(arg)};
+        }
+        return {std::string(arg.substr(0, dot)), std::string(arg.substr(dot + 1))};
+    }
+
+    std::string quote_identifier(std::string_view name)
+    {
+        std::string quoted = "\"";
+        for (char c : name)
+        {
+            quoted += c;
+            if (c == '"')
+            {
+                quoted += c;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    bool iequals(std::string_view lhs, std::string_view rhs)
+    {
+        return lhs.size() == rhs.size() &&
+            std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b)
+            {
+                return std::toupper(static_cast<unsigned char>(a)) ==
+                       std::toupper(static_cast<unsigned char>(b));
+            });
+    }
+
+    std::string to_upper(std::string_view text)
+    {
+        std::string upper(text);
+        std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c)
+        {
+            return static_cast<char>(std::toupper(c));
+        });
+        return upper;
+    }
+
+    std::string plural(std::size_t count, const std::string& noun)
+    {
+        return std::to_string(count) + " " + noun + (count == 1 ? "" : "s");
+    }
+}
@@ -0,0 +1,259 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "xeus-sqlite/xmaintenance.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Pages freed per pass, keeps a pass short on large databases */
+        constexpr int vacuum_pages = 1000;
+        /* Rows examined per index by the ANALYZE run from PRAGMA optimize */
+        constexpr int analysis_limit = 1000;
+
+        std::string format_duration(std::chrono::steady_clock::duration duration)
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+            return ms < 1000 ? std::to_string(ms) + " ms" : std::to_string(ms / 1000) + " s";
+        }
+
+        int pragma_int(SQLite::Database& db, const char* pragma)
+        {
+            SQLite::Statement query(db, pragma);
+            return query.executeStep() ? query.getColumn(0).getInt() : 0;
+        }
+    }
+
+    maintenance_scheduler::maintenance_scheduler()
+        : m_idle(std::chrono::seconds(60))
+        , m_last_activity(clock::now())
+    {
+    }
+
+    maintenance_scheduler::~maintenance_scheduler()
+    {
+        stop();
+    }
+
+    void maintenance_scheduler::start(std::chrono::milliseconds idle)
+    {
+#ifdef XSQL_EMSCRIPTEN_WASM_BUILD
+        (void)idle;
+        throw std::runtime_error("Background maintenance is not available in this build.");
+#else
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle = idle;
+        m_stage = 0;
+        if (!m_thread.joinable())
+        {
+            m_stop = false;
+            m_thread = std::thread(&maintenance_scheduler::run, this);
+        }
+        m_wakeup.notify_all();
+#endif
+    }
+
+    void maintenance_scheduler::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            if (m_in_pass && m_db != nullptr)
+            {
+                sqlite3_interrupt(m_db->getHandle());
+            }
+        }
+        m_wakeup.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool maintenance_scheduler::running() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_thread.joinable() && !m_stop;
+    }
+
+    void maintenance_scheduler::set_database(const std::string& path, bool read_only)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = path;
+        m_read_only = read_only;
+        m_stage = 0;
+    }
+
+    void maintenance_scheduler::begin_activity()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_busy = true;
+        m_stage = 0;
+        /* The kernel has priority over a running pass, the cell starts once it stopped */
+        if (m_in_pass && m_db != nullptr)
+        {
+            sqlite3_interrupt(m_db->getHandle());
+        }
+        m_pass_done.wait(lock, [this]() { return !m_in_pass; });
+    }
+
+    void maintenance_scheduler::end_activity()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+            m_last_activity = clock::now();
+        }
+        m_wakeup.notify_all();
+    }
+
+    std::string maintenance_scheduler::status() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const bool on = m_thread.joinable() && !m_stop;
+        std::string result = std::string("Maintenance: ") + (on ? "on" : "off");
+        if (on)
+        {
+            result += ", after " + format_duration(m_idle) + " of inactivity";
+            result += "\nDatabase: " + (m_path.empty() ? std::string("none") : m_path) +
+                      (m_read_only ? " (read-only, skipped)" : "");
+        }
+        result += "\nPasses: " + std::to_string(m_passes);
+        if (m_passes != 0)
+        {
+            result += "\nLast pass: " + format_duration(clock::now() - m_last_pass) + " ago, " + m_last_report;
+        }
+        return result;
+    }
+
+    void maintenance_scheduler::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            const clock::time_point deadline = m_last_activity + m_idle * (m_stage + 1);
+            const bool skip = m_path.empty() || m_read_only || m_path == ":memory:";
+            if (m_busy || m_stage == 2 || skip || clock::now() < deadline)
+            {
+                if (m_busy || m_stage == 2 || skip)
+                {
+                    m_wakeup.wait(lock);
+                }
+                else
+                {
+                    m_wakeup.wait_until(lock, deadline);
+                }
+                continue;
+            }
+
+            const bool escalate = m_stage == 1;
+            if (m_db == nullptr || m_db_path != m_path)
+            {
+                m_db.reset();
+                m_db_path = m_path;
+            }
+            m_in_pass = true;
+            lock.unlock();
+
+            run_pass(escalate);
+
+            lock.lock();
+            m_in_pass = false;
+            m_pass_done.notify_all();
+            /* Activity during the pass resets the stage, it will run again */
+            if (!m_busy && m_stage == (escalate ? 1 : 0))
+            {
+                m_stage = escalate ? 2 : 1;
+            }
+        }
+        m_db.reset();
+    }
+
+    bool maintenance_scheduler::pass_cancelled() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_busy || m_stop;
+    }
+
+    void maintenance_scheduler::run_pass(bool escalate)
+    {
+        std::string report;
+        try
+        {
+            if (m_db == nullptr)
+            {
+                /* No busy timeout, a locked database is retried at the next pass */
+                auto db = std::make_unique<SQLite::Database>(m_db_path, SQLite::OPEN_READWRITE);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_db = std::move(db);
+            }
+
+            if (!escalate)
+            {
+                m_db->exec("PRAGMA analysis_limit=" + std::to_string(analysis_limit));
+                m_db->exec("PRAGMA optimize");
+                report += "optimize";
+
+                /* sqlite3_interrupt only stops the statement running, not the next ones */
+                if (pass_cancelled())
+                {
+                    throw std::runtime_error("interrupted");
+                }
+                if (pragma_int(*m_db, "PRAGMA auto_vacuum") == 2)
+                {
+                    int free_pages = pragma_int(*m_db, "PRAGMA freelist_count");
+                    int pages = std::min(free_pages, vacuum_pages);
+                    if (pages > 0)
+                    {
+                        m_db->exec("PRAGMA incremental_vacuum(" + std::to_string(pages) + ")");
+                    }
+                    report += ", incremental_vacuum " + std::to_string(pages) + " pages";
+                }
+            }
+
+            if (pass_cancelled())
+            {
+                throw std::runtime_error("interrupted");
+            }
+            SQLite::Statement mode(*m_db, "PRAGMA journal_mode");
+            if (mode.executeStep() && std::string(mode.getColumn(0).getText()) == "wal")
+            {
+                SQLite::Statement checkpoint(*m_db, escalate ? "PRAGMA wal_checkpoint(TRUNCATE)"
+                                                             : "PRAGMA wal_checkpoint(PASSIVE)");
+                if (checkpoint.executeStep())
+                {
+                    report += std::string(report.empty() ? "" : ", ") + "checkpoint " +
+                              (escalate ? "TRUNCATE " : "PASSIVE ") +
+                              std::to_string(checkpoint.getColumn(2).getInt()) + "/" +
+                              std::to_string(checkpoint.getColumn(1).getInt()) + " frames" +
+                              (checkpoint.getColumn(0).getInt() != 0 ? " (busy)" : "");
+                }
+            }
+            else if (escalate)
+            {
+                report += "nothing to checkpoint";
+            }
+        }
+        catch (const std::exception& err)
+        {
+            report += std::string(report.empty() ? "" : ", ") + "stopped: " + err.what();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_passes;
+        m_last_pass = clock::now();
+        m_last_report = report;
+    }
+}
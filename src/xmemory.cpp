@@ -0,0 +1,235 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xmemory.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Page size the pool slots are sized for, larger pages use the heap */
+        constexpr int pool_page_size = 4096;
+
+        /* What configure_sqlite_memory applied, for the report */
+        sqlite_memory_options applied_options;
+        int pagecache_slot_size = 0;
+        int pagecache_slots = 0;
+
+        bool starts_with(std::string_view text, std::string_view prefix)
+        {
+            return text.substr(0, prefix.size()) == prefix;
+        }
+
+        int parse_count(std::string_view text, const std::string& option)
+        {
+            int value = 0;
+            auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+            if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size() || value <= 0)
+            {
+                throw std::runtime_error("Invalid value " + std::string(text) + " for " + option + ".");
+            }
+            return value;
+        }
+
+        std::int64_t status(int op, bool reset, bool highwater)
+        {
+            sqlite3_int64 current = 0;
+            sqlite3_int64 peak = 0;
+            sqlite3_status64(op, &current, &peak, reset ? 1 : 0);
+            return highwater ? peak : current;
+        }
+
+        int db_status(sqlite3* db, int op, bool reset)
+        {
+            int current = 0;
+            int peak = 0;
+            sqlite3_db_status(db, op, &current, &peak, reset ? 1 : 0);
+            return current;
+        }
+    }
+
+    sqlite_memory_options parse_sqlite_memory_options(int& argc, char* argv[])
+    {
+        sqlite_memory_options options;
+        int kept = 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view arg(argv[i]);
+            if (starts_with(arg, "--sqlite-pagecache="))
+            {
+                options.pagecache = parse_byte_size(arg.substr(19));
+            }
+            else if (starts_with(arg, "--sqlite-heap-limit="))
+            {
+                options.heap_limit = parse_byte_size(arg.substr(20));
+            }
+            else if (starts_with(arg, "--sqlite-lookaside="))
+            {
+                std::string_view value = arg.substr(19);
+                std::size_t comma = value.find(',');
+                if (comma == std::string_view::npos)
+                {
+                    throw std::runtime_error("Invalid value " + std::string(value) +
+                                             " for --sqlite-lookaside, expected <slot size>,<slots>.");
+                }
+                options.lookaside_slot_size = parse_count(value.substr(0, comma), "--sqlite-lookaside");
+                options.lookaside_slots = parse_count(value.substr(comma + 1), "--sqlite-lookaside");
+            }
+            else
+            {
+                argv[kept++] = argv[i];
+            }
+        }
+        argc = kept;
+        return options;
+    }
+
+    void configure_sqlite_memory(const sqlite_memory_options& options)
+    {
+        if (options.pagecache > 0)
+        {
+            int header = 0;
+            sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &header);
+            const int slot_size = pool_page_size + header;
+            const std::int64_t slots = options.pagecache / slot_size;
+            if (slots < 1 || slots > 0x7fffffff)
+            {
+                throw std::runtime_error("Invalid page cache size " + format_bytes(options.pagecache) + ".");
+            }
+            /* Owned by SQLite until the process exits */
+            void* pool = std::malloc(static_cast<std::size_t>(slots) * static_cast<std::size_t>(slot_size));
+            if (pool == nullptr ||
+                sqlite3_config(SQLITE_CONFIG_PAGECACHE, pool, slot_size, static_cast<int>(slots)) != SQLITE_OK)
+            {
+                std::free(pool);
+                throw std::runtime_error("Could not configure the SQLite page cache, it must be done before opening a database.");
+            }
+            pagecache_slot_size = slot_size;
+            pagecache_slots = static_cast<int>(slots);
+        }
+
+        if (options.lookaside_slots > 0 &&
+            sqlite3_config(SQLITE_CONFIG_LOOKASIDE, options.lookaside_slot_size, options.lookaside_slots) != SQLITE_OK)
+        {
+            throw std::runtime_error("Could not configure the SQLite lookaside, it must be done before opening a database.");
+        }
+
+        if (options.heap_limit > 0)
+        {
+            /* Caches are released at the soft limit, before allocations fail */
+            sqlite3_hard_heap_limit64(options.heap_limit);
+            sqlite3_soft_heap_limit64(options.heap_limit / 10 * 9);
+        }
+        applied_options = options;
+    }
+
+    std::int64_t parse_byte_size(std::string_view text)
+    {
+        std::int64_t value = 0;
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        std::string unit = to_upper(text.substr(static_cast<std::size_t>(parsed.ptr - text.data())));
+        if (!unit.empty() && unit.back() == 'B')
+        {
+            unit.pop_back();
+        }
+
+        std::int64_t factor = 0;
+        if (unit.empty())
+        {
+            factor = 1;
+        }
+        else if (unit == "K" || unit == "KI")
+        {
+            factor = std::int64_t(1) << 10;
+        }
+        else if (unit == "M" || unit == "MI")
+        {
+            factor = std::int64_t(1) << 20;
+        }
+        else if (unit == "G" || unit == "GI")
+        {
+            factor = std::int64_t(1) << 30;
+        }
+
+        if (parsed.ec != std::errc() || parsed.ptr == text.data() || value <= 0 || factor == 0 ||
+            value > (std::int64_t(1) << 62) / factor)
+        {
+            throw std::runtime_error("Invalid size " + std::string(text) + ", expected for instance 512K, 64M or 1G.");
+        }
+        return value * factor;
+    }
+
+    std::string format_bytes(std::int64_t bytes)
+    {
+        static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        double value = static_cast<double>(bytes);
+        int unit = 0;
+        while (value >= 1024.0 && unit < 4)
+        {
+            value /= 1024.0;
+            ++unit;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+        return buffer;
+    }
+
+    std::string sqlite_memory_report(bool reset)
+    {
+        std::string report = "SQLite heap: " + format_bytes(sqlite3_memory_used()) + " used, " +
+                             format_bytes(sqlite3_memory_highwater(reset ? 1 : 0)) + " peak, " +
+                             std::to_string(status(SQLITE_STATUS_MALLOC_COUNT, reset, false)) + " allocations";
+
+        const sqlite3_int64 hard = sqlite3_hard_heap_limit64(-1);
+        const sqlite3_int64 soft = sqlite3_soft_heap_limit64(-1);
+        report += "\nHeap limit: " + (hard > 0 ? format_bytes(hard) : std::string("none"));
+        if (soft > 0)
+        {
+            report += " (caches released from " + format_bytes(soft) + ")";
+        }
+
+        if (pagecache_slots > 0)
+        {
+            report += "\nPage cache pool: " +
+                      std::to_string(status(SQLITE_STATUS_PAGECACHE_USED, reset, false)) + " of " +
+                      std::to_string(pagecache_slots) + " slots of " + format_bytes(pagecache_slot_size) +
+                      " used, " + format_bytes(status(SQLITE_STATUS_PAGECACHE_OVERFLOW, reset, false)) +
+                      " on the heap";
+        }
+        if (applied_options.lookaside_slots > 0)
+        {
+            report += "\nLookaside: " + std::to_string(applied_options.lookaside_slots) + " slots of " +
+                      format_bytes(applied_options.lookaside_slot_size) + " per connection";
+        }
+        return report;
+    }
+
+    std::string connection_memory_report(sqlite3* db, bool reset)
+    {
+        const int hits = db_status(db, SQLITE_DBSTATUS_CACHE_HIT, reset);
+        const int misses = db_status(db, SQLITE_DBSTATUS_CACHE_MISS, reset);
+        std::string report = "cache " + format_bytes(db_status(db, SQLITE_DBSTATUS_CACHE_USED, reset)) +
+                             ", schema " + format_bytes(db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, reset)) +
+                             ", statements " + format_bytes(db_status(db, SQLITE_DBSTATUS_STMT_USED, reset)) +
+                             ", lookaside " + std::to_string(db_status(db, SQLITE_DBSTATUS_LOOKASIDE_USED, reset)) +
+                             " slots";
+        if (hits + misses > 0)
+        {
+            report += ", cache hits " + std::to_string(100LL * hits / (hits + misses)) + "%";
+        }
+        return report;
+    }
+}
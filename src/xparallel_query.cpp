@@ -0,0 +1,1178 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+
+#ifndef XSQL_EMSCRIPTEN_WASM_BUILD
+#include <thread>
+#endif
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xparallel_query.hpp"
+#include "xeus-sqlite/xsql_functions.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /*****************
+         * SQL tokenizer *
+         *****************/
+
+        struct sql_token
+        {
+            std::string_view text;
+            /* Parenthesis depth, both parentheses of a pair get the outer one */
+            int depth;
+        };
+
+        using token_range = std::pair<std::size_t, std::size_t>;
+
+        inline bool is_word_char(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' ||
+                   static_cast<unsigned char>(c) >= 0x80;
+        }
+
+        std::vector<sql_token> tokenize_sql(std::string_view sql)
+        {
+            std::vector<sql_token> tokens;
+            int depth = 0;
+            std::size_t pos = 0;
+            while (pos < sql.size())
+            {
+                char c = sql[pos];
+                if (std::isspace(static_cast<unsigned char>(c)))
+                {
+                    ++pos;
+                }
+                else if (sql.compare(pos, 2, "--") == 0)
+                {
+                    std::size_t end = sql.find('\n', pos);
+                    pos = end == std::string_view::npos ? sql.size() : end;
+                }
+                else if (sql.compare(pos, 2, "/*") == 0)
+                {
+                    std::size_t end = sql.find("*/", pos + 2);
+                    pos = end == std::string_view::npos ? sql.size() : end + 2;
+                }
+                else if (c == '\'' || c == '"' || c == '`' || c == '[')
+                {
+                    /* Quotes are escaped by doubling them */
+                    const char close = c == '[' ? ']' : c;
+                    std::size_t end = pos + 1;
+                    while (end < sql.size())
+                    {
+                        if (sql[end] == close)
+                        {
+                            if (close != ']' && end + 1 < sql.size() && sql[end + 1] == close)
+                            {
+                                end += 2;
+                                continue;
+                            }
+                            break;
+                        }
+                        ++end;
+                    }
+                    end = std::min(end + 1, sql.size());
+                    tokens.push_back({sql.substr(pos, end - pos), depth});
+                    pos = end;
+                }
+                else if (is_word_char(c))
+                {
+                    std::size_t end = pos;
+                    while (end < sql.size() && is_word_char(sql[end]))
+                    {
+                        ++end;
+                    }
+                    tokens.push_back({sql.substr(pos, end - pos), depth});
+                    pos = end;
+                }
+                else
+                {
+                    if (c == ')')
+                    {
+                        --depth;
+                    }
+                    tokens.push_back({sql.substr(pos, 1), depth});
+                    if (c == '(')
+                    {
+                        ++depth;
+                    }
+                    ++pos;
+                }
+            }
+
+            if (!tokens.empty() && tokens.back().text == ";")
+            {
+                tokens.pop_back();
+            }
+            return tokens;
+        }
+
+        /* Lower case text with identifier quotes removed, used to compare terms */
+        std::string normalize(const std::vector<sql_token>& tokens, token_range range)
+        {
+            std::string result;
+            for (std::size_t i = range.first; i < range.second; ++i)
+            {
+                std::string_view text = tokens[i].text;
+                if (text.size() >= 2 && (text.front() == '"' || text.front() == '`' || text.front() == '['))
+                {
+                    text = text.substr(1, text.size() - 2);
+                }
+                if (text.empty() || text.front() != '\'')
+                {
+                    std::string lower(text);
+                    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char ch)
+                    {
+                        return static_cast<char>(std::tolower(ch));
+                    });
+                    result += lower;
+                }
+                else
+                {
+                    result += text;
+                }
+                result += ' ';
+            }
+            if (!result.empty())
+            {
+                result.pop_back();
+            }
+            return result;
+        }
+
+        std::string original_text(const std::vector<sql_token>& tokens, token_range range)
+        {
+            if (range.first >= range.second)
+            {
+                return "";
+            }
+            const char* first = tokens[range.first].text.data();
+            const char* last = tokens[range.second - 1].text.data() + tokens[range.second - 1].text.size();
+            return std::string(first, static_cast<std::size_t>(last - first));
+        }
+
+        /* Splits a range on the commas at the given depth */
+        std::vector<token_range> split_on_commas(const std::vector<sql_token>& tokens,
+                                                 token_range range,
+                                                 int depth)
+        {
+            std::vector<token_range> parts;
+            std::size_t start = range.first;
+            for (std::size_t i = range.first; i < range.second; ++i)
+            {
+                if (tokens[i].depth == depth && tokens[i].text == ",")
+                {
+                    parts.emplace_back(start, i);
+                    start = i + 1;
+                }
+            }
+            parts.emplace_back(start, range.second);
+            return parts;
+        }
+
+        /*********************
+         * Select list items *
+         *********************/
+
+        struct select_item
+        {
+            token_range expression;
+            std::string alias;
+            aggregate_kind aggregate = aggregate_kind::none;
+        };
+
+        bool is_aggregate_name(std::string_view name)
+        {
+            for (const char* aggregate : {"count", "sum", "total", "min", "max", "avg",
+                                          "group_concat", "string_agg"})
+            {
+                if (iequals(name, aggregate))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /* Index after the parenthesis closing the one at open */
+        std::size_t skip_parentheses(const std::vector<sql_token>& tokens, std::size_t open)
+        {
+            std::size_t i = open + 1;
+            while (i < tokens.size() && !(tokens[i].text == ")" && tokens[i].depth == tokens[open].depth))
+            {
+                ++i;
+            }
+            return i + 1;
+        }
+
+        bool has_arguments_separator(const std::vector<sql_token>& tokens, std::size_t open)
+        {
+            const std::size_t close = skip_parentheses(tokens, open) - 1;
+            for (std::size_t i = open + 1; i < close && i < tokens.size(); ++i)
+            {
+                if (tokens[i].depth == tokens[open].depth + 1 && tokens[i].text == ",")
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        select_item parse_item(const std::vector<sql_token>& tokens, token_range range)
+        {
+            select_item item;
+            std::size_t end = range.second;
+            const int depth = tokens[range.first].depth;
+
+            /* expr AS alias, or expr alias after a closing parenthesis or a name */
+            const bool keyword_end = iequals(tokens[end - 1].text, "END") ||
+                                     iequals(tokens[end - 1].text, "NULL") ||
+                                     iequals(tokens[end - 1].text, "TRUE") ||
+                                     iequals(tokens[end - 1].text, "FALSE");
+            if (end - range.first >= 3 && iequals(tokens[end - 2].text, "AS"))
+            {
+                item.alias = normalize(tokens, {end - 1, end});
+                end -= 2;
+            }
+            else if (end - range.first >= 2 && !keyword_end && tokens[end - 1].depth == depth &&
+                     is_word_char(tokens[end - 1].text.front()) &&
+                     (tokens[end - 2].text == ")" || is_word_char(tokens[end - 2].text.front()) ||
+                      tokens[end - 2].text.front() == '"'))
+            {
+                item.alias = normalize(tokens, {end - 1, end});
+                end -= 1;
+            }
+            item.expression = {range.first, end};
+
+            const std::size_t first = range.first;
+            for (std::size_t i = first; i < end; ++i)
+            {
+                if (iequals(tokens[i].text, "OVER"))
+                {
+                    throw std::runtime_error("Window functions cannot be merged across files.");
+                }
+            }
+
+            /* A single aggregate call, like count(*) or max(x) */
+            const bool single_call = end - first >= 3 && tokens[first + 1].text == "(" &&
+                                     skip_parentheses(tokens, first + 1) == end;
+            if (single_call && is_aggregate_name(tokens[first].text) &&
+                !((iequals(tokens[first].text, "min") || iequals(tokens[first].text, "max")) &&
+                  has_arguments_separator(tokens, first + 1)))
+            {
+                std::string_view name = tokens[first].text;
+                if (iequals(tokens[first + 2].text, "DISTINCT"))
+                {
+                    throw std::runtime_error("DISTINCT aggregates cannot be merged across files.");
+                }
+                if (iequals(name, "count"))
+                {
+                    item.aggregate = aggregate_kind::count;
+                }
+                else if (iequals(name, "sum"))
+                {
+                    item.aggregate = aggregate_kind::sum;
+                }
+                else if (iequals(name, "total"))
+                {
+                    item.aggregate = aggregate_kind::total;
+                }
+                else if (iequals(name, "min"))
+                {
+                    item.aggregate = aggregate_kind::min;
+                }
+                else if (iequals(name, "max"))
+                {
+                    item.aggregate = aggregate_kind::max;
+                }
+                else if (iequals(name, "avg"))
+                {
+                    throw std::runtime_error("AVG cannot be merged across files, select SUM and COUNT instead.");
+                }
+                else
+                {
+                    throw std::runtime_error(to_upper(name) + " cannot be merged across files.");
+                }
+                return item;
+            }
+
+            for (std::size_t i = first; i + 1 < end; ++i)
+            {
+                if (is_aggregate_name(tokens[i].text) && tokens[i + 1].text == "(" &&
+                    !has_arguments_separator(tokens, i + 1))
+                {
+                    throw std::runtime_error("Cannot merge " + original_text(tokens, {first, end}) +
+                                             ", only COUNT, SUM, TOTAL, MIN and MAX columns are combined.");
+                }
+            }
+            return item;
+        }
+
+        /* Resolves an ORDER BY or GROUP BY term to a result column */
+        std::size_t resolve_term(const std::vector<sql_token>& tokens,
+                                 token_range term,
+                                 const std::vector<select_item>& items,
+                                 const std::vector<std::string>& column_names)
+        {
+            std::string text = normalize(tokens, term);
+            std::size_t position = 0;
+            auto parsed = std::from_chars(text.data(), text.data() + text.size(), position);
+            if (parsed.ec == std::errc() && parsed.ptr == text.data() + text.size())
+            {
+                if (position == 0 || position > column_names.size())
+                {
+                    throw std::runtime_error("Term " + text + " is out of range.");
+                }
+                return position - 1;
+            }
+
+            for (std::size_t col = 0; col < items.size(); ++col)
+            {
+                if (items[col].alias == text || normalize(tokens, items[col].expression) == text)
+                {
+                    return col;
+                }
+            }
+            for (std::size_t col = 0; col < column_names.size(); ++col)
+            {
+                if (iequals(column_names[col], text))
+                {
+                    return col;
+                }
+            }
+            throw std::runtime_error("Term " + original_text(tokens, term) +
+                                     " must be one of the selected columns to be merged across files.");
+        }
+
+        /*****************
+         * Cell ordering *
+         *****************/
+
+        int type_rank(cell_type type)
+        {
+            switch (type)
+            {
+                case cell_type::null: return 0;
+                case cell_type::integer:
+                case cell_type::floating: return 1;
+                case cell_type::text: return 2;
+                default: return 3;
+            }
+        }
+
+        std::int64_t to_integer(std::string_view text)
+        {
+            std::int64_t value = 0;
+            std::from_chars(text.data(), text.data() + text.size(), value);
+            return value;
+        }
+
+        double to_double(std::string_view text)
+        {
+            char buffer[64];
+            std::size_t size = std::min(text.size(), sizeof(buffer) - 1);
+            std::memcpy(buffer, text.data(), size);
+            buffer[size] = '\0';
+            return std::strtod(buffer, nullptr);
+        }
+
+        std::string format_double(double value)
+        {
+            /* SQLite always shows a decimal point for REAL values */
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+            std::string text(buffer);
+            if (text.find_first_of(".eni") == std::string::npos)
+            {
+                text += ".0";
+            }
+            return text;
+        }
+
+        /* Same ordering as SQLite with the BINARY collation */
+        int compare_cells(cell_type lhs_type, std::string_view lhs,
+                          cell_type rhs_type, std::string_view rhs)
+        {
+            const int lhs_rank = type_rank(lhs_type);
+            const int rhs_rank = type_rank(rhs_type);
+            if (lhs_rank != rhs_rank)
+            {
+                return lhs_rank < rhs_rank ? -1 : 1;
+            }
+            if (lhs_rank == 0)
+            {
+                return 0;
+            }
+            if (lhs_rank == 1)
+            {
+                if (lhs_type == cell_type::integer && rhs_type == cell_type::integer)
+                {
+                    std::int64_t a = to_integer(lhs);
+                    std::int64_t b = to_integer(rhs);
+                    return a < b ? -1 : (a > b ? 1 : 0);
+                }
+                double a = to_double(lhs);
+                double b = to_double(rhs);
+                return a < b ? -1 : (a > b ? 1 : 0);
+            }
+            int result = lhs.compare(rhs);
+            return result < 0 ? -1 : (result > 0 ? 1 : 0);
+        }
+
+        struct row_ref
+        {
+            const result_table* table;
+            std::size_t row;
+        };
+
+        /* Negative when lhs comes first */
+        int compare_rows(const row_ref& lhs, const row_ref& rhs, const std::vector<order_term>& order)
+        {
+            for (const order_term& term : order)
+            {
+                cell_type lhs_type = lhs.table->type(lhs.row, term.column);
+                cell_type rhs_type = rhs.table->type(rhs.row, term.column);
+                const bool lhs_null = lhs_type == cell_type::null;
+                const bool rhs_null = rhs_type == cell_type::null;
+                if (lhs_null != rhs_null)
+                {
+                    return lhs_null == term.nulls_first ? -1 : 1;
+                }
+
+                int result = compare_cells(lhs_type, lhs.table->cell(lhs.row, term.column),
+                                           rhs_type, rhs.table->cell(rhs.row, term.column));
+                if (result != 0)
+                {
+                    return term.descending ? -result : result;
+                }
+            }
+            return 0;
+        }
+
+        /************************
+         * Aggregate combination *
+         ************************/
+
+        struct value
+        {
+            cell_type type;
+            std::string text;
+        };
+
+        void combine(aggregate_kind kind, value& acc, cell_type type, std::string_view text)
+        {
+            if (type == cell_type::null)
+            {
+                return;
+            }
+            if (acc.type == cell_type::null)
+            {
+                acc.type = type;
+                acc.text.assign(text);
+                return;
+            }
+
+            switch (kind)
+            {
+                case aggregate_kind::count:
+                case aggregate_kind::sum:
+                {
+                    if (acc.type == cell_type::integer && type == cell_type::integer)
+                    {
+                        std::int64_t a = to_integer(acc.text);
+                        std::int64_t b = to_integer(text);
+                        const bool overflow = (b > 0 && a > std::numeric_limits<std::int64_t>::max() - b) ||
+                                              (b < 0 && a < std::numeric_limits<std::int64_t>::min() - b);
+                        if (!overflow)
+                        {
+                            acc.text = std::to_string(a + b);
+                            break;
+                        }
+                        if (kind == aggregate_kind::sum)
+                        {
+                            throw std::runtime_error("integer overflow");
+                        }
+                    }
+                    acc.type = cell_type::floating;
+                    acc.text = format_double(to_double(acc.text) + to_double(text));
+                    break;
+                }
+                case aggregate_kind::total:
+                    acc.type = cell_type::floating;
+                    acc.text = format_double(to_double(acc.text) + to_double(text));
+                    break;
+                case aggregate_kind::min:
+                case aggregate_kind::max:
+                {
+                    int result = compare_cells(type, text, acc.type, acc.text);
+                    if ((kind == aggregate_kind::min && result < 0) ||
+                        (kind == aggregate_kind::max && result > 0))
+                    {
+                        acc.type = type;
+                        acc.text.assign(text);
+                    }
+                    break;
+                }
+                case aggregate_kind::none:
+                    break;
+            }
+        }
+
+        result_table empty_like(const result_table& table)
+        {
+            result_table result;
+            for (std::size_t col = 0; col < table.column_count(); ++col)
+            {
+                result.add_column(table.column_name(col), table.column_declared_type(col));
+            }
+            return result;
+        }
+
+        result_table merge_groups(const std::vector<result_table>& parts, const merge_plan& plan)
+        {
+            const std::size_t columns = plan.aggregates.size();
+            std::unordered_map<std::string, std::size_t> group_index;
+            std::vector<std::vector<value>> groups;
+            std::string key;
+
+            for (const result_table& part : parts)
+            {
+                for (std::size_t row = 0; row < part.row_count(); ++row)
+                {
+                    /* The key holds the type and size of each cell to stay unambiguous */
+                    key.clear();
+                    for (std::size_t col = 0; col < columns; ++col)
+                    {
+                        if (plan.aggregates[col] == aggregate_kind::none)
+                        {
+                            std::string_view text = part.cell(row, col);
+                            key += static_cast<char>(part.type(row, col));
+                            key += std::to_string(text.size());
+                            key += ':';
+                            key += text;
+                        }
+                    }
+
+                    auto inserted = group_index.emplace(key, groups.size());
+                    if (inserted.second)
+                    {
+                        std::vector<value> group;
+                        group.reserve(columns);
+                        for (std::size_t col = 0; col < columns; ++col)
+                        {
+                            group.push_back({part.type(row, col), std::string(part.cell(row, col))});
+                        }
+                        groups.push_back(std::move(group));
+                        continue;
+                    }
+
+                    std::vector<value>& group = groups[inserted.first->second];
+                    for (std::size_t col = 0; col < columns; ++col)
+                    {
+                        if (plan.aggregates[col] != aggregate_kind::none)
+                        {
+                            combine(plan.aggregates[col], group[col], part.type(row, col), part.cell(row, col));
+                        }
+                    }
+                }
+            }
+
+            result_table combined = empty_like(parts.front());
+            combined.reserve_rows(groups.size());
+            for (const auto& group : groups)
+            {
+                for (const value& cell : group)
+                {
+                    combined.push_cell(cell.type, cell.text.data(), cell.text.size());
+                }
+            }
+
+            if (plan.order.empty())
+            {
+                return combined;
+            }
+
+            std::vector<std::size_t> rows(combined.row_count());
+            for (std::size_t row = 0; row < rows.size(); ++row)
+            {
+                rows[row] = row;
+            }
+            std::stable_sort(rows.begin(), rows.end(), [&](std::size_t lhs, std::size_t rhs)
+            {
+                return compare_rows({&combined, lhs}, {&combined, rhs}, plan.order) < 0;
+            });
+
+            result_table sorted = empty_like(combined);
+            sorted.reserve_rows(rows.size());
+            for (std::size_t row : rows)
+            {
+                sorted.push_row(combined, row);
+            }
+            return sorted;
+        }
+
+        /*************
+         * File glob *
+         *************/
+
+        bool has_wildcard(const std::string& text)
+        {
+            return text.find_first_of("*?[") != std::string::npos;
+        }
+
+        bool match_component(std::string_view pattern, std::string_view name)
+        {
+            std::size_t p = 0;
+            std::size_t n = 0;
+            std::size_t star = std::string_view::npos;
+            std::size_t star_match = 0;
+
+            while (n < name.size())
+            {
+                if (p < pattern.size() && pattern[p] == '*')
+                {
+                    star = p++;
+                    star_match = n;
+                    continue;
+                }
+                if (p < pattern.size() && pattern[p] == '[')
+                {
+                    std::size_t close = pattern.find(']', p + 2);
+                    if (close != std::string_view::npos)
+                    {
+                        const bool negate = pattern[p + 1] == '!' || pattern[p + 1] == '^';
+                        bool found = false;
+                        for (std::size_t i = p + 1 + (negate ? 1 : 0); i < close; ++i)
+                        {
+                            if (i + 2 < close && pattern[i + 1] == '-')
+                            {
+                                found |= name[n] >= pattern[i] && name[n] <= pattern[i + 2];
+                                i += 2;
+                            }
+                            else
+                            {
+                                found |= name[n] == pattern[i];
+                            }
+                        }
+                        if (found != negate)
+                        {
+                            p = close + 1;
+                            ++n;
+                            continue;
+                        }
+                    }
+                }
+                else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+                {
+                    ++p;
+                    ++n;
+                    continue;
+                }
+
+                if (star == std::string_view::npos)
+                {
+                    return false;
+                }
+                p = star + 1;
+                n = ++star_match;
+            }
+
+            while (p < pattern.size() && pattern[p] == '*')
+            {
+                ++p;
+            }
+            return p == pattern.size();
+        }
+    }
+
+    merge_plan plan_merge(std::string_view sql, const std::vector<std::string>& column_names)
+    {
+        std::vector<sql_token> tokens = tokenize_sql(sql);
+
+        /* The main SELECT is the first one outside of parentheses, after the CTEs */
+        std::size_t select = 0;
+        while (select < tokens.size() && !(tokens[select].depth == 0 && iequals(tokens[select].text, "SELECT")))
+        {
+            ++select;
+        }
+        if (select == tokens.size())
+        {
+            throw std::runtime_error("%PARALLEL only runs SELECT queries.");
+        }
+
+        std::size_t items_begin = select + 1;
+        if (items_begin < tokens.size() && iequals(tokens[items_begin].text, "DISTINCT"))
+        {
+            throw std::runtime_error("SELECT DISTINCT cannot be merged across files.");
+        }
+        if (items_begin < tokens.size() && iequals(tokens[items_begin].text, "ALL"))
+        {
+            ++items_begin;
+        }
+
+        /* Top-level clauses */
+        std::size_t items_end = tokens.size();
+        std::size_t group_by = 0;
+        std::size_t order_by = 0;
+        std::size_t limit = 0;
+        for (std::size_t i = items_begin; i < tokens.size(); ++i)
+        {
+            if (tokens[i].depth != 0)
+            {
+                continue;
+            }
+            std::string_view word = tokens[i].text;
+            if (iequals(word, "UNION") || iequals(word, "INTERSECT") || iequals(word, "EXCEPT"))
+            {
+                throw std::runtime_error("Compound SELECT statements cannot be merged across files.");
+            }
+            if (iequals(word, "HAVING"))
+            {
+                throw std::runtime_error("HAVING cannot be merged across files.");
+            }
+            if (iequals(word, "OFFSET"))
+            {
+                throw std::runtime_error("OFFSET cannot be merged across files.");
+            }
+            if (iequals(word, "FROM") || iequals(word, "WHERE") || iequals(word, "WINDOW"))
+            {
+                items_end = std::min(items_end, i);
+            }
+            else if (iequals(word, "GROUP") && i + 1 < tokens.size() && iequals(tokens[i + 1].text, "BY"))
+            {
+                items_end = std::min(items_end, i);
+                group_by = i + 2;
+            }
+            else if (iequals(word, "ORDER") && i + 1 < tokens.size() && iequals(tokens[i + 1].text, "BY"))
+            {
+                items_end = std::min(items_end, i);
+                order_by = i + 2;
+            }
+            else if (iequals(word, "LIMIT"))
+            {
+                items_end = std::min(items_end, i);
+                limit = i + 1;
+            }
+        }
+
+        merge_plan plan;
+        plan.aggregates.assign(column_names.size(), aggregate_kind::none);
+
+        std::vector<select_item> items;
+        bool star = false;
+        for (token_range range : split_on_commas(tokens, {items_begin, items_end}, 0))
+        {
+            if (range.first == range.second)
+            {
+                continue;
+            }
+            if (tokens[range.second - 1].text == "*")
+            {
+                star = true;
+                continue;
+            }
+            items.push_back(parse_item(tokens, range));
+        }
+
+        const bool has_aggregate = std::any_of(items.begin(), items.end(),
+                                               [](const select_item& item) { return item.aggregate != aggregate_kind::none; });
+        if (star && has_aggregate)
+        {
+            throw std::runtime_error("SELECT * cannot be merged across files with aggregates.");
+        }
+        if (star)
+        {
+            /* Columns cannot be mapped to the items, only names and positions are resolved */
+            items.clear();
+        }
+        else if (items.size() == column_names.size())
+        {
+            for (std::size_t col = 0; col < items.size(); ++col)
+            {
+                plan.aggregates[col] = items[col].aggregate;
+            }
+        }
+        else if (has_aggregate)
+        {
+            throw std::runtime_error("The selected columns cannot be matched to the result, "
+                                     "the aggregates cannot be merged across files.");
+        }
+        plan.grouped = group_by != 0 || has_aggregate;
+
+        /* Columns that are neither grouped nor aggregated take the value of any row of SQLite */
+        std::vector<bool> in_group(column_names.size(), false);
+
+        if (group_by != 0)
+        {
+            if (star)
+            {
+                throw std::runtime_error("GROUP BY cannot be merged across files with SELECT *.");
+            }
+            std::size_t group_end = group_by;
+            while (group_end < tokens.size() && tokens[group_end].depth >= 0 &&
+                   !(tokens[group_end].depth == 0 && (iequals(tokens[group_end].text, "ORDER") ||
+                                                      iequals(tokens[group_end].text, "LIMIT") ||
+                                                      iequals(tokens[group_end].text, "WINDOW"))))
+            {
+                ++group_end;
+            }
+            for (token_range term : split_on_commas(tokens, {group_by, group_end}, 0))
+            {
+                std::size_t col = resolve_term(tokens, term, items, column_names);
+                if (plan.aggregates[col] != aggregate_kind::none)
+                {
+                    throw std::runtime_error("GROUP BY terms must not be aggregates.");
+                }
+                in_group[col] = true;
+            }
+        }
+        if (plan.grouped)
+        {
+            for (std::size_t col = 0; col < column_names.size(); ++col)
+            {
+                if (plan.aggregates[col] == aggregate_kind::none && !in_group[col])
+                {
+                    throw std::runtime_error("Column " + column_names[col] + " is neither aggregated nor in "
+                                             "GROUP BY, it cannot be merged across files.");
+                }
+            }
+        }
+
+        if (order_by != 0)
+        {
+            std::size_t order_end = order_by;
+            while (order_end < tokens.size() &&
+                   !(tokens[order_end].depth == 0 && iequals(tokens[order_end].text, "LIMIT")))
+            {
+                ++order_end;
+            }
+            for (token_range term : split_on_commas(tokens, {order_by, order_end}, 0))
+            {
+                order_term order{0, false, true};
+                bool nulls_set = false;
+                if (term.second - term.first >= 2 && iequals(tokens[term.second - 2].text, "NULLS"))
+                {
+                    order.nulls_first = iequals(tokens[term.second - 1].text, "FIRST");
+                    nulls_set = true;
+                    term.second -= 2;
+                }
+                if (term.second > term.first && (iequals(tokens[term.second - 1].text, "DESC") ||
+                                                 iequals(tokens[term.second - 1].text, "ASC")))
+                {
+                    order.descending = iequals(tokens[term.second - 1].text, "DESC");
+                    term.second -= 1;
+                }
+                if (!nulls_set)
+                {
+                    order.nulls_first = !order.descending;
+                }
+                for (std::size_t i = term.first; i < term.second; ++i)
+                {
+                    if (iequals(tokens[i].text, "COLLATE"))
+                    {
+                        throw std::runtime_error("COLLATE in ORDER BY cannot be merged across files.");
+                    }
+                }
+                order.column = resolve_term(tokens, term, items, column_names);
+                plan.order.push_back(order);
+            }
+        }
+
+        if (limit != 0)
+        {
+            if (plan.grouped)
+            {
+                throw std::runtime_error("LIMIT cannot be combined with aggregates across files.");
+            }
+            long long value = 0;
+            bool negative = limit < tokens.size() && tokens[limit].text == "-";
+            std::size_t number = negative ? limit + 1 : limit;
+            if (number + 1 != tokens.size() ||
+                std::from_chars(tokens[number].text.data(),
+                                tokens[number].text.data() + tokens[number].text.size(),
+                                value).ptr != tokens[number].text.data() + tokens[number].text.size())
+            {
+                throw std::runtime_error("LIMIT must be an integer to be merged across files.");
+            }
+            plan.limit = negative ? -1 : value;
+        }
+
+        return plan;
+    }
+
+    result_table merge_results(const std::vector<result_table>& parts, const merge_plan& plan)
+    {
+        if (parts.empty())
+        {
+            return result_table();
+        }
+        for (const result_table& part : parts)
+        {
+            if (part.column_count() != parts.front().column_count())
+            {
+                throw std::runtime_error("The files do not return the same columns.");
+            }
+        }
+
+        if (plan.grouped)
+        {
+            return merge_groups(parts, plan);
+        }
+
+        result_table merged = empty_like(parts.front());
+        std::size_t total_rows = 0;
+        for (const result_table& part : parts)
+        {
+            total_rows += part.row_count();
+        }
+        const std::size_t limit = plan.limit < 0 ? total_rows :
+            std::min(total_rows, static_cast<std::size_t>(plan.limit));
+        merged.reserve_rows(limit);
+
+        if (plan.order.empty())
+        {
+            for (const result_table& part : parts)
+            {
+                for (std::size_t row = 0; row < part.row_count() && merged.row_count() < limit; ++row)
+                {
+                    merged.push_row(part, row);
+                }
+            }
+            return merged;
+        }
+
+        /* k-way merge, each part is already sorted by SQLite */
+        auto later = [&plan](const row_ref& lhs, const row_ref& rhs)
+        {
+            int result = compare_rows(lhs, rhs, plan.order);
+            return result != 0 ? result > 0 : lhs.table > rhs.table;
+        };
+        std::priority_queue<row_ref, std::vector<row_ref>, decltype(later)> heads(later);
+        for (const result_table& part : parts)
+        {
+            if (part.row_count() != 0)
+            {
+                heads.push({&part, 0});
+            }
+        }
+
+        while (!heads.empty() && merged.row_count() < limit)
+        {
+            row_ref head = heads.top();
+            heads.pop();
+            merged.push_row(*head.table, head.row);
+            if (head.row + 1 < head.table->row_count())
+            {
+                heads.push({head.table, head.row + 1});
+            }
+        }
+        return merged;
+    }
+
+    std::vector<std::string> glob_files(const std::string& pattern)
+    {
+        std::vector<std::string> files;
+        std::error_code ec;
+        if (!has_wildcard(pattern))
+        {
+            if (fs::is_regular_file(pattern, ec))
+            {
+                files.push_back(pattern);
+            }
+            return files;
+        }
+
+        std::vector<fs::path> candidates{fs::path()};
+        for (const fs::path& component : fs::path(pattern))
+        {
+            std::vector<fs::path> expanded;
+            const std::string name = component.string();
+            for (const fs::path& candidate : candidates)
+            {
+                if (!has_wildcard(name))
+                {
+                    expanded.push_back(candidate / component);
+                    continue;
+                }
+
+                const fs::path directory = candidate.empty() ? fs::path(".") : candidate;
+                for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+                {
+                    const std::string entry = it->path().filename().string();
+                    /* Hidden files are only matched explicitly */
+                    if ((entry[0] != '.' || name[0] == '.') && match_component(name, entry))
+                    {
+                        expanded.push_back(candidate / entry);
+                    }
+                }
+                ec.clear();
+            }
+            candidates = std::move(expanded);
+        }
+
+        for (const fs::path& candidate : candidates)
+        {
+            if (fs::is_regular_file(candidate, ec))
+            {
+                files.push_back(candidate.string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    result_table run_parallel(const std::vector<std::string>& files,
+                              const std::string& sql,
+                              std::size_t max_threads,
+                              const query_limits& limits,
+                              const std::atomic<bool>* interrupted)
+    {
+        if (files.empty())
+        {
+            throw std::runtime_error("No database file to query.");
+        }
+
+        /* Unsupported queries are rejected before any file is read */
+        merge_plan plan;
+        {
+            SQLite::Database db(files.front(), SQLite::OPEN_READONLY);
+            register_sql_functions(db.getHandle());
+            SQLite::Statement query(db, sql);
+            std::vector<std::string> column_names;
+            for (int col = 0; col < query.getColumnCount(); ++col)
+            {
+                column_names.emplace_back(query.getColumnName(col));
+            }
+            plan = plan_merge(sql, column_names);
+        }
+
+        /* BLOBs are compared whole when sorting and grouping, previews suffice otherwise */
+        const std::size_t blob_limit = plan.grouped || !plan.order.empty()
+            ? std::numeric_limits<std::size_t>::max()
+            : blob_preview_size;
+
+        /* No file contributes more rows than the LIMIT of the merged result. Without
+           LIMIT every row is in it, max_rows then bounds the rows of all the files */
+        const std::size_t part_limit = !plan.grouped && plan.limit >= 0
+            ? static_cast<std::size_t>(plan.limit)
+            : std::numeric_limits<std::size_t>::max();
+        const bool count_total = !plan.grouped && plan.limit < 0;
+        std::atomic<std::int64_t> total_rows(0);
+
+        std::vector<result_table> parts(files.size());
+        std::vector<std::string> errors(files.size());
+        std::atomic<std::size_t> next(0);
+
+        /* Each worker takes the next file, connections are never shared */
+        auto worker = [&]()
+        {
+            for (std::size_t i = next++; i < files.size(); i = next++)
+            {
+                if (interrupted != nullptr && interrupted->load())
+                {
+                    break;
+                }
+                try
+                {
+                    SQLite::Database db(files[i], SQLite::OPEN_READONLY | SQLite::OPEN_NOMUTEX);
+                    register_sql_functions(db.getHandle());
+                    /* The limits apply to each file */
+                    query_governor governor(db.getHandle(), limits, interrupted);
+                    SQLite::Statement query(db, sql);
+                    add_columns(parts[i], query);
+                    try
+                    {
+                        while (parts[i].row_count() < part_limit && query.executeStep())
+                        {
+                            push_row(parts[i], query, blob_limit);
+                            governor.count_row(&parts[i]);
+                            if (count_total)
+                            {
+                                governor.count_total_rows(++total_rows);
+                            }
+                        }
+                    }
+                    catch (const SQLite::Exception&)
+                    {
+                        governor.throw_if_exceeded();
+                        throw;
+                    }
+                }
+                catch (const std::exception& err)
+                {
+                    errors[i] = files[i] + ": " + err.what();
+                }
+            }
+        };
+
+#ifdef XSQL_EMSCRIPTEN_WASM_BUILD
+        (void)max_threads;
+        worker();
+#else
+        std::size_t thread_count = max_threads != 0 ? max_threads :
+            std::max(1u, std::thread::hardware_concurrency());
+        thread_count = std::min(thread_count, files.size());
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        try
+        {
+            for (std::size_t i = 1; i < thread_count; ++i)
+            {
+                threads.emplace_back(worker);
+            }
+        }
+        catch (const std::system_error&)
+        {
+            /* The threads already started take the remaining files with this one */
+        }
+        worker();
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+#endif
+
+        if (interrupted != nullptr && interrupted->load())
+        {
+            throw std::runtime_error("Query interrupted.");
+        }
+
+        for (const std::string& error : errors)
+        {
+            if (!error.empty())
+            {
+                throw std::runtime_error(error);
+            }
+        }
+
+        return merge_results(parts, plan);
+    }
+}
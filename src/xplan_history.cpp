@@ -0,0 +1,509 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "xeus-sqlite/xhistory.hpp"
+#include "xeus-sqlite/xplan_history.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Records between two removals of the oldest runs */
+        constexpr std::size_t prune_every = 64;
+
+        bool is_word(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+        }
+
+        bool is_digit(char c)
+        {
+            return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        }
+
+        /* End of a quoted token starting at begin, a doubled quote is an escaped one */
+        std::size_t skip_quoted(std::string_view sql, std::size_t begin, char close)
+        {
+            std::size_t i = begin + 1;
+            while (i < sql.size())
+            {
+                if (sql[i] == close)
+                {
+                    if (close != ']' && i + 1 < sql.size() && sql[i + 1] == close)
+                    {
+                        i += 2;
+                        continue;
+                    }
+                    return i + 1;
+                }
+                ++i;
+            }
+            return sql.size();
+        }
+
+        std::size_t skip_number(std::string_view sql, std::size_t i)
+        {
+            if (sql[i] == '0' && i + 1 < sql.size() && (sql[i + 1] == 'x' || sql[i + 1] == 'X'))
+            {
+                i += 2;
+                while (i < sql.size() && std::isxdigit(static_cast<unsigned char>(sql[i])))
+                {
+                    ++i;
+                }
+                return i;
+            }
+            while (i < sql.size() && (is_digit(sql[i]) || sql[i] == '.' || sql[i] == '_'))
+            {
+                ++i;
+            }
+            if (i < sql.size() && (sql[i] == 'e' || sql[i] == 'E'))
+            {
+                ++i;
+                if (i < sql.size() && (sql[i] == '+' || sql[i] == '-'))
+                {
+                    ++i;
+                }
+                while (i < sql.size() && is_digit(sql[i]))
+                {
+                    ++i;
+                }
+            }
+            return i;
+        }
+
+        std::vector<std::string> tokenize(std::string_view sql)
+        {
+            static const char* const operators[] = {"<=", ">=", "<>", "!=", "==", "||", "<<", ">>", "->"};
+
+            std::vector<std::string> tokens;
+            std::size_t i = 0;
+            while (i < sql.size())
+            {
+                const char c = sql[i];
+                const char next = i + 1 < sql.size() ? sql[i + 1] : '\0';
+                if (std::isspace(static_cast<unsigned char>(c)))
+                {
+                    ++i;
+                }
+                else if (c == '-' && next == '-')
+                {
+                    i = std::min(sql.find('\n', i), sql.size());
+                }
+                else if (c == '/' && next == '*')
+                {
+                    std::size_t end = sql.find("*/", i + 2);
+                    i = end == std::string_view::npos ? sql.size() : end + 2;
+                }
+                else if (c == '\'' || ((c == 'x' || c == 'X') && next == '\''))
+                {
+                    /* Strings and blobs */
+                    i = skip_quoted(sql, c == '\'' ? i : i + 1, '\'');
+                    tokens.emplace_back("?");
+                }
+                else if (c == '"' || c == '`' || c == '[')
+                {
+                    std::size_t end = skip_quoted(sql, i, c == '[' ? ']' : c);
+                    tokens.emplace_back(sql.substr(i, end - i));
+                    i = end;
+                }
+                else if (is_digit(c) || (c == '.' && is_digit(next)))
+                {
+                    i = skip_number(sql, i);
+                    tokens.emplace_back("?");
+                }
+                else if (c == '?' || ((c == ':' || c == '@' || c == '$') && is_word(next)))
+                {
+                    ++i;
+                    while (i < sql.size() && is_word(sql[i]))
+                    {
+                        ++i;
+                    }
+                    tokens.emplace_back("?");
+                }
+                else if (is_word(c))
+                {
+                    std::string word;
+                    while (i < sql.size() && is_word(sql[i]))
+                    {
+                        word += static_cast<char>(std::tolower(static_cast<unsigned char>(sql[i])));
+                        ++i;
+                    }
+                    tokens.push_back(std::move(word));
+                }
+                else
+                {
+                    std::size_t size = 1;
+                    for (const char* op : operators)
+                    {
+                        if (c == op[0] && next == op[1])
+                        {
+                            size = 2;
+                            break;
+                        }
+                    }
+                    tokens.emplace_back(sql.substr(i, size));
+                    i += size;
+                }
+            }
+            return tokens;
+        }
+
+        double median(std::vector<double> values)
+        {
+            auto middle = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+            std::nth_element(values.begin(), middle, values.end());
+            return *middle;
+        }
+
+        std::string format_ms(double ms)
+        {
+            char text[32];
+            std::snprintf(text, sizeof(text), ms < 10 ? "%.2f ms" : "%.0f ms", ms);
+            return text;
+        }
+
+        std::string indent(const std::string& plan)
+        {
+            std::string result;
+            std::size_t begin = 0;
+            while (begin < plan.size())
+            {
+                std::size_t end = plan.find('\n', begin);
+                end = end == std::string::npos ? plan.size() : end + 1;
+                result += "    ";
+                result.append(plan, begin, end - begin);
+                begin = end;
+            }
+            return result;
+        }
+    }
+
+    std::string normalize_query(std::string_view sql)
+    {
+        std::vector<std::string> tokens = tokenize(sql);
+        while (!tokens.empty() && tokens.back() == ";")
+        {
+            tokens.pop_back();
+        }
+
+        std::string normalized;
+        for (std::size_t i = 0; i < tokens.size(); ++i)
+        {
+            /* IN (?, ?, ?) and IN (?) are the same query */
+            if (tokens[i] == "," && i + 1 < tokens.size() && tokens[i + 1] == "?" && !normalized.empty() &&
+                normalized.back() == '?')
+            {
+                ++i;
+                continue;
+            }
+            if (!normalized.empty())
+            {
+                normalized += ' ';
+            }
+            normalized += tokens[i];
+        }
+        return normalized;
+    }
+
+    std::string explain_plan(sqlite3_stmt* stmt)
+    {
+        if (stmt == nullptr || sqlite3_stmt_isexplain(stmt) != 0)
+        {
+            return "";
+        }
+
+        const std::string sql = std::string("EXPLAIN QUERY PLAN ") + sqlite3_sql(stmt);
+        sqlite3_stmt* explain = nullptr;
+        if (sqlite3_prepare_v2(sqlite3_db_handle(stmt), sql.c_str(), -1, &explain, nullptr) != SQLITE_OK)
+        {
+            sqlite3_finalize(explain);
+            return "";
+        }
+
+        /* Rows are id, parent, unused, detail, parents come first */
+        std::map<int, std::size_t> depths;
+        std::string plan;
+        while (sqlite3_step(explain) == SQLITE_ROW)
+        {
+            const int id = sqlite3_column_int(explain, 0);
+            auto parent = depths.find(sqlite3_column_int(explain, 1));
+            const std::size_t depth = parent == depths.end() ? 0 : parent->second + 1;
+            depths[id] = depth;
+
+            const unsigned char* detail = sqlite3_column_text(explain, 3);
+            plan.append(2 * depth, ' ');
+            plan += detail != nullptr ? reinterpret_cast<const char*>(detail) : "";
+            plan += '\n';
+        }
+        sqlite3_finalize(explain);
+        return plan;
+    }
+
+    std::string plan_fingerprint(std::string_view plan)
+    {
+        /* FNV-1a */
+        std::uint64_t hash = 14695981039346656037ull;
+        for (char c : plan)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+        return text;
+    }
+
+    plan_history::plan_history(const std::string& path, const plan_history_options& options)
+        : m_path(path)
+        , m_options(options)
+    {
+        p_db = std::make_unique<SQLite::Database>(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        p_db->setBusyTimeout(1000);
+        if (path != ":memory:")
+        {
+            p_db->exec("PRAGMA journal_mode = WAL");
+        }
+        /* Runs are recorded on the shell thread, no fsync per cell */
+        p_db->exec("PRAGMA synchronous = NORMAL");
+        p_db->exec("CREATE TABLE IF NOT EXISTS queries("
+                   "id INTEGER PRIMARY KEY, db TEXT NOT NULL, query TEXT NOT NULL, "
+                   "last_plan INTEGER, UNIQUE(db, query))");
+        p_db->exec("CREATE TABLE IF NOT EXISTS plans("
+                   "id INTEGER PRIMARY KEY, query_id INTEGER NOT NULL, fingerprint TEXT NOT NULL, "
+                   "plan TEXT NOT NULL, first_seen TEXT NOT NULL, UNIQUE(query_id, fingerprint))");
+        p_db->exec("CREATE TABLE IF NOT EXISTS runs("
+                   "query_id INTEGER NOT NULL, plan_id INTEGER NOT NULL, time TEXT NOT NULL, "
+                   "duration_ms REAL NOT NULL, rows INTEGER)");
+        /* The last runs of a query are a range of this index */
+        p_db->exec("CREATE INDEX IF NOT EXISTS runs_query ON runs(query_id)");
+
+        m_find_query = std::make_unique<SQLite::Statement>(*p_db,
+            "SELECT id, last_plan FROM queries WHERE db = ? AND query = ?");
+        m_insert_query = std::make_unique<SQLite::Statement>(*p_db,
+            "INSERT INTO queries(db, query) VALUES (?, ?)");
+        m_last_runs = std::make_unique<SQLite::Statement>(*p_db,
+            "SELECT duration_ms FROM runs WHERE query_id = ? ORDER BY rowid DESC LIMIT ?");
+        m_find_plan = std::make_unique<SQLite::Statement>(*p_db,
+            "SELECT id FROM plans WHERE query_id = ? AND fingerprint = ?");
+        m_insert_plan = std::make_unique<SQLite::Statement>(*p_db,
+            "INSERT INTO plans(query_id, fingerprint, plan, first_seen) VALUES (?, ?, ?, datetime('now'))");
+        m_insert_run = std::make_unique<SQLite::Statement>(*p_db,
+            "INSERT INTO runs(query_id, plan_id, time, duration_ms, rows) VALUES (?, ?, datetime('now'), ?, ?)");
+    }
+
+    plan_history::~plan_history() = default;
+
+    std::string plan_history::record(const std::string& database,
+                                     std::string_view sql,
+                                     const std::string& plan,
+                                     double duration_ms,
+                                     long long rows)
+    {
+        /* Cached statements are reset whatever happens */
+        auto reset = [](SQLite::Statement& statement)
+        {
+            statement.reset();
+            statement.clearBindings();
+        };
+        try
+        {
+            const std::string query = normalize_query(sql);
+            const std::string fingerprint = plan_fingerprint(plan);
+            SQLite::Transaction transaction(*p_db);
+
+            std::int64_t query_id = 0;
+            std::int64_t last_plan = 0;
+            m_find_query->bind(1, database);
+            m_find_query->bind(2, query);
+            if (m_find_query->executeStep())
+            {
+                query_id = m_find_query->getColumn(0).getInt64();
+                last_plan = m_find_query->getColumn(1).getInt64();
+            }
+            reset(*m_find_query);
+            if (query_id == 0)
+            {
+                m_insert_query->bind(1, database);
+                m_insert_query->bind(2, query);
+                m_insert_query->exec();
+                reset(*m_insert_query);
+                query_id = static_cast<std::int64_t>(p_db->getLastInsertRowid());
+            }
+
+            std::vector<double> durations;
+            m_last_runs->bind(1, query_id);
+            m_last_runs->bind(2, static_cast<std::int64_t>(m_options.window));
+            while (m_last_runs->executeStep())
+            {
+                durations.push_back(m_last_runs->getColumn(0).getDouble());
+            }
+            reset(*m_last_runs);
+
+            std::int64_t plan_id = 0;
+            m_find_plan->bind(1, query_id);
+            m_find_plan->bind(2, fingerprint);
+            if (m_find_plan->executeStep())
+            {
+                plan_id = m_find_plan->getColumn(0).getInt64();
+            }
+            reset(*m_find_plan);
+            if (plan_id == 0)
+            {
+                m_insert_plan->bind(1, query_id);
+                m_insert_plan->bind(2, fingerprint);
+                m_insert_plan->bind(3, plan);
+                m_insert_plan->exec();
+                reset(*m_insert_plan);
+                plan_id = static_cast<std::int64_t>(p_db->getLastInsertRowid());
+            }
+
+            m_insert_run->bind(1, query_id);
+            m_insert_run->bind(2, plan_id);
+            m_insert_run->bind(3, duration_ms);
+            m_insert_run->bind(4, static_cast<std::int64_t>(rows));
+            m_insert_run->exec();
+            reset(*m_insert_run);
+
+            std::string previous_plan;
+            if (last_plan != plan_id)
+            {
+                if (last_plan != 0)
+                {
+                    SQLite::Statement text(*p_db, "SELECT plan FROM plans WHERE id = ?");
+                    text.bind(1, last_plan);
+                    if (text.executeStep())
+                    {
+                        previous_plan = text.getColumn(0).getString();
+                    }
+                }
+                SQLite::Statement update(*p_db, "UPDATE queries SET last_plan = ? WHERE id = ?");
+                update.bind(1, plan_id);
+                update.bind(2, query_id);
+                update.exec();
+            }
+
+            if (++m_records % prune_every == 1)
+            {
+                SQLite::Statement prune(*p_db, "DELETE FROM runs WHERE rowid <= (SELECT max(rowid) FROM runs) - ?");
+                prune.bind(1, static_cast<std::int64_t>(m_options.max_runs));
+                prune.exec();
+                /* Queries and plans without runs left go with them, the last plan of a query is kept */
+                p_db->exec("DELETE FROM queries WHERE id NOT IN (SELECT query_id FROM runs)");
+                p_db->exec("DELETE FROM plans WHERE query_id NOT IN (SELECT id FROM queries) OR "
+                           "(id NOT IN (SELECT plan_id FROM runs) AND "
+                           "id NOT IN (SELECT last_plan FROM queries WHERE last_plan IS NOT NULL))");
+            }
+            transaction.commit();
+
+            std::string warning;
+            const bool slower = durations.size() >= m_options.min_runs &&
+                                duration_ms >= static_cast<double>(m_options.min_duration.count()) &&
+                                duration_ms > m_options.slowdown * median(durations);
+            const std::string runs = "the median of the last " + std::to_string(durations.size()) + " runs";
+            if (last_plan != 0 && last_plan != plan_id)
+            {
+                warning = "Warning: the query plan changed since the last run of this query.\n"
+                          "Before:\n" + indent(previous_plan) + "Now:\n" + indent(plan);
+                if (slower)
+                {
+                    warning += "This run took " + format_ms(duration_ms) + ", " + runs + " is " +
+                               format_ms(median(durations)) + ".\n";
+                }
+            }
+            else if (slower)
+            {
+                char factor[32];
+                std::snprintf(factor, sizeof(factor), "%.0fx", duration_ms / std::max(median(durations), 1e-3));
+                warning = "Warning: this run took " + format_ms(duration_ms) + ", " + factor + " " + runs +
+                          " (" + format_ms(median(durations)) + "), with the same query plan:\n" + indent(plan);
+            }
+            return warning;
+        }
+        catch (const std::exception&)
+        {
+            /* The history is best effort, the query itself succeeded */
+            for (auto* statement : {&m_find_query, &m_insert_query, &m_last_runs, &m_find_plan,
+                                    &m_insert_plan, &m_insert_run})
+            {
+                try
+                {
+                    reset(**statement);
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
+            return "";
+        }
+    }
+
+    result_table plan_history::recent_plans(const std::string& database, std::size_t limit)
+    {
+        SQLite::Statement query(*p_db, "SELECT q.query AS query, "
+                                       "rtrim(replace(p.plan, char(10), '; '), '; ') AS plan, "
+                                       "count(r.plan_id) AS runs, "
+                                       "round(avg(r.duration_ms), 3) AS avg_ms, "
+                                       "round(max(r.duration_ms), 3) AS max_ms, "
+                                       "p.first_seen AS first_seen, max(r.time) AS last_run "
+                                       "FROM queries q JOIN plans p ON p.query_id = q.id "
+                                       "LEFT JOIN runs r ON r.plan_id = p.id "
+                                       "WHERE q.db = ? GROUP BY p.id ORDER BY max(r.rowid) DESC LIMIT ?");
+        query.bind(1, database);
+        query.bind(2, static_cast<std::int64_t>(limit));
+
+        result_table table;
+        add_columns(table, query);
+        while (query.executeStep())
+        {
+            push_row(table, query);
+        }
+        return table;
+    }
+
+    void plan_history::clear(const std::string& database)
+    {
+        SQLite::Transaction transaction(*p_db);
+        for (const char* sql : {"DELETE FROM runs WHERE query_id IN (SELECT id FROM queries WHERE db = ?1)",
+                                "DELETE FROM plans WHERE query_id IN (SELECT id FROM queries WHERE db = ?1)",
+                                "DELETE FROM queries WHERE db = ?1"})
+        {
+            SQLite::Statement statement(*p_db, sql);
+            statement.bind(1, database);
+            statement.exec();
+        }
+        transaction.commit();
+    }
+
+    const std::string& plan_history::path() const noexcept
+    {
+        return m_path;
+    }
+
+    plan_history_options& plan_history::options() noexcept
+    {
+        return m_options;
+    }
+
+    std::string default_plan_history_path()
+    {
+        if (const char* path = std::getenv("XSQLITE_PLAN_HISTORY"))
+        {
+            return path;
+        }
+        return jupyter_data_file("xsqlite_plans.db");
+    }
+}
@@ -0,0 +1,271 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xmemory.hpp"
+#include "xeus-sqlite/xprewarm.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Bytes read at once when the whole file is warmed */
+        constexpr std::size_t file_chunk_size = 1024 * 1024;
+        /* Page size assumed for files without a readable header */
+        constexpr std::uint32_t default_page_size = 4096;
+
+        std::uint32_t read_be(const char* data, std::size_t bytes)
+        {
+            std::uint32_t value = 0;
+            for (std::size_t i = 0; i < bytes; ++i)
+            {
+                value = (value << 8) | static_cast<unsigned char>(data[i]);
+            }
+            return value;
+        }
+
+        /* Page size from the header, 0 for a file that is not a plain SQLite database */
+        std::uint32_t header_page_size(const std::string& path)
+        {
+            char header[100];
+            std::ifstream in(path, std::ios::binary);
+            if (!in.read(header, sizeof(header)) || std::memcmp(header, "SQLite format 3", 16) != 0)
+            {
+                return 0;
+            }
+            std::uint32_t size = read_be(header + 16, 2);
+            return size == 1 ? 65536 : size;
+        }
+
+        std::string format_seconds(std::chrono::steady_clock::duration duration)
+        {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.1f s", std::chrono::duration<double>(duration).count());
+            return buffer;
+        }
+    }
+
+    prewarmer::~prewarmer()
+    {
+        stop();
+    }
+
+    void prewarmer::start(const std::string& path, const std::vector<std::string>& objects)
+    {
+#ifdef XSQL_EMSCRIPTEN_WASM_BUILD
+        (void)path;
+        (void)objects;
+        throw std::runtime_error("Prewarming is not available in this build.");
+#else
+        stop();
+
+        std::uint32_t page_size = header_page_size(path);
+        std::vector<target> targets;
+        std::string scope = "the whole file";
+        if (objects.empty())
+        {
+            targets.push_back({"", 0});
+        }
+        else
+        {
+            if (page_size == 0)
+            {
+                throw std::runtime_error("Tables can only be prewarmed on unencrypted databases, "
+                                         "prewarm the whole file instead.");
+            }
+            SQLite::Database db(path, SQLite::OPEN_READONLY);
+            SQLite::Statement query(db, "SELECT name, rootpage FROM sqlite_master "
+                                        "WHERE (name = ?1 COLLATE NOCASE OR tbl_name = ?1 COLLATE NOCASE) "
+                                        "AND type IN ('table', 'index') AND rootpage > 0");
+            scope.clear();
+            for (const std::string& object : objects)
+            {
+                query.reset();
+                query.bind(1, object);
+                bool found = false;
+                while (query.executeStep())
+                {
+                    targets.push_back({query.getColumn(0).getString(),
+                                       static_cast<std::uint32_t>(query.getColumn(1).getInt64())});
+                    found = true;
+                }
+                if (!found)
+                {
+                    throw std::runtime_error("No table or index named " + object + ".");
+                }
+                scope += (scope.empty() ? "" : ", ") + object;
+            }
+        }
+
+        std::error_code ec;
+        const std::uintmax_t file_size = std::filesystem::file_size(path, ec);
+        if (ec)
+        {
+            throw std::runtime_error("Could not read " + path + ": " + ec.message() + ".");
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_path = path;
+        m_scope = std::move(scope);
+        m_page_size = page_size == 0 ? default_page_size : page_size;
+        m_page_count = static_cast<std::uint32_t>(file_size / m_page_size);
+        m_pages = 0;
+        m_cancel = false;
+        m_state = "running";
+        m_error.clear();
+        m_start = clock::now();
+        m_thread = std::thread(&prewarmer::run, this, std::move(targets));
+#endif
+    }
+
+    void prewarmer::cancel() noexcept
+    {
+        m_cancel = true;
+    }
+
+    void prewarmer::stop()
+    {
+        cancel();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    std::string prewarmer::status() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_state == "idle")
+        {
+            return "Prewarm: idle";
+        }
+
+        const std::uint64_t pages = m_pages;
+        std::string result = "Prewarm: " + m_state + ", " + std::to_string(pages) +
+                             (m_state == "running" ? " of " + std::to_string(m_page_count) : "") + " pages (" +
+                             format_bytes(static_cast<std::int64_t>(pages * m_page_size)) + ") in " +
+                             format_seconds((m_state == "running" ? clock::now() : m_end) - m_start);
+        result += "\nDatabase: " + m_path + ", " + m_scope;
+        if (!m_error.empty())
+        {
+            result += "\nError: " + m_error;
+        }
+        return result;
+    }
+
+    void prewarmer::run(std::vector<target> targets)
+    {
+        std::string error;
+        try
+        {
+            std::ifstream in(m_path, std::ios::binary);
+            if (!in)
+            {
+                throw std::runtime_error("Could not open " + m_path + ".");
+            }
+
+            if (targets.front().root == 0)
+            {
+                std::vector<char> buffer(file_chunk_size);
+                read_file(in, buffer);
+            }
+            else
+            {
+                std::vector<char> visited(static_cast<std::size_t>(m_page_count) + 1, 0);
+                std::vector<char> page(m_page_size);
+                for (const target& t : targets)
+                {
+                    walk_btree(in, t.root, visited, page);
+                }
+            }
+        }
+        catch (const std::exception& err)
+        {
+            error = err.what();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_end = clock::now();
+        m_error = std::move(error);
+        m_state = !m_error.empty() ? "failed" : (m_cancel ? "cancelled" : "finished");
+    }
+
+    void prewarmer::read_file(std::istream& in, std::vector<char>& buffer)
+    {
+        /* Sequential reads, the operating system reads ahead of them */
+        while (!m_cancel && in)
+        {
+            in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            const std::uint64_t bytes = static_cast<std::uint64_t>(in.gcount());
+            m_pages += (bytes + m_page_size - 1) / m_page_size;
+        }
+    }
+
+    void prewarmer::walk_btree(std::istream& in, std::uint32_t root, std::vector<char>& visited,
+                               std::vector<char>& page)
+    {
+        /*
+            Reads the interior pages and follows their child pointers down to
+            the leaves. Overflow pages of large values are not read. Pages
+            moved by a transaction still in the WAL may point to stale
+            children, which only costs a few useless reads.
+        */
+        std::vector<std::uint32_t> pending = {root};
+        while (!pending.empty() && !m_cancel)
+        {
+            const std::uint32_t number = pending.back();
+            pending.pop_back();
+            if (number == 0 || number > m_page_count || visited[number])
+            {
+                continue;
+            }
+            visited[number] = 1;
+
+            in.seekg(static_cast<std::streamoff>(number - 1) * m_page_size);
+            if (!in.read(page.data(), static_cast<std::streamsize>(page.size())))
+            {
+                in.clear();
+                continue;
+            }
+            ++m_pages;
+
+            /* The first page starts with the 100 bytes of the file header */
+            const std::size_t header = number == 1 ? 100 : 0;
+            const unsigned char type = static_cast<unsigned char>(page[header]);
+            if (type != 0x02 && type != 0x05)
+            {
+                continue;
+            }
+
+            const std::uint32_t cells = read_be(&page[header + 3], 2);
+            pending.push_back(read_be(&page[header + 8], 4));
+            for (std::uint32_t i = cells; i-- > 0;)
+            {
+                const std::size_t pointer = header + 12 + 2 * static_cast<std::size_t>(i);
+                if (pointer + 2 > page.size())
+                {
+                    continue;
+                }
+                const std::size_t cell = read_be(&page[pointer], 2);
+                if (cell + 4 <= page.size())
+                {
+                    pending.push_back(read_be(&page[cell], 4));
+                }
+            }
+        }
+    }
+}
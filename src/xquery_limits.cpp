@@ -0,0 +1,217 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xmemory.hpp"
+#include "xeus-sqlite/xquery_limits.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Instructions between two calls of the progress handler */
+        constexpr int progress_period = 1000;
+        /* Rows between two checks of the result buffer size */
+        constexpr std::int64_t buffer_check_rows = 1024;
+
+        /* 1000000 or 1e6 */
+        std::int64_t parse_limit_count(std::string_view text, std::string_view key)
+        {
+            const std::string value(text);
+            char* end = nullptr;
+            const double count = std::strtod(value.c_str(), &end);
+            if (value.empty() || end != value.c_str() + value.size() || !(count >= 1) ||
+                count > 1e18 || std::floor(count) != count)
+            {
+                throw std::runtime_error("Invalid value " + value + " for " + std::string(key) +
+                                         ", expected a count such as 1000000 or 1e6.");
+            }
+            return static_cast<std::int64_t>(count);
+        }
+
+        std::string format_duration(std::chrono::milliseconds duration)
+        {
+            const long long ms = duration.count();
+            return ms % 1000 == 0 ? std::to_string(ms / 1000) + "s" : std::to_string(ms) + "ms";
+        }
+    }
+
+    void parse_query_limits(const std::vector<std::string_view>& args, query_limits& limits)
+    {
+        for (std::string_view arg : args)
+        {
+            std::string_view key, value;
+            if (!split_option(arg, key, value))
+            {
+                throw std::runtime_error("Invalid limit " + std::string(arg) +
+                                         ", expected timeout=, max_steps=, max_rows= or max_mem=.");
+            }
+            const bool off = iequals(value, "off");
+            if (iequals(key, "timeout"))
+            {
+                limits.timeout = off ? std::chrono::milliseconds(0) : parse_duration(value);
+            }
+            else if (iequals(key, "max_steps"))
+            {
+                limits.max_steps = off ? 0 : parse_limit_count(value, key);
+            }
+            else if (iequals(key, "max_rows"))
+            {
+                limits.max_rows = off ? 0 : parse_limit_count(value, key);
+            }
+            else if (iequals(key, "max_mem"))
+            {
+                limits.max_mem = off ? 0 : parse_byte_size(value);
+            }
+            else
+            {
+                throw std::runtime_error("Unknown limit " + std::string(key) +
+                                         ", expected timeout, max_steps, max_rows or max_mem.");
+            }
+        }
+    }
+
+    std::string query_limits_to_string(const query_limits& limits)
+    {
+        auto count = [](std::int64_t value) { return value == 0 ? std::string("off") : std::to_string(value); };
+        return "timeout=" + (limits.timeout.count() == 0 ? std::string("off") : format_duration(limits.timeout)) +
+               " max_steps=" + count(limits.max_steps) +
+               " max_rows=" + count(limits.max_rows) +
+               " max_mem=" + (limits.max_mem == 0 ? std::string("off") : format_bytes(limits.max_mem));
+    }
+
+    query_governor::query_governor(sqlite3* db, const query_limits& limits,
+                                   const std::atomic<bool>* interrupted)
+        : p_db(db)
+        , m_limits(limits)
+        , p_interrupted(interrupted)
+        , m_deadline(clock::now() + limits.timeout)
+    {
+        if (uses_progress_handler())
+        {
+            sqlite3_progress_handler(p_db, progress_period, &query_governor::progress, this);
+        }
+        if (m_limits.max_mem != 0)
+        {
+            /* The heap limit of SQLite is global, the budget is checked by the progress handler instead */
+            m_heap_base = sqlite3_memory_used();
+            const int length = static_cast<int>(std::min<std::int64_t>(m_limits.max_mem, INT_MAX));
+            m_previous_length_limit = sqlite3_limit(p_db, SQLITE_LIMIT_LENGTH, -1);
+            sqlite3_limit(p_db, SQLITE_LIMIT_LENGTH, std::min(length, m_previous_length_limit));
+        }
+    }
+
+    query_governor::~query_governor()
+    {
+        if (uses_progress_handler())
+        {
+            sqlite3_progress_handler(p_db, 0, nullptr, nullptr);
+        }
+        if (m_limits.max_mem != 0)
+        {
+            sqlite3_limit(p_db, SQLITE_LIMIT_LENGTH, m_previous_length_limit);
+        }
+    }
+
+    void query_governor::count_row(const result_table* table)
+    {
+        ++m_rows;
+        if (m_limits.max_rows != 0 && m_rows > m_limits.max_rows)
+        {
+            exceeded("max_rows");
+        }
+        if (table != nullptr && m_limits.max_mem != 0 && m_rows % buffer_check_rows == 0 &&
+            table->memory_usage() > static_cast<std::size_t>(m_limits.max_mem))
+        {
+            exceeded("max_mem");
+        }
+    }
+
+    void query_governor::count_total_rows(std::int64_t total) const
+    {
+        if (m_limits.max_rows != 0 && total > m_limits.max_rows)
+        {
+            exceeded("max_rows");
+        }
+    }
+
+    void query_governor::throw_if_exceeded() const
+    {
+        if (!m_stopped_by.empty())
+        {
+            exceeded(m_stopped_by);
+        }
+        if (m_limits.max_mem != 0 && sqlite3_errcode(p_db) == SQLITE_TOOBIG)
+        {
+            exceeded("max_mem");
+        }
+    }
+
+    bool query_governor::uses_progress_handler() const
+    {
+        return m_limits.timeout.count() != 0 || m_limits.max_steps != 0 || m_limits.max_mem != 0 ||
+               p_interrupted != nullptr;
+    }
+
+    int query_governor::progress(void* self)
+    {
+        query_governor& governor = *static_cast<query_governor*>(self);
+        if (governor.p_interrupted != nullptr && governor.p_interrupted->load())
+        {
+            /* Fails with SQLITE_INTERRUPT, like sqlite3_interrupt */
+            return 1;
+        }
+        governor.m_steps += progress_period;
+        if (governor.m_limits.max_steps != 0 && governor.m_steps > governor.m_limits.max_steps)
+        {
+            governor.m_stopped_by = "max_steps";
+        }
+        else if (governor.m_limits.timeout.count() != 0 && clock::now() > governor.m_deadline)
+        {
+            governor.m_stopped_by = "timeout";
+        }
+        else if (governor.m_limits.max_mem != 0 &&
+                 sqlite3_memory_used() - governor.m_heap_base > governor.m_limits.max_mem)
+        {
+            governor.m_stopped_by = "max_mem";
+        }
+        /* Non zero interrupts the statement */
+        return governor.m_stopped_by.empty() ? 0 : 1;
+    }
+
+    void query_governor::exceeded(const std::string& key) const
+    {
+        std::string budget;
+        if (key == "timeout")
+        {
+            budget = "timeout of " + format_duration(m_limits.timeout);
+        }
+        else if (key == "max_steps")
+        {
+            budget = "budget of " + std::to_string(m_limits.max_steps) + " steps";
+        }
+        else if (key == "max_rows")
+        {
+            budget = "budget of " + std::to_string(m_limits.max_rows) + " rows";
+        }
+        else
+        {
+            budget = "memory budget of " + format_bytes(m_limits.max_mem);
+        }
+        throw std::runtime_error("Query stopped, it exceeded the " + budget + " (" + key + "). " +
+                                 "Change it with %LIMITS " + key + "=<value> or remove it with %LIMITS " +
+                                 key + "=off.");
+    }
+}
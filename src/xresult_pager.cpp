@@ -0,0 +1,503 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#include "xeus-sqlite/xresult_pager.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Rows copied between two checks of the spill file size */
+        constexpr long long size_check_rows = 4096;
+
+        std::string column_ref(std::size_t col)
+        {
+            return "c" + std::to_string(col);
+        }
+
+        std::size_t find_column(const std::vector<std::string>& columns, const nl::json& column)
+        {
+            if (column.is_number_integer() && column.get<long long>() >= 0 &&
+                column.get<unsigned long long>() < columns.size())
+            {
+                return column.get<std::size_t>();
+            }
+            if (column.is_string())
+            {
+                auto it = std::find(columns.begin(), columns.end(), column.get<std::string>());
+                if (it != columns.end())
+                {
+                    return static_cast<std::size_t>(it - columns.begin());
+                }
+            }
+            throw std::runtime_error("No column " + column.dump() + " in the result.");
+        }
+
+        void bind_json(SQLite::Statement& statement, int index, const nl::json& value)
+        {
+            if (value.is_number_integer())
+            {
+                statement.bind(index, value.get<std::int64_t>());
+            }
+            else if (value.is_number())
+            {
+                statement.bind(index, value.get<double>());
+            }
+            else if (value.is_string())
+            {
+                statement.bind(index, value.get<std::string>());
+            }
+            else if (value.is_boolean())
+            {
+                statement.bind(index, value.get<bool>() ? 1 : 0);
+            }
+            else if (value.is_null())
+            {
+                statement.bind(index);
+            }
+            else
+            {
+                throw std::runtime_error("Filter values must be numbers, strings, booleans or null.");
+            }
+        }
+    }
+
+    result_pager::result_pager(const pager_options& options)
+        : m_options(options)
+    {
+    }
+
+    result_pager::~result_pager() = default;
+
+    void result_pager::set_options(const pager_options& options)
+    {
+        m_options = options;
+    }
+
+    const pager_options& result_pager::options() const noexcept
+    {
+        return m_options;
+    }
+
+    SQLite::Database& result_pager::database()
+    {
+        if (m_db == nullptr)
+        {
+            /* An empty name opens a private database in a temporary file, removed on close */
+            m_db = std::make_unique<SQLite::Database>("", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            /* The file is thrown away with the kernel, nothing needs to survive a crash */
+            m_db->exec("PRAGMA journal_mode = OFF");
+            m_db->exec("PRAGMA synchronous = OFF");
+            m_db->exec("PRAGMA cache_size = -2048");
+            m_db->exec("PRAGMA temp_store = FILE");
+            /* Evicted results give their pages back to the file system */
+            m_db->exec("PRAGMA auto_vacuum = FULL");
+        }
+        return *m_db;
+    }
+
+    void result_pager::begin(const SQLite::Statement& query)
+    {
+        discard();
+        SQLite::Database& db = database();
+
+        m_pending = result_entry();
+        m_pending_handle = "r" + std::to_string(m_next_handle);
+        std::string columns;
+        std::string placeholders;
+        for (int col = 0; col < query.getColumnCount(); ++col)
+        {
+            m_pending.columns.emplace_back(query.getColumnName(col));
+            columns += (col == 0 ? "" : ", ") + column_ref(static_cast<std::size_t>(col));
+            placeholders += col == 0 ? "?" : ", ?";
+        }
+
+        /* The transaction is committed or the table dropped once the statement is done */
+        db.exec("BEGIN");
+        try
+        {
+            /* No declared types, so that values are stored as they are */
+            db.exec("CREATE TABLE " + m_pending_handle + "(" + columns + ")");
+            m_insert = std::make_unique<SQLite::Statement>(db, "INSERT INTO " + m_pending_handle +
+                                                               " VALUES (" + placeholders + ")");
+        }
+        catch (...)
+        {
+            sqlite3_exec(db.getHandle(), "COMMIT", nullptr, nullptr, nullptr);
+            m_pending_handle.clear();
+            throw;
+        }
+    }
+
+    void result_pager::append(const SQLite::Statement& query)
+    {
+        if (m_insert == nullptr || m_pending.truncated)
+        {
+            return;
+        }
+
+        if (m_pending.rows % size_check_rows == size_check_rows - 1)
+        {
+            while (spill_bytes() > m_options.max_spill_bytes && evict_one(m_pending_handle))
+            {
+            }
+            if (spill_bytes() > m_options.max_spill_bytes)
+            {
+                m_pending.truncated = true;
+                return;
+            }
+        }
+
+        sqlite3_stmt* source = query.getPreparedStatement();
+        sqlite3_stmt* insert = m_insert->getPreparedStatement();
+        const int columns = static_cast<int>(m_pending.columns.size());
+        for (int col = 0; col < columns; ++col)
+        {
+            sqlite3_bind_value(insert, col + 1, sqlite3_column_value(source, col));
+        }
+        m_insert->exec();
+        m_insert->reset();
+        ++m_pending.rows;
+    }
+
+    bool result_pager::spilling() const noexcept
+    {
+        return m_insert != nullptr;
+    }
+
+    nl::json result_pager::commit()
+    {
+        if (!spilling())
+        {
+            throw std::runtime_error("No result is being copied.");
+        }
+        m_insert.reset();
+        m_db->exec("COMMIT");
+
+        const std::string handle = m_pending_handle;
+        m_pending.last_used = clock::now();
+        m_results[handle] = std::move(m_pending);
+        m_pending_handle.clear();
+        ++m_next_handle;
+
+        while (m_results.size() > std::max<std::size_t>(m_options.max_handles, 1) && evict_one(handle))
+        {
+        }
+        return describe(handle, m_results.at(handle));
+    }
+
+    void result_pager::discard()
+    {
+        if (!spilling())
+        {
+            return;
+        }
+        m_insert.reset();
+        /* Nothing to roll back to without a journal, the table is dropped instead */
+        const std::string drop = "DROP TABLE IF EXISTS " + m_pending_handle;
+        sqlite3_exec(m_db->getHandle(), drop.c_str(), nullptr, nullptr, nullptr);
+        sqlite3_exec(m_db->getHandle(), "COMMIT", nullptr, nullptr, nullptr);
+        m_pending_handle.clear();
+    }
+
+    nl::json result_pager::handle_request(const nl::json& request)
+    {
+        nl::json reply;
+        try
+        {
+            const std::string action = request.at("action").get<std::string>();
+            if (action == "page")
+            {
+                reply = page(request);
+            }
+            else if (action == "close")
+            {
+                const std::string handle = request.at("handle").get<std::string>();
+                if (m_results.count(handle) != 0)
+                {
+                    drop(handle);
+                }
+                reply["action"] = "closed";
+                reply["handle"] = handle;
+            }
+            else if (action == "list")
+            {
+                reply["action"] = "results";
+                reply["results"] = nl::json::array();
+                for (const auto& result : m_results)
+                {
+                    reply["results"].push_back(describe(result.first, result.second));
+                }
+            }
+            else
+            {
+                throw std::runtime_error("Unknown action " + action + ", expected page, close or list.");
+            }
+        }
+        catch (const std::exception& e)
+        {
+            reply = nl::json::object();
+            reply["action"] = "error";
+            reply["message"] = e.what();
+        }
+        if (request.is_object() && request.contains("id"))
+        {
+            reply["id"] = request["id"];
+        }
+        return reply;
+    }
+
+    nl::json result_pager::page(const nl::json& request)
+    {
+        const std::string handle = request.at("handle").get<std::string>();
+        auto it = m_results.find(handle);
+        if (it == m_results.end())
+        {
+            throw std::runtime_error("No result " + handle + ", it may have been evicted, run the query again.");
+        }
+        result_entry& entry = it->second;
+        entry.last_used = clock::now();
+
+        const long long page_size = static_cast<long long>(std::clamp<std::size_t>(
+            request.value("page_size", std::size_t(100)), 1, std::max<std::size_t>(m_options.max_page_size, 1)));
+        const long long page_number = request.value("page", 0LL);
+        if (page_number < 0)
+        {
+            throw std::runtime_error("Pages are numbered from 0.");
+        }
+
+        /* Filters, their values are bound after the clauses are built */
+        std::string where;
+        std::vector<const nl::json*> values;
+        const nl::json filters = request.value("filter", nl::json::array());
+        for (const nl::json& filter : filters)
+        {
+            const std::string ref = column_ref(find_column(entry.columns, filter.at("column")));
+            const std::string op = filter.value("op", std::string("="));
+            std::string clause;
+            if (op == "=" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=")
+            {
+                clause = ref + " " + op + " ?";
+                values.push_back(&filter.at("value"));
+            }
+            else if (op == "contains")
+            {
+                clause = "instr(lower(" + ref + "), lower(?)) > 0";
+                values.push_back(&filter.at("value"));
+            }
+            else if (op == "null" || op == "not_null")
+            {
+                clause = ref + (op == "null" ? " IS NULL" : " IS NOT NULL");
+            }
+            else
+            {
+                throw std::runtime_error("Unknown filter operator " + op + ".");
+            }
+            where += (where.empty() ? " WHERE " : " AND ") + clause;
+        }
+        auto bind_filters = [&values](SQLite::Statement& statement)
+        {
+            for (std::size_t i = 0; i < values.size(); ++i)
+            {
+                bind_json(statement, static_cast<int>(i + 1), *values[i]);
+            }
+        };
+
+        const std::string filter_key = filters.dump();
+        if (where.empty())
+        {
+            entry.count = entry.rows;
+            entry.count_filter = filter_key;
+        }
+        else if (entry.count < 0 || entry.count_filter != filter_key)
+        {
+            SQLite::Statement count(database(), "SELECT count(*) FROM " + handle + where);
+            bind_filters(count);
+            count.executeStep();
+            entry.count = count.getColumn(0).getInt64();
+            entry.count_filter = filter_key;
+        }
+
+        std::string order;
+        const nl::json sort = request.value("sort", nl::json::array());
+        bool descending = false;
+        for (const nl::json& key : sort)
+        {
+            const std::size_t col = find_column(entry.columns, key.at("column"));
+            const bool desc = key.value("descending", false);
+            if (order.empty())
+            {
+                /* Later pages of the same order walk the index instead of sorting again */
+                descending = desc;
+                database().exec("CREATE INDEX IF NOT EXISTS " + handle + "_" + column_ref(col) +
+                                " ON " + handle + "(" + column_ref(col) + ")");
+            }
+            order += column_ref(col) + (desc ? " DESC, " : ", ");
+        }
+        order += descending ? "rowid DESC" : "rowid";
+
+        /* Only the first bytes of BLOBs are read, a page stays small */
+        std::string columns = "rowid";
+        for (std::size_t col = 0; col < entry.columns.size(); ++col)
+        {
+            const std::string ref = column_ref(col);
+            columns += ", CASE WHEN typeof(" + ref + ") = 'blob' THEN substr(" + ref + ", 1, " +
+                       std::to_string(blob_preview_size) + ") ELSE " + ref + " END" +
+                       ", CASE WHEN typeof(" + ref + ") = 'blob' THEN length(" + ref + ") END";
+        }
+
+        const long long offset = page_number * page_size;
+        std::unique_ptr<SQLite::Statement> query;
+        if (where.empty() && sort.empty())
+        {
+            /* Rowids are the row numbers, a page is a range of them */
+            query = std::make_unique<SQLite::Statement>(database(), "SELECT " + columns + " FROM " + handle +
+                                                                    " WHERE rowid > ? ORDER BY rowid LIMIT ?");
+            query->bind(1, static_cast<std::int64_t>(offset));
+            query->bind(2, static_cast<std::int64_t>(page_size));
+        }
+        else
+        {
+            query = std::make_unique<SQLite::Statement>(database(), "SELECT " + columns + " FROM " + handle + where +
+                                                                    " ORDER BY " + order + " LIMIT ? OFFSET ?");
+            bind_filters(*query);
+            query->bind(static_cast<int>(values.size() + 1), static_cast<std::int64_t>(page_size));
+            query->bind(static_cast<int>(values.size() + 2), static_cast<std::int64_t>(offset));
+        }
+
+        nl::json rows = nl::json::array();
+        nl::json index = nl::json::array();
+        sqlite3_stmt* stmt = query->getPreparedStatement();
+        while (query->executeStep())
+        {
+            index.push_back(sqlite3_column_int64(stmt, 0) - 1);
+            nl::json row = nl::json::array();
+            for (std::size_t col = 0; col < entry.columns.size(); ++col)
+            {
+                const int value = static_cast<int>(2 * col + 1);
+                switch (sqlite3_column_type(stmt, value))
+                {
+                    case SQLITE_INTEGER:
+                        row.push_back(static_cast<std::int64_t>(sqlite3_column_int64(stmt, value)));
+                        break;
+                    case SQLITE_FLOAT:
+                        row.push_back(sqlite3_column_double(stmt, value));
+                        break;
+                    case SQLITE_TEXT:
+                        row.push_back(std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, value)),
+                                                  static_cast<std::size_t>(sqlite3_column_bytes(stmt, value))));
+                        break;
+                    case SQLITE_BLOB:
+                        row.push_back(blob_summary(
+                            std::string_view(static_cast<const char*>(sqlite3_column_blob(stmt, value)),
+                                             static_cast<std::size_t>(sqlite3_column_bytes(stmt, value))),
+                            static_cast<std::size_t>(sqlite3_column_int64(stmt, value + 1))));
+                        break;
+                    default:
+                        row.push_back(nullptr);
+                        break;
+                }
+            }
+            rows.push_back(std::move(row));
+        }
+
+        nl::json reply;
+        reply["action"] = "page";
+        reply["handle"] = handle;
+        reply["page"] = page_number;
+        reply["page_size"] = page_size;
+        reply["page_count"] = (entry.count + page_size - 1) / page_size;
+        reply["total_rows"] = entry.count;
+        reply["truncated"] = entry.truncated;
+        reply["columns"] = entry.columns;
+        reply["index"] = std::move(index);
+        reply["rows"] = std::move(rows);
+        return reply;
+    }
+
+    void result_pager::drop(const std::string& handle)
+    {
+        database().exec("DROP TABLE IF EXISTS " + handle);
+        m_results.erase(handle);
+    }
+
+    bool result_pager::evict_one(const std::string& keep)
+    {
+        auto oldest = m_results.end();
+        for (auto it = m_results.begin(); it != m_results.end(); ++it)
+        {
+            if (it->first != keep && (oldest == m_results.end() || it->second.last_used < oldest->second.last_used))
+            {
+                oldest = it;
+            }
+        }
+        if (oldest == m_results.end())
+        {
+            return false;
+        }
+        drop(oldest->first);
+        return true;
+    }
+
+    void result_pager::evict_idle(clock::time_point now)
+    {
+        std::vector<std::string> idle;
+        for (const auto& result : m_results)
+        {
+            if (now - result.second.last_used > m_options.idle_timeout)
+            {
+                idle.push_back(result.first);
+            }
+        }
+        for (const std::string& handle : idle)
+        {
+            drop(handle);
+        }
+    }
+
+    void result_pager::clear()
+    {
+        discard();
+        m_results.clear();
+        /* Closing the database removes the file */
+        m_db.reset();
+    }
+
+    std::size_t result_pager::size() const noexcept
+    {
+        return m_results.size();
+    }
+
+    std::size_t result_pager::spill_bytes() const
+    {
+        if (m_db == nullptr)
+        {
+            return 0;
+        }
+        SQLite::Statement size(*m_db, "SELECT page_count * page_size FROM pragma_page_count, pragma_page_size");
+        size.executeStep();
+        return static_cast<std::size_t>(size.getColumn(0).getInt64());
+    }
+
+    nl::json result_pager::describe(const std::string& handle, const result_entry& entry) const
+    {
+        nl::json description;
+        description["handle"] = handle;
+        description["columns"] = entry.columns;
+        description["rows"] = entry.rows;
+        description["truncated"] = entry.truncated;
+        return description;
+    }
+}
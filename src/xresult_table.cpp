@@ -0,0 +1,258 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xmemory.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        cell_type to_cell_type(int sqlite_type)
+        {
+            switch (sqlite_type)
+            {
+                case SQLITE_INTEGER: return cell_type::integer;
+                case SQLITE_FLOAT: return cell_type::floating;
+                case SQLITE_BLOB: return cell_type::blob;
+                case SQLITE_NULL: return cell_type::null;
+                default: return cell_type::text;
+            }
+        }
+
+        /* A BLOB cell starts with its full size and the size of its summary */
+        struct blob_header
+        {
+            std::uint64_t full_size;
+            std::uint64_t summary_size;
+        };
+
+        blob_header read_header(const std::string& arena, std::size_t offset)
+        {
+            blob_header header;
+            std::memcpy(&header, arena.data() + offset, sizeof(header));
+            return header;
+        }
+
+        /* Expressions and computed columns have no declared type */
+        std::string declared_type(const SQLite::Statement& query, int col)
+        {
+            try
+            {
+                return query.getColumnDeclaredType(col);
+            }
+            catch (const SQLite::Exception&)
+            {
+                return "";
+            }
+        }
+    }
+
+    void result_table::add_column(std::string name, std::string declared_type)
+    {
+        m_names.push_back(std::move(name));
+        m_declared_types.push_back(std::move(declared_type));
+    }
+
+    void result_table::push_cell(cell_type type, const char* data, std::size_t size)
+    {
+        if (type == cell_type::blob)
+        {
+            push_blob(data, size, size);
+            return;
+        }
+        m_cells.push_back({m_arena.size(), size, type});
+        if (size != 0)
+        {
+            m_arena.append(data, size);
+        }
+    }
+
+    void result_table::push_blob(const char* data, std::size_t stored, std::size_t full_size)
+    {
+        std::string summary = blob_summary(std::string_view(data, std::min(stored, blob_preview_size)), full_size);
+        const blob_header header = {full_size, summary.size()};
+        m_cells.push_back({m_arena.size(), stored, cell_type::blob});
+        m_arena.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (stored != 0)
+        {
+            m_arena.append(data, stored);
+        }
+        m_arena.append(summary);
+    }
+
+    void result_table::push_row(const result_table& other, std::size_t row)
+    {
+        for (std::size_t col = 0; col < other.column_count(); ++col)
+        {
+            std::string_view text = other.cell(row, col);
+            if (other.type(row, col) == cell_type::blob)
+            {
+                push_blob(text.data(), text.size(), other.blob_size(row, col));
+            }
+            else
+            {
+                push_cell(other.type(row, col), text.data(), text.size());
+            }
+        }
+    }
+
+    void result_table::reserve_rows(std::size_t rows)
+    {
+        m_cells.reserve(rows * m_names.size());
+    }
+
+    void result_table::clear()
+    {
+        m_names.clear();
+        m_declared_types.clear();
+        clear_rows();
+    }
+
+    void result_table::clear_rows()
+    {
+        m_cells.clear();
+        m_arena.clear();
+        m_omitted_rows = 0;
+    }
+
+    void result_table::set_omitted_rows(std::size_t count) noexcept
+    {
+        m_omitted_rows = count;
+    }
+
+    std::size_t result_table::omitted_rows() const noexcept
+    {
+        return m_omitted_rows;
+    }
+
+    std::size_t result_table::column_count() const noexcept
+    {
+        return m_names.size();
+    }
+
+    std::size_t result_table::row_count() const noexcept
+    {
+        return m_names.empty() ? 0 : m_cells.size() / m_names.size();
+    }
+
+    std::size_t result_table::content_size() const noexcept
+    {
+        return m_arena.size();
+    }
+
+    std::size_t result_table::memory_usage() const noexcept
+    {
+        std::size_t names = 0;
+        for (std::size_t col = 0; col < m_names.size(); ++col)
+        {
+            names += m_names[col].capacity() + m_declared_types[col].capacity();
+        }
+        return m_arena.capacity() + m_cells.capacity() * sizeof(cell_ref) + names;
+    }
+
+    const std::string& result_table::column_name(std::size_t col) const
+    {
+        return m_names[col];
+    }
+
+    const std::string& result_table::column_declared_type(std::size_t col) const
+    {
+        return m_declared_types[col];
+    }
+
+    std::string_view result_table::cell(std::size_t row, std::size_t col) const
+    {
+        const cell_ref& ref = m_cells[row * m_names.size() + col];
+        const std::size_t offset = ref.offset + (ref.type == cell_type::blob ? sizeof(blob_header) : 0);
+        return std::string_view(m_arena.data() + offset, ref.size);
+    }
+
+    cell_type result_table::type(std::size_t row, std::size_t col) const
+    {
+        return m_cells[row * m_names.size() + col].type;
+    }
+
+    std::string_view result_table::display(std::size_t row, std::size_t col) const
+    {
+        const cell_ref& ref = m_cells[row * m_names.size() + col];
+        if (ref.type != cell_type::blob)
+        {
+            return std::string_view(m_arena.data() + ref.offset, ref.size);
+        }
+        const blob_header header = read_header(m_arena, ref.offset);
+        return std::string_view(m_arena.data() + ref.offset + sizeof(header) + ref.size,
+                                static_cast<std::size_t>(header.summary_size));
+    }
+
+    std::size_t result_table::blob_size(std::size_t row, std::size_t col) const
+    {
+        const cell_ref& ref = m_cells[row * m_names.size() + col];
+        if (ref.type != cell_type::blob)
+        {
+            return ref.size;
+        }
+        return static_cast<std::size_t>(read_header(m_arena, ref.offset).full_size);
+    }
+
+    void add_columns(result_table& table, const SQLite::Statement& query)
+    {
+        for (int col = 0; col < query.getColumnCount(); ++col)
+        {
+            table.add_column(query.getColumnName(col), declared_type(query, col));
+        }
+    }
+
+    void push_row(result_table& table, const SQLite::Statement& query, std::size_t blob_limit)
+    {
+        for (int col = 0; col < query.getColumnCount(); ++col)
+        {
+            SQLite::Column column = query.getColumn(col);
+            const cell_type type = to_cell_type(column.getType());
+            if (type == cell_type::blob)
+            {
+                /* No conversion, the value is read in place */
+                const char* data = static_cast<const char*>(column.getBlob());
+                const std::size_t size = static_cast<std::size_t>(column.getBytes());
+                table.push_blob(data, std::min(size, blob_limit), size);
+            }
+            else
+            {
+                table.push_cell(type, column.getText(), static_cast<std::size_t>(column.getBytes()));
+            }
+        }
+    }
+
+    std::string blob_summary(std::string_view preview, std::size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string summary = "BLOB " + format_bytes(static_cast<std::int64_t>(size));
+        if (!preview.empty())
+        {
+            summary += ' ';
+            for (unsigned char c : preview)
+            {
+                summary += digits[c >> 4];
+                summary += digits[c & 0xf];
+            }
+            if (preview.size() < size)
+            {
+                summary += "...";
+            }
+        }
+        return summary;
+    }
+}
@@ -0,0 +1,499 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+/* The session API of sqlite3.h is only declared with these */
+#ifdef XSQL_HAVE_SQLITE_SESSION
+#ifndef SQLITE_ENABLE_SESSION
+#define SQLITE_ENABLE_SESSION
+#endif
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+#define SQLITE_ENABLE_PREUPDATE_HOOK
+#endif
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#include <sqlite3.h>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xmemory.hpp"
+#include "xeus-sqlite/xsession.hpp"
+
+#include "xfile_handle.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Conflicts described in the report, the others are only counted */
+        constexpr std::size_t max_reported_conflicts = 20;
+
+#ifdef XSQL_HAVE_SQLITE_SESSION
+        [[noreturn]] void throw_sqlite_error(sqlite3* db, const std::string& context)
+        {
+            throw std::runtime_error(context + ": " + sqlite3_errmsg(db));
+        }
+
+        int read_chunk(void* in, void* data, int* size)
+        {
+            *size = static_cast<int>(std::fread(data, 1, static_cast<std::size_t>(*size), static_cast<std::FILE*>(in)));
+            return std::ferror(static_cast<std::FILE*>(in)) ? SQLITE_IOERR : SQLITE_OK;
+        }
+
+        int write_chunk(void* out, const void* data, int size)
+        {
+            return std::fwrite(data, 1, static_cast<std::size_t>(size), static_cast<std::FILE*>(out)) ==
+                   static_cast<std::size_t>(size) ? SQLITE_OK : SQLITE_IOERR;
+        }
+
+        std::FILE* open_changeset(file_handle& handle, const std::string& path)
+        {
+            if (handle.file == nullptr)
+            {
+                throw std::runtime_error("Could not open " + path + " for reading.");
+            }
+            return handle.file;
+        }
+
+        std::string value_text(sqlite3_value* value)
+        {
+            if (value == nullptr)
+            {
+                return "?";
+            }
+            switch (sqlite3_value_type(value))
+            {
+                case SQLITE_NULL:
+                    return "NULL";
+                case SQLITE_BLOB:
+                    return "BLOB " + format_bytes(sqlite3_value_bytes(value));
+                case SQLITE_TEXT:
+                {
+                    std::string text(reinterpret_cast<const char*>(sqlite3_value_text(value)),
+                                     static_cast<std::size_t>(sqlite3_value_bytes(value)));
+                    return "'" + (text.size() > 40 ? text.substr(0, 40) + "..." : text) + "'";
+                }
+                default:
+                    return reinterpret_cast<const char*>(sqlite3_value_text(value));
+            }
+        }
+
+        const char* operation_name(int op)
+        {
+            return op == SQLITE_INSERT ? "INSERT" : op == SQLITE_UPDATE ? "UPDATE" : "DELETE";
+        }
+
+        const char* conflict_reason(int conflict)
+        {
+            switch (conflict)
+            {
+                case SQLITE_CHANGESET_DATA:
+                    return "the row differs from the one the change was recorded on";
+                case SQLITE_CHANGESET_NOTFOUND:
+                    return "the row does not exist";
+                case SQLITE_CHANGESET_CONFLICT:
+                    return "a row with the same primary key exists";
+                case SQLITE_CHANGESET_CONSTRAINT:
+                    return "a constraint failed";
+                default:
+                    return "foreign key constraints are violated";
+            }
+        }
+
+        std::string column_name(sqlite3* db, const char* table, int column)
+        {
+            std::string name = "#" + std::to_string(column + 1);
+            sqlite3_stmt* stmt = nullptr;
+            if (sqlite3_prepare_v2(db, "SELECT name FROM pragma_table_info(?) WHERE cid = ?", -1, &stmt, nullptr) == SQLITE_OK)
+            {
+                sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 2, column);
+                if (sqlite3_step(stmt) == SQLITE_ROW)
+                {
+                    name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                }
+            }
+            sqlite3_finalize(stmt);
+            return name;
+        }
+
+        /* table OPERATION key=value: reason */
+        std::string describe_conflict(sqlite3* db, int conflict, sqlite3_changeset_iter* it)
+        {
+            if (conflict == SQLITE_CHANGESET_FOREIGN_KEY)
+            {
+                int count = 0;
+                sqlite3changeset_fk_conflicts(it, &count);
+                return plural(static_cast<std::size_t>(count), "foreign key violation") + " after applying the changes";
+            }
+            const char* table = nullptr;
+            int columns = 0;
+            int op = 0;
+            int indirect = 0;
+            sqlite3changeset_op(it, &table, &columns, &op, &indirect);
+            unsigned char* pk = nullptr;
+            sqlite3changeset_pk(it, &pk, &columns);
+
+            std::string key;
+            for (int i = 0; i < columns; ++i)
+            {
+                if (pk[i] == 0)
+                {
+                    continue;
+                }
+                sqlite3_value* value = nullptr;
+                if (op == SQLITE_INSERT)
+                {
+                    sqlite3changeset_new(it, i, &value);
+                }
+                else
+                {
+                    sqlite3changeset_old(it, i, &value);
+                }
+                key += (key.empty() ? "" : ", ") + column_name(db, table, i) + "=" + value_text(value);
+            }
+            return std::string(table) + " " + operation_name(op) + " " + key + ": " + conflict_reason(conflict);
+        }
+
+        struct apply_context
+        {
+            sqlite3* db;
+            changeset_conflict policy;
+            changeset_report* report;
+            std::string abort_reason;
+        };
+
+        int on_conflict(void* context, int conflict, sqlite3_changeset_iter* it)
+        {
+            apply_context& apply = *static_cast<apply_context*>(context);
+            changeset_report& report = *apply.report;
+            const std::string description = describe_conflict(apply.db, conflict, it);
+            ++report.conflict_count;
+            if (report.conflicts.size() < max_reported_conflicts)
+            {
+                report.conflicts.push_back(description);
+            }
+
+            /* Omitting a foreign key conflict would commit the violations */
+            if (apply.policy == changeset_conflict::abort || conflict == SQLITE_CHANGESET_FOREIGN_KEY)
+            {
+                apply.abort_reason = description;
+                return SQLITE_CHANGESET_ABORT;
+            }
+            /* REPLACE is only valid for these two */
+            if (apply.policy == changeset_conflict::replace &&
+                (conflict == SQLITE_CHANGESET_DATA || conflict == SQLITE_CHANGESET_CONFLICT))
+            {
+                ++report.replaced;
+                return SQLITE_CHANGESET_REPLACE;
+            }
+            ++report.omitted;
+            return SQLITE_CHANGESET_OMIT;
+        }
+#endif
+    }
+
+    changeset_conflict parse_changeset_conflict(std::string_view text)
+    {
+        if (iequals(text, "abort"))
+        {
+            return changeset_conflict::abort;
+        }
+        if (iequals(text, "omit"))
+        {
+            return changeset_conflict::omit;
+        }
+        if (iequals(text, "replace"))
+        {
+            return changeset_conflict::replace;
+        }
+        throw std::runtime_error("Invalid conflict " + std::string(text) + ", expected abort, omit or replace.");
+    }
+
+    std::size_t changeset_summary::changes() const noexcept
+    {
+        std::size_t count = 0;
+        for (const auto& table : tables)
+        {
+            count += table.second.inserts + table.second.updates + table.second.deletes;
+        }
+        return count;
+    }
+
+    std::string changeset_summary::to_string() const
+    {
+        std::string text = plural(changes(), "change") + " (" + format_bytes(static_cast<std::int64_t>(bytes)) + ")";
+        for (const auto& table : tables)
+        {
+            text += "\n    " + table.first + ": " + std::to_string(table.second.inserts) + " inserted, " +
+                    std::to_string(table.second.updates) + " updated, " +
+                    std::to_string(table.second.deletes) + " deleted";
+        }
+        return text;
+    }
+
+    std::string changeset_report::to_string() const
+    {
+        std::string text = "Applied a changeset of " + summary.to_string();
+        if (conflict_count != 0)
+        {
+            text += "\n" + plural(conflict_count, "conflict") + ", " + std::to_string(omitted) + " skipped, " +
+                    std::to_string(replaced) + " replaced:";
+            for (const std::string& conflict : conflicts)
+            {
+                text += "\n    " + conflict;
+            }
+            if (conflict_count > conflicts.size())
+            {
+                text += "\n    ...";
+            }
+        }
+        return text;
+    }
+
+#ifdef XSQL_HAVE_SQLITE_SESSION
+
+    changeset_summary read_changeset_summary(const std::string& path)
+    {
+        file_handle file(path, "rb");
+        changeset_summary summary;
+        sqlite3_changeset_iter* it = nullptr;
+        if (sqlite3changeset_start_strm(&it, read_chunk, open_changeset(file, path)) != SQLITE_OK)
+        {
+            throw std::runtime_error(path + " is not a changeset.");
+        }
+        int rc = SQLITE_OK;
+        while ((rc = sqlite3changeset_next(it)) == SQLITE_ROW)
+        {
+            const char* table = nullptr;
+            int columns = 0;
+            int op = 0;
+            int indirect = 0;
+            sqlite3changeset_op(it, &table, &columns, &op, &indirect);
+            changeset_counts& counts = summary.tables[table];
+            ++(op == SQLITE_INSERT ? counts.inserts : op == SQLITE_UPDATE ? counts.updates : counts.deletes);
+        }
+        sqlite3changeset_finalize(it);
+        if (rc != SQLITE_DONE)
+        {
+            throw std::runtime_error(path + " is not a valid changeset.");
+        }
+        std::error_code ec;
+        summary.bytes = static_cast<std::size_t>(fs::file_size(path, ec));
+        return summary;
+    }
+
+    changeset_report apply_changeset(sqlite3* db, const std::string& path, changeset_conflict policy)
+    {
+        changeset_report report;
+        /* Counted first, so that a corrupt file fails before any change */
+        report.summary = read_changeset_summary(path);
+
+        file_handle file(path, "rb");
+        apply_context context{db, policy, &report, {}};
+        const int rc = sqlite3changeset_apply_v2_strm(db, read_chunk, open_changeset(file, path),
+                                                      nullptr, on_conflict, &context,
+                                                      nullptr, nullptr, 0);
+        if (rc == SQLITE_ABORT && !context.abort_reason.empty())
+        {
+            throw std::runtime_error("The changeset was not applied, conflict on " + context.abort_reason + "." +
+                                     (policy == changeset_conflict::abort
+                                          ? " Use conflict=omit or conflict=replace to apply the other changes."
+                                          : ""));
+        }
+        if (rc != SQLITE_OK)
+        {
+            throw_sqlite_error(db, "Could not apply " + path);
+        }
+        return report;
+    }
+
+    change_recorder::~change_recorder()
+    {
+        stop();
+    }
+
+    std::string change_recorder::start(sqlite3* db, const std::vector<std::string>& tables)
+    {
+        stop();
+
+        /* Changes to tables without primary key are silently dropped by the session */
+        std::vector<std::string> missing_key;
+        {
+            sqlite3_stmt* stmt = nullptr;
+            sqlite3_prepare_v2(db, "SELECT m.name FROM sqlite_master m WHERE m.type = 'table' AND m.name NOT LIKE 'sqlite_%' "
+                                   "AND NOT EXISTS (SELECT 1 FROM pragma_table_info(m.name) WHERE pk > 0)",
+                               -1, &stmt, nullptr);
+            while (stmt != nullptr && sqlite3_step(stmt) == SQLITE_ROW)
+            {
+                missing_key.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
+            sqlite3_finalize(stmt);
+        }
+        for (const std::string& table : tables)
+        {
+            if (sqlite3_table_column_metadata(db, "main", table.c_str(), nullptr,
+                                              nullptr, nullptr, nullptr, nullptr, nullptr) != SQLITE_OK)
+            {
+                throw std::runtime_error("No table " + table + " in the main database.");
+            }
+            for (const std::string& name : missing_key)
+            {
+                if (iequals(name, table))
+                {
+                    throw std::runtime_error("Table " + table + " has no primary key, its changes cannot be recorded.");
+                }
+            }
+        }
+
+        p_db = db;
+        m_tables = tables;
+        attach();
+
+        std::string text = "Recording changes to ";
+        if (tables.empty())
+        {
+            text += "all the tables";
+            if (!missing_key.empty())
+            {
+                text += ", except the tables without primary key:";
+                for (const std::string& name : missing_key)
+                {
+                    text += " " + name;
+                }
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < tables.size(); ++i)
+            {
+                text += (i == 0 ? "" : ", ") + tables[i];
+            }
+        }
+        return text + ".";
+    }
+
+    void change_recorder::attach()
+    {
+        if (sqlite3session_create(p_db, "main", &p_session) != SQLITE_OK)
+        {
+            p_session = nullptr;
+            throw_sqlite_error(p_db, "Could not start the session");
+        }
+        if (m_tables.empty())
+        {
+            sqlite3session_attach(p_session, nullptr);
+        }
+        for (const std::string& table : m_tables)
+        {
+            if (sqlite3session_attach(p_session, table.c_str()) != SQLITE_OK)
+            {
+                stop();
+                throw std::runtime_error("Could not record the changes to " + table + ".");
+            }
+        }
+    }
+
+    void change_recorder::stop()
+    {
+        if (p_session != nullptr)
+        {
+            sqlite3session_delete(p_session);
+            p_session = nullptr;
+        }
+        p_db = nullptr;
+        m_tables.clear();
+    }
+
+    changeset_summary change_recorder::save(const std::string& path)
+    {
+        if (p_session == nullptr)
+        {
+            throw std::runtime_error("No session, start one with %SESSION_START.");
+        }
+        file_handle file(path, "wb");
+        if (file.file == nullptr)
+        {
+            throw std::runtime_error("Could not open " + path + " for writing.");
+        }
+        const bool written = sqlite3session_changeset_strm(p_session, write_chunk, file.file) == SQLITE_OK;
+        if (!file.close() || !written)
+        {
+            std::error_code ec;
+            fs::remove(path, ec);
+            throw std::runtime_error("Could not write the changeset to " + path + ".");
+        }
+
+        /* The next changeset starts from here */
+        sqlite3session_delete(p_session);
+        p_session = nullptr;
+        attach();
+        return read_changeset_summary(path);
+    }
+
+#else
+
+    namespace
+    {
+        [[noreturn]] void throw_unavailable()
+        {
+            throw std::runtime_error("Sessions are not available, SQLite was built without the session extension.");
+        }
+    }
+
+    changeset_summary read_changeset_summary(const std::string&)
+    {
+        throw_unavailable();
+    }
+
+    changeset_report apply_changeset(sqlite3*, const std::string&, changeset_conflict)
+    {
+        throw_unavailable();
+    }
+
+    change_recorder::~change_recorder()
+    {
+    }
+
+    std::string change_recorder::start(sqlite3*, const std::vector<std::string>&)
+    {
+        throw_unavailable();
+    }
+
+    void change_recorder::attach()
+    {
+    }
+
+    void change_recorder::stop()
+    {
+    }
+
+    changeset_summary change_recorder::save(const std::string&)
+    {
+        throw_unavailable();
+    }
+
+#endif
+
+    bool change_recorder::active() const noexcept
+    {
+        return p_session != nullptr;
+    }
+
+    sqlite3* change_recorder::database() const noexcept
+    {
+        return p_db;
+    }
+}
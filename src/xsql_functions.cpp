@@ -0,0 +1,660 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "xeus-sqlite/xsql_functions.hpp"
+
+#ifndef SQLITE_RESULT_SUBTYPE
+/* Declared by SQLite 3.45, older versions ignore the flag */
+#define SQLITE_RESULT_SUBTYPE 0x001000000
+#endif
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        constexpr double pi = 3.14159265358979323846;
+
+        /* False for NULL and for values that are not numbers */
+        bool numeric_value(sqlite3_value* value, double& result)
+        {
+            int type = sqlite3_value_numeric_type(value);
+            if (type != SQLITE_INTEGER && type != SQLITE_FLOAT)
+            {
+                return false;
+            }
+            result = sqlite3_value_double(value);
+            return !std::isnan(result);
+        }
+
+        bool read_fraction(sqlite3_context* context, sqlite3_value* value, double& fraction)
+        {
+            if (!numeric_value(value, fraction) || fraction < 0.0 || fraction > 1.0)
+            {
+                sqlite3_result_error(context, "the fraction must be between 0 and 1", -1);
+                return false;
+            }
+            return true;
+        }
+
+        /* Accumulators holding C++ objects keep a pointer in the aggregate
+           context, they are deleted in xFinal */
+        template <class T>
+        T* get_state(sqlite3_context* context, bool create)
+        {
+            T** slot = static_cast<T**>(sqlite3_aggregate_context(context, create ? sizeof(T*) : 0));
+            if (slot == nullptr)
+            {
+                if (create)
+                {
+                    sqlite3_result_error_nomem(context);
+                }
+                return nullptr;
+            }
+            if (*slot == nullptr && create)
+            {
+                *slot = new (std::nothrow) T();
+                if (*slot == nullptr)
+                {
+                    sqlite3_result_error_nomem(context);
+                }
+            }
+            return *slot;
+        }
+
+        template <class T>
+        void delete_state(sqlite3_context* context)
+        {
+            T** slot = static_cast<T**>(sqlite3_aggregate_context(context, 0));
+            if (slot != nullptr)
+            {
+                delete *slot;
+                *slot = nullptr;
+            }
+        }
+
+        /*****************************
+         * median, percentile_cont   *
+         *****************************/
+
+        struct values_state
+        {
+            /* Contiguous, the selection is done in place with nth_element */
+            std::vector<double> values;
+            double fraction = 0.5;
+        };
+
+        void percentile_step(sqlite3_context* context, int argc, sqlite3_value** argv)
+        {
+            values_state* state = get_state<values_state>(context, true);
+            if (state == nullptr)
+            {
+                return;
+            }
+            if (argc == 2 && !read_fraction(context, argv[1], state->fraction))
+            {
+                return;
+            }
+            double value;
+            if (numeric_value(argv[0], value))
+            {
+                state->values.push_back(value);
+            }
+        }
+
+        void percentile_inverse(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            values_state* state = get_state<values_state>(context, false);
+            double value;
+            if (state == nullptr || !numeric_value(argv[0], value))
+            {
+                return;
+            }
+            auto it = std::find(state->values.begin(), state->values.end(), value);
+            if (it != state->values.end())
+            {
+                *it = state->values.back();
+                state->values.pop_back();
+            }
+        }
+
+        /* Linear interpolation between the closest ranks */
+        void percentile_value(sqlite3_context* context)
+        {
+            values_state* state = get_state<values_state>(context, false);
+            if (state == nullptr || state->values.empty())
+            {
+                sqlite3_result_null(context);
+                return;
+            }
+
+            std::vector<double>& values = state->values;
+            const double position = state->fraction * static_cast<double>(values.size() - 1);
+            const std::size_t lower = static_cast<std::size_t>(position);
+            std::nth_element(values.begin(), values.begin() + lower, values.end());
+            double result = values[lower];
+
+            const double weight = position - static_cast<double>(lower);
+            if (weight > 0.0)
+            {
+                double upper = *std::min_element(values.begin() + lower + 1, values.end());
+                result += weight * (upper - result);
+            }
+            sqlite3_result_double(context, result);
+        }
+
+        void percentile_final(sqlite3_context* context)
+        {
+            percentile_value(context);
+            delete_state<values_state>(context);
+        }
+
+        /***************************************
+         * stddev, variance, stddev_pop, var_pop *
+         ***************************************/
+
+        /* Welford's running moments, kept in the aggregate context itself */
+        struct moments
+        {
+            std::int64_t count;
+            double mean;
+            double m2;
+        };
+
+        void moments_step(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            double value;
+            if (!numeric_value(argv[0], value))
+            {
+                return;
+            }
+            moments* state = static_cast<moments*>(sqlite3_aggregate_context(context, sizeof(moments)));
+            if (state == nullptr)
+            {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+            ++state->count;
+            const double delta = value - state->mean;
+            state->mean += delta / static_cast<double>(state->count);
+            state->m2 += delta * (value - state->mean);
+        }
+
+        void moments_inverse(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            double value;
+            moments* state = static_cast<moments*>(sqlite3_aggregate_context(context, 0));
+            if (state == nullptr || state->count == 0 || !numeric_value(argv[0], value))
+            {
+                return;
+            }
+            if (state->count == 1)
+            {
+                *state = moments{0, 0.0, 0.0};
+                return;
+            }
+            const double count = static_cast<double>(state->count);
+            const double previous_mean = (count * state->mean - value) / (count - 1.0);
+            state->m2 = std::max(0.0, state->m2 - (value - previous_mean) * (value - state->mean));
+            state->mean = previous_mean;
+            --state->count;
+        }
+
+        template <bool sample, bool root>
+        void moments_value(sqlite3_context* context)
+        {
+            moments* state = static_cast<moments*>(sqlite3_aggregate_context(context, 0));
+            const std::int64_t minimum = sample ? 2 : 1;
+            if (state == nullptr || state->count < minimum)
+            {
+                sqlite3_result_null(context);
+                return;
+            }
+            double variance = state->m2 / static_cast<double>(state->count - (sample ? 1 : 0));
+            sqlite3_result_double(context, root ? std::sqrt(variance) : variance);
+        }
+
+        /***************************
+         * width_bucket, histogram *
+         ***************************/
+
+        struct bucket_bounds
+        {
+            double low;
+            double high;
+            std::int64_t count;
+        };
+
+        bool read_bounds(sqlite3_context* context, sqlite3_value** argv, bucket_bounds& bounds)
+        {
+            double count;
+            if (!numeric_value(argv[1], bounds.low) || !numeric_value(argv[2], bounds.high) ||
+                !numeric_value(argv[3], count) || !(bounds.high > bounds.low) || count < 1.0 ||
+                count > 1e6)
+            {
+                sqlite3_result_error(context, "expected low < high and a bucket count between 1 and 1000000", -1);
+                return false;
+            }
+            bounds.count = static_cast<std::int64_t>(count);
+            return true;
+        }
+
+        /* 0 below low, count + 1 from high, as in PostgreSQL */
+        std::int64_t bucket_of(double value, const bucket_bounds& bounds)
+        {
+            if (value < bounds.low)
+            {
+                return 0;
+            }
+            if (value >= bounds.high)
+            {
+                return bounds.count + 1;
+            }
+            std::int64_t bucket = static_cast<std::int64_t>(
+                (value - bounds.low) / (bounds.high - bounds.low) * static_cast<double>(bounds.count)) + 1;
+            return std::min(bucket, bounds.count);
+        }
+
+        void width_bucket(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            bucket_bounds bounds;
+            double value;
+            if (!read_bounds(context, argv, bounds))
+            {
+                return;
+            }
+            if (!numeric_value(argv[0], value))
+            {
+                sqlite3_result_null(context);
+                return;
+            }
+            sqlite3_result_int64(context, bucket_of(value, bounds));
+        }
+
+        struct histogram_state
+        {
+            bucket_bounds bounds{0.0, 0.0, 0};
+            std::vector<std::int64_t> counts;
+        };
+
+        void histogram_step(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            histogram_state* state = get_state<histogram_state>(context, true);
+            if (state == nullptr)
+            {
+                return;
+            }
+            if (state->counts.empty())
+            {
+                if (!read_bounds(context, argv, state->bounds))
+                {
+                    return;
+                }
+                state->counts.assign(static_cast<std::size_t>(state->bounds.count), 0);
+            }
+            double value;
+            if (numeric_value(argv[0], value))
+            {
+                std::int64_t bucket = bucket_of(value, state->bounds);
+                if (bucket >= 1 && bucket <= state->bounds.count)
+                {
+                    ++state->counts[static_cast<std::size_t>(bucket - 1)];
+                }
+            }
+        }
+
+        /* JSON array with the count of each bucket */
+        void histogram_final(sqlite3_context* context)
+        {
+            histogram_state* state = get_state<histogram_state>(context, false);
+            if (state == nullptr)
+            {
+                sqlite3_result_null(context);
+                return;
+            }
+            std::string json = "[";
+            for (std::size_t i = 0; i < state->counts.size(); ++i)
+            {
+                json += (i == 0 ? "" : ",") + std::to_string(state->counts[i]);
+            }
+            json += "]";
+            sqlite3_result_text(context, json.c_str(), static_cast<int>(json.size()), SQLITE_TRANSIENT);
+            sqlite3_result_subtype(context, 'J');
+            delete_state<histogram_state>(context);
+        }
+
+        /*************************
+         * approx_count_distinct *
+         *************************/
+
+        constexpr int hll_precision = 14;
+        constexpr std::size_t hll_registers = std::size_t(1) << hll_precision;
+
+        /* 16 KiB of registers, allocated zeroed by SQLite in the aggregate context */
+        struct hyperloglog
+        {
+            std::uint8_t registers[hll_registers];
+        };
+
+        inline std::uint64_t mix64(std::uint64_t x)
+        {
+            x ^= x >> 33;
+            x *= 0xff51afd7ed558ccdull;
+            x ^= x >> 33;
+            x *= 0xc4ceb9fe1a85ec53ull;
+            x ^= x >> 33;
+            return x;
+        }
+
+        std::uint64_t hash_bytes(const unsigned char* data, std::size_t size, std::uint64_t seed)
+        {
+            std::uint64_t hash = mix64(seed ^ (size * 0x9e3779b97f4a7c15ull));
+            std::size_t pos = 0;
+            for (; pos + 8 <= size; pos += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + pos, 8);
+                hash = mix64(hash ^ word) * 0x9e3779b97f4a7c15ull;
+            }
+            std::uint64_t tail = 0;
+            std::memcpy(&tail, data + pos, size - pos);
+            return mix64(hash ^ tail);
+        }
+
+        /* Equal values for DISTINCT hash the same, 1 and 1.0 included */
+        std::uint64_t hash_value(sqlite3_value* value)
+        {
+            switch (sqlite3_value_type(value))
+            {
+                case SQLITE_INTEGER:
+                    return mix64(static_cast<std::uint64_t>(sqlite3_value_int64(value)) ^ 0x1);
+                case SQLITE_FLOAT:
+                {
+                    double number = sqlite3_value_double(value);
+                    if (number == std::floor(number) && std::fabs(number) < 9.2e18)
+                    {
+                        return mix64(static_cast<std::uint64_t>(static_cast<std::int64_t>(number)) ^ 0x1);
+                    }
+                    std::uint64_t bits;
+                    std::memcpy(&bits, &number, sizeof(bits));
+                    return mix64(bits ^ 0x2);
+                }
+                case SQLITE_TEXT:
+                    return hash_bytes(sqlite3_value_text(value),
+                                      static_cast<std::size_t>(sqlite3_value_bytes(value)), 0x3);
+                default:
+                    return hash_bytes(static_cast<const unsigned char*>(sqlite3_value_blob(value)),
+                                      static_cast<std::size_t>(sqlite3_value_bytes(value)), 0x4);
+            }
+        }
+
+        void hll_step(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+            {
+                return;
+            }
+            hyperloglog* state = static_cast<hyperloglog*>(sqlite3_aggregate_context(context, sizeof(hyperloglog)));
+            if (state == nullptr)
+            {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+
+            const std::uint64_t hash = hash_value(argv[0]);
+            const std::size_t index = static_cast<std::size_t>(hash >> (64 - hll_precision));
+            std::uint64_t rest = hash << hll_precision;
+            std::uint8_t rank = 1;
+            while (rank <= 64 - hll_precision && (rest & (std::uint64_t(1) << 63)) == 0)
+            {
+                ++rank;
+                rest <<= 1;
+            }
+            state->registers[index] = std::max(state->registers[index], rank);
+        }
+
+        void hll_final(sqlite3_context* context)
+        {
+            hyperloglog* state = static_cast<hyperloglog*>(sqlite3_aggregate_context(context, 0));
+            if (state == nullptr)
+            {
+                sqlite3_result_int64(context, 0);
+                return;
+            }
+
+            const double m = static_cast<double>(hll_registers);
+            double sum = 0.0;
+            std::size_t zeros = 0;
+            for (std::uint8_t reg : state->registers)
+            {
+                sum += std::ldexp(1.0, -reg);
+                zeros += reg == 0 ? 1 : 0;
+            }
+            double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+            /* Linear counting is more accurate for small cardinalities */
+            if (estimate <= 2.5 * m && zeros != 0)
+            {
+                estimate = m * std::log(m / static_cast<double>(zeros));
+            }
+            sqlite3_result_int64(context, static_cast<sqlite3_int64>(std::llround(estimate)));
+        }
+
+        /********************
+         * tdigest_quantile *
+         ********************/
+
+        /* Merging t-digest with the k1 scale function */
+        class tdigest
+        {
+        public:
+
+            void add(double value)
+            {
+                m_buffer.push_back(value);
+                if (m_buffer.size() >= buffer_size)
+                {
+                    compress();
+                }
+            }
+
+            double quantile(double fraction)
+            {
+                compress();
+                if (m_centroids.size() == 1)
+                {
+                    return m_centroids.front().mean;
+                }
+
+                const double target = fraction * m_total;
+                double cumulated = 0.0;
+                double previous_center = 0.0;
+                double previous_mean = m_min;
+                for (const centroid& c : m_centroids)
+                {
+                    const double center = cumulated + c.weight / 2.0;
+                    if (target < center)
+                    {
+                        double span = center - previous_center;
+                        double t = span > 0.0 ? (target - previous_center) / span : 0.0;
+                        return previous_mean + t * (c.mean - previous_mean);
+                    }
+                    cumulated += c.weight;
+                    previous_center = center;
+                    previous_mean = c.mean;
+                }
+                double span = m_total - previous_center;
+                double t = span > 0.0 ? (target - previous_center) / span : 1.0;
+                return previous_mean + t * (m_max - previous_mean);
+            }
+
+            bool empty() const
+            {
+                return m_buffer.empty() && m_centroids.empty();
+            }
+
+            double fraction = 0.5;
+
+        private:
+
+            struct centroid
+            {
+                double mean;
+                double weight;
+            };
+
+            static constexpr double compression = 200.0;
+            static constexpr std::size_t buffer_size = 2048;
+
+            static double scale(double q)
+            {
+                return compression / (2.0 * pi) * std::asin(2.0 * q - 1.0);
+            }
+
+            static double inverse_scale(double k)
+            {
+                double clamped = std::max(-compression / 4.0, std::min(compression / 4.0, k));
+                return (std::sin(clamped * 2.0 * pi / compression) + 1.0) / 2.0;
+            }
+
+            void compress()
+            {
+                if (m_buffer.empty())
+                {
+                    return;
+                }
+                std::sort(m_buffer.begin(), m_buffer.end());
+                m_min = m_centroids.empty() ? m_buffer.front() : std::min(m_min, m_buffer.front());
+                m_max = m_centroids.empty() ? m_buffer.back() : std::max(m_max, m_buffer.back());
+
+                std::vector<centroid> incoming;
+                incoming.reserve(m_centroids.size() + m_buffer.size());
+                std::vector<centroid> points;
+                points.reserve(m_buffer.size());
+                for (double value : m_buffer)
+                {
+                    points.push_back({value, 1.0});
+                }
+                std::merge(m_centroids.begin(), m_centroids.end(), points.begin(), points.end(),
+                           std::back_inserter(incoming),
+                           [](const centroid& lhs, const centroid& rhs) { return lhs.mean < rhs.mean; });
+                m_total += static_cast<double>(m_buffer.size());
+                m_buffer.clear();
+
+                m_centroids.clear();
+                centroid current = incoming.front();
+                double merged_weight = 0.0;
+                double limit = inverse_scale(scale(0.0) + 1.0) * m_total;
+                for (std::size_t i = 1; i < incoming.size(); ++i)
+                {
+                    const centroid& next = incoming[i];
+                    if (merged_weight + current.weight + next.weight <= limit)
+                    {
+                        current.weight += next.weight;
+                        current.mean += (next.mean - current.mean) * next.weight / current.weight;
+                    }
+                    else
+                    {
+                        merged_weight += current.weight;
+                        m_centroids.push_back(current);
+                        limit = inverse_scale(scale(merged_weight / m_total) + 1.0) * m_total;
+                        current = next;
+                    }
+                }
+                m_centroids.push_back(current);
+            }
+
+            std::vector<centroid> m_centroids;
+            std::vector<double> m_buffer;
+            double m_total = 0.0;
+            double m_min = 0.0;
+            double m_max = 0.0;
+        };
+
+        void tdigest_step(sqlite3_context* context, int, sqlite3_value** argv)
+        {
+            tdigest* state = get_state<tdigest>(context, true);
+            if (state == nullptr || !read_fraction(context, argv[1], state->fraction))
+            {
+                return;
+            }
+            double value;
+            if (numeric_value(argv[0], value))
+            {
+                state->add(value);
+            }
+        }
+
+        void tdigest_final(sqlite3_context* context)
+        {
+            tdigest* state = get_state<tdigest>(context, false);
+            if (state == nullptr || state->empty())
+            {
+                sqlite3_result_null(context);
+            }
+            else
+            {
+                sqlite3_result_double(context, state->quantile(state->fraction));
+            }
+            delete_state<tdigest>(context);
+        }
+
+        using step_function = void (*)(sqlite3_context*, int, sqlite3_value**);
+        using final_function = void (*)(sqlite3_context*);
+
+        void create_window(sqlite3* db, const char* name, int argc,
+                           step_function step, final_function value_fn, final_function final_fn,
+                           step_function inverse)
+        {
+            int rc = sqlite3_create_window_function(db, name, argc, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                                    nullptr, step, final_fn, value_fn, inverse, nullptr);
+            if (rc != SQLITE_OK)
+            {
+                throw std::runtime_error(std::string("Could not register ") + name + ": " + sqlite3_errmsg(db));
+            }
+        }
+
+        /* flags adds to SQLITE_UTF8 | SQLITE_DETERMINISTIC, such as SQLITE_RESULT_SUBTYPE */
+        void create_function(sqlite3* db, const char* name, int argc, step_function scalar,
+                             step_function step, final_function final_fn, int flags = 0)
+        {
+            int rc = sqlite3_create_function_v2(db, name, argc, SQLITE_UTF8 | SQLITE_DETERMINISTIC | flags,
+                                                nullptr, scalar, step, final_fn, nullptr);
+            if (rc != SQLITE_OK)
+            {
+                throw std::runtime_error(std::string("Could not register ") + name + ": " + sqlite3_errmsg(db));
+            }
+        }
+    }
+
+    void register_sql_functions(sqlite3* db)
+    {
+        create_window(db, "median", 1, percentile_step, percentile_value, percentile_final, percentile_inverse);
+        create_window(db, "percentile_cont", 2, percentile_step, percentile_value, percentile_final, percentile_inverse);
+
+        create_window(db, "stddev", 1, moments_step, moments_value<true, true>, moments_value<true, true>, moments_inverse);
+        create_window(db, "variance", 1, moments_step, moments_value<true, false>, moments_value<true, false>, moments_inverse);
+        create_window(db, "stddev_pop", 1, moments_step, moments_value<false, true>, moments_value<false, true>, moments_inverse);
+        create_window(db, "var_pop", 1, moments_step, moments_value<false, false>, moments_value<false, false>, moments_inverse);
+
+        create_function(db, "width_bucket", 4, width_bucket, nullptr, nullptr);
+        /* The JSON subtype lets json_each and json_extract read the result as JSON */
+        create_function(db, "histogram", 4, nullptr, histogram_step, histogram_final, SQLITE_RESULT_SUBTYPE);
+        create_function(db, "approx_count_distinct", 1, nullptr, hll_step, hll_final);
+        create_function(db, "tdigest_quantile", 2, nullptr, tdigest_step, tdigest_final);
+    }
+}
@@ -0,0 +1,313 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <vector>
+
+#include "xeus-sqlite/xtext_renderer.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        struct codepoint_range
+        {
+            char32_t first;
+            char32_t last;
+        };
+
+        /* Combining marks and zero width characters */
+        constexpr codepoint_range zero_width_ranges[] = {
+            {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD},
+            {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0E31, 0x0E31},
+            {0x0E34, 0x0E3A}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+            {0x200B, 0x200F}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+            {0xFE20, 0xFE2F}
+        };
+
+        /* East Asian wide and fullwidth characters, emojis */
+        constexpr codepoint_range wide_ranges[] = {
+            {0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF},
+            {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+            {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE30, 0xFE4F},
+            {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F},
+            {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+        };
+
+        template <std::size_t N>
+        bool in_ranges(char32_t cp, const codepoint_range (&ranges)[N])
+        {
+            for (const auto& range : ranges)
+            {
+                if (cp < range.first)
+                {
+                    return false;
+                }
+                if (cp <= range.last)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::size_t codepoint_width(char32_t cp)
+        {
+            if (cp < 0x300)
+            {
+                return 1;
+            }
+            if (in_ranges(cp, zero_width_ranges))
+            {
+                return 0;
+            }
+            return in_ranges(cp, wide_ranges) ? 2 : 1;
+        }
+
+        /* Decodes the code point starting at text[pos], invalid sequences
+           are consumed one byte at a time */
+        std::size_t decode_utf8(std::string_view text, std::size_t pos, char32_t& cp)
+        {
+            const auto lead = static_cast<unsigned char>(text[pos]);
+            std::size_t length = lead < 0x80 ? 1 :
+                                 (lead >> 5) == 0x6 ? 2 :
+                                 (lead >> 4) == 0xE ? 3 :
+                                 (lead >> 3) == 0x1E ? 4 : 0;
+            if (length == 0 || pos + length > text.size())
+            {
+                cp = lead;
+                return 1;
+            }
+
+            cp = length == 1 ? lead : lead & (0x7F >> length);
+            for (std::size_t i = 1; i < length; ++i)
+            {
+                const auto next = static_cast<unsigned char>(text[pos + i]);
+                if ((next >> 6) != 0x2)
+                {
+                    cp = lead;
+                    return 1;
+                }
+                cp = (cp << 6) | (next & 0x3F);
+            }
+            return length;
+        }
+
+        bool is_ascii(std::string_view text)
+        {
+            return std::all_of(text.begin(), text.end(), [](char c)
+            {
+                return static_cast<unsigned char>(c) < 0x80;
+            });
+        }
+
+        struct fitted_cell
+        {
+            std::size_t bytes;
+            std::size_t width;
+            bool truncated;
+        };
+
+        /* Measures a cell and, if it is wider than max_width, finds the
+           longest prefix that fits with the trailing "..." */
+        fitted_cell fit_cell(std::string_view text, std::size_t max_width)
+        {
+            if (is_ascii(text))
+            {
+                if (text.size() <= max_width)
+                {
+                    return {text.size(), text.size(), false};
+                }
+                std::size_t keep = max_width > 3 ? max_width - 3 : 0;
+                return {keep, keep, true};
+            }
+
+            std::size_t limit = max_width > 3 ? max_width - 3 : 0;
+            std::size_t width = 0;
+            std::size_t cut_bytes = 0;
+            std::size_t cut_width = 0;
+            std::size_t pos = 0;
+            while (pos < text.size())
+            {
+                char32_t cp;
+                std::size_t length = decode_utf8(text, pos, cp);
+                width += codepoint_width(cp);
+                pos += length;
+                if (width <= limit)
+                {
+                    cut_bytes = pos;
+                    cut_width = width;
+                }
+            }
+
+            if (width <= max_width)
+            {
+                return {text.size(), width, false};
+            }
+            return {cut_bytes, cut_width, true};
+        }
+
+        /* Cells are kept on a single line */
+        void append_cell(std::string& out, std::string_view text)
+        {
+            for (char c : text)
+            {
+                out.push_back(c == '\n' || c == '\r' || c == '\t' ? ' ' : c);
+            }
+        }
+
+        template <class F>
+        void append_line(std::string& out,
+                         F&& cell_at,
+                         const std::vector<std::size_t>& widths,
+                         std::size_t max_width)
+        {
+            out.push_back('|');
+            for (std::size_t col = 0; col < widths.size(); ++col)
+            {
+                std::string_view text = cell_at(col);
+                fitted_cell fitted = fit_cell(text, max_width);
+
+                out.push_back(' ');
+                append_cell(out, text.substr(0, fitted.bytes));
+                std::size_t width = fitted.width;
+                if (fitted.truncated)
+                {
+                    out.append("...");
+                    width += 3;
+                }
+                out.append(widths[col] - width + 1, ' ');
+                out.push_back('|');
+            }
+        }
+    }
+
+    std::size_t display_width(std::string_view text)
+    {
+        if (is_ascii(text))
+        {
+            return text.size();
+        }
+
+        std::size_t width = 0;
+        std::size_t pos = 0;
+        while (pos < text.size())
+        {
+            char32_t cp;
+            pos += decode_utf8(text, pos, cp);
+            width += codepoint_width(cp);
+        }
+        return width;
+    }
+
+    std::string render_text_table(const result_table& table,
+                                  const text_table_options& options)
+    {
+        const std::size_t columns = table.column_count();
+        /* The omitted rows are in the elided part, the tail is the end of the buffer */
+        const std::size_t stored = table.row_count();
+        const std::size_t rows = stored + table.omitted_rows();
+        if (columns == 0)
+        {
+            return "";
+        }
+
+        const std::size_t max_width = std::max<std::size_t>(options.max_column_width, 4);
+        const bool elided = options.max_rows != 0 && rows > options.max_rows;
+        const std::size_t head = elided ? (options.max_rows + 1) / 2 : rows;
+        const std::size_t tail = elided ? options.max_rows / 2 : 0;
+
+        /* First pass: column widths and the extra bytes of multi-byte cells */
+        std::vector<std::size_t> widths(columns, elided ? 3 : 0);
+        std::size_t extra_bytes = 0;
+
+        auto measure = [&](std::string_view text, std::size_t col)
+        {
+            fitted_cell fitted = fit_cell(text, max_width);
+            std::size_t width = fitted.width + (fitted.truncated ? 3 : 0);
+            widths[col] = std::max(widths[col], width);
+            extra_bytes += fitted.bytes - fitted.width;
+        };
+
+        for (std::size_t col = 0; col < columns; ++col)
+        {
+            measure(table.column_name(col), col);
+        }
+        for (std::size_t row = 0; row < head; ++row)
+        {
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                measure(table.display(row, col), col);
+            }
+        }
+        for (std::size_t row = stored - tail; row < stored; ++row)
+        {
+            for (std::size_t col = 0; col < columns; ++col)
+            {
+                measure(table.display(row, col), col);
+            }
+        }
+
+        /* Second pass: writes into a buffer sized from the first one */
+        std::string border(1, '+');
+        for (std::size_t width : widths)
+        {
+            border.append(width + 2, '-');
+            border.push_back('+');
+        }
+
+        const std::size_t line_count = 2 * (head + tail + (elided ? 2 : 1)) + 1;
+        std::string out;
+        out.reserve(line_count * (border.size() + 1) + extra_bytes + 64);
+
+        out.append(border);
+        out.push_back('\n');
+        append_line(out, [&](std::size_t col) -> std::string_view
+        {
+            return table.column_name(col);
+        }, widths, max_width);
+
+        for (std::size_t row = 0; row < head; ++row)
+        {
+            out.push_back('\n');
+            out.append(border);
+            out.push_back('\n');
+            append_line(out, [&](std::size_t col) { return table.display(row, col); },
+                        widths, max_width);
+        }
+
+        if (elided)
+        {
+            out.push_back('\n');
+            out.append(border);
+            out.push_back('\n');
+            append_line(out, [](std::size_t) { return std::string_view("..."); },
+                        widths, max_width);
+
+            for (std::size_t row = stored - tail; row < stored; ++row)
+            {
+                out.push_back('\n');
+                out.append(border);
+                out.push_back('\n');
+                append_line(out, [&](std::size_t col) { return table.display(row, col); },
+                        widths, max_width);
+            }
+        }
+
+        out.push_back('\n');
+        out.append(border);
+
+        if (elided)
+        {
+            out.append("\n[" + std::to_string(rows) + " rows x "
+                       + std::to_string(columns) + " columns]");
+        }
+        return out;
+    }
+}
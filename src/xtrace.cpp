@@ -0,0 +1,127 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <stdexcept>
+
+#include "xeus-sqlite/xtrace.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Cells run on a single thread, every span shares the same track */
+        constexpr int trace_pid = 1;
+        constexpr int trace_tid = 1;
+
+        double microseconds(tracer::clock::duration duration)
+        {
+            return std::chrono::duration<double, std::micro>(duration).count();
+        }
+    }
+
+    tracer::~tracer()
+    {
+        stop();
+    }
+
+    void tracer::start(const std::string& path)
+    {
+        stop();
+        m_file.open(path, std::ios::out | std::ios::trunc);
+        if (!m_file)
+        {
+            throw std::runtime_error("Could not write the trace to " + path + ".");
+        }
+        m_path = path;
+        m_origin = clock::now();
+        m_events.clear();
+        m_written = 0;
+        m_first_event = true;
+        m_enabled = true;
+
+        m_file << "[\n";
+        write({{"name", "process_name"}, {"ph", "M"}, {"pid", trace_pid}, {"tid", trace_tid},
+               {"args", {{"name", "xsqlite"}}}});
+        write({{"name", "thread_name"}, {"ph", "M"}, {"pid", trace_pid}, {"tid", trace_tid},
+               {"args", {{"name", "execute"}}}});
+        m_file.flush();
+    }
+
+    void tracer::stop()
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        flush();
+        m_file << "\n]\n";
+        m_file.close();
+        m_enabled = false;
+    }
+
+    void tracer::flush()
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        for (event& e : m_events)
+        {
+            nl::json trace_event = {
+                {"name", e.name},
+                {"cat", e.category},
+                {"ph", "X"},
+                {"ts", microseconds(e.start - m_origin)},
+                {"dur", microseconds(e.end - e.start)},
+                {"pid", trace_pid},
+                {"tid", trace_tid}
+            };
+            if (!e.args.is_null())
+            {
+                trace_event["args"] = std::move(e.args);
+            }
+            write(trace_event);
+            ++m_written;
+        }
+        m_events.clear();
+        m_file.flush();
+    }
+
+    void tracer::record(const char* name,
+                        const char* category,
+                        clock::time_point start,
+                        clock::time_point end,
+                        nl::json args)
+    {
+        if (m_enabled)
+        {
+            m_events.push_back(event{name, category, start, end, std::move(args)});
+        }
+    }
+
+    const std::string& tracer::path() const noexcept
+    {
+        return m_path;
+    }
+
+    std::size_t tracer::event_count() const noexcept
+    {
+        return m_written + m_events.size();
+    }
+
+    void tracer::write(const nl::json& trace_event)
+    {
+        if (!m_first_event)
+        {
+            m_file << ",\n";
+        }
+        m_file << trace_event.dump();
+        m_first_event = false;
+    }
+}
@@ -9,10 +9,16 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
 #include <vector>
 #include <iterator>
 #include <map>
 
+#include "xeus-sqlite/xmagic_parser.hpp"
 #include "xeus-sqlite/xvega_sqlite.hpp"
 #include "xvega-bindings/xvega_bindings.hpp"
 
@@ -20,6 +26,81 @@ namespace nl = nlohmann;
 
 namespace xeus_sqlite
 {
+    namespace
+    {
+        /* FNV-1a, only used to derive stable dataset names */
+        std::string dataset_name(const std::string& serialized_values)
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (unsigned char c : serialized_values)
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            char name[32];
+            std::snprintf(name, sizeof(name), "data-%016llx",
+                          static_cast<unsigned long long>(hash));
+            return name;
+        }
+
+        void externalize_spec_data(nl::json& spec,
+                                   nl::json& datasets,
+                                   const std::string& data_dir)
+        {
+            if (!spec.is_object())
+            {
+                return;
+            }
+
+            auto data = spec.find("data");
+            if (data != spec.end() && data->is_object() && data->contains("values"))
+            {
+                std::string serialized = (*data)["values"].dump();
+                std::string name = dataset_name(serialized);
+
+                if (data_dir.empty())
+                {
+                    if (!datasets.contains(name))
+                    {
+                        datasets[name] = std::move((*data)["values"]);
+                    }
+                    *data = nl::json{{"name", name}};
+                }
+                else
+                {
+                    std::string url = data_dir + "/" + name + ".json";
+                    std::error_code ec;
+                    std::filesystem::create_directories(data_dir, ec);
+                    if (ec)
+                    {
+                        throw std::runtime_error("Could not create the chart data directory " + data_dir +
+                                                 ": " + ec.message() + ".");
+                    }
+                    std::ofstream out(url, std::ios::out | std::ios::binary | std::ios::trunc);
+                    if (!out.is_open())
+                    {
+                        throw std::runtime_error("Could not write chart data to " + url + ".");
+                    }
+                    out.write(serialized.data(), static_cast<std::streamsize>(serialized.size()));
+                    *data = nl::json{{"url", url}, {"format", {{"type", "json"}}}};
+                }
+            }
+
+            /* Composite views carry their own data */
+            for (const char* key : {"layer", "hconcat", "vconcat", "concat"})
+            {
+                auto views = spec.find(key);
+                if (views != spec.end() && views->is_array())
+                {
+                    for (auto& view : *views)
+                    {
+                        externalize_spec_data(view, datasets, data_dir);
+                    }
+                }
+            }
+        }
+    }
+
     std::pair<std::vector<std::string>, std::vector<std::string>> 
         xv_sqlite::split_xv_sqlite_input(std::vector<std::string> complete_input)
     {
@@ -33,4 +114,50 @@ namespace xeus_sqlite
 
         return std::make_pair(xvega_input, sqlite_input);
     }
+
+    std::pair<std::vector<std::string>, std::string_view>
+        xv_sqlite::split_xv_sqlite_input(std::string_view arguments)
+    {
+        std::vector<std::string> xvega_input;
+        for (std::string_view token : split_arguments(arguments))
+        {
+            if (token == "<>")
+            {
+                std::size_t sql_start = static_cast<std::size_t>(token.data() - arguments.data()) + 2;
+                std::string_view sql = arguments.substr(sql_start);
+                sql.remove_prefix(std::min(sql.find_first_not_of(" \t\r\n"), sql.size()));
+                return std::make_pair(std::move(xvega_input), sql);
+            }
+            xvega_input.emplace_back(token);
+        }
+        throw std::runtime_error("XVEGA_PLOT expects <> followed by a SQLite query.");
+    }
+
+    nl::json xv_sqlite::externalize_datasets(nl::json mime_bundle,
+                                             const std::string& data_dir)
+    {
+        for (auto& item : mime_bundle.items())
+        {
+            if (item.key().rfind("application/vnd.vegalite", 0) != 0)
+            {
+                continue;
+            }
+
+            nl::json& spec = item.value();
+            nl::json datasets = spec.contains("datasets") ?
+                std::move(spec["datasets"]) : nl::json::object();
+
+            externalize_spec_data(spec, datasets, data_dir);
+
+            if (!datasets.empty())
+            {
+                spec["datasets"] = std::move(datasets);
+            }
+            else
+            {
+                spec.erase("datasets");
+            }
+        }
+        return mime_bundle;
+    }
 }
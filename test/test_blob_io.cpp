@@ -0,0 +1,90 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xblob_io.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        std::string read_file(const std::string& path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+    }
+
+    TEST(xeus_sqlite_blob_io, preview)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        SQLite::Statement query(db, "SELECT x'89504e470d0a1a0a0000000d', x'', zeroblob(3 * 1024 * 1024), 'text'");
+        ASSERT_TRUE(query.executeStep());
+
+        result_table table;
+        add_columns(table, query);
+        push_row(table, query);
+
+        EXPECT_EQ(table.display(0, 0), "BLOB 12 B 89504e470d0a1a0a...");
+        EXPECT_EQ(table.display(0, 1), "BLOB 0 B");
+        EXPECT_EQ(table.display(0, 2), "BLOB 3.0 MiB 0000000000000000...");
+        EXPECT_EQ(table.display(0, 3), "text");
+        EXPECT_EQ(table.cell(0, 0).size(), blob_preview_size);
+        EXPECT_EQ(table.blob_size(0, 2), 3u * 1024 * 1024);
+        EXPECT_LT(table.content_size(), 1024u);
+
+        result_table copy;
+        for (std::size_t col = 0; col < table.column_count(); ++col)
+        {
+            copy.add_column(table.column_name(col), "");
+        }
+        copy.push_row(table, 0);
+        EXPECT_EQ(copy.display(0, 2), table.display(0, 2));
+        EXPECT_EQ(copy.blob_size(0, 2), table.blob_size(0, 2));
+    }
+
+    TEST(xeus_sqlite_blob_io, round_trip)
+    {
+        std::string content;
+        for (std::size_t i = 0; i < 2 * blob_chunk_size + 1000; ++i)
+        {
+            content += static_cast<char>((i * 7919) % 251);
+        }
+        {
+            std::ofstream out("test_blob_io.in", std::ios::binary);
+            out << content;
+        }
+
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db.exec("CREATE TABLE files(name TEXT, data BLOB)");
+        db.exec("INSERT INTO files VALUES ('a', x'00'), ('b', NULL)");
+
+        EXPECT_EQ(import_blob(db.getHandle(), "test_blob_io.in", "main.files", "data", 2),
+                  static_cast<std::int64_t>(content.size()));
+        EXPECT_EQ(export_blob(db.getHandle(), "files", "data", 2, "test_blob_io.out"),
+                  static_cast<std::int64_t>(content.size()));
+        EXPECT_EQ(read_file("test_blob_io.out"), content);
+
+        EXPECT_THROW(import_blob(db.getHandle(), "test_blob_io.in", "files", "data", 3), std::runtime_error);
+        EXPECT_THROW(export_blob(db.getHandle(), "files", "missing", 1, "test_blob_io.out"), std::runtime_error);
+
+        std::remove("test_blob_io.in");
+        std::remove("test_blob_io.out");
+    }
+}
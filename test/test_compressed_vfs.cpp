@@ -0,0 +1,138 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xcompressed_vfs.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+#ifdef XSQL_HAVE_ZLIB
+
+    namespace
+    {
+        const char* const source_path = "test_compressed_vfs.db";
+        const char* const archive_path = "test_compressed_vfs.sqlz";
+
+        void create_source()
+        {
+            std::remove(source_path);
+            SQLite::Database db(source_path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            db.exec("PRAGMA journal_mode = WAL");
+            db.exec("CREATE TABLE readings(id INTEGER PRIMARY KEY, sensor TEXT, value REAL)");
+            db.exec("CREATE INDEX readings_sensor ON readings(sensor)");
+            db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) "
+                    "INSERT INTO readings SELECT i, 'sensor-' || (i % 37), i * 0.5 FROM n");
+        }
+
+        void remove_files()
+        {
+            std::remove(source_path);
+            std::remove((std::string(source_path) + "-wal").c_str());
+            std::remove((std::string(source_path) + "-shm").c_str());
+            std::remove(archive_path);
+        }
+    }
+
+    TEST(xeus_sqlite_compressed_vfs, round_trip)
+    {
+        create_source();
+        compress_options options;
+        options.block_size = 4096;
+        compress_result result = compress_database(source_path, archive_path, options);
+        EXPECT_GT(result.blocks, 1u);
+        EXPECT_LT(result.compressed_bytes, result.database_bytes);
+
+        /* A cache smaller than the database, blocks are evicted and read again */
+        compressed_vfs_options vfs_options;
+        vfs_options.cache_size = 4 * 4096;
+        register_compressed_vfs(vfs_options);
+        {
+            SQLite::Database archive(archive_path, SQLite::OPEN_READONLY, 0, compressed_vfs_name);
+            EXPECT_EQ(scalar(archive, "SELECT count(*) FROM readings"), "20000");
+            EXPECT_EQ(scalar(archive, "SELECT sum(value) FROM readings WHERE sensor = 'sensor-3'"), "2703106.5");
+            EXPECT_EQ(scalar(archive, "SELECT value FROM readings WHERE id = 19999"), "9999.5");
+            EXPECT_EQ(scalar(archive, "PRAGMA integrity_check"), "ok");
+            EXPECT_EQ(scalar(archive, "PRAGMA journal_mode"), "delete");
+            EXPECT_THROW(archive.exec("DELETE FROM readings"), SQLite::Exception);
+        }
+
+        /* Registering again only changes the cache size */
+        register_compressed_vfs();
+        {
+            SQLite::Database archive(archive_path, SQLite::OPEN_READWRITE, 0, compressed_vfs_name);
+            EXPECT_THROW(archive.exec("CREATE TABLE other(x)"), SQLite::Exception);
+        }
+
+        EXPECT_THROW(compress_database(source_path, archive_path), std::runtime_error);
+        remove_files();
+    }
+
+    TEST(xeus_sqlite_compressed_vfs, plain_database)
+    {
+        create_source();
+        register_compressed_vfs();
+        {
+            /* Databases that are not compressed are opened as usual */
+            SQLite::Database db(source_path, SQLite::OPEN_READWRITE, 0, compressed_vfs_name);
+            db.exec("INSERT INTO readings VALUES (20001, 'extra', 1)");
+            EXPECT_EQ(scalar(db, "SELECT count(*) FROM readings"), "20001");
+        }
+        remove_files();
+    }
+
+    TEST(xeus_sqlite_compressed_vfs, invalid)
+    {
+        compress_options options;
+        options.block_size = 1000;
+        EXPECT_THROW(compress_database(source_path, archive_path, options), std::runtime_error);
+        options.block_size = 4096;
+        options.level = 12;
+        EXPECT_THROW(compress_database(source_path, archive_path, options), std::runtime_error);
+        EXPECT_THROW(compress_database("missing.db", archive_path), std::runtime_error);
+
+        /* Truncated archive */
+        create_source();
+        compress_database(source_path, archive_path);
+        std::FILE* file = std::fopen(archive_path, "r+b");
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);
+        std::fclose(file);
+        std::string content(static_cast<std::size_t>(size) / 2, '\0');
+        file = std::fopen(archive_path, "rb");
+        std::fread(&content[0], 1, content.size(), file);
+        std::fclose(file);
+        file = std::fopen(archive_path, "wb");
+        std::fwrite(content.data(), 1, content.size(), file);
+        std::fclose(file);
+
+        register_compressed_vfs();
+        EXPECT_THROW(SQLite::Database(archive_path, SQLite::OPEN_READONLY, 0, compressed_vfs_name),
+                     SQLite::Exception);
+        remove_files();
+    }
+
+#else
+
+    TEST(xeus_sqlite_compressed_vfs, unavailable)
+    {
+        EXPECT_FALSE(compressed_vfs_available());
+        EXPECT_THROW(register_compressed_vfs(), std::runtime_error);
+    }
+
+#endif
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "xeus-sqlite/xconnection_pool.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        connection make_connection(const std::string& name)
+        {
+            return connection{name, ":memory:",
+                              std::make_unique<SQLite::Database>(":memory:",
+                                  SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)};
+        }
+    }
+
+    TEST(xeus_sqlite_connection_pool, keeps_connections_warm)
+    {
+        connection_pool pool(2);
+        connection first = make_connection("first");
+        first.db->exec("CREATE TEMP TABLE t (x INTEGER)");
+        SQLite::Database* handle = first.db.get();
+
+        pool.park(std::move(first));
+        pool.park(make_connection("second"));
+        EXPECT_EQ(pool.names(), (std::vector<std::string>{"second", "first"}));
+
+        connection taken = pool.take("first");
+        EXPECT_EQ(taken.db.get(), handle);
+        EXPECT_NO_THROW(taken.db->exec("SELECT * FROM temp.t"));
+        EXPECT_FALSE(pool.contains("first"));
+        EXPECT_THROW(pool.take("first"), std::runtime_error);
+    }
+
+    TEST(xeus_sqlite_connection_pool, evicts_least_recently_used)
+    {
+        connection_pool pool(2);
+        pool.park(make_connection("a"));
+        pool.park(make_connection("b"));
+        pool.park(make_connection("c"));
+        EXPECT_EQ(pool.names(), (std::vector<std::string>{"c", "b"}));
+
+        pool.park(make_connection("b"));
+        EXPECT_EQ(pool.names(), (std::vector<std::string>{"b", "c"}));
+
+        pool.set_capacity(0);
+        EXPECT_EQ(pool.size(), 0u);
+    }
+}
@@ -0,0 +1,82 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xfile_table.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+    TEST(xeus_sqlite_file_table, csv)
+    {
+        {
+            std::ofstream out("test_file_table.csv", std::ios::binary);
+            out << "id,name,\"say \"\"hi\"\"\"\r\n";
+            for (int i = 1; i <= 3000; ++i)
+            {
+                out << i << ",n" << i % 10 << "," << (i == 2000 ? "\"two\nlines, \"\"quoted\"\"\"" : "x") << "\r\n";
+            }
+            out << "\n";
+        }
+
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        register_file_tables(db.getHandle());
+        db.exec("CREATE VIRTUAL TABLE t USING xcsv(path='test_file_table.csv')");
+
+        EXPECT_EQ(rows(db, "SELECT count(*), count(DISTINCT name) FROM t"), "3000|10\n");
+        EXPECT_EQ(rows(db, "SELECT name FROM pragma_table_info('t') WHERE cid = 2"), "say \"hi\"\n");
+        EXPECT_EQ(rows(db, "SELECT rowid, id, \"say \"\"hi\"\"\" FROM t WHERE rowid = 2000"),
+                  "2000|2000|two\nlines, \"quoted\"\n");
+        EXPECT_EQ(rows(db, "SELECT id FROM t WHERE rowid > 2047 AND rowid <= 2049"), "2048\n2049\n");
+        EXPECT_EQ(rows(db, "SELECT count(*) FROM t WHERE name = 'n3'"), "300\n");
+        EXPECT_EQ(rows(db, "SELECT count(*) FROM t WHERE id = 25"), "1\n");
+        EXPECT_EQ(rows(db, "SELECT count(*) FROM t WHERE name = NULL"), "0\n");
+        EXPECT_THROW(db.exec("CREATE VIRTUAL TABLE u USING xcsv(path='missing.csv')"), SQLite::Exception);
+
+        std::remove("test_file_table.csv");
+    }
+
+    TEST(xeus_sqlite_file_table, jsonl)
+    {
+        {
+            std::ofstream out("test_file_table.jsonl", std::ios::binary);
+            out << "{\"id\": 1, \"name\": \"caf\\u00e9\", \"ok\": true, \"tags\": [1, {\"k\": \"]\"}]}\n";
+            out << "\n";
+            out << "{\"id\": 2.5, \"name\": \"plain\", \"ok\": false, \"extra\": null}\n";
+        }
+
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        register_file_tables(db.getHandle());
+        db.exec("CREATE VIRTUAL TABLE t USING xjsonl(path='test_file_table.jsonl')");
+
+        EXPECT_EQ(rows(db, "SELECT rowid, typeof(id), name, ok, tags FROM t"),
+                  "1|integer|caf\xC3\xA9|1|[1, {\"k\": \"]\"}]\n2|real|plain|0|NULL\n");
+        EXPECT_EQ(rows(db, "SELECT id FROM t WHERE name = 'plain'"), "2.5\n");
+        EXPECT_EQ(rows(db, "SELECT count(*) FROM t WHERE name = 1"), "0\n");
+        EXPECT_EQ(rows(db, "SELECT count(extra) FROM t"), "0\n");
+
+        std::remove("test_file_table.jsonl");
+    }
+
+    TEST(xeus_sqlite_file_table, names)
+    {
+        EXPECT_EQ(file_table_module("logs/a.JSONL"), "xjsonl");
+        EXPECT_EQ(file_table_module("logs/a.tsv"), "xcsv");
+        EXPECT_EQ(file_table_name("logs/access-log.csv"), "access_log");
+        EXPECT_EQ(file_table_name("2024.csv"), "t_2024");
+    }
+}
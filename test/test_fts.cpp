@@ -0,0 +1,68 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xfts.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+    TEST(xeus_sqlite_fts, index_and_search)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db.exec("CREATE TABLE notes(id INTEGER PRIMARY KEY, title TEXT, body TEXT, views INT)");
+        db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100) "
+                "INSERT INTO notes SELECT i * 3, 'note ' || i, CASE WHEN i % 10 = 0 THEN 'rare word' "
+                "ELSE 'common text' END, 0 FROM n");
+
+        fts_index_options options;
+        options.batch_rows = 7;
+        std::vector<long long> reports;
+        long long count = create_fts_index(db, "main.notes", {"title", "body"}, options,
+                                           [&](long long indexed, long long total)
+                                           {
+                                               EXPECT_EQ(total, 100);
+                                               reports.push_back(indexed);
+                                           });
+        EXPECT_EQ(count, 100);
+        ASSERT_EQ(reports.size(), 15u);
+        EXPECT_EQ(reports.front(), 7);
+        EXPECT_EQ(reports.back(), 100);
+        EXPECT_THROW(create_fts_index(db, "notes", {"title"}, options, nullptr), std::runtime_error);
+
+        EXPECT_EQ(rows(db, fts_search_query(db, "notes", "rare", 3)),
+                  "30|2.154|[rare] word\n60|2.154|[rare] word\n90|2.154|[rare] word\n");
+
+        /* The triggers keep the index in sync */
+        db.exec("UPDATE notes SET body = 'rare again' WHERE id = 3");
+        db.exec("UPDATE notes SET views = 1 WHERE id = 6");
+        db.exec("DELETE FROM notes WHERE id = 30");
+        EXPECT_EQ(rows(db, "SELECT rowid FROM notes_fts WHERE notes_fts MATCH 'rare' ORDER BY rowid LIMIT 3"),
+                  "3\n60\n90\n");
+        db.exec("INSERT INTO notes_fts(notes_fts) VALUES ('integrity-check')");
+
+        /* Quotes are escaped in the literal, FTS5 rejects the syntax */
+        EXPECT_THROW(rows(db, fts_search_query(db, "notes", "it's", 1)), SQLite::Exception);
+
+        drop_fts_index(db, "notes");
+        EXPECT_FALSE(db.tableExists("notes_fts"));
+        db.exec("INSERT INTO notes(title) VALUES ('after drop')");
+        EXPECT_THROW(fts_search_query(db, "notes", "rare", 3), std::runtime_error);
+        EXPECT_THROW(create_fts_index(db, "notes", {"missing"}, options, nullptr), std::runtime_error);
+        EXPECT_FALSE(db.tableExists("notes_fts"));
+    }
+}
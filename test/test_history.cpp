@@ -0,0 +1,127 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xhistory.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        const char* const history_path = "test_history.db";
+
+        void remove_history()
+        {
+            std::remove(history_path);
+            std::remove((std::string(history_path) + "-wal").c_str());
+            std::remove((std::string(history_path) + "-shm").c_str());
+        }
+
+        nl::json request(const sqlite_history_manager& history, nl::json content)
+        {
+            return history.process_request(content)["history"];
+        }
+    }
+
+    TEST(xeus_sqlite_history, round_trip)
+    {
+        remove_history();
+        history_options options;
+        options.flush_interval = std::chrono::milliseconds(10);
+        {
+            sqlite_history_manager history(history_path, options);
+            history.store_inputs(0, 1, "SELECT 1");
+            history.store_inputs(0, 2, "SELECT name FROM tracks");
+            history.record_execution(2, 1.5, 42);
+            /* Statistics written before the input */
+            history.record_execution(3, 2.5, 7);
+            history.store_inputs(0, 3, "%LOAD chinook.db");
+            /* Statistics of a cell that has no input, not listed */
+            history.record_execution(4, 0.5, 0);
+
+            nl::json tail = request(history, {{"hist_access_type", "tail"}, {"n", 2}});
+            ASSERT_EQ(tail.size(), 2u);
+            EXPECT_EQ(tail[0][1], 2);
+            EXPECT_EQ(tail[1][1], 3);
+            EXPECT_EQ(tail[1][2], "%LOAD chinook.db");
+
+            nl::json range = request(history, {{"hist_access_type", "range"}, {"start", 1}, {"stop", 3}});
+            ASSERT_EQ(range.size(), 2u);
+            EXPECT_EQ(range[0][2], "SELECT 1");
+            EXPECT_EQ(range[1][2], "SELECT name FROM tracks");
+
+            nl::json found = request(history, {{"hist_access_type", "search"}, {"pattern", "*name*"}, {"n", 10}});
+            ASSERT_EQ(found.size(), 1u);
+            EXPECT_EQ(found[0][1], 2);
+
+            nl::json with_output = request(history, {{"hist_access_type", "tail"}, {"n", 1}, {"output", true}});
+            ASSERT_EQ(with_output.size(), 1u);
+            EXPECT_EQ(with_output[0][2][0], "%LOAD chinook.db");
+            EXPECT_EQ(history.dropped(), 0u);
+        }
+
+        {
+            SQLite::Database db(history_path, SQLite::OPEN_READONLY);
+            SQLite::Statement statistics(db, "SELECT duration_ms, rows FROM history WHERE line = 3");
+            ASSERT_TRUE(statistics.executeStep());
+            EXPECT_EQ(statistics.getColumn(0).getDouble(), 2.5);
+            EXPECT_EQ(statistics.getColumn(1).getInt(), 7);
+        }
+
+        /* A new session of the same file, the previous one stays available */
+        {
+            sqlite_history_manager history(history_path, options);
+            history.store_inputs(0, 1, "SELECT 2");
+            nl::json current = request(history, {{"hist_access_type", "range"}, {"session", 0},
+                                                 {"start", 1}, {"stop", 0}});
+            ASSERT_EQ(current.size(), 1u);
+            EXPECT_EQ(current[0][0], history.session());
+            nl::json previous = request(history, {{"hist_access_type", "range"}, {"session", -1},
+                                                  {"start", 1}, {"stop", 0}});
+            EXPECT_EQ(previous.size(), 3u);
+
+            nl::json unique = request(history, {{"hist_access_type", "search"}, {"pattern", "SELECT*"},
+                                                {"n", 10}, {"unique", true}});
+            EXPECT_EQ(unique.size(), 3u);
+        }
+        remove_history();
+    }
+
+    TEST(xeus_sqlite_history, pruning)
+    {
+        remove_history();
+        history_options options;
+        options.max_entries = 5;
+        options.flush_interval = std::chrono::seconds(1);
+        {
+            sqlite_history_manager history(history_path, options);
+            for (int line = 1; line <= 20; ++line)
+            {
+                history.store_inputs(0, line, "SELECT " + std::to_string(line));
+            }
+            history.flush();
+
+            /* The oldest cells are removed, and their search entries with them */
+            nl::json tail = request(history, {{"hist_access_type", "tail"}, {"n", 100}});
+            ASSERT_EQ(tail.size(), 5u);
+            EXPECT_EQ(tail[0][2], "SELECT 16");
+            EXPECT_EQ(tail[4][2], "SELECT 20");
+            EXPECT_EQ(request(history, {{"hist_access_type", "search"}, {"pattern", "SELECT 1*"},
+                                        {"n", 100}}).size(), 4u);
+        }
+        remove_history();
+    }
+}
@@ -0,0 +1,169 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xingest.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        template <class T>
+        xeus::binary_buffer to_buffer(const std::vector<T>& values)
+        {
+            xeus::binary_buffer buffer(values.size() * sizeof(T));
+            if (!buffer.empty())
+            {
+                std::memcpy(buffer.data(), values.data(), buffer.size());
+            }
+            return buffer;
+        }
+
+        xeus::binary_buffer to_buffer(const std::string& text)
+        {
+            return xeus::binary_buffer(text.begin(), text.end());
+        }
+
+        /* id int64, price float64 with a NULL, name utf8 */
+        xeus::buffer_sequence trades(nl::json& request)
+        {
+            request = {
+                {"action", "insert"},
+                {"id", 7},
+                {"table", "trades"},
+                {"rows", 3},
+                {"columns", {
+                    {{"name", "id"}, {"type", "int64"}, {"data", 0}},
+                    {{"name", "price"}, {"type", "float64"}, {"data", 1}, {"validity", 2}},
+                    {{"name", "name"}, {"type", "utf8"}, {"data", 3}, {"offsets", 4}}
+                }}
+            };
+            xeus::buffer_sequence buffers;
+            buffers.push_back(to_buffer(std::vector<std::int64_t>{1, 2, 3}));
+            buffers.push_back(to_buffer(std::vector<double>{10.5, 0, 12.25}));
+            buffers.push_back(xeus::binary_buffer{char(0b101)});
+            buffers.push_back(to_buffer("abcdéf"));
+            buffers.push_back(to_buffer(std::vector<std::int32_t>{0, 2, 2, 7}));
+            return buffers;
+        }
+    }
+
+    TEST(xeus_sqlite_ingest, insert)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        nl::json request;
+        xeus::buffer_sequence buffers = trades(request);
+
+        nl::json reply = handle_ingest_request(db.getHandle(), request, buffers);
+        EXPECT_EQ(reply["action"], "inserted");
+        EXPECT_EQ(reply["rows"], 3);
+        EXPECT_EQ(reply["id"], 7);
+
+        {
+            SQLite::Statement query(db, "SELECT id, price, name, typeof(price), typeof(name) FROM trades ORDER BY id");
+            ASSERT_TRUE(query.executeStep());
+            EXPECT_EQ(query.getColumn(0).getInt64(), 1);
+            EXPECT_EQ(query.getColumn(1).getDouble(), 10.5);
+            EXPECT_EQ(query.getColumn(2).getString(), "ab");
+            ASSERT_TRUE(query.executeStep());
+            EXPECT_EQ(query.getColumn(3).getString(), "null");
+            EXPECT_EQ(query.getColumn(4).getString(), "text");
+            ASSERT_TRUE(query.executeStep());
+            EXPECT_EQ(query.getColumn(1).getDouble(), 12.25);
+            EXPECT_EQ(query.getColumn(2).getString(), "cdéf");
+        }
+
+        /* Appended by default, replaced on request */
+        ingest_columns(db.getHandle(), request, buffers);
+        EXPECT_EQ(scalar(db, "SELECT count(*) FROM trades"), "6");
+        request["if_exists"] = "replace";
+        ingest_columns(db.getHandle(), request, buffers);
+        EXPECT_EQ(scalar(db, "SELECT count(*) FROM trades"), "3");
+        EXPECT_EQ(scalar(db, "SELECT type FROM pragma_table_info('trades') WHERE name = 'price'"), "REAL");
+    }
+
+    TEST(xeus_sqlite_ingest, existing_table)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db.exec("CREATE TABLE flags(id INTEGER PRIMARY KEY, done INTEGER, note TEXT DEFAULT 'none')");
+
+        nl::json request = {
+            {"action", "insert"},
+            {"table", "main.flags"},
+            {"rows", 10},
+            {"columns", {
+                {{"name", "id"}, {"type", "int32"}, {"data", 0}},
+                {{"name", "done"}, {"type", "bool"}, {"data", 1}}
+            }}
+        };
+        xeus::buffer_sequence buffers;
+        buffers.push_back(to_buffer(std::vector<std::int32_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+        buffers.push_back(to_buffer(std::vector<std::uint8_t>{0b10000001, 0b10}));
+        EXPECT_EQ(ingest_columns(db.getHandle(), request, buffers), 10);
+        EXPECT_EQ(scalar(db, "SELECT group_concat(id) FROM flags WHERE done"), "1,8,10");
+        EXPECT_EQ(scalar(db, "SELECT count(*) FROM flags WHERE note = 'none'"), "10");
+
+        request["if_exists"] = "fail";
+        EXPECT_THROW(ingest_columns(db.getHandle(), request, buffers), std::runtime_error);
+    }
+
+    TEST(xeus_sqlite_ingest, atomic)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db.exec("CREATE TABLE trades(id INTEGER PRIMARY KEY, price REAL, name TEXT)");
+        db.exec("INSERT INTO trades VALUES (3, 1, 'x')");
+        nl::json request;
+        xeus::buffer_sequence buffers = trades(request);
+
+        /* The third row violates the primary key, none is inserted */
+        nl::json reply = handle_ingest_request(db.getHandle(), request, buffers);
+        EXPECT_EQ(reply["action"], "error");
+        EXPECT_NE(reply["message"].get<std::string>().find("row 2"), std::string::npos);
+        EXPECT_EQ(scalar(db, "SELECT count(*) FROM trades"), "1");
+        EXPECT_EQ(sqlite3_get_autocommit(db.getHandle()), 1);
+    }
+
+    TEST(xeus_sqlite_ingest, invalid_buffers)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        nl::json request;
+        xeus::buffer_sequence buffers = trades(request);
+
+        /* Offsets past the end of the data */
+        xeus::buffer_sequence past_end = buffers;
+        past_end[4] = to_buffer(std::vector<std::int32_t>{0, 2, 2, 8});
+        EXPECT_THROW(ingest_columns(db.getHandle(), request, past_end), std::runtime_error);
+
+        xeus::buffer_sequence short_data = buffers;
+        short_data[0].resize(16);
+        EXPECT_THROW(ingest_columns(db.getHandle(), request, short_data), std::runtime_error);
+
+        xeus::buffer_sequence missing = buffers;
+        missing.pop_back();
+        EXPECT_THROW(ingest_columns(db.getHandle(), request, missing), std::runtime_error);
+
+        nl::json unknown = request;
+        unknown["columns"][0]["type"] = "decimal128";
+        EXPECT_THROW(ingest_columns(db.getHandle(), unknown, buffers), std::runtime_error);
+
+        EXPECT_THROW(ingest_columns(nullptr, request, buffers), std::runtime_error);
+        EXPECT_FALSE(db.tableExists("trades"));
+    }
+}
@@ -0,0 +1,65 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xvega_sqlite.hpp"
+
+namespace xeus_sqlite
+{
+    TEST(xeus_sqlite_magic_parser, is_magic)
+    {
+        EXPECT_TRUE(is_magic("%LOAD db.sqlite"));
+        EXPECT_TRUE(is_magic("\n  %LOAD db.sqlite"));
+        EXPECT_FALSE(is_magic("SELECT '%LOAD'"));
+        EXPECT_FALSE(is_magic("   "));
+    }
+
+    TEST(xeus_sqlite_magic_parser, parse_magic)
+    {
+        std::string code = "  %load  data/my db.sqlite\tr\n";
+        magic_input input = parse_magic(code);
+        EXPECT_EQ(input.name, "load");
+        ASSERT_EQ(input.args.size(), 3u);
+        EXPECT_EQ(input.args[0], "data/my");
+        EXPECT_EQ(input.args[2], "r");
+        EXPECT_EQ(input.arguments, "data/my db.sqlite\tr\n");
+        EXPECT_EQ(input.name.data(), code.data() + 3);
+        EXPECT_TRUE(iequals(input.name, "LOAD"));
+        EXPECT_EQ(to_upper(input.name), "LOAD");
+
+        magic_input bare = parse_magic("%DELETE");
+        EXPECT_EQ(bare.name, "DELETE");
+        EXPECT_TRUE(bare.args.empty());
+    }
+
+    TEST(xeus_sqlite_magic_parser, split_option)
+    {
+        std::string_view key, value;
+        EXPECT_TRUE(split_option("savepoint_every=10", key, value));
+        EXPECT_EQ(key, "savepoint_every");
+        EXPECT_EQ(value, "10");
+        EXPECT_FALSE(split_option("off", key, value));
+    }
+
+    TEST(xeus_sqlite_magic_parser, xvega_plot_keeps_query)
+    {
+        std::string arguments = "X_FIELD a Y_FIELD b <> SELECT a,\n  b FROM t WHERE c = 'x  y'";
+        auto split = xv_sqlite::split_xv_sqlite_input(std::string_view(arguments));
+        ASSERT_EQ(split.first.size(), 4u);
+        EXPECT_EQ(split.first[3], "b");
+        EXPECT_EQ(split.second, "SELECT a,\n  b FROM t WHERE c = 'x  y'");
+
+        EXPECT_THROW(xv_sqlite::split_xv_sqlite_input(std::string_view("X_FIELD a")),
+                     std::runtime_error);
+    }
+}
@@ -0,0 +1,134 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xmaintenance.hpp"
+
+namespace xeus_sqlite
+{
+#ifndef XSQL_EMSCRIPTEN_WASM_BUILD
+
+    namespace
+    {
+        const char* const db_path = "test_maintenance.db";
+
+        void create_database()
+        {
+            std::remove(db_path);
+            SQLite::Database db(db_path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            db.exec("PRAGMA journal_mode = WAL");
+            db.exec("CREATE TABLE m(id INTEGER PRIMARY KEY, value TEXT)");
+            db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+                    "INSERT INTO m SELECT i, hex(randomblob(32)) FROM n");
+        }
+
+        void remove_database()
+        {
+            std::remove(db_path);
+            std::remove((std::string(db_path) + "-wal").c_str());
+            std::remove((std::string(db_path) + "-shm").c_str());
+        }
+
+        std::size_t passes(const maintenance_scheduler& scheduler)
+        {
+            const std::string status = scheduler.status();
+            const std::size_t pos = status.find("Passes: ");
+            return pos == std::string::npos ? 0 : std::strtoul(status.c_str() + pos + 8, nullptr, 10);
+        }
+
+        /* Polls until count passes ran, or a few seconds elapsed */
+        bool wait_for_passes(const maintenance_scheduler& scheduler, std::size_t count)
+        {
+            for (int i = 0; i < 300 && passes(scheduler) < count; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return passes(scheduler) >= count;
+        }
+    }
+
+    TEST(xeus_sqlite_maintenance, stages)
+    {
+        create_database();
+        maintenance_scheduler scheduler;
+        scheduler.set_database(db_path, false);
+        scheduler.start(std::chrono::milliseconds(20));
+        EXPECT_TRUE(scheduler.running());
+        scheduler.end_activity();
+
+        /* A light pass, then an escalated checkpoint, then nothing until the next activity */
+        ASSERT_TRUE(wait_for_passes(scheduler, 2));
+        EXPECT_NE(scheduler.status().find("checkpoint TRUNCATE"), std::string::npos);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_EQ(passes(scheduler), 2u);
+
+        scheduler.begin_activity();
+        scheduler.end_activity();
+        ASSERT_TRUE(wait_for_passes(scheduler, 3));
+        EXPECT_NE(scheduler.status().find("optimize"), std::string::npos);
+
+        scheduler.stop();
+        EXPECT_FALSE(scheduler.running());
+        remove_database();
+    }
+
+    TEST(xeus_sqlite_maintenance, read_only_database)
+    {
+        create_database();
+        maintenance_scheduler scheduler;
+        scheduler.set_database(db_path, true);
+        scheduler.start(std::chrono::milliseconds(10));
+        scheduler.end_activity();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_EQ(passes(scheduler), 0u);
+        EXPECT_NE(scheduler.status().find("read-only, skipped"), std::string::npos);
+        scheduler.stop();
+        remove_database();
+    }
+
+    TEST(xeus_sqlite_maintenance, activity_interrupts_pass)
+    {
+        create_database();
+        maintenance_scheduler scheduler;
+        scheduler.set_database(db_path, false);
+        scheduler.start(std::chrono::milliseconds(1));
+
+        SQLite::Database kernel(db_path, SQLite::OPEN_READWRITE);
+        for (int i = 0; i < 50; ++i)
+        {
+            scheduler.end_activity();
+            std::this_thread::sleep_for(std::chrono::milliseconds(i % 5));
+
+            /* Once begin_activity returns, no pass runs until the next end_activity */
+            scheduler.begin_activity();
+            const std::size_t before = passes(scheduler);
+            kernel.exec("INSERT INTO m(value) VALUES ('cell')");
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            EXPECT_EQ(passes(scheduler), before);
+        }
+        scheduler.end_activity();
+        scheduler.stop();
+
+        SQLite::Statement count(kernel, "SELECT count(*) FROM m");
+        ASSERT_TRUE(count.executeStep());
+        EXPECT_EQ(count.getColumn(0).getInt(), 5050);
+        remove_database();
+    }
+
+#endif
+}
@@ -0,0 +1,48 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "xeus-sqlite/xmemory.hpp"
+
+namespace xeus_sqlite
+{
+    TEST(xeus_sqlite_memory, byte_sizes)
+    {
+        EXPECT_EQ(parse_byte_size("4096"), 4096);
+        EXPECT_EQ(parse_byte_size("512K"), 512 * 1024);
+        EXPECT_EQ(parse_byte_size("64MiB"), 64LL * 1024 * 1024);
+        EXPECT_EQ(parse_byte_size("2g"), 2LL * 1024 * 1024 * 1024);
+        EXPECT_THROW(parse_byte_size("12X"), std::runtime_error);
+        EXPECT_THROW(parse_byte_size("-1M"), std::runtime_error);
+
+        EXPECT_EQ(format_bytes(812), "812 B");
+        EXPECT_EQ(format_bytes(3 * 1024 + 512), "3.5 KiB");
+    }
+
+    TEST(xeus_sqlite_memory, options)
+    {
+        std::string args[] = {"xsqlite", "--sqlite-heap-limit=256M", "-f",
+                              "kernel.json", "--sqlite-lookaside=1200,100"};
+        char* argv[] = {&args[0][0], &args[1][0], &args[2][0], &args[3][0], &args[4][0]};
+        int argc = 5;
+
+        sqlite_memory_options options = parse_sqlite_memory_options(argc, argv);
+        EXPECT_EQ(options.heap_limit, 256LL * 1024 * 1024);
+        EXPECT_EQ(options.lookaside_slot_size, 1200);
+        EXPECT_EQ(options.lookaside_slots, 100);
+        EXPECT_EQ(options.pagecache, 0);
+        ASSERT_EQ(argc, 3);
+        EXPECT_EQ(std::string(argv[1]), "-f");
+        EXPECT_EQ(std::string(argv[2]), "kernel.json");
+    }
+}
@@ -0,0 +1,135 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xparallel_query.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        result_table make_part(const std::vector<std::pair<std::string, long long>>& rows)
+        {
+            result_table table;
+            table.add_column("sensor");
+            table.add_column("n");
+            for (const auto& row : rows)
+            {
+                std::string n = std::to_string(row.second);
+                table.push_cell(cell_type::text, row.first.data(), row.first.size());
+                table.push_cell(cell_type::integer, n.data(), n.size());
+            }
+            return table;
+        }
+    }
+
+    TEST(xeus_sqlite_parallel_query, plan_merge)
+    {
+        merge_plan plan = plan_merge("SELECT sensor, count(*) AS n FROM m GROUP BY sensor ORDER BY n DESC;",
+                                     {"sensor", "n"});
+        EXPECT_TRUE(plan.grouped);
+        EXPECT_TRUE(plan.aggregates[0] == aggregate_kind::none);
+        EXPECT_TRUE(plan.aggregates[1] == aggregate_kind::count);
+        ASSERT_EQ(plan.order.size(), 1u);
+        EXPECT_EQ(plan.order[0].column, 1u);
+        EXPECT_TRUE(plan.order[0].descending);
+
+        plan = plan_merge("SELECT sensor, n FROM m ORDER BY 2 LIMIT 10", {"sensor", "n"});
+        EXPECT_FALSE(plan.grouped);
+        EXPECT_EQ(plan.limit, 10);
+
+        EXPECT_THROW(plan_merge("SELECT avg(n) FROM m", {"avg(n)"}), std::runtime_error);
+        EXPECT_THROW(plan_merge("SELECT n FROM m LIMIT 5 OFFSET 2", {"n"}), std::runtime_error);
+        EXPECT_THROW(plan_merge("SELECT sum(n) FROM m LIMIT 1", {"sum(n)"}), std::runtime_error);
+
+        /* Columns that are neither grouped nor aggregated */
+        EXPECT_THROW(plan_merge("SELECT sensor, max(n) FROM m", {"sensor", "max(n)"}), std::runtime_error);
+        EXPECT_THROW(plan_merge("SELECT sensor, kind, count(*) FROM m GROUP BY sensor",
+                                {"sensor", "kind", "count(*)"}), std::runtime_error);
+        EXPECT_THROW(plan_merge("SELECT m.*, count(*) FROM m", {"sensor", "n", "count(*)"}),
+                     std::runtime_error);
+    }
+
+    TEST(xeus_sqlite_parallel_query, ordered_merge)
+    {
+        std::vector<result_table> parts;
+        parts.push_back(make_part({{"a", 1}, {"b", 4}, {"c", 7}}));
+        parts.push_back(make_part({{"d", 2}, {"e", 3}, {"f", 9}}));
+
+        merge_plan plan = plan_merge("SELECT sensor, n FROM m ORDER BY n LIMIT 4", {"sensor", "n"});
+        result_table merged = merge_results(parts, plan);
+        ASSERT_EQ(merged.row_count(), 4u);
+        EXPECT_EQ(merged.cell(0, 0), "a");
+        EXPECT_EQ(merged.cell(1, 0), "d");
+        EXPECT_EQ(merged.cell(2, 0), "e");
+        EXPECT_EQ(merged.cell(3, 0), "b");
+    }
+
+    TEST(xeus_sqlite_parallel_query, aggregate_merge)
+    {
+        std::vector<result_table> parts;
+        parts.push_back(make_part({{"a", 3}, {"b", 1}}));
+        parts.push_back(make_part({{"b", 5}, {"c", 2}}));
+
+        merge_plan plan = plan_merge("SELECT sensor, sum(n) FROM m GROUP BY sensor ORDER BY 2",
+                                     {"sensor", "sum(n)"});
+        result_table merged = merge_results(parts, plan);
+        ASSERT_EQ(merged.row_count(), 3u);
+        EXPECT_EQ(merged.cell(0, 0), "c");
+        EXPECT_EQ(merged.cell(1, 0), "a");
+        EXPECT_EQ(merged.cell(2, 0), "b");
+        EXPECT_EQ(merged.cell(2, 1), "6");
+    }
+
+    TEST(xeus_sqlite_parallel_query, worker_limits)
+    {
+        const std::vector<std::string> files = {"test_parallel_a.db", "test_parallel_b.db"};
+        for (const std::string& file : files)
+        {
+            std::remove(file.c_str());
+            SQLite::Database db(file, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            db.exec("CREATE TABLE m(sensor TEXT, n INTEGER)");
+            db.exec("WITH RECURSIVE i(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM i WHERE x < 100) "
+                    "INSERT INTO m SELECT 's' || (x % 3), x FROM i");
+        }
+
+        result_table merged = run_parallel(files, "SELECT sensor, count(*) FROM m GROUP BY sensor ORDER BY 1", 2);
+        ASSERT_EQ(merged.row_count(), 3u);
+        EXPECT_EQ(merged.cell(0, 1), "66");
+
+        query_limits limits;
+        limits.max_rows = 50;
+        EXPECT_THROW(run_parallel(files, "SELECT n FROM m", 2, limits), std::runtime_error);
+
+        /* Every file is within max_rows, all of them together are not */
+        limits.max_rows = 150;
+        EXPECT_THROW(run_parallel(files, "SELECT n FROM m", 2, limits), std::runtime_error);
+        merged = run_parallel(files, "SELECT n FROM m ORDER BY n DESC LIMIT 120", 2, limits);
+        ASSERT_EQ(merged.row_count(), 120u);
+        EXPECT_EQ(merged.cell(0, 0), "100");
+        EXPECT_EQ(merged.cell(119, 0), "41");
+
+        std::atomic<bool> interrupted(true);
+        EXPECT_THROW(run_parallel(files, "SELECT n FROM m", 2, query_limits(), &interrupted),
+                     std::runtime_error);
+
+        for (const std::string& file : files)
+        {
+            std::remove(file.c_str());
+        }
+    }
+}
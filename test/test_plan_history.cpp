@@ -0,0 +1,140 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "SQLiteCpp/SQLiteCpp.h"
+
+#include "xeus-sqlite/xplan_history.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        std::string plan_of(SQLite::Database& db, const std::string& sql)
+        {
+            SQLite::Statement query(db, sql);
+            return explain_plan(query.getPreparedStatement());
+        }
+
+        void fill(SQLite::Database& db)
+        {
+            db.exec("CREATE TABLE t(a INTEGER, b TEXT)");
+            db.exec("CREATE INDEX t_a ON t(a)");
+        }
+    }
+
+    TEST(xeus_sqlite_plan_history, normalize_query)
+    {
+        EXPECT_EQ(normalize_query("SELECT * FROM t WHERE a = 1"),
+                  normalize_query("select *  from T\n where a = 42;"));
+        EXPECT_EQ(normalize_query("SELECT * FROM t WHERE b = 'x' -- comment"),
+                  normalize_query("SELECT * FROM t WHERE b = :name"));
+        EXPECT_EQ(normalize_query("SELECT * FROM t WHERE a IN (1, 2, 3)"),
+                  normalize_query("SELECT * FROM t WHERE a IN (?)"));
+        EXPECT_NE(normalize_query("SELECT * FROM t WHERE a = 1"),
+                  normalize_query("SELECT * FROM t WHERE b = 1"));
+        /* Quoted identifiers are kept as written */
+        EXPECT_NE(normalize_query("SELECT \"A\" FROM t"),
+                  normalize_query("SELECT \"a\" FROM t"));
+    }
+
+    TEST(xeus_sqlite_plan_history, explain_plan)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        const std::string search = plan_of(db, "SELECT * FROM t WHERE a = 1");
+        EXPECT_NE(search.find("t_a"), std::string::npos);
+        db.exec("DROP INDEX t_a");
+        const std::string scan = plan_of(db, "SELECT * FROM t WHERE a = 1");
+        EXPECT_NE(scan.find("SCAN"), std::string::npos);
+        EXPECT_NE(plan_fingerprint(search), plan_fingerprint(scan));
+        EXPECT_EQ(plan_fingerprint(scan), plan_fingerprint(plan_of(db, "SELECT * FROM t WHERE a = 2")));
+        EXPECT_EQ(plan_of(db, "CREATE TABLE u(a)"), "");
+    }
+
+    TEST(xeus_sqlite_plan_history, plan_change)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        plan_history history(":memory:");
+
+        const std::string search = plan_of(db, "SELECT * FROM t WHERE a = 1");
+        EXPECT_EQ(history.record("main.db", "SELECT * FROM t WHERE a = 1", search, 1., 1), "");
+        EXPECT_EQ(history.record("main.db", "SELECT * FROM t WHERE a = 2", search, 1., 1), "");
+
+        db.exec("DROP INDEX t_a");
+        const std::string scan = plan_of(db, "SELECT * FROM t WHERE a = 3");
+        const std::string warning = history.record("main.db", "SELECT * FROM t WHERE a = 3", scan, 1., 0);
+        EXPECT_NE(warning.find("plan changed"), std::string::npos);
+        EXPECT_NE(warning.find("t_a"), std::string::npos);
+        EXPECT_EQ(history.record("main.db", "SELECT * FROM t WHERE a = 4", scan, 1., 0), "");
+
+        /* Histories of different databases are independent */
+        EXPECT_EQ(history.record("other.db", "SELECT * FROM t WHERE a = 1", search, 1., 1), "");
+    }
+
+    TEST(xeus_sqlite_plan_history, slowdown)
+    {
+        plan_history_options options;
+        options.slowdown = 5;
+        options.min_duration = std::chrono::milliseconds(50);
+        plan_history history(":memory:", options);
+
+        const std::string plan = "SCAN t";
+        const std::string sql = "SELECT * FROM t";
+        for (int i = 0; i < 3; ++i)
+        {
+            EXPECT_EQ(history.record("main.db", sql, plan, 20., 10), "");
+        }
+        /* Slower, but under the minimum duration */
+        EXPECT_EQ(history.record("main.db", sql, plan, 40., 10), "");
+        const std::string warning = history.record("main.db", sql, plan, 200., 10);
+        EXPECT_NE(warning.find("same query plan"), std::string::npos);
+        EXPECT_NE(warning.find("SCAN t"), std::string::npos);
+    }
+
+    TEST(xeus_sqlite_plan_history, recent_plans)
+    {
+        plan_history history(":memory:");
+        history.record("main.db", "SELECT * FROM t WHERE a = 1", "SEARCH t USING INDEX t_a (a=?)\n", 1., 1);
+        history.record("main.db", "SELECT * FROM t WHERE a = 2", "SEARCH t USING INDEX t_a (a=?)\n", 3., 1);
+        history.record("main.db", "SELECT * FROM t WHERE a = 3", "SCAN t\n", 1., 1);
+        history.record("other.db", "SELECT * FROM u", "SCAN u\n", 1., 1);
+
+        result_table table = history.recent_plans("main.db", 10);
+        ASSERT_EQ(table.row_count(), 2u);
+        EXPECT_EQ(table.cell(0, 1), "SCAN t");
+        EXPECT_EQ(table.cell(1, 2), "2");
+        EXPECT_EQ(history.recent_plans("main.db", 1).row_count(), 1u);
+
+        history.clear("main.db");
+        EXPECT_EQ(history.recent_plans("main.db", 10).row_count(), 0u);
+        EXPECT_EQ(history.recent_plans("other.db", 10).row_count(), 1u);
+    }
+
+    TEST(xeus_sqlite_plan_history, pruning)
+    {
+        plan_history_options options;
+        options.max_runs = 10;
+        plan_history history(":memory:", options);
+        for (int i = 0; i < 200; ++i)
+        {
+            const std::string table = "t" + std::to_string(i);
+            history.record("main.db", "SELECT * FROM " + table, "SCAN " + table + "\n", 1., 1);
+        }
+        /* The queries and plans of the removed runs are removed with them */
+        const std::size_t kept = history.recent_plans("main.db", 1000).row_count();
+        EXPECT_GE(kept, 10u);
+        EXPECT_LT(kept, 100u);
+        EXPECT_EQ(history.recent_plans("main.db", 1).cell(0, 1), "SCAN t199");
+    }
+}
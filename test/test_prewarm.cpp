@@ -0,0 +1,71 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xprewarm.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        std::string wait_for(const prewarmer& warm)
+        {
+            std::string status = warm.status();
+            for (int i = 0; i < 500 && status.find("running") != std::string::npos; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                status = warm.status();
+            }
+            return status.substr(0, status.find(" pages"));
+        }
+    }
+
+    TEST(xeus_sqlite_prewarm, btrees)
+    {
+        std::remove("test_prewarm.db");
+        {
+            SQLite::Database db("test_prewarm.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+            db.exec("PRAGMA page_size = 4096");
+            db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+            db.exec("CREATE TABLE u(x)");
+            db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) "
+                    "INSERT INTO t SELECT i, printf('%0100d', i) FROM n");
+            db.exec("CREATE INDEX t_name ON t(name)");
+        }
+        SQLite::Database db("test_prewarm.db", SQLite::OPEN_READONLY);
+        SQLite::Statement pages(db, "PRAGMA page_count");
+        ASSERT_TRUE(pages.executeStep());
+        const std::string page_count = pages.getColumn(0).getString();
+
+        prewarmer warm;
+        EXPECT_EQ(warm.status(), "Prewarm: idle");
+
+        warm.start("test_prewarm.db", {"u"});
+        EXPECT_EQ(wait_for(warm), "Prewarm: finished, 1");
+
+        /* Every page but the schema and u belongs to t or its index */
+        warm.start("test_prewarm.db", {"T"});
+        EXPECT_EQ(wait_for(warm), "Prewarm: finished, " + std::to_string(std::stoi(page_count) - 2));
+
+        warm.start("test_prewarm.db", {});
+        EXPECT_EQ(wait_for(warm), "Prewarm: finished, " + page_count);
+
+        EXPECT_THROW(warm.start("test_prewarm.db", {"missing"}), std::runtime_error);
+        std::remove("test_prewarm.db");
+    }
+}
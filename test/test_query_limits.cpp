@@ -0,0 +1,125 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xmagic_parser.hpp"
+#include "xeus-sqlite/xquery_limits.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* Steps through a query under limits, returns the error message */
+        std::string run(SQLite::Database& db, const std::string& sql, const query_limits& limits)
+        {
+            try
+            {
+                SQLite::Statement query(db, sql);
+                query_governor governor(db.getHandle(), limits);
+                result_table table;
+                add_columns(table, query);
+                try
+                {
+                    while (query.executeStep())
+                    {
+                        push_row(table, query);
+                        governor.count_row(&table);
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    governor.throw_if_exceeded();
+                    throw;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                return e.what();
+            }
+            return "";
+        }
+
+        const char* const cartesian = "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n "
+                                      "WHERE i < 3000) SELECT count(*) FROM n a, n b";
+    }
+
+    TEST(xeus_sqlite_query_limits, parse)
+    {
+        query_limits limits;
+        parse_query_limits(split_arguments("timeout=30s max_rows=1e6 max_mem=2GB"), limits);
+        EXPECT_EQ(limits.timeout.count(), 30000);
+        EXPECT_EQ(limits.max_rows, 1000000);
+        EXPECT_EQ(limits.max_mem, std::int64_t(2) << 30);
+        EXPECT_EQ(query_limits_to_string(limits), "timeout=30s max_steps=off max_rows=1000000 max_mem=2.0 GiB");
+
+        parse_query_limits(split_arguments("timeout=off max_steps=500000"), limits);
+        EXPECT_EQ(limits.timeout.count(), 0);
+        EXPECT_EQ(limits.max_steps, 500000);
+        EXPECT_THROW(parse_query_limits(split_arguments("max_rows=1.5"), limits), std::runtime_error);
+        EXPECT_THROW(parse_query_limits(split_arguments("rows=10"), limits), std::runtime_error);
+    }
+
+    TEST(xeus_sqlite_query_limits, budgets)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+        query_limits limits;
+        limits.timeout = std::chrono::milliseconds(50);
+        std::string error = run(db, cartesian, limits);
+        EXPECT_NE(error.find("timeout of 50ms (timeout)"), std::string::npos);
+
+        limits = query_limits();
+        limits.max_steps = 100000;
+        error = run(db, cartesian, limits);
+        EXPECT_NE(error.find("budget of 100000 steps (max_steps)"), std::string::npos);
+
+        limits = query_limits();
+        limits.max_rows = 10;
+        EXPECT_EQ(run(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10) "
+                          "SELECT i FROM n", limits), "");
+        error = run(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 11) "
+                        "SELECT i FROM n", limits);
+        EXPECT_NE(error.find("budget of 10 rows (max_rows)"), std::string::npos);
+
+        limits = query_limits();
+        limits.max_mem = 1 << 20;
+        error = run(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 200000) "
+                        "SELECT i, randomblob(100) FROM n ORDER BY random()", limits);
+        EXPECT_NE(error.find("memory budget of 1.0 MiB (max_mem)"), std::string::npos);
+        error = run(db, "SELECT zeroblob(2000000)", limits);
+        EXPECT_NE(error.find("(max_mem)"), std::string::npos);
+
+        /* The limits are lifted once the statement is done, other errors are unchanged */
+        EXPECT_EQ(run(db, cartesian, query_limits()), "");
+        error = run(db, "SELECT * FROM missing", limits);
+        EXPECT_NE(error.find("no such table"), std::string::npos);
+    }
+
+    TEST(xeus_sqlite_query_limits, memory_budget_is_per_connection)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        SQLite::Database other(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+        /* While a statement runs under a memory budget, other connections allocate freely */
+        query_limits limits;
+        limits.max_mem = 1 << 20;
+        SQLite::Statement query(db, "SELECT 1");
+        query_governor governor(db.getHandle(), limits);
+        EXPECT_EQ(sqlite3_hard_heap_limit64(-1), 0);
+        other.exec("CREATE TABLE t AS WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n "
+                   "WHERE i < 20000) SELECT i, randomblob(200) FROM n");
+        other.exec("SELECT length(zeroblob(4000000))");
+    }
+}
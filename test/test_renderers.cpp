@@ -0,0 +1,166 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "xeus-sqlite/xhtml_renderer.hpp"
+#include "xeus-sqlite/xjson_renderer.hpp"
+#include "xeus-sqlite/xresult_table.hpp"
+#include "xeus-sqlite/xtext_renderer.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        result_table make_table(const std::vector<std::vector<std::string>>& rows)
+        {
+            result_table table;
+            table.add_column("id");
+            table.add_column("name");
+            for (const auto& row : rows)
+            {
+                for (const auto& cell : row)
+                {
+                    table.push_cell(cell_type::text, cell.data(), cell.size());
+                }
+            }
+            return table;
+        }
+    }
+
+    TEST(xeus_sqlite_renderers, text_table_layout)
+    {
+        result_table table = make_table({{"1", "Alice"}, {"2", "Bob"}});
+        std::string expected =
+            "+----+-------+\n"
+            "| id | name  |\n"
+            "+----+-------+\n"
+            "| 1  | Alice |\n"
+            "+----+-------+\n"
+            "| 2  | Bob   |\n"
+            "+----+-------+";
+        EXPECT_EQ(render_text_table(table), expected);
+    }
+
+    TEST(xeus_sqlite_renderers, text_table_truncation)
+    {
+        result_table table = make_table({{"1", "abcdefghij"}, {"2", "b"}, {"3", "c"}});
+        text_table_options options;
+        options.max_rows = 2;
+        options.max_column_width = 8;
+        std::string expected =
+            "+-----+----------+\n"
+            "| id  | name     |\n"
+            "+-----+----------+\n"
+            "| 1   | abcde... |\n"
+            "+-----+----------+\n"
+            "| ... | ...      |\n"
+            "+-----+----------+\n"
+            "| 3   | c        |\n"
+            "+-----+----------+\n"
+            "[3 rows x 2 columns]";
+        EXPECT_EQ(render_text_table(table, options), expected);
+
+        /* Rows left out of the buffer are counted, the last row shown is the last one stored */
+        table = make_table({{"1", "abcdefghij"}, {"3", "c"}});
+        table.set_omitted_rows(1);
+        EXPECT_EQ(render_text_table(table, options), expected);
+        html_table_options html_options;
+        html_options.max_rows = 2;
+        html_options.column_classes = false;
+        EXPECT_EQ(render_html_table(table, html_options),
+                  "<table><thead><tr><th>id</th><th>name</th></tr></thead><tbody>"
+                  "<tr><td>1</td><td>abcdefghij</td></tr><tr><td>...</td><td>...</td></tr>"
+                  "<tr><td>3</td><td>c</td></tr></tbody></table><p>3 rows &times; 2 columns</p>");
+    }
+
+    TEST(xeus_sqlite_renderers, display_width)
+    {
+        EXPECT_EQ(display_width("abc"), 3u);
+        EXPECT_EQ(display_width("\xC3\xA9t\xC3\xA9"), 3u);
+        EXPECT_EQ(display_width("\xE6\x97\xA5\xE6\x9C\xAC"), 4u);
+        EXPECT_EQ(display_width("e\xCC\x81"), 1u);
+    }
+
+    TEST(xeus_sqlite_renderers, html_escaping)
+    {
+        std::string out;
+        append_html_escaped(out, "a <b> & \"c\" 'd' and a longer tail without specials");
+        EXPECT_EQ(out, "a &lt;b&gt; &amp; &quot;c&quot; &#39;d&#39; and a longer tail without specials");
+    }
+
+    TEST(xeus_sqlite_renderers, html_table_layout)
+    {
+        result_table table = make_table({{"1", "<x>"}});
+        html_table_options options;
+        options.column_classes = false;
+        EXPECT_EQ(render_html_table(table, options),
+                  "<table><thead><tr><th>id</th><th>name</th></tr></thead>"
+                  "<tbody><tr><td>1</td><td>&lt;x&gt;</td></tr></tbody></table>");
+    }
+
+    TEST(xeus_sqlite_renderers, dataresource)
+    {
+        result_table table;
+        table.add_column("id", "INTEGER");
+        table.add_column("done", "BOOLEAN");
+        table.add_column("at", "DATETIME");
+        table.add_column("id");
+        const std::vector<std::pair<cell_type, std::string>> cells = {
+            {cell_type::integer, "1"}, {cell_type::integer, "0"}, {cell_type::text, "2024-01-01 10:00:00"},
+            {cell_type::floating, "2.5"},
+            {cell_type::integer, "2"}, {cell_type::integer, "1"}, {cell_type::null, ""},
+            {cell_type::integer, "3"}};
+        for (const auto& cell : cells)
+        {
+            table.push_cell(cell.first, cell.second.data(), cell.second.size());
+        }
+
+        dataresource_options options;
+        options.max_rows = 1;
+        nl::json resource = render_dataresource(table, options);
+        EXPECT_EQ(resource["schema"]["fields"],
+                  nl::json::parse(R"([{"name": "id", "type": "integer"}, {"name": "done", "type": "boolean"},
+                                      {"name": "at", "type": "datetime"}, {"name": "id_2", "type": "number"}])"));
+        EXPECT_EQ(resource["data"],
+                  nl::json::parse(R"([{"id": 1, "done": false, "at": "2024-01-01 10:00:00", "id_2": 2.5}])"));
+
+        nl::json records = render_json_records(table);
+        ASSERT_EQ(records.size(), 2u);
+        EXPECT_EQ(records[1], nl::json::parse(R"({"id": 2, "done": 1, "at": null, "id_2": 3})"));
+        EXPECT_EQ(render_json_records(table, options).size(), 1u);
+    }
+
+    TEST(xeus_sqlite_renderers, json_writer)
+    {
+        result_table table;
+        table.add_column("t\"x");
+        table.add_column("f");
+        const std::vector<std::pair<cell_type, std::string>> cells = {
+            {cell_type::text, "a\"b\\c\n\x01 \xC3\xA9 \xFF\xC3"}, {cell_type::floating, "-1.5e+20"},
+            {cell_type::text, ""}, {cell_type::floating, "Inf"}};
+        for (const auto& cell : cells)
+        {
+            table.push_cell(cell.first, cell.second.data(), cell.second.size());
+        }
+
+        /* Invalid UTF-8 is replaced, infinities have no JSON number */
+        std::string out;
+        write_json_records(out, table);
+        EXPECT_EQ(out, "[{\"t\\\"x\":\"a\\\"b\\\\c\\n\\u0001 \xC3\xA9 \xEF\xBF\xBD\xEF\xBF\xBD\",\"f\":-1.5e+20},"
+                       "{\"t\\\"x\":\"\",\"f\":null}]");
+        EXPECT_EQ(nl::json::parse(out)[0]["t\"x"], "a\"b\\c\n\x01 \xC3\xA9 \xEF\xBF\xBD\xEF\xBF\xBD");
+
+        out.clear();
+        write_dataresource(out, result_table());
+        EXPECT_EQ(out, "{\"schema\":{\"fields\":[]},\"data\":[]}");
+    }
+}
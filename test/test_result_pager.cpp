@@ -0,0 +1,119 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xresult_pager.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        nl::json spill(result_pager& pager, SQLite::Database& db, const std::string& sql)
+        {
+            SQLite::Statement query(db, sql);
+            pager.begin(query);
+            while (query.executeStep())
+            {
+                pager.append(query);
+            }
+            return pager.commit();
+        }
+
+        nl::json page(result_pager& pager, const std::string& handle, nl::json request)
+        {
+            request["action"] = "page";
+            request["handle"] = handle;
+            return pager.handle_request(request);
+        }
+    }
+
+    TEST(xeus_sqlite_result_pager, pages)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        db.exec("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT, price REAL, data BLOB)");
+        db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2500) "
+                "INSERT INTO items SELECT i, 'item ' || i, i % 7 + 0.5, CASE WHEN i = 3 THEN zeroblob(100) END FROM n");
+
+        result_pager pager;
+        nl::json result = spill(pager, db, "SELECT id, name, price, data FROM items");
+        EXPECT_EQ(result["rows"], 2500);
+        EXPECT_EQ(result["columns"], nl::json({"id", "name", "price", "data"}));
+        const std::string handle = result["handle"];
+
+        nl::json reply = page(pager, handle, {{"page", 1}, {"page_size", 100}, {"id", 7}});
+        EXPECT_EQ(reply["action"], "page");
+        EXPECT_EQ(reply["id"], 7);
+        EXPECT_EQ(reply["total_rows"], 2500);
+        EXPECT_EQ(reply["page_count"], 25);
+        ASSERT_EQ(reply["rows"].size(), 100u);
+        EXPECT_EQ(reply["rows"][0], nl::json({101, "item 101", 3.5, nullptr}));
+        EXPECT_EQ(reply["index"][0], 100);
+
+        reply = page(pager, handle, {{"page_size", 3}});
+        EXPECT_EQ(reply["rows"][2][3], "BLOB 100 B 0000000000000000...");
+
+        reply = page(pager, handle, {{"page_size", 2},
+                                     {"sort", {{{"column", "price"}, {"descending", true}}}},
+                                     {"filter", {{{"column", "name"}, {"op", "contains"}, {"value", "ITEM 24"}},
+                                                 {{"column", 0}, {"op", ">"}, {"value", 2000}}}}});
+        EXPECT_EQ(reply["total_rows"], 100);
+        EXPECT_EQ(reply["rows"][0][0], 2498);
+        EXPECT_EQ(reply["rows"][1][0], 2491);
+
+        reply = page(pager, handle, {{"filter", {{{"column", "missing"}}}}});
+        EXPECT_EQ(reply["action"], "error");
+        reply = page(pager, "r99", {});
+        EXPECT_EQ(reply["action"], "error");
+
+        reply = pager.handle_request({{"action", "close"}, {"handle", handle}});
+        EXPECT_EQ(reply["action"], "closed");
+        EXPECT_EQ(pager.size(), 0u);
+    }
+
+    TEST(xeus_sqlite_result_pager, eviction)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        pager_options options;
+        options.max_handles = 2;
+        result_pager pager(options);
+
+        const std::string first = spill(pager, db, "SELECT 1")["handle"];
+        const std::string second = spill(pager, db, "SELECT 2")["handle"];
+        page(pager, first, {});
+        spill(pager, db, "SELECT 3");
+        EXPECT_EQ(pager.size(), 2u);
+        EXPECT_EQ(page(pager, second, {})["action"], "error");
+        EXPECT_EQ(page(pager, first, {})["action"], "page");
+
+        pager.evict_idle(result_pager::clock::now() + options.idle_timeout + std::chrono::seconds(1));
+        EXPECT_EQ(pager.size(), 0u);
+
+        /* A statement that is not committed leaves nothing behind */
+        SQLite::Statement query(db, "SELECT 4");
+        pager.begin(query);
+        pager.discard();
+        EXPECT_FALSE(pager.spilling());
+        EXPECT_EQ(pager.handle_request({{"action", "list"}})["results"].size(), 0u);
+
+        /* A result larger than the spill file is truncated */
+        options.max_spill_bytes = 256 * 1024;
+        pager.set_options(options);
+        nl::json result = spill(pager, db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n "
+                                           "WHERE i < 100000) SELECT i, randomblob(64) FROM n");
+        EXPECT_TRUE(result["truncated"].get<bool>());
+        EXPECT_LT(result["rows"].get<long long>(), 100000);
+        EXPECT_LE(pager.spill_bytes(), 2 * options.max_spill_bytes);
+    }
+}
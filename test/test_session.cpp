@@ -0,0 +1,144 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xsession.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+    TEST(xeus_sqlite_session, parse_changeset_conflict)
+    {
+        EXPECT_EQ(parse_changeset_conflict("abort"), changeset_conflict::abort);
+        EXPECT_EQ(parse_changeset_conflict("OMIT"), changeset_conflict::omit);
+        EXPECT_EQ(parse_changeset_conflict("replace"), changeset_conflict::replace);
+        EXPECT_THROW(parse_changeset_conflict("ignore"), std::runtime_error);
+    }
+
+#ifdef XSQL_HAVE_SQLITE_SESSION
+
+    namespace
+    {
+        const char* const changeset_path = "test_session.changeset";
+
+        void create(SQLite::Database& db)
+        {
+            db.exec("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT, price REAL)");
+            db.exec("CREATE TABLE log(line TEXT)");
+            db.exec("INSERT INTO items VALUES (1, 'pen', 1.5), (2, 'ink', 7), (3, 'pad', 3)");
+        }
+    }
+
+    TEST(xeus_sqlite_session, save_and_apply)
+    {
+        SQLite::Database source(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        SQLite::Database target(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        create(source);
+        create(target);
+
+        change_recorder recorder;
+        const std::string started = recorder.start(source.getHandle(), {});
+        EXPECT_NE(started.find("log"), std::string::npos);
+        EXPECT_TRUE(recorder.active());
+
+        source.exec("INSERT INTO items VALUES (4, 'cup', 2)");
+        source.exec("UPDATE items SET price = 8 WHERE id = 2");
+        source.exec("DELETE FROM items WHERE id = 3");
+        source.exec("INSERT INTO log VALUES ('not recorded')");
+
+        changeset_summary saved = recorder.save(changeset_path);
+        EXPECT_EQ(saved.changes(), 3u);
+        EXPECT_EQ(saved.tables["items"].inserts, 1u);
+        EXPECT_EQ(saved.tables.count("log"), 0u);
+
+        changeset_report report = apply_changeset(target.getHandle(), changeset_path, changeset_conflict::abort);
+        EXPECT_EQ(report.summary.changes(), 3u);
+        EXPECT_EQ(report.conflict_count, 0u);
+        EXPECT_EQ(scalar(target, "SELECT group_concat(id || ':' || price) FROM items"), "1:1.5,2:8.0,4:2.0");
+
+        /* Successive changesets hold successive changes */
+        source.exec("UPDATE items SET name = 'mug' WHERE id = 4");
+        saved = recorder.save(changeset_path);
+        EXPECT_EQ(saved.changes(), 1u);
+        apply_changeset(target.getHandle(), changeset_path, changeset_conflict::abort);
+        EXPECT_EQ(scalar(target, "SELECT name FROM items WHERE id = 4"), "mug");
+
+        recorder.stop();
+        EXPECT_FALSE(recorder.active());
+        EXPECT_THROW(recorder.save(changeset_path), std::runtime_error);
+        std::remove(changeset_path);
+    }
+
+    TEST(xeus_sqlite_session, conflicts)
+    {
+        SQLite::Database source(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        create(source);
+        change_recorder recorder;
+        recorder.start(source.getHandle(), {"items"});
+        source.exec("UPDATE items SET price = 2 WHERE id = 1");
+        source.exec("INSERT INTO items VALUES (5, 'box', 4)");
+        recorder.save(changeset_path);
+
+        /* The target changed the same row and already has the inserted one */
+        SQLite::Database target(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        create(target);
+        target.exec("UPDATE items SET price = 9 WHERE id = 1");
+        target.exec("INSERT INTO items VALUES (5, 'bag', 6)");
+
+        std::string message;
+        try
+        {
+            apply_changeset(target.getHandle(), changeset_path, changeset_conflict::abort);
+        }
+        catch (const std::runtime_error& e)
+        {
+            message = e.what();
+        }
+        EXPECT_NE(message.find("items UPDATE id=1"), std::string::npos);
+        EXPECT_EQ(scalar(target, "SELECT price FROM items WHERE id = 1"), "9.0");
+
+        changeset_report report = apply_changeset(target.getHandle(), changeset_path, changeset_conflict::omit);
+        EXPECT_EQ(report.conflict_count, 2u);
+        EXPECT_EQ(report.omitted, 2u);
+        EXPECT_EQ(scalar(target, "SELECT name FROM items WHERE id = 5"), "bag");
+
+        report = apply_changeset(target.getHandle(), changeset_path, changeset_conflict::replace);
+        EXPECT_EQ(report.replaced, 2u);
+        EXPECT_EQ(scalar(target, "SELECT price FROM items WHERE id = 1"), "2.0");
+        EXPECT_EQ(scalar(target, "SELECT name FROM items WHERE id = 5"), "box");
+        std::remove(changeset_path);
+    }
+
+    TEST(xeus_sqlite_session, invalid)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        create(db);
+        change_recorder recorder;
+        EXPECT_THROW(recorder.start(db.getHandle(), {"log"}), std::runtime_error);
+        EXPECT_THROW(recorder.start(db.getHandle(), {"missing"}), std::runtime_error);
+        EXPECT_FALSE(recorder.active());
+
+        std::FILE* file = std::fopen(changeset_path, "wb");
+        std::fputs("not a changeset", file);
+        std::fclose(file);
+        EXPECT_THROW(apply_changeset(db.getHandle(), changeset_path, changeset_conflict::abort), std::runtime_error);
+        EXPECT_EQ(scalar(db, "SELECT count(*) FROM items"), "3");
+        std::remove(changeset_path);
+    }
+
+#endif
+}
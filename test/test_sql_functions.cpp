@@ -0,0 +1,99 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cmath>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "xeus-sqlite/xsql_functions.hpp"
+
+#include "test_utils.hpp"
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* 1000 rows, x from 1 to 1000 and g = x % 3 */
+        void fill(SQLite::Database& db)
+        {
+            register_sql_functions(db.getHandle());
+            db.exec("CREATE TABLE t (x INTEGER, g INTEGER);"
+                    "WITH RECURSIVE s(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM s WHERE x < 1000) "
+                    "INSERT INTO t SELECT x, x % 3 FROM s;"
+                    "INSERT INTO t VALUES (NULL, 0), ('text', 0);");
+        }
+    }
+
+    TEST(xeus_sqlite_sql_functions, percentiles)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        EXPECT_DOUBLE_EQ(number(db, "SELECT median(x) FROM t"), 500.5);
+        EXPECT_DOUBLE_EQ(number(db, "SELECT percentile_cont(x, 0.25) FROM t"), 250.75);
+        EXPECT_DOUBLE_EQ(number(db, "SELECT percentile_cont(x, 1) FROM t"), 1000.0);
+        EXPECT_EQ(scalar(db, "SELECT median(x) FROM t WHERE x IS NULL"), "NULL");
+        EXPECT_THROW(scalar(db, "SELECT percentile_cont(x, 2) FROM t"), SQLite::Exception);
+    }
+
+    TEST(xeus_sqlite_sql_functions, moments)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        /* Variance of 1..n is n(n+1)/12 */
+        EXPECT_NEAR(number(db, "SELECT variance(x) FROM t"), 1000.0 * 1001.0 / 12.0, 1e-6);
+        EXPECT_NEAR(number(db, "SELECT var_pop(x) FROM t"), (1000.0 * 1000.0 - 1.0) / 12.0, 1e-6);
+        EXPECT_NEAR(number(db, "SELECT stddev(x) FROM t"), std::sqrt(1000.0 * 1001.0 / 12.0), 1e-9);
+    }
+
+    TEST(xeus_sqlite_sql_functions, sliding_windows)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        SQLite::Statement query(db, "SELECT x, variance(x) OVER w, median(x) OVER w FROM t WHERE x IS NOT NULL "
+                                    "AND typeof(x) = 'integer' WINDOW w AS (ORDER BY x ROWS 4 PRECEDING)");
+        while (query.executeStep())
+        {
+            int x = query.getColumn(0).getInt();
+            if (x >= 5)
+            {
+                /* Five consecutive integers */
+                EXPECT_NEAR(query.getColumn(1).getDouble(), 2.5, 1e-9);
+                EXPECT_DOUBLE_EQ(query.getColumn(2).getDouble(), x - 2.0);
+            }
+        }
+    }
+
+    TEST(xeus_sqlite_sql_functions, buckets)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        EXPECT_EQ(scalar(db, "SELECT width_bucket(5, 0, 10, 5)"), "3");
+        EXPECT_EQ(scalar(db, "SELECT width_bucket(-1, 0, 10, 5)"), "0");
+        EXPECT_EQ(scalar(db, "SELECT width_bucket(10, 0, 10, 5)"), "6");
+        EXPECT_EQ(scalar(db, "SELECT histogram(x, 0, 1000, 4) FROM t"),
+                  "[249,250,250,250]");
+        /* The JSON subtype makes it an array, not a string, inside other JSON */
+        EXPECT_EQ(scalar(db, "SELECT json_array(histogram(x, 0, 1000, 2)) FROM t"), "[[499,500]]");
+        EXPECT_THROW(scalar(db, "SELECT width_bucket(1, 10, 0, 5)"), SQLite::Exception);
+    }
+
+    TEST(xeus_sqlite_sql_functions, sketches)
+    {
+        SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        fill(db);
+        EXPECT_NEAR(number(db, "SELECT approx_count_distinct(x) FROM t"), 1001.0, 20.0);
+        EXPECT_EQ(scalar(db, "SELECT approx_count_distinct(g) FROM t"), "3");
+        EXPECT_EQ(scalar(db, "SELECT approx_count_distinct(v) FROM (SELECT 1 AS v UNION ALL SELECT 1.0)"), "1");
+        EXPECT_NEAR(number(db, "SELECT tdigest_quantile(x, 0.5) FROM t"), 500.5, 5.0);
+        EXPECT_NEAR(number(db, "SELECT tdigest_quantile(x, 0.99) FROM t"), 990.01, 2.0);
+    }
+}
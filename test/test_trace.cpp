@@ -0,0 +1,130 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "nlohmann/json.hpp"
+
+#include "xeus-sqlite/xtrace.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        const char* const trace_path = "test_trace.json";
+
+        std::string read_file(const std::string& path)
+        {
+            std::ifstream file(path);
+            std::stringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+
+        /* Complete events of the trace, in the order they were written */
+        nl::json spans(const nl::json& trace)
+        {
+            nl::json result = nl::json::array();
+            for (const auto& e : trace)
+            {
+                if (e["ph"] == "X")
+                {
+                    result.push_back(e);
+                }
+            }
+            return result;
+        }
+    }
+
+    TEST(xeus_sqlite_trace, disabled)
+    {
+        tracer recorder;
+        {
+            trace_span span(recorder, "cell", "kernel");
+            span.arg("rows", 3);
+        }
+        EXPECT_FALSE(recorder.enabled());
+        EXPECT_EQ(recorder.event_count(), 0u);
+    }
+
+    TEST(xeus_sqlite_trace, spans)
+    {
+        tracer recorder;
+        recorder.start(trace_path);
+        {
+            trace_span cell(recorder, "execute_request", "kernel");
+            cell.arg("execution_count", 7);
+            {
+                trace_span steps(recorder, "step", "sqlite");
+                steps.arg("rows", 4096);
+                steps.restart();
+                steps.arg("rows", 10);
+            }
+        }
+        EXPECT_EQ(recorder.event_count(), 3u);
+        recorder.stop();
+        EXPECT_FALSE(recorder.enabled());
+
+        const nl::json trace = nl::json::parse(read_file(trace_path));
+        EXPECT_EQ(trace[0]["ph"], "M");
+        const nl::json events = spans(trace);
+        EXPECT_EQ(events.size(), 3u);
+        EXPECT_EQ(events[0]["name"], "step");
+        EXPECT_EQ(events[0]["args"]["rows"], 4096);
+        EXPECT_EQ(events[1]["args"]["rows"], 10);
+        EXPECT_EQ(events[2]["name"], "execute_request");
+        EXPECT_EQ(events[2]["cat"], "kernel");
+        EXPECT_EQ(events[2]["args"]["execution_count"], 7);
+
+        /* The batches follow each other inside the cell */
+        const double cell_start = events[2]["ts"].get<double>();
+        const double cell_end = cell_start + events[2]["dur"].get<double>();
+        EXPECT_GE(events[0]["ts"].get<double>(), cell_start);
+        EXPECT_GE(events[1]["ts"].get<double>(),
+                  events[0]["ts"].get<double>() + events[0]["dur"].get<double>());
+        EXPECT_LE(events[1]["ts"].get<double>() + events[1]["dur"].get<double>(), cell_end);
+        std::remove(trace_path);
+    }
+
+    TEST(xeus_sqlite_trace, flush)
+    {
+        tracer recorder;
+        recorder.start(trace_path);
+        {
+            trace_span span(recorder, "prepare", "sqlite");
+        }
+        recorder.flush();
+
+        /* Written so far, without the closing bracket of stop */
+        std::string content = read_file(trace_path);
+        EXPECT_EQ(content.find(']'), std::string::npos);
+        EXPECT_EQ(spans(nl::json::parse(content + "]")).size(), 1u);
+
+        recorder.start(trace_path);
+        EXPECT_EQ(recorder.event_count(), 0u);
+        recorder.stop();
+        EXPECT_EQ(spans(nl::json::parse(read_file(trace_path))).size(), 0u);
+        std::remove(trace_path);
+    }
+
+    TEST(xeus_sqlite_trace, unwritable)
+    {
+        tracer recorder;
+        EXPECT_THROW(recorder.start("no_such_directory/trace.json"), std::runtime_error);
+        EXPECT_FALSE(recorder.enabled());
+    }
+}
@@ -0,0 +1,57 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEUS_SQLITE_TEST_UTILS_HPP
+#define XEUS_SQLITE_TEST_UTILS_HPP
+
+#include <string>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace xeus_sqlite
+{
+    inline std::string value_text(const SQLite::Column& column)
+    {
+        return column.isNull() ? std::string("NULL") : column.getString();
+    }
+
+    /* First column of the first row as text, NULL for a NULL value */
+    inline std::string scalar(SQLite::Database& db, const std::string& sql)
+    {
+        SQLite::Statement query(db, sql);
+        query.executeStep();
+        return value_text(query.getColumn(0));
+    }
+
+    /* First column of the first row as a number */
+    inline double number(SQLite::Database& db, const std::string& sql)
+    {
+        SQLite::Statement query(db, sql);
+        query.executeStep();
+        return query.getColumn(0).getDouble();
+    }
+
+    /* All rows, one per line with the columns separated by | */
+    inline std::string rows(SQLite::Database& db, const std::string& sql)
+    {
+        SQLite::Statement query(db, sql);
+        std::string result;
+        while (query.executeStep())
+        {
+            for (int col = 0; col < query.getColumnCount(); ++col)
+            {
+                result += (col == 0 ? "" : "|") + value_text(query.getColumn(col));
+            }
+            result += "\n";
+        }
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,82 @@
+/***************************************************************************
+* Copyright (c) 2020, QuantStack and Xeus-SQLite contributors              *
+*                                                                          *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "gtest/gtest.h"
+
+#include "xeus-sqlite/xvega_sqlite.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_sqlite
+{
+    namespace
+    {
+        /* A directory of the temporary directory, removed on destruction */
+        struct temporary_directory
+        {
+            fs::path path = fs::temp_directory_path() /
+                            ("xsqlite_test_xvega_" +
+                             std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+            ~temporary_directory()
+            {
+                std::error_code ec;
+                fs::remove_all(path, ec);
+            }
+        };
+
+        nl::json chart_bundle(const nl::json& values)
+        {
+            return {{"application/vnd.vegalite.v3+json", {{"data", {{"values", values}}}}}};
+        }
+    }
+
+    TEST(xeus_sqlite_xvega, named_datasets)
+    {
+        nl::json values = nl::json::array({{{"a", "1"}}, {{"a", "2"}}});
+        nl::json named = xv_sqlite::externalize_datasets(chart_bundle(values));
+        const nl::json& spec = named["application/vnd.vegalite.v3+json"];
+        ASSERT_TRUE(spec["data"].contains("name"));
+        EXPECT_EQ(spec["datasets"][spec["data"]["name"].get<std::string>()], values);
+    }
+
+    TEST(xeus_sqlite_xvega, data_file)
+    {
+        temporary_directory tmp;
+        nl::json values = nl::json::array({{{"a", "1"}}, {{"a", "2"}}});
+
+        /* The data leaves the bundle, the spec refers to the file */
+        const std::string dir = (tmp.path / "charts").string();
+        nl::json external = xv_sqlite::externalize_datasets(chart_bundle(values), dir);
+        const nl::json& data = external["application/vnd.vegalite.v3+json"]["data"];
+        ASSERT_TRUE(data.contains("url"));
+        EXPECT_FALSE(data.contains("values"));
+        EXPECT_EQ(data["url"].get<std::string>().rfind(dir + "/", 0), 0u);
+        EXPECT_TRUE(fs::exists(data["url"].get<std::string>()));
+    }
+
+    TEST(xeus_sqlite_xvega, data_file_invalid_directory)
+    {
+        temporary_directory tmp;
+        fs::create_directories(tmp.path);
+        const fs::path file = tmp.path / "file";
+        std::ofstream(file.string()) << "not a directory";
+
+        nl::json values = nl::json::array({{{"a", "1"}}});
+        EXPECT_THROW(xv_sqlite::externalize_datasets(chart_bundle(values), (file / "charts").string()),
+                     std::runtime_error);
+    }
+}